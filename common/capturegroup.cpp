@@ -0,0 +1,92 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Platform independent group of streams whose frames
+    are captured together.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "capturegroup.h"
+
+CaptureGroup::CaptureGroup(const int32_t *streamIDs, uint32_t count) :
+    m_streamIDs(streamIDs, streamIDs + count),
+    m_lastSequences(count, 0)
+{
+}
+
+bool CaptureGroup::findSet(const std::vector<std::vector<FrameRef> > &histories, uint64_t tolerance,
+    std::vector<uint32_t> &sequences) const
+{
+    const size_t count = m_streamIDs.size();
+    if ((histories.size() != count) || (count == 0))
+    {
+        return false;
+    }
+
+    // Every frame is tried as the newest frame of a set, the
+    // newest one first. The other streams then contribute their
+    // newest frame that is not newer than it and at most
+    // 'tolerance' older. The histories only hold a few frames,
+    // so trying them all is cheap.
+    bool found = false;
+    uint64_t bestTime = 0;
+    std::vector<uint32_t> set(count);
+    for(size_t anchorStream=0; anchorStream<count; anchorStream++)
+    {
+        for(auto const &anchor : histories[anchorStream])
+        {
+            if ((anchor.m_sequence <= m_lastSequences[anchorStream]) || 
+                (found && (anchor.m_captureTime <= bestTime)))
+            {
+                continue;
+            }
+
+            const uint64_t newest = anchor.m_captureTime;
+            const uint64_t oldest = (newest > tolerance) ? newest - tolerance : 0;
+            bool complete = true;
+            for(size_t s=0; (s<count) && complete; s++)
+            {
+                complete = false;
+                const std::vector<FrameRef> &frames = histories[s];
+                for(auto frame = frames.rbegin(); frame != frames.rend(); ++frame)
+                {
+                    if ((frame->m_sequence > m_lastSequences[s]) &&
+                        (frame->m_captureTime <= newest) && (frame->m_captureTime >= oldest))
+                    {
+                        set[s] = frame->m_sequence;
+                        complete = true;
+                        break;
+                    }
+                }
+            }
+
+            if (complete)
+            {
+                found = true;
+                bestTime = newest;
+                sequences = set;
+            }
+        }
+    }
+    return found;
+}
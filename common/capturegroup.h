@@ -0,0 +1,75 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Platform independent group of streams whose frames
+    are captured together.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef capturegroup_h
+#define capturegroup_h
+
+#include <stdint.h>
+#include <vector>
+#include "framepool.h"
+
+/** A capture group is a set of streams, e.g. the cameras of a 
+    machine, whose frames are read together. It selects one 
+    frame of each stream from the frame histories such that 
+    all frames were captured within a tolerance window.
+
+    The group remembers the frames of the set it handed out
+    last, so every set it returns consists of newer frames.
+*/
+class CaptureGroup
+{
+public:
+    CaptureGroup(const int32_t *streamIDs, uint32_t count);
+
+    /** return the IDs of the streams in the group */
+    const std::vector<int32_t>& getStreamIDs() const
+    {
+        return m_streamIDs;
+    }
+
+    /** Find the newest set of frames, one of each stream, whose
+        capture times differ at most 'tolerance' microseconds and
+        that are all newer than the previous set. 'histories' holds 
+        the frames of each stream, oldest first. The sequence 
+        numbers of the frames are written to 'sequences'.
+        Returns false if there is no such set. */
+    bool findSet(const std::vector<std::vector<FrameRef> > &histories, uint64_t tolerance,
+        std::vector<uint32_t> &sequences) const;
+
+    /** remember the sequence numbers of the set that was handed out */
+    void setLastSet(const std::vector<uint32_t> &sequences)
+    {
+        m_lastSequences = sequences;
+    }
+
+protected:
+    std::vector<int32_t>    m_streamIDs;        ///< streams in the group
+    std::vector<uint32_t>   m_lastSequences;    ///< frame of each stream in the previous set, 0 if none
+};
+
+#endif
@@ -26,12 +26,19 @@
 */
 
 #include <vector>
+#include <chrono>
 #include "context.h"
 #include "logging.h"
 #include "stream.h"
+#include "workerpool.h"
+#include "capturegroup.h"
 
 Context::Context() :
-    m_streamCounter(0)
+    m_streamCounter(0),
+    m_consumerCounter(0),
+    m_groupCounter(0),
+    m_workerPool(nullptr),
+    m_frameWaiters(0)
 {
     //NOTE: derived platform dependent class must enumerate
     //      the devices here and place them in m_devices.
@@ -39,14 +46,16 @@ Context::Context() :
 
 Context::~Context()
 {
-    // delete stream objects
-    auto iter = m_streams.begin();
-    while(iter != m_streams.end())
+    closeAllStreams();
+
+    for(auto &group : m_groups)
     {
-        delete iter->second;
-        iter++;
+        delete group.second;
     }
 
+    // the streams no longer use the worker pool
+    delete m_workerPool;
+
     //delete capture devices
     auto iter2 = m_devices.begin();
     while(iter2 != m_devices.end())
@@ -57,6 +66,51 @@ Context::~Context()
     LOG(LOG_DEBUG, "Context destroyed\n");
 }
 
+CapResult Context::setOption(uint32_t optionID, int32_t value)
+{
+    switch(optionID)
+    {
+    case CAPCTXOPT_WORKERTHREADS:
+        if ((value < 0) || (value > 64))
+        {
+            LOG(LOG_ERR, "setOption: invalid number of worker threads (%d)\n", value);
+            return CAPRESULT_ERR;
+        }
+        if (!m_streams.empty())
+        {
+            // the capture threads of the open streams 
+            // might be using the current pool.
+            LOG(LOG_ERR, "setOption: worker threads cannot be changed while streams are open\n");
+            return CAPRESULT_ERR;
+        }
+        delete m_workerPool;
+        m_workerPool = nullptr;
+        if (value > 0)
+        {
+            m_workerPool = new WorkerPool(static_cast<uint32_t>(value));
+        }
+        return CAPRESULT_OK;
+    default:
+        break;
+    }
+    LOG(LOG_ERR, "setOption: unknown option ID %d\n", optionID);
+    return CAPRESULT_PROPERTYNOTSUPPORTED;
+}
+
+CapResult Context::getOption(uint32_t optionID, int32_t &outValue) const
+{
+    switch(optionID)
+    {
+    case CAPCTXOPT_WORKERTHREADS:
+        outValue = (m_workerPool != nullptr) ? static_cast<int32_t>(m_workerPool->getThreadCount()) : 0;
+        return CAPRESULT_OK;
+    default:
+        break;
+    }
+    LOG(LOG_ERR, "getOption: unknown option ID %d\n", optionID);
+    return CAPRESULT_PROPERTYNOTSUPPORTED;
+}
+
 const char* Context::getDeviceName(CapDeviceID id) const
 {
     if (id >= m_devices.size())
@@ -133,7 +187,8 @@ bool Context::getFormatInfo(CapDeviceID index, CapFormatID formatID, CapFormatIn
     return true;
 }
 
-int32_t Context::openStream(CapDeviceID id, CapFormatID formatID)
+int32_t Context::openStream(CapDeviceID id, CapFormatID formatID, 
+    const CapStreamOption *options, uint32_t optionCount)
 {
     deviceInfo *device = nullptr;
 
@@ -154,14 +209,27 @@ int32_t Context::openStream(CapDeviceID id, CapFormatID formatID)
         return -1;        
     }
 
-    Stream *s = createPlatformStream();
+    Stream *s = createStream();
+
+    for(uint32_t i=0; i<optionCount; i++)
+    {
+        if (!s->setOpenOption(options[i].id, options[i].value))
+        {
+            LOG(LOG_ERR, "openStream: invalid stream option %d (value %d)\n", 
+                options[i].id, options[i].value);
+            delete s;
+            return -1;
+        }
+    }
 
+    s->recordOpen();
     if (!s->open(this, device, device->m_formats[formatID].width,
                  device->m_formats[formatID].height,
                  device->m_formats[formatID].fourcc,
                  device->m_formats[formatID].fps))
     {
         LOG(LOG_ERR, "Could not open stream for device %s\n", device->m_name.c_str());
+        delete s;
         return -1;
     }
     else
@@ -173,6 +241,73 @@ int32_t Context::openStream(CapDeviceID id, CapFormatID formatID)
     return streamID;
 }
 
+bool Context::getStreamOption(int32_t streamID, uint32_t optionID, int32_t &outValue)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "getStreamOption was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    return stream->getOpenOption(optionID, outValue);
+}
+
+bool Context::triggerCapture(int32_t streamID, uint32_t frames)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "triggerCapture was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    if (frames == 0)
+    {
+        LOG(LOG_ERR, "triggerCapture was called without frames to capture\n");
+        return false;
+    }
+
+    return stream->triggerCapture(frames);
+}
+
+bool Context::pauseStream(int32_t streamID)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "pauseStream was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    return stream->pause();
+}
+
+bool Context::resumeStream(int32_t streamID)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "resumeStream was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    return stream->resume();
+}
+
+bool Context::getStreamStats(int32_t streamID, CapStreamStats *stats)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "getStreamStats was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    stream->getStats(stats);
+    return true;
+}
+
 bool Context::closeStream(int32_t streamID)
 {
     if (streamID < 0)
@@ -207,6 +342,35 @@ uint32_t Context::isOpenStream(int32_t streamID)
     return m_streams[streamID]->isOpen() ? 1 : 0;
 }
 
+CapResult Context::setStreamOutputFormat(int32_t streamID, uint32_t fourcc)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "setStreamOutputFormat was called with an unknown stream ID\n");
+        return CAPRESULT_ERR;
+    }
+
+    if (!stream->setOutputFormat(fourcc))
+    {
+        LOG(LOG_ERR, "setStreamOutputFormat: output format %s is not supported\n", fourCCToString(fourcc).c_str());
+        return CAPRESULT_FORMATNOTSUPPORTED;
+    }
+    return CAPRESULT_OK;
+}
+
+bool Context::setStreamROI(int32_t streamID, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "setStreamROI was called with an unknown stream ID\n");
+        return false;
+    }
+
+    return stream->setROI(x, y, width, height);
+}
+
 bool Context::captureFrame(int32_t streamID, uint8_t *RGBbufferPtr, size_t RGBbufferBytes)
 {
     if (streamID < 0)
@@ -225,6 +389,526 @@ bool Context::captureFrame(int32_t streamID, uint8_t *RGBbufferPtr, size_t RGBbu
     return m_streams[streamID]->captureFrame(RGBbufferPtr, static_cast<uint32_t>(RGBbufferBytes));
 }
 
+bool Context::acquireFrame(int32_t streamID, CapFrameLease *lease)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "acquireFrame was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    return stream->acquireFrame(lease);
+}
+
+bool Context::releaseFrame(int32_t streamID, CapFrameLease *lease)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "releaseFrame was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    return stream->releaseFrame(lease);
+}
+
+CapResult Context::acquireFrameAfter(int32_t streamID, uint64_t timestamp, uint32_t timeoutMs,
+    CapFrameLease *lease, CapFrameInfo *info)
+{
+    // the frame is pinned after waiting, so a lazy conversion
+    // does not hold up the capture threads of other streams.
+    CapResult result = waitUntil(timeoutMs, [&]()
+    {
+        auto it = m_streams.find(streamID);
+        if ((it == m_streams.end()) || (it->second == nullptr))
+        {
+            LOG(LOG_ERR, "acquireFrameAfter: stream with ID %d does not exist\n", streamID);
+            return CAPRESULT_ERR;
+        }
+        return it->second->hasFrameAfter(timestamp) ? CAPRESULT_OK : CAPRESULT_TIMEOUT;
+    });
+
+    if (result != CAPRESULT_OK)
+    {
+        return result;
+    }
+
+    Stream *stream = lookupStreamByID(streamID);
+    if ((stream == nullptr) || !stream->acquireFrameAfter(timestamp, lease, info))
+    {
+        return CAPRESULT_ERR;
+    }
+    return CAPRESULT_OK;
+}
+
+CapResult Context::waitForSettle(int32_t streamID, float threshold, uint32_t timeoutMs,
+    CapFrameLease *lease, CapFrameInfo *info)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "waitForSettle was called with an unknown stream ID\n");
+        return CAPRESULT_ERR;
+    }
+
+    // the capture thread computes the signatures while the
+    // stream has a waiter. Only frames published after this
+    // call count.
+    stream->beginSettleWait();
+    const uint32_t afterSequence = stream->getFrameCount();
+    CapResult result = waitUntil(timeoutMs, [&]()
+    {
+        auto it = m_streams.find(streamID);
+        if ((it == m_streams.end()) || (it->second == nullptr))
+        {
+            LOG(LOG_ERR, "waitForSettle: stream with ID %d does not exist\n", streamID);
+            return CAPRESULT_ERR;
+        }
+        return it->second->hasSettledFrame(afterSequence, threshold) ? CAPRESULT_OK : CAPRESULT_TIMEOUT;
+    });
+
+    stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        return CAPRESULT_ERR;
+    }
+    stream->endSettleWait();
+
+    if (result != CAPRESULT_OK)
+    {
+        return result;
+    }
+    if (!stream->acquireSettledFrame(afterSequence, threshold, lease, info))
+    {
+        return CAPRESULT_ERR;
+    }
+    return CAPRESULT_OK;
+}
+
+bool Context::acquireFrameBySequence(int32_t streamID, uint32_t sequence, 
+    CapFrameLease *lease, CapFrameInfo *info)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "acquireFrameBySequence was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    return stream->acquireFrameBySequence(sequence, lease, info);
+}
+
+CapResult Context::waitForFrame(const int32_t *streamIDs, uint32_t count, uint32_t timeoutMs, uint32_t *readyIndex)
+{
+    return waitUntil(timeoutMs, [&]()
+    {
+        for(uint32_t i=0; i<count; i++)
+        {
+            auto it = m_streams.find(streamIDs[i]);
+            if ((it == m_streams.end()) || (it->second == nullptr))
+            {
+                LOG(LOG_ERR, "waitForFrame: stream with ID %d does not exist\n", streamIDs[i]);
+                return CAPRESULT_ERR;
+            }
+            else if (it->second->hasNewFrame())
+            {
+                if (readyIndex != nullptr)
+                {
+                    *readyIndex = i;
+                }
+                return CAPRESULT_OK;
+            }
+        }
+        return CAPRESULT_TIMEOUT;
+    });
+}
+
+CapResult Context::consumerWaitForFrame(int32_t consumerID, uint32_t timeoutMs)
+{
+    return waitUntil(timeoutMs, [&]()
+    {
+        auto it = m_consumers.find(consumerID);
+        auto streamIt = (it != m_consumers.end()) ? m_streams.find(it->second.m_streamID) : m_streams.end();
+        if (streamIt == m_streams.end())
+        {
+            LOG(LOG_ERR, "consumerWaitForFrame: consumer with ID %d does not exist\n", consumerID);
+            return CAPRESULT_ERR;
+        }
+        return streamIt->second->hasNewFrame(it->second.m_cursor) ? CAPRESULT_OK : CAPRESULT_TIMEOUT;
+    });
+}
+
+CapResult Context::waitUntil(uint32_t timeoutMs, const std::function<CapResult()> &check)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    // Announce the waiter before checking the streams. A capture
+    // thread that publishes a frame after the check below sees the
+    // waiter and signals the condition variable.
+    m_frameWaiters++;
+
+    CapResult result = CAPRESULT_TIMEOUT;
+    std::unique_lock<std::mutex> lock(m_waitMutex);
+    while(true)
+    {
+        result = check();
+        if ((result != CAPRESULT_TIMEOUT) || (std::chrono::steady_clock::now() >= deadline))
+        {
+            break;
+        }
+
+        // the streams are checked once more after a time-out
+        m_frameCondition.wait_until(lock, deadline);
+    }
+    lock.unlock();
+
+    m_frameWaiters--;
+    return result;
+}
+
+int32_t Context::openConsumer(int32_t streamID)
+{
+    std::lock_guard<std::mutex> lock(m_waitMutex);
+    if (m_streams.find(streamID) == m_streams.end())
+    {
+        LOG(LOG_ERR, "openConsumer was called with an unknown stream ID\n");
+        return -1;
+    }
+
+    // a new consumer has not read any frame, so the
+    // newest frame of the stream is new to it.
+    Consumer consumer;
+    consumer.m_streamID = streamID;
+    consumer.m_cursor   = new FrameCursor();
+    int32_t ID = m_consumerCounter++;
+    m_consumers.insert(std::pair<int32_t,Consumer>(ID, consumer));
+    return ID;
+}
+
+bool Context::closeConsumer(int32_t consumerID)
+{
+    FrameCursor *cursor = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_waitMutex);
+        auto it = m_consumers.find(consumerID);
+        if (it == m_consumers.end())
+        {
+            LOG(LOG_ERR, "closeConsumer was called with an unknown consumer ID\n");
+            return false;
+        }
+        cursor = it->second.m_cursor;
+        m_consumers.erase(it);
+    }
+
+    // wake up threads waiting for this consumer
+    m_frameCondition.notify_all();
+    delete cursor;
+    return true;
+}
+
+int32_t Context::openGroup(const int32_t *streamIDs, uint32_t count)
+{
+    std::lock_guard<std::mutex> lock(m_waitMutex);
+    for(uint32_t i=0; i<count; i++)
+    {
+        if (m_streams.find(streamIDs[i]) == m_streams.end())
+        {
+            LOG(LOG_ERR, "openGroup: stream with ID %d does not exist\n", streamIDs[i]);
+            return -1;
+        }
+    }
+
+    int32_t ID = m_groupCounter++;
+    m_groups[ID] = new CaptureGroup(streamIDs, count);
+    return ID;
+}
+
+bool Context::closeGroup(int32_t groupID)
+{
+    CaptureGroup *group = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_waitMutex);
+        auto it = m_groups.find(groupID);
+        if (it == m_groups.end())
+        {
+            LOG(LOG_ERR, "closeGroup was called with an unknown group ID\n");
+            return false;
+        }
+        group = it->second;
+        m_groups.erase(it);
+    }
+
+    // wake up threads waiting for this group
+    m_frameCondition.notify_all();
+    delete group;
+    return true;
+}
+
+CapResult Context::captureGroup(int32_t groupID, uint32_t toleranceUs, uint32_t timeoutMs,
+    CapFrameLease *leases, CapFrameInfo *infos)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    std::vector<int32_t> streamIDs;
+    std::vector<uint32_t> sequences;
+    std::vector<std::vector<FrameRef> > histories;
+    while(true)
+    {
+        // look for a set each time a stream publishes a frame
+        const auto now = std::chrono::steady_clock::now();
+        const uint32_t remaining = (now < deadline) ? static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count()) : 0;
+        CapResult result = waitUntil(remaining, [&]()
+        {
+            auto it = m_groups.find(groupID);
+            if (it == m_groups.end())
+            {
+                LOG(LOG_ERR, "captureGroup: group with ID %d does not exist\n", groupID);
+                return CAPRESULT_ERR;
+            }
+
+            streamIDs = it->second->getStreamIDs();
+            histories.resize(streamIDs.size());
+            for(size_t i=0; i<streamIDs.size(); i++)
+            {
+                auto streamIt = m_streams.find(streamIDs[i]);
+                if ((streamIt == m_streams.end()) || (streamIt->second == nullptr))
+                {
+                    LOG(LOG_ERR, "captureGroup: stream with ID %d does not exist\n", streamIDs[i]);
+                    return CAPRESULT_ERR;
+                }
+                streamIt->second->getHistory(histories[i]);
+            }
+            return it->second->findSet(histories, toleranceUs, sequences) ? CAPRESULT_OK : CAPRESULT_TIMEOUT;
+        });
+
+        if (result != CAPRESULT_OK)
+        {
+            return result;
+        }
+
+        // the frames are pinned without holding the lock, so 
+        // one of them can leave its history in the mean time.
+        size_t pinned = 0;
+        for(; pinned<streamIDs.size(); pinned++)
+        {
+            Stream *stream = lookupStreamByID(streamIDs[pinned]);
+            if ((stream == nullptr) || !stream->acquireFrameBySequence(sequences[pinned], &leases[pinned],
+                (infos != nullptr) ? &infos[pinned] : nullptr))
+            {
+                break;
+            }
+        }
+
+        if (pinned == streamIDs.size())
+        {
+            std::lock_guard<std::mutex> lock(m_waitMutex);
+            auto it = m_groups.find(groupID);
+            if (it != m_groups.end())
+            {
+                it->second->setLastSet(sequences);
+            }
+            return CAPRESULT_OK;
+        }
+
+        for(size_t i=0; i<pinned; i++)
+        {
+            releaseFrame(streamIDs[i], &leases[i]);
+        }
+
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            return CAPRESULT_TIMEOUT;
+        }
+    }
+}
+
+bool Context::releaseGroup(int32_t groupID, CapFrameLease *leases)
+{
+    std::vector<int32_t> streamIDs;
+    {
+        std::lock_guard<std::mutex> lock(m_waitMutex);
+        auto it = m_groups.find(groupID);
+        if (it == m_groups.end())
+        {
+            LOG(LOG_ERR, "releaseGroup was called with an unknown group ID\n");
+            return false;
+        }
+        streamIDs = it->second->getStreamIDs();
+    }
+
+    bool ok = true;
+    for(size_t i=0; i<streamIDs.size(); i++)
+    {
+        ok = releaseFrame(streamIDs[i], &leases[i]) && ok;
+    }
+    return ok;
+}
+
+Stream* Context::lookupConsumerByID(int32_t ID, FrameCursor *&cursor)
+{
+    std::lock_guard<std::mutex> lock(m_waitMutex);
+    auto it = m_consumers.find(ID);
+    if (it == m_consumers.end())
+    {
+        return nullptr;
+    }
+    cursor = it->second.m_cursor;
+    return lookupStreamByID(it->second.m_streamID);
+}
+
+bool Context::consumerHasNewFrame(int32_t consumerID)
+{
+    FrameCursor *cursor = nullptr;
+    Stream *stream = lookupConsumerByID(consumerID, cursor);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "consumerHasNewFrame was called with an unknown consumer ID\n");
+        return false;
+    }
+
+    return stream->hasNewFrame(cursor);
+}
+
+bool Context::consumerCaptureFrame(int32_t consumerID, uint8_t *RGBbufferPtr, size_t RGBbufferBytes)
+{
+    FrameCursor *cursor = nullptr;
+    Stream *stream = lookupConsumerByID(consumerID, cursor);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "consumerCaptureFrame was called with an unknown consumer ID\n");
+        return false;
+    }
+
+    return stream->captureFrame(RGBbufferPtr, static_cast<uint32_t>(RGBbufferBytes), cursor);
+}
+
+bool Context::consumerAcquireFrame(int32_t consumerID, CapFrameLease *lease)
+{
+    FrameCursor *cursor = nullptr;
+    Stream *stream = lookupConsumerByID(consumerID, cursor);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "consumerAcquireFrame was called with an unknown consumer ID\n");
+        return false;
+    }
+
+    return stream->acquireFrame(lease, cursor);
+}
+
+bool Context::consumerReleaseFrame(int32_t consumerID, CapFrameLease *lease)
+{
+    FrameCursor *cursor = nullptr;
+    Stream *stream = lookupConsumerByID(consumerID, cursor);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "consumerReleaseFrame was called with an unknown consumer ID\n");
+        return false;
+    }
+
+    return stream->releaseFrame(lease);
+}
+
+bool Context::consumerGetFrameInfo(int32_t consumerID, CapFrameInfo *info)
+{
+    FrameCursor *cursor = nullptr;
+    Stream *stream = lookupConsumerByID(consumerID, cursor);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "consumerGetFrameInfo was called with an unknown consumer ID\n");
+        return false;
+    }
+
+    return stream->getFrameInfo(info, cursor);
+}
+
+void Context::notifyNewFrame()
+{
+    if (m_frameWaiters.load() != 0)
+    {
+        // taking the lock makes sure a waiter is either still 
+        // about to check the streams or already waiting.
+        {
+            std::lock_guard<std::mutex> lock(m_waitMutex);
+        }
+        m_frameCondition.notify_all();
+    }
+}
+
+bool Context::retainFrame(int32_t streamID, const CapFrameLease *lease)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "retainFrame was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    return stream->retainFrame(lease);
+}
+
+bool Context::exportFrame(int32_t streamID, const CapFrameLease *lease, CapFrameExport *exportInfo)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "exportFrame was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    return stream->exportFrame(lease, exportInfo);
+}
+
+bool Context::startBroker(int32_t streamID, const char *name)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "startBroker was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    return stream->startBroker(name);
+}
+
+bool Context::stopBroker(int32_t streamID)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "stopBroker was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    stream->stopBroker();
+    return true;
+}
+
+bool Context::setFrameCallback(int32_t streamID, CapFrameCallback callback, void *userData)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "setFrameCallback was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    stream->setFrameCallback(streamID, callback, userData);
+    return true;
+}
+
+bool Context::getFrameInfo(int32_t streamID, CapFrameInfo *info)
+{
+    Stream *stream = lookupStreamByID(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "getFrameInfo was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    return stream->getFrameInfo(info);
+}
+
 bool Context::hasNewFrame(int32_t streamID)
 {
     if (streamID < 0)
@@ -279,7 +963,6 @@ bool Context::setStreamFrameRate(int32_t streamID, uint32_t fps)
     return stream->setFrameRate(fps);
 }
 
-#if 0
 /** Lookup a stream by ID and return a pointer
     to it if it exists. If it doesnt exist, 
     return NULL */
@@ -292,12 +975,12 @@ Stream* Context::lookupStreamByID(int32_t ID)
     }
     return nullptr;
 }
-#endif
 
 /** Store a stream pointer in the m_streams map
     and return its unique ID */
 int32_t Context::storeStream(Stream *stream)
 {   
+    std::lock_guard<std::mutex> lock(m_waitMutex);
     int32_t ID = m_streamCounter++; 
     m_streams.insert(std::pair<int32_t,Stream*>(ID, stream));    
     return ID;
@@ -305,16 +988,68 @@ int32_t Context::storeStream(Stream *stream)
 
 /** Remove a stream from the m_streams map.
     Return true if this was successful */
+void Context::closeAllStreams()
+{
+    // delete stream objects
+    auto iter = m_streams.begin();
+    while(iter != m_streams.end())
+    {
+        delete iter->second;
+        iter++;
+    }
+    m_streams.clear();
+
+    // and the consumers of the streams
+    for(auto &consumer : m_consumers)
+    {
+        delete consumer.second.m_cursor;
+    }
+    m_consumers.clear();
+}
+
 bool Context::removeStream(int32_t ID)
 {
-    auto it = m_streams.find(ID);
-    if (it != m_streams.end())
+    Stream *stream = nullptr;
+    std::vector<FrameCursor*> cursors;
     {
-        delete it->second;
+        // waitForFrame only uses streams while holding the 
+        // lock, so it will not see the stream after this.
+        std::lock_guard<std::mutex> lock(m_waitMutex);
+        auto it = m_streams.find(ID);
+        if (it == m_streams.end())
+        {
+            return false;
+        }
+        stream = it->second;
         m_streams.erase(it);
-        return true;
+
+        // the consumers of a stream are closed with it
+        auto consumer = m_consumers.begin();
+        while(consumer != m_consumers.end())
+        {
+            if (consumer->second.m_streamID == ID)
+            {
+                cursors.push_back(consumer->second.m_cursor);
+                consumer = m_consumers.erase(consumer);
+            }
+            else
+            {
+                consumer++;
+            }
+        }
     }
-    return false;
+
+    // wake up threads waiting for this stream
+    m_frameCondition.notify_all();
+
+    // the capture thread of the stream calls notifyNewFrame,
+    // so the stream must be deleted without holding the lock.
+    delete stream;
+    for(auto cursor : cursors)
+    {
+        delete cursor;
+    }
+    return true;
 }
 
 bool Context::getStreamPropertyLimits(int32_t streamID, uint32_t propertyID, 
@@ -31,12 +31,19 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <stdint.h>
 
 #include "openpnp-capture.h"
 #include "deviceinfo.h"
 
-class Stream;   // pre-declaration
+class Stream;       // pre-declaration
+struct FrameCursor; // pre-declaration
+class CaptureGroup; // pre-declaration
+class WorkerPool;   // pre-declaration
 
 /* Define a platform stream factory call to
    separate platform dependent code from this class.
@@ -60,6 +67,23 @@ public:
     Context();
     virtual ~Context();
 
+    /** Set a context wide option (CAPCTXOPT_xxx).
+        Returns CAPRESULT_OK if successful */
+    virtual CapResult setOption(uint32_t optionID, int32_t value);
+
+    /** Get the value of a context wide option (CAPCTXOPT_xxx).
+        Returns CAPRESULT_OK if successful */
+    virtual CapResult getOption(uint32_t optionID, int32_t &outValue) const;
+
+    /** Return the worker pool shared by the streams of this
+        context, or nullptr if frames should be processed on 
+        the capture thread only. The pool does not change 
+        while streams are open. */
+    WorkerPool* getWorkerPool() const
+    {
+        return m_workerPool;
+    }
+
     /** Get the UTF-8 device name of a device with index/ID id */
     const char* getDeviceName(CapDeviceID id) const;
 
@@ -103,7 +127,12 @@ public:
         Note: for now, only one stream per device is supported but opening more
               streams might or might not work.
     */
-    int32_t openStream(CapDeviceID id, CapFormatID formatID);
+    int32_t openStream(CapDeviceID id, CapFormatID formatID, 
+        const CapStreamOption *options, uint32_t optionCount);
+
+    /** get the value of a stream option (CAPSTREAMOPT_xxx), 
+        returns true if succeeds */
+    bool getStreamOption(int32_t streamID, uint32_t optionID, int32_t &outValue);
 
     /** close the stream to a device */
     bool closeStream(int32_t streamID);
@@ -111,9 +140,141 @@ public:
     /** returns 1 if the stream is open and capturing, else 0 */
     uint32_t isOpenStream(int32_t streamID);
 
+    /** capture 'frames' frames on a stream opened in trigger mode,
+        returns true if streaming was started */
+    bool triggerCapture(int32_t streamID, uint32_t frames);
+
+    /** stop streaming but keep the device open, returns true if succeeds */
+    bool pauseStream(int32_t streamID);
+
+    /** start streaming on a paused stream, returns true if succeeds */
+    bool resumeStream(int32_t streamID);
+
+    /** get the streaming statistics of a stream, returns true if succeeds */
+    bool getStreamStats(int32_t streamID, CapStreamStats *stats);
+
+    /** select the pixel layout of the frames of a stream (CAPFOURCC_xxx).
+        returns CAPRESULT_OK if succeeds */
+    CapResult setStreamOutputFormat(int32_t streamID, uint32_t fourcc);
+
+    /** convert only a region of the frames of a stream, 
+        returns true if succeeds */
+    bool setStreamROI(int32_t streamID, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
     /** returns true if succeeds, else false */
     bool captureFrame(int32_t streamID, uint8_t *RGBbufferPtr, size_t RGBbufferBytes);
 
+    /** pin the most recent frame of a stream, returns true if succeeds */
+    bool acquireFrame(int32_t streamID, CapFrameLease *lease);
+
+    /** hand back a frame pinned by acquireFrame, returns true if succeeds */
+    bool releaseFrame(int32_t streamID, CapFrameLease *lease);
+
+    /** Pin the first frame of a stream captured at or after 'timestamp',
+        waiting up to timeoutMs for it to be captured.
+        Returns CAPRESULT_OK, CAPRESULT_TIMEOUT or CAPRESULT_ERR if
+        the stream does not exist (anymore).
+    */
+    CapResult acquireFrameAfter(int32_t streamID, uint64_t timestamp, uint32_t timeoutMs,
+        CapFrameLease *lease, CapFrameInfo *info);
+
+    /** pin a frame in the history of a stream by its sequence number, 
+        returns true if succeeds */
+    bool acquireFrameBySequence(int32_t streamID, uint32_t sequence, 
+        CapFrameLease *lease, CapFrameInfo *info);
+
+    /** Pin the first frame of a stream captured after this call
+        that differs less than 'threshold' from the frame before it,
+        waiting up to timeoutMs for the image to settle.
+        Returns CAPRESULT_OK, CAPRESULT_TIMEOUT or CAPRESULT_ERR if
+        the stream does not exist (anymore).
+    */
+    CapResult waitForSettle(int32_t streamID, float threshold, uint32_t timeoutMs,
+        CapFrameLease *lease, CapFrameInfo *info);
+
+    /** Wait until one of the streams has a new frame or the timeout
+        expires. The index of a stream with a new frame is written
+        to readyIndex, if not NULL.
+        Returns CAPRESULT_OK, CAPRESULT_TIMEOUT or CAPRESULT_ERR if
+        a stream does not exist (anymore).
+    */
+    CapResult waitForFrame(const int32_t *streamIDs, uint32_t count, uint32_t timeoutMs, uint32_t *readyIndex);
+
+    /** Open a consumer of a stream: a reader with its own 
+        new-frame state and frame information, so several
+        readers can share a stream without taking frames from
+        each other. Returns the consumer ID or -1. */
+    int32_t openConsumer(int32_t streamID);
+
+    /** close a consumer, returns true if succeeds */
+    bool closeConsumer(int32_t consumerID);
+
+    /** returns true if the consumer has not read the newest frame yet */
+    bool consumerHasNewFrame(int32_t consumerID);
+
+    /** copy the newest frame for a consumer, returns true if succeeds */
+    bool consumerCaptureFrame(int32_t consumerID, uint8_t *RGBbufferPtr, size_t RGBbufferBytes);
+
+    /** pin the newest frame for a consumer, returns true if succeeds */
+    bool consumerAcquireFrame(int32_t consumerID, CapFrameLease *lease);
+
+    /** hand back a frame pinned by consumerAcquireFrame, returns true if succeeds */
+    bool consumerReleaseFrame(int32_t consumerID, CapFrameLease *lease);
+
+    /** get information about the frame most recently read by a consumer,
+        returns true if succeeds */
+    bool consumerGetFrameInfo(int32_t consumerID, CapFrameInfo *info);
+
+    /** Wait until a consumer has a new frame or the timeout expires.
+        Returns CAPRESULT_OK, CAPRESULT_TIMEOUT or CAPRESULT_ERR if
+        the consumer or its stream does not exist (anymore). */
+    CapResult consumerWaitForFrame(int32_t consumerID, uint32_t timeoutMs);
+
+    /** Create a group of streams whose frames are captured
+        together. Returns the group ID or -1. */
+    int32_t openGroup(const int32_t *streamIDs, uint32_t count);
+
+    /** delete a group, returns true if succeeds */
+    bool closeGroup(int32_t groupID);
+
+    /** Pin one frame of each stream of a group, such that all
+        frames were captured within 'toleranceUs' microseconds,
+        waiting up to timeoutMs for such a set. 'leases' and, if
+        not nullptr, 'infos' have an entry for each stream.
+        Returns CAPRESULT_OK, CAPRESULT_TIMEOUT or CAPRESULT_ERR if
+        the group or one of its streams does not exist (anymore).
+    */
+    CapResult captureGroup(int32_t groupID, uint32_t toleranceUs, uint32_t timeoutMs,
+        CapFrameLease *leases, CapFrameInfo *infos);
+
+    /** hand back the frames pinned by captureGroup, returns true if succeeds */
+    bool releaseGroup(int32_t groupID, CapFrameLease *leases);
+
+    /** Called by the capture threads of the streams each time 
+        a new frame has been published, to wake up waitForFrame */
+    void notifyNewFrame();
+
+    /** add a lease to a leased frame, returns true if succeeds */
+    bool retainFrame(int32_t streamID, const CapFrameLease *lease);
+
+    /** export a leased frame as a file descriptor, returns true if succeeds */
+    bool exportFrame(int32_t streamID, const CapFrameLease *lease, CapFrameExport *exportInfo);
+
+    /** share the frames of a stream with client contexts in
+        other processes, returns true if succeeds */
+    bool startBroker(int32_t streamID, const char *name);
+
+    /** stop sharing the frames of a stream, returns true if succeeds */
+    bool stopBroker(int32_t streamID);
+
+    /** register or unregister (nullptr) the frame callback of a stream,
+        returns true if succeeds */
+    bool setFrameCallback(int32_t streamID, CapFrameCallback callback, void *userData);
+
+    /** get information about the frame most recently read from a stream,
+        returns true if succeeds */
+    bool getFrameInfo(int32_t streamID, CapFrameInfo *info);
+
     /** returns true if the stream has a new frame, false otherwise */
     bool hasNewFrame(int32_t streamID);
 
@@ -184,10 +345,35 @@ protected:
     */
     virtual bool enumerateDevices() = 0;
 
+    /** Create a stream object for openStream. Contexts that
+        do not open platform devices override this. */
+    virtual Stream* createStream()
+    {
+        return createPlatformStream();
+    }
+
     /** Store a stream pointer in the m_streams map
         and return its unique ID */
     int32_t storeStream(Stream *stream);
 
+    /** Lookup a stream by ID and return a pointer
+        to it if it exists. If it doesnt exist, 
+        return NULL */
+    Stream* lookupStreamByID(int32_t ID);
+
+    /** Close and delete all streams. Platform contexts call
+        this before releasing resources the streams use. */
+    void closeAllStreams();
+
+    /** Lookup a consumer by ID and return its stream
+        and read state, or nullptr if it doesnt exist */
+    Stream* lookupConsumerByID(int32_t ID, FrameCursor *&cursor);
+
+    /** Wait until 'check', which is called with m_waitMutex
+        held, returns something other than CAPRESULT_TIMEOUT 
+        or the timeout expires. */
+    CapResult waitUntil(uint32_t timeoutMs, const std::function<CapResult()> &check);
+
     /** Remove a stream from the m_streams map
         and call delete on the object.
         Return true if this was successful */
@@ -196,6 +382,23 @@ protected:
     std::vector<deviceInfo*>    m_devices;          ///< list of enumerated devices
     std::map<int32_t, Stream*>  m_streams;          ///< collection of streams
     int32_t                     m_streamCounter;    ///< counter to generate stream IDs
+
+    /** a reader of a stream with its own read state */
+    struct Consumer
+    {
+        int32_t         m_streamID;
+        FrameCursor*    m_cursor;
+    };
+
+    std::map<int32_t, Consumer> m_consumers;        ///< consumers, protected by m_waitMutex
+    int32_t                     m_consumerCounter;  ///< counter to generate consumer IDs
+    std::map<int32_t, CaptureGroup*> m_groups;      ///< capture groups, protected by m_waitMutex
+    int32_t                     m_groupCounter;     ///< counter to generate group IDs
+    WorkerPool*                 m_workerPool;       ///< worker threads shared by the streams or nullptr
+
+    std::mutex                  m_waitMutex;        ///< protects m_streams changes against waitForFrame, m_consumers and m_groups
+    std::condition_variable     m_frameCondition;   ///< signalled when any stream has a new frame
+    std::atomic<uint32_t>       m_frameWaiters;     ///< number of threads in waitForFrame
 };
 
 /** convert a FOURCC uint32_t to human readable form */
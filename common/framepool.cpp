@@ -0,0 +1,320 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Platform independent pool of frame buffer slots.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#include "openpnp-capture.h"
+#include "framepool.h"
+#include "logging.h"
+
+uint64_t FrameSlot::getCaptureTime() const
+{
+    return ((m_flags & CAPFRAMEFLAG_DEVICETIMESTAMP) != 0) ? m_deviceTimestamp : m_timestamp;
+}
+
+FramePool::FramePool() :
+    m_slots(nullptr),
+    m_slotCount(0),
+    m_latest(-1),
+    m_historyHead(0),
+    m_historyCount(0)
+{
+}
+
+FramePool::~FramePool()
+{
+    clear();
+}
+
+void FramePool::init(uint32_t slotCount, uint32_t historyDepth)
+{
+    clear();
+    m_slots = new FrameSlot[slotCount];
+    m_slotCount = slotCount;
+    m_history.assign((historyDepth != 0) ? historyDepth : 1, -1);
+}
+
+void FramePool::clear()
+{
+    clearHistory();
+    for(uint32_t i=0; i<m_slotCount; i++)
+    {
+        if (m_slots[i].m_leases != 0)
+        {
+            LOG(LOG_WARNING, "FramePool::clear called while slot %d is still leased\n", i);
+        }
+    }
+    m_latest = -1;
+    delete[] m_slots;
+    m_slots = nullptr;
+    m_slotCount = 0;
+}
+
+FrameSlot* FramePool::beginWrite()
+{
+    const int32_t latest = m_latest.load();
+    for(uint32_t i=0; i<m_slotCount; i++)
+    {
+        FrameSlot &slot = m_slots[i];
+        if ((static_cast<int32_t>(i) != latest) &&
+            (slot.m_leases.load() == 0) &&
+            (slot.m_externalIndex < 0))
+        {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+void FramePool::commitWrite(FrameSlot *slot)
+{
+    // publishing the slot index releases the frame
+    // data written by the producer to the consumers.
+    const int32_t index = static_cast<int32_t>(indexOf(slot));
+    m_latest.store(index);
+
+    if (m_history.empty())
+    {
+        return;
+    }
+
+    // the history lease keeps the frame in the pool after
+    // newer frames have been published. The oldest frame
+    // makes room and becomes available to the producer 
+    // once its other leases are released.
+    std::lock_guard<std::mutex> lock(m_historyMutex);
+    const uint32_t depth = static_cast<uint32_t>(m_history.size());
+    if (m_historyCount == depth)
+    {
+        release(static_cast<uint32_t>(m_history[m_historyHead]));
+        m_historyHead = (m_historyHead + 1) % depth;
+        m_historyCount--;
+    }
+    slot->m_leases++;
+    m_history[(m_historyHead + m_historyCount) % depth] = index;
+    m_historyCount++;
+}
+
+void FramePool::abortWrite(FrameSlot *slot)
+{
+    // the slot was never published, so it simply
+    // remains available for the next beginWrite.
+}
+
+FrameSlot* FramePool::acquireLatest()
+{
+    while(true)
+    {
+        const int32_t latest = m_latest.load();
+        if (latest < 0)
+        {
+            return nullptr;
+        }
+
+        FrameSlot *slot = &m_slots[latest];
+        slot->m_leases++;
+
+        // if the producer has published another slot in the 
+        // mean time, it might already be writing into this one.
+        if (m_latest.load() == latest)
+        {
+            return slot;
+        }
+        slot->m_leases--;
+    }
+}
+
+int32_t FramePool::findFirst(const SlotMatch &match) const
+{
+    const uint32_t depth = static_cast<uint32_t>(m_history.size());
+    for(uint32_t i=0; i<m_historyCount; i++)
+    {
+        const uint32_t pos = (m_historyHead + i) % depth;
+        if (match(&m_slots[m_history[pos]]))
+        {
+            return static_cast<int32_t>(pos);
+        }
+    }
+    return -1;
+}
+
+FrameSlot* FramePool::acquireFirst(const SlotMatch &match)
+{
+    // slots in the history are leased, so they cannot
+    // be overwritten while the lock is held.
+    std::lock_guard<std::mutex> lock(m_historyMutex);
+    const int32_t pos = findFirst(match);
+    if (pos < 0)
+    {
+        return nullptr;
+    }
+    FrameSlot *slot = &m_slots[m_history[pos]];
+    slot->m_leases++;
+    return slot;
+}
+
+bool FramePool::hasFrame(const SlotMatch &match)
+{
+    std::lock_guard<std::mutex> lock(m_historyMutex);
+    return findFirst(match) >= 0;
+}
+
+FrameSlot* FramePool::acquireAfter(uint64_t timestamp)
+{
+    return acquireFirst([timestamp](const FrameSlot *slot)
+    {
+        return slot->getCaptureTime() >= timestamp;
+    });
+}
+
+FrameSlot* FramePool::acquireBySequence(uint32_t sequence)
+{
+    return acquireFirst([sequence](const FrameSlot *slot)
+    {
+        return slot->m_sequence == sequence;
+    });
+}
+
+bool FramePool::hasFrameAfter(uint64_t timestamp)
+{
+    return hasFrame([timestamp](const FrameSlot *slot)
+    {
+        return slot->getCaptureTime() >= timestamp;
+    });
+}
+
+void FramePool::getHistory(std::vector<FrameRef> &frames)
+{
+    std::lock_guard<std::mutex> lock(m_historyMutex);
+    const uint32_t depth = static_cast<uint32_t>(m_history.size());
+    frames.resize(m_historyCount);
+    for(uint32_t i=0; i<m_historyCount; i++)
+    {
+        const FrameSlot &slot = m_slots[m_history[(m_historyHead + i) % depth]];
+        frames[i].m_sequence    = slot.m_sequence;
+        frames[i].m_captureTime = slot.getCaptureTime();
+    }
+}
+
+void FramePool::clearHistory()
+{
+    std::lock_guard<std::mutex> lock(m_historyMutex);
+    const uint32_t depth = static_cast<uint32_t>(m_history.size());
+    for(uint32_t i=0; i<m_historyCount; i++)
+    {
+        release(static_cast<uint32_t>(m_history[(m_historyHead + i) % depth]));
+    }
+    m_historyHead  = 0;
+    m_historyCount = 0;
+}
+
+void FramePool::retain(FrameSlot *slot)
+{
+    // the producer does not write into the most recent 
+    // slot, so it can be pinned without checking.
+    slot->m_leases++;
+}
+
+bool FramePool::retainLeased(uint32_t slotIndex)
+{
+    if (slotIndex >= m_slotCount)
+    {
+        return false;
+    }
+
+    // a slot with at least one lease cannot be reused, 
+    // so adding a lease is safe as long as one is held.
+    std::atomic<uint32_t> &leases = m_slots[slotIndex].m_leases;
+    uint32_t count = leases.load();
+    do
+    {
+        if (count == 0)
+        {
+            return false;
+        }
+    } while(!leases.compare_exchange_weak(count, count+1));
+    return true;
+}
+
+bool FramePool::release(const FrameSlot *slot)
+{
+    return release(indexOf(slot));
+}
+
+bool FramePool::release(uint32_t slotIndex)
+{
+    if (slotIndex >= m_slotCount)
+    {
+        return false;
+    }
+
+    std::atomic<uint32_t> &leases = m_slots[slotIndex].m_leases;
+    uint32_t count = leases.load();
+    do
+    {
+        if (count == 0)
+        {
+            return false;
+        }
+    } while(!leases.compare_exchange_weak(count, count-1));
+    return true;
+}
+
+uint32_t FramePool::indexOf(const FrameSlot *slot) const
+{
+    return static_cast<uint32_t>(slot - m_slots);
+}
+
+uint32_t FramePool::externalCount() const
+{
+    uint32_t count = 0;
+    for(uint32_t i=0; i<m_slotCount; i++)
+    {
+        if (m_slots[i].m_externalIndex >= 0)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+void FramePool::reclaimExternal(std::vector<int32_t> &indices)
+{
+    const int32_t latest = m_latest.load();
+    for(uint32_t i=0; i<m_slotCount; i++)
+    {
+        FrameSlot &slot = m_slots[i];
+        if ((slot.m_externalIndex >= 0) &&
+            (static_cast<int32_t>(i) != latest) &&
+            (slot.m_leases.load() == 0))
+        {
+            indices.push_back(slot.m_externalIndex);
+            slot.m_externalIndex = -1;
+            slot.m_data  = nullptr;
+            slot.m_bytes = 0;
+        }
+    }
+}
@@ -0,0 +1,258 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Platform independent pool of frame buffer slots that
+    can be leased to the application without copying.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef framepool_h
+#define framepool_h
+
+#include <stdint.h>
+#include <stdlib.h> // size_t
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <functional>
+
+/** A frame buffer slot holds one complete frame and
+    the information needed to interpret it. */
+struct FrameSlot
+{
+    FrameSlot() :
+        m_storage(nullptr),
+        m_storageFd(-1),
+        m_storageSize(0),
+        m_data(nullptr),
+        m_bytes(0),
+        m_width(0),
+        m_height(0),
+        m_stride(0),
+        m_fourcc(0),
+        m_roiX(0),
+        m_roiY(0),
+        m_timestamp(0),
+        m_sequence(0),
+        m_deviceTimestamp(0),
+        m_deviceSequence(0),
+        m_flags(0),
+        m_deviceFlags(0),
+        m_dropped(0),
+        m_leases(0),
+        m_externalIndex(-1),
+        m_pending(false),
+        m_difference(-1.0f)
+    {
+    }
+
+    std::vector<uint8_t> m_buffer;  ///< library owned frame storage
+    uint8_t*        m_storage;      ///< where the producer writes the frame, m_buffer or shared memory
+    int32_t         m_storageFd;    ///< file descriptor of the shared memory at m_storage or -1
+    size_t          m_storageSize;  ///< size of the shared memory at m_storage
+    const uint8_t*  m_data;         ///< start of the frame, either in m_buffer or in platform memory
+    size_t          m_bytes;        ///< number of valid bytes at m_data
+    uint32_t        m_width;        ///< width of the frame in pixels
+    uint32_t        m_height;       ///< height of the frame in pixels
+    uint32_t        m_stride;       ///< number of bytes per row
+    uint32_t        m_fourcc;       ///< pixel layout of the frame
+    uint32_t        m_roiX;         ///< column of the full image where the frame starts, non-zero for a region
+    uint32_t        m_roiY;         ///< row of the full image where the frame starts, non-zero for a region
+    uint64_t        m_timestamp;    ///< capture time in microseconds
+    uint32_t        m_sequence;     ///< frame number assigned when the slot was published
+    uint64_t        m_deviceTimestamp;  ///< capture time reported by the device in microseconds, 0 if unknown
+    uint32_t        m_deviceSequence;   ///< frame number reported by the device
+    uint32_t        m_flags;        ///< CAPFRAMEFLAG_xxx
+    uint32_t        m_deviceFlags;  ///< platform dependent buffer flags
+    uint32_t        m_dropped;      ///< total number of frames dropped before this one was published
+    std::atomic<uint32_t> m_leases; ///< number of outstanding leases
+    int32_t         m_externalIndex;///< platform buffer index when m_data points to platform memory, else -1
+    std::vector<uint8_t> m_rawBuffer;   ///< undecoded frame waiting for a lazy conversion
+    std::atomic<bool> m_pending;    ///< true if m_buffer has not been converted from m_rawBuffer yet
+    float           m_difference;   ///< luminance difference to the previous frame, negative if unknown
+
+    /** return the time the frame was captured: the device
+        timestamp if it is valid, else the library timestamp */
+    uint64_t getCaptureTime() const;
+};
+
+/** The sequence number and capture time of a frame in the history */
+struct FrameRef
+{
+    uint32_t    m_sequence;     ///< frame number assigned when the slot was published
+    uint64_t    m_captureTime;  ///< see FrameSlot::getCaptureTime
+};
+
+/** The frame pool manages a fixed number of frame slots
+    shared between a single producer (the capture thread)
+    and any number of consumers.
+
+    The producer writes into a slot that is neither leased
+    nor holding the most recent frame, and then publishes it.
+    Consumers pin the most recent frame for as long as they
+    need it, so the producer never overwrites a frame that
+    is being read.
+
+    The exchange is lock-free: the producer never waits for
+    a consumer that is copying a frame, and consumers never
+    wait for the producer to finish decoding. A consumer pins
+    a slot by incrementing its lease count and then checking
+    that the slot is still the most recent one. Because the 
+    producer only writes into slots that are not the most 
+    recent one, a slot that passes this check cannot be in
+    the process of being overwritten.
+
+    The pool can also keep a history of the most recently
+    published frames, which consumers look up by capture time
+    or sequence number. The history holds a lease on each of
+    its frames. It is protected by a mutex that the producer
+    only holds to add a frame, never while a frame is read.
+
+    Only the init, clear and producer functions must be 
+    called from the same thread.
+*/
+class FramePool
+{
+public:
+    FramePool();
+    virtual ~FramePool();
+
+    /** Allocate the slot table. The slot memory itself is
+        allocated by the producer on first use. The last 
+        'historyDepth' published frames stay in the pool,
+        so slotCount must leave enough room for them.
+        Must not be called while frames are leased. */
+    void init(uint32_t slotCount, uint32_t historyDepth = 1);
+
+    /** Release all slots and their memory. */
+    void clear();
+
+    /** Producer: return a slot to write the next frame into
+        or nullptr if all slots are in use. */
+    FrameSlot* beginWrite();
+
+    /** Producer: publish a slot obtained by beginWrite as the
+        most recent frame. */
+    void commitWrite(FrameSlot *slot);
+
+    /** Producer: hand back a slot obtained by beginWrite
+        without publishing it. */
+    void abortWrite(FrameSlot *slot);
+
+    /** Consumer: pin the most recent frame so it will not be
+        overwritten. Returns nullptr if no frame has been
+        published yet. Unpin the slot with release(). */
+    FrameSlot* acquireLatest();
+
+    /** Consumer: pin the oldest frame in the history that was
+        captured at or after 'timestamp' (see getCaptureTime). 
+        Returns nullptr if there is no such frame yet. Unpin 
+        the slot with release(). */
+    FrameSlot* acquireAfter(uint64_t timestamp);
+
+    /** Consumer: pin the frame in the history with sequence
+        number 'sequence', or return nullptr if it is not
+        in the history. */
+    FrameSlot* acquireBySequence(uint32_t sequence);
+
+    /** Consumer: returns true if the history holds a frame
+        captured at or after 'timestamp'. */
+    bool hasFrameAfter(uint64_t timestamp);
+
+    /** Consumer: list the frames in the history, oldest first */
+    void getHistory(std::vector<FrameRef> &frames);
+
+    typedef std::function<bool(const FrameSlot *slot)> SlotMatch;
+
+    /** Consumer: pin the oldest frame in the history for which
+        'match' returns true, or return nullptr. 'match' is
+        called with the history locked. */
+    FrameSlot* acquireFirst(const SlotMatch &match);
+
+    /** Consumer: returns true if 'match' returns true 
+        for a frame in the history. */
+    bool hasFrame(const SlotMatch &match);
+
+    /** Producer: pin a slot it has just published. */
+    void retain(FrameSlot *slot);
+
+    /** Consumer: add a lease to a slot that is already leased.
+        Returns false if the slot is not leased. */
+    bool retainLeased(uint32_t slotIndex);
+
+    /** Consumer: unpin a slot. Returns false if the slot was
+        not leased. */
+    bool release(const FrameSlot *slot);
+
+    /** Consumer: unpin a slot by its index. */
+    bool release(uint32_t slotIndex);
+
+    /** return the number of slots in the pool */
+    uint32_t getSlotCount() const
+    {
+        return m_slotCount;
+    }
+
+    /** return a slot by its index or nullptr */
+    FrameSlot* getSlot(uint32_t slotIndex)
+    {
+        return (slotIndex < m_slotCount) ? &m_slots[slotIndex] : nullptr;
+    }
+
+    /** return the number of frames the history can hold */
+    uint32_t getHistoryDepth() const
+    {
+        return static_cast<uint32_t>(m_history.size());
+    }
+
+    /** return the index of a slot in the pool */
+    uint32_t indexOf(const FrameSlot *slot) const;
+
+    /** Producer: return the number of slots that currently
+        reference platform memory. */
+    uint32_t externalCount() const;
+
+    /** Producer: collect the platform buffer indices of slots
+        that reference platform memory that is no longer needed.
+        These slots are returned to the pool. */
+    void reclaimExternal(std::vector<int32_t> &indices);
+
+protected:
+    /** return the history index of the oldest frame for which
+        'match' returns true or -1, m_historyMutex must be held */
+    int32_t findFirst(const SlotMatch &match) const;
+
+    /** drop all frames from the history and release their leases */
+    void clearHistory();
+
+    FrameSlot*              m_slots;        ///< frame slots
+    uint32_t                m_slotCount;    ///< number of frame slots
+    std::atomic<int32_t>    m_latest;       ///< index of the most recent frame or -1
+
+    std::mutex              m_historyMutex; ///< protects the history
+    std::vector<int32_t>    m_history;      ///< ring of leased slot indices, oldest at m_historyHead
+    uint32_t                m_historyHead;  ///< position of the oldest frame in m_history
+    uint32_t                m_historyCount; ///< number of frames in the history
+};
+
+#endif
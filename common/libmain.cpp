@@ -29,6 +29,7 @@
 
 #include "openpnp-capture.h"
 #include "context.h"
+#include "stream.h"
 #include "logging.h"
 #include "version.h"
 
@@ -39,6 +40,14 @@
 // This function must be implemented in platformcontext.cpp
 Context* createPlatformContext();
 
+// Define a factory call for contexts that read the
+// frames shared by a broker in another process.
+// Returns NULL if not supported or the broker
+// cannot be reached.
+//
+// This function must be implemented in platformcontext.cpp
+Context* createClientContext(const char *brokerName);
+
 
 DLLPUBLIC CapContext Cap_createContext()
 {
@@ -46,6 +55,12 @@ DLLPUBLIC CapContext Cap_createContext()
     return ctx;
 }
 
+DLLPUBLIC CapContext Cap_createClientContext(const char *brokerName)
+{
+    Context *ctx = createClientContext(brokerName);
+    return ctx;
+}
+
 DLLPUBLIC CapResult Cap_releaseContext(CapContext ctx)
 {
     if (ctx != 0)
@@ -58,6 +73,24 @@ DLLPUBLIC CapResult Cap_releaseContext(CapContext ctx)
     return CAPRESULT_ERR;
 }
 
+DLLPUBLIC CapResult Cap_setContextOption(CapContext ctx, CapContextOptionID optionID, int32_t value)
+{
+    if (ctx != 0)
+    {
+        return reinterpret_cast<Context*>(ctx)->setOption(optionID, value);
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_getContextOption(CapContext ctx, CapContextOptionID optionID, int32_t *outValue)
+{
+    if ((ctx != 0) && (outValue != nullptr))
+    {
+        return reinterpret_cast<Context*>(ctx)->getOption(optionID, *outValue);
+    }
+    return CAPRESULT_ERR;
+}
+
 DLLPUBLIC uint32_t Cap_getDeviceCount(CapContext ctx)
 {
     if (ctx != 0)
@@ -116,11 +149,33 @@ DLLPUBLIC CapStream Cap_openStream(CapContext ctx, CapDeviceID index, CapFormatI
     if (ctx != 0)
     {
         Context *c = reinterpret_cast<Context*>(ctx);
-        return c->openStream(index, formatID);
+        return c->openStream(index, formatID, nullptr, 0);
     }
     return -1;
 }
 
+DLLPUBLIC CapStream Cap_openStreamWithOptions(CapContext ctx, CapDeviceID index, CapFormatID formatID,
+    const CapStreamOption *options, uint32_t count)
+{
+    if ((ctx != 0) && ((options != nullptr) || (count == 0)))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->openStream(index, formatID, options, count);
+    }
+    return -1;
+}
+
+DLLPUBLIC CapResult Cap_getStreamOption(CapContext ctx, CapStream stream, CapStreamOptionID optionID, 
+    int32_t *outValue)
+{
+    if ((ctx != 0) && (outValue != nullptr))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->getStreamOption(stream, optionID, *outValue) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
 DLLPUBLIC CapResult Cap_closeStream(CapContext ctx, CapStream stream)
 {
     if (ctx != 0)
@@ -141,6 +196,67 @@ DLLPUBLIC uint32_t Cap_isOpenStream(CapContext ctx, CapStream stream)
     return 0;   // closed stream
 }
 
+DLLPUBLIC CapResult Cap_triggerCapture(CapContext ctx, CapStream stream, uint32_t frames)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->triggerCapture(stream, frames) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_pauseStream(CapContext ctx, CapStream stream)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->pauseStream(stream) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_resumeStream(CapContext ctx, CapStream stream)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->resumeStream(stream) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_getStreamStats(CapContext ctx, CapStream stream, CapStreamStats *stats)
+{
+    if ((ctx != 0) && (stats != nullptr))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->getStreamStats(stream, stats) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_setOutputFormat(CapContext ctx, CapStream stream, uint32_t fourcc)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setStreamOutputFormat(stream, fourcc);
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_setROI(CapContext ctx, CapStream stream, uint32_t x, uint32_t y, 
+    uint32_t width, uint32_t height)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setStreamROI(stream, x, y, width, height) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
 DLLPUBLIC CapResult Cap_captureFrame(CapContext ctx, CapStream stream, void *RGBbufferPtr, uint32_t RGBbufferBytes)
 {
     if (ctx != 0)
@@ -151,6 +267,269 @@ DLLPUBLIC CapResult Cap_captureFrame(CapContext ctx, CapStream stream, void *RGB
     return CAPRESULT_ERR;
 }
 
+DLLPUBLIC CapResult Cap_acquireFrame(CapContext ctx, CapStream stream, CapFrameLease *lease)
+{
+    if ((ctx != 0) && (lease != NULL))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->acquireFrame(stream, lease) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_releaseFrame(CapContext ctx, CapStream stream, CapFrameLease *lease)
+{
+    if ((ctx != 0) && (lease != NULL))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->releaseFrame(stream, lease) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_acquireFrameAfter(CapContext ctx, CapStream stream, uint64_t timestamp, 
+    uint32_t timeoutMs, CapFrameLease *lease, CapFrameInfo *info)
+{
+    if ((ctx != 0) && (lease != NULL))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->acquireFrameAfter(stream, timestamp, timeoutMs, lease, info);
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_acquireFrameBySequence(CapContext ctx, CapStream stream, uint32_t sequence, 
+    CapFrameLease *lease, CapFrameInfo *info)
+{
+    if ((ctx != 0) && (lease != NULL))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->acquireFrameBySequence(stream, sequence, lease, info) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_waitForSettle(CapContext ctx, CapStream stream, float threshold, 
+    uint32_t timeoutMs, CapFrameLease *lease, CapFrameInfo *info)
+{
+    if ((ctx != 0) && (lease != NULL))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->waitForSettle(stream, threshold, timeoutMs, lease, info);
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC uint64_t Cap_getTimestamp()
+{
+    return Stream::getTimestamp();
+}
+
+DLLPUBLIC CapResult Cap_waitForFrame(CapContext ctx, CapStream stream, uint32_t timeoutMs)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->waitForFrame(&stream, 1, timeoutMs, nullptr);
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_waitForAnyFrame(CapContext ctx, const CapStream *streams, uint32_t count, 
+    uint32_t timeoutMs, uint32_t *readyIndex)
+{
+    if ((ctx != 0) && (streams != nullptr) && (count != 0))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->waitForFrame(streams, count, timeoutMs, readyIndex);
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_retainFrame(CapContext ctx, CapStream stream, const CapFrameLease *lease)
+{
+    if ((ctx != 0) && (lease != nullptr))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->retainFrame(stream, lease) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_exportFrame(CapContext ctx, CapStream stream, const CapFrameLease *lease, 
+    CapFrameExport *exportInfo)
+{
+    if ((ctx != 0) && (lease != nullptr) && (exportInfo != nullptr))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->exportFrame(stream, lease, exportInfo) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_startBroker(CapContext ctx, CapStream stream, const char *name)
+{
+    if ((ctx != 0) && (name != nullptr))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->startBroker(stream, name) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_stopBroker(CapContext ctx, CapStream stream)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->stopBroker(stream) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapConsumer Cap_openConsumer(CapContext ctx, CapStream stream)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->openConsumer(stream);
+    }
+    return -1;
+}
+
+DLLPUBLIC CapResult Cap_closeConsumer(CapContext ctx, CapConsumer consumer)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->closeConsumer(consumer) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC uint32_t Cap_consumerHasNewFrame(CapContext ctx, CapConsumer consumer)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->consumerHasNewFrame(consumer) ? 1 : 0;
+    }
+    return 0;
+}
+
+DLLPUBLIC CapResult Cap_consumerCaptureFrame(CapContext ctx, CapConsumer consumer, 
+    void *RGBbufferPtr, uint32_t RGBbufferBytes)
+{
+    if ((ctx != 0) && (RGBbufferPtr != NULL))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->consumerCaptureFrame(consumer, (uint8_t*)RGBbufferPtr, RGBbufferBytes) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_consumerAcquireFrame(CapContext ctx, CapConsumer consumer, CapFrameLease *lease)
+{
+    if ((ctx != 0) && (lease != NULL))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->consumerAcquireFrame(consumer, lease) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_consumerReleaseFrame(CapContext ctx, CapConsumer consumer, CapFrameLease *lease)
+{
+    if ((ctx != 0) && (lease != NULL))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->consumerReleaseFrame(consumer, lease) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_consumerGetFrameInfo(CapContext ctx, CapConsumer consumer, CapFrameInfo *info)
+{
+    if ((ctx != 0) && (info != NULL))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->consumerGetFrameInfo(consumer, info) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_consumerWaitForFrame(CapContext ctx, CapConsumer consumer, uint32_t timeoutMs)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->consumerWaitForFrame(consumer, timeoutMs);
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapGroup Cap_openGroup(CapContext ctx, const CapStream *streams, uint32_t count)
+{
+    if ((ctx != 0) && (streams != NULL) && (count != 0))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->openGroup(streams, count);
+    }
+    return -1;
+}
+
+DLLPUBLIC CapResult Cap_closeGroup(CapContext ctx, CapGroup group)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->closeGroup(group) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_captureGroup(CapContext ctx, CapGroup group, uint32_t toleranceUs, 
+    uint32_t timeoutMs, CapFrameLease *leases, CapFrameInfo *infos)
+{
+    if ((ctx != 0) && (leases != NULL))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->captureGroup(group, toleranceUs, timeoutMs, leases, infos);
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_releaseGroup(CapContext ctx, CapGroup group, CapFrameLease *leases)
+{
+    if ((ctx != 0) && (leases != NULL))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->releaseGroup(group, leases) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_setFrameCallback(CapContext ctx, CapStream stream, 
+    CapFrameCallback callback, void *userData)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setFrameCallback(stream, callback, userData) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_getFrameInfo(CapContext ctx, CapStream stream, CapFrameInfo *info)
+{
+    if ((ctx != 0) && (info != nullptr))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->getFrameInfo(stream, info) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
 DLLPUBLIC uint32_t Cap_hasNewFrame(CapContext ctx, CapStream stream)
 {
     if (ctx != 0)
@@ -0,0 +1,111 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Platform independent luminance signature of a frame,
+    used to detect when the image has stopped changing.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include "openpnp-capture.h"
+#include "lumasignature.h"
+
+/** number of samples per cell in each direction */
+static const uint32_t c_samples = 4;
+
+template<typename LumaFunc> bool LumaSignature::compute(uint32_t width, uint32_t height, 
+    uint32_t stride, uint32_t pixelStep, LumaFunc luma)
+{
+    if ((width < c_width) || (height < c_height))
+    {
+        return false;
+    }
+
+    for(uint32_t cy=0; cy<c_height; cy++)
+    {
+        const uint32_t y0 = cy*height/c_height;
+        const uint32_t ch = (cy+1)*height/c_height - y0;
+        for(uint32_t cx=0; cx<c_width; cx++)
+        {
+            const uint32_t x0 = cx*width/c_width;
+            const uint32_t cw = (cx+1)*width/c_width - x0;
+
+            // sample the centers of a 4x4 grid within the cell
+            uint32_t sum = 0;
+            for(uint32_t sy=0; sy<c_samples; sy++)
+            {
+                const uint32_t y = y0 + (2*sy+1)*ch/(2*c_samples);
+                for(uint32_t sx=0; sx<c_samples; sx++)
+                {
+                    const uint32_t x = x0 + (2*sx+1)*cw/(2*c_samples);
+                    sum += luma(static_cast<size_t>(y)*stride + x*pixelStep);
+                }
+            }
+            m_cells[cy*c_width + cx] = static_cast<uint8_t>(sum / (c_samples*c_samples));
+        }
+    }
+    return true;
+}
+
+bool LumaSignature::fromLuma(const uint8_t *plane, uint32_t width, uint32_t height, 
+    uint32_t stride, uint32_t pixelStep)
+{
+    return compute(width, height, stride, pixelStep, [plane](size_t offset)
+    {
+        return static_cast<uint32_t>(plane[offset]);
+    });
+}
+
+bool LumaSignature::fromFrame(const uint8_t *data, uint32_t width, uint32_t height, 
+    uint32_t stride, uint32_t fourcc)
+{
+    // BT.601 luminance with 8-bit fixed point weights
+    switch(fourcc)
+    {
+    case CAPFOURCC_GRAY8:
+        return fromLuma(data, width, height, stride);
+    case CAPFOURCC_RGB24:
+    case CAPFOURCC_RGBA32:
+        return compute(width, height, stride, (fourcc == CAPFOURCC_RGB24) ? 3 : 4, [data](size_t offset)
+        {
+            return (77*data[offset] + 150*data[offset+1] + 29*data[offset+2]) >> 8;
+        });
+    case CAPFOURCC_BGR24:
+        return compute(width, height, stride, 3, [data](size_t offset)
+        {
+            return (29*data[offset] + 150*data[offset+1] + 77*data[offset+2]) >> 8;
+        });
+    default:
+        return false;
+    }
+}
+
+float LumaSignature::difference(const LumaSignature &other) const
+{
+    uint32_t sum = 0;
+    for(uint32_t i=0; i<c_width*c_height; i++)
+    {
+        sum += static_cast<uint32_t>(abs(static_cast<int32_t>(m_cells[i]) - other.m_cells[i]));
+    }
+    return static_cast<float>(sum) / (c_width*c_height);
+}
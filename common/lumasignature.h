@@ -0,0 +1,76 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Platform independent luminance signature of a frame,
+    used to detect when the image has stopped changing.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef lumasignature_h
+#define lumasignature_h
+
+#include <stdint.h>
+
+/** A luminance signature is a tiny grayscale thumbnail of a
+    frame: the average luminance of each cell of a fixed grid.
+    Comparing the signatures of two frames tells whether the 
+    image has changed, at a fraction of the cost of comparing
+    the frames themselves.
+
+    Each cell is averaged over a sparse grid of samples, so 
+    computing a signature reads a few thousand pixels, 
+    regardless of the frame size.
+*/
+class LumaSignature
+{
+public:
+    static const uint32_t c_width  = 32;    ///< number of cells per row
+    static const uint32_t c_height = 24;    ///< number of cell rows
+
+    /** Compute the signature of an 8-bit luminance plane, such as
+        the Y plane of a planar YUV frame. 'pixelStep' is the number
+        of bytes between two luminance samples, e.g. 2 for YUYV.
+        Returns false if the frame is smaller than the grid. */
+    bool fromLuma(const uint8_t *plane, uint32_t width, uint32_t height, 
+        uint32_t stride, uint32_t pixelStep = 1);
+
+    /** Compute the signature of a frame in a pixel layout produced
+        by the library (CAPFOURCC_xxx). Returns false if the layout
+        is not supported or the frame is smaller than the grid. */
+    bool fromFrame(const uint8_t *data, uint32_t width, uint32_t height, 
+        uint32_t stride, uint32_t fourcc);
+
+    /** Return the mean absolute difference between the cells of
+        two signatures, in luminance levels (0 .. 255). */
+    float difference(const LumaSignature &other) const;
+
+protected:
+    /** Average a 4x4 grid of samples in each cell. 'luma' returns 
+        the luminance of the pixel at a byte offset into the frame. */
+    template<typename LumaFunc> bool compute(uint32_t width, uint32_t height, 
+        uint32_t stride, uint32_t pixelStep, LumaFunc luma);
+
+    uint8_t m_cells[c_width*c_height];  ///< average luminance of each cell
+};
+
+#endif
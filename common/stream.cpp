@@ -27,8 +27,11 @@
 */
 
 #include <memory.h> // for memcpy
+#include <chrono>
+#include <algorithm>
 #include "stream.h"
 #include "context.h"
+#include "workerpool.h"
 
 
 // **********************************************************************
@@ -39,36 +42,771 @@ Stream::Stream() :
     m_owner(nullptr),
     m_isOpen(false),
     m_frames(0),
-    m_newFrame(false)
+    m_outputFormat(CAPFOURCC_RGB24),
+    m_deviceTimestamp(0),
+    m_deviceSequence(0),
+    m_deviceFlags(0),
+    m_frameFlags(0),
+    m_droppedFrames(0),
+    m_hasPrevSignature(false),
+    m_settleWaiters(0),
+    m_callback(nullptr),
+    m_callbackUserData(nullptr),
+    m_callbackStreamID(-1),
+    m_callbackDropped(0),
+    m_callbackSequence(0),
+    m_hasCallback(false),
+    m_startTime(0),
+    m_openTime(0),
+    m_awaitFirstFrame(false),
+    m_awaitOpenFrame(false),
+    m_sink(nullptr),
+    m_hasSink(false)
 {
+    memset(&m_stats, 0, sizeof(m_stats));
 }
 
 Stream::~Stream()
 {
-    LOG(LOG_DEBUG,"Stream::~Stream reports %d frames captured.\n", m_frames);
+    LOG(LOG_DEBUG,"Stream::~Stream reports %d frames captured.\n", m_frames.load());
     //Note: close() should be called/handled by the PlatformStream!
 }
 
-bool Stream::hasNewFrame()
+bool Stream::setOpenOption(uint32_t optionID, int32_t value)
 {
-    m_bufferMutex.lock();
-    bool ok = m_newFrame;
-    m_bufferMutex.unlock();
-    return ok;
+    switch(optionID)
+    {
+    case CAPSTREAMOPT_BUFFERCOUNT:
+        if ((value < 2) || (value > 32))
+        {
+            return false;
+        }
+        m_openOptions.m_bufferCount = static_cast<uint32_t>(value);
+        return true;
+    case CAPSTREAMOPT_LATESTONLY:
+        if ((value != 0) && (value != 1))
+        {
+            return false;
+        }
+        m_openOptions.m_latestOnly = (value == 1);
+        return true;
+    case CAPSTREAMOPT_LAZYCONVERSION:
+        if ((value != 0) && (value != 1))
+        {
+            return false;
+        }
+        m_openOptions.m_lazyConversion = (value == 1);
+        return true;
+    case CAPSTREAMOPT_IOMETHOD:
+        if ((value < CAPIOMETHOD_AUTO) || (value > CAPIOMETHOD_READ))
+        {
+            return false;
+        }
+        m_openOptions.m_ioMethod = static_cast<uint32_t>(value);
+        return true;
+    case CAPSTREAMOPT_EXPORTFRAMES:
+        if ((value != 0) && (value != 1))
+        {
+            return false;
+        }
+        m_openOptions.m_exportFrames = (value == 1);
+        return true;
+    case CAPSTREAMOPT_HISTORYFRAMES:
+        if ((value < 1) || (value > 32))
+        {
+            return false;
+        }
+        m_openOptions.m_historyFrames = static_cast<uint32_t>(value);
+        return true;
+    case CAPSTREAMOPT_TRIGGERMODE:
+        if ((value != 0) && (value != 1))
+        {
+            return false;
+        }
+        m_openOptions.m_triggerMode = (value == 1);
+        return true;
+    case CAPSTREAMOPT_WARMUPFRAMES:
+        if ((value < 0) || (value > 30))
+        {
+            return false;
+        }
+        m_openOptions.m_warmupFrames = static_cast<uint32_t>(value);
+        return true;
+    case CAPSTREAMOPT_STARTPAUSED:
+        if ((value != 0) && (value != 1))
+        {
+            return false;
+        }
+        m_openOptions.m_startPaused = (value == 1);
+        return true;
+    case CAPSTREAMOPT_DECODESCALE:
+        if ((value != 1) && (value != 2) && (value != 4) && (value != 8))
+        {
+            return false;
+        }
+        m_openOptions.m_decodeScale = static_cast<uint32_t>(value);
+        return true;
+    case CAPSTREAMOPT_CROPX:
+        if ((value < 0) || (value > 65535))
+        {
+            return false;
+        }
+        m_openOptions.m_cropX = static_cast<uint32_t>(value);
+        return true;
+    case CAPSTREAMOPT_CROPY:
+        if ((value < 0) || (value > 65535))
+        {
+            return false;
+        }
+        m_openOptions.m_cropY = static_cast<uint32_t>(value);
+        return true;
+    case CAPSTREAMOPT_CROPWIDTH:
+        if ((value < 0) || (value > 65535))
+        {
+            return false;
+        }
+        m_openOptions.m_cropWidth = static_cast<uint32_t>(value);
+        return true;
+    case CAPSTREAMOPT_CROPHEIGHT:
+        if ((value < 0) || (value > 65535))
+        {
+            return false;
+        }
+        m_openOptions.m_cropHeight = static_cast<uint32_t>(value);
+        return true;
+    case CAPSTREAMOPT_BINNING:
+        if ((value != 1) && (value != 2) && (value != 4))
+        {
+            return false;
+        }
+        m_openOptions.m_binning = static_cast<uint32_t>(value);
+        return true;
+    case CAPSTREAMOPT_DECODEERRORS:
+        if ((value < CAPDECODEERRORS_IGNORE) || (value > CAPDECODEERRORS_WARNINGS))
+        {
+            return false;
+        }
+        m_openOptions.m_decodeErrors = static_cast<uint32_t>(value);
+        return true;
+    case CAPSTREAMOPT_DECODEQUEUE:
+        if ((value < 0) || (value > 16))
+        {
+            return false;
+        }
+        m_openOptions.m_decodeQueue = static_cast<uint32_t>(value);
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool Stream::getOpenOption(uint32_t optionID, int32_t &outValue) const
+{
+    switch(optionID)
+    {
+    case CAPSTREAMOPT_BUFFERCOUNT:
+        outValue = static_cast<int32_t>(m_openOptions.m_bufferCount);
+        return true;
+    case CAPSTREAMOPT_LATESTONLY:
+        outValue = m_openOptions.m_latestOnly ? 1 : 0;
+        return true;
+    case CAPSTREAMOPT_LAZYCONVERSION:
+        outValue = m_openOptions.m_lazyConversion ? 1 : 0;
+        return true;
+    case CAPSTREAMOPT_IOMETHOD:
+        outValue = static_cast<int32_t>(m_openOptions.m_ioMethod);
+        return true;
+    case CAPSTREAMOPT_EXPORTFRAMES:
+        outValue = m_openOptions.m_exportFrames ? 1 : 0;
+        return true;
+    case CAPSTREAMOPT_HISTORYFRAMES:
+        outValue = static_cast<int32_t>(m_openOptions.m_historyFrames);
+        return true;
+    case CAPSTREAMOPT_TRIGGERMODE:
+        outValue = m_openOptions.m_triggerMode ? 1 : 0;
+        return true;
+    case CAPSTREAMOPT_WARMUPFRAMES:
+        outValue = static_cast<int32_t>(m_openOptions.m_warmupFrames);
+        return true;
+    case CAPSTREAMOPT_STARTPAUSED:
+        outValue = m_openOptions.m_startPaused ? 1 : 0;
+        return true;
+    case CAPSTREAMOPT_DECODESCALE:
+        outValue = static_cast<int32_t>(m_openOptions.m_decodeScale);
+        return true;
+    case CAPSTREAMOPT_CROPX:
+        outValue = static_cast<int32_t>(m_openOptions.m_cropX);
+        return true;
+    case CAPSTREAMOPT_CROPY:
+        outValue = static_cast<int32_t>(m_openOptions.m_cropY);
+        return true;
+    case CAPSTREAMOPT_CROPWIDTH:
+        outValue = static_cast<int32_t>(m_openOptions.m_cropWidth);
+        return true;
+    case CAPSTREAMOPT_CROPHEIGHT:
+        outValue = static_cast<int32_t>(m_openOptions.m_cropHeight);
+        return true;
+    case CAPSTREAMOPT_BINNING:
+        outValue = static_cast<int32_t>(m_openOptions.m_binning);
+        return true;
+    case CAPSTREAMOPT_DECODEERRORS:
+        outValue = static_cast<int32_t>(m_openOptions.m_decodeErrors);
+        return true;
+    case CAPSTREAMOPT_DECODEQUEUE:
+        outValue = static_cast<int32_t>(m_openOptions.m_decodeQueue);
+        return true;
+    default:
+        return false;
+    }
 }
 
-bool Stream::captureFrame(uint8_t *RGBbufferPtr, uint32_t RGBbufferBytes)
+bool Stream::hasNewFrame(FrameCursor *cursor)
+{
+    return m_frames.load() != getCursor(cursor).m_lastReadFrame.load();
+}
+
+bool Stream::captureFrame(uint8_t *RGBbufferPtr, uint32_t RGBbufferBytes, FrameCursor *cursor)
 {
     if (!m_isOpen) return false;
 
-    m_bufferMutex.lock();    
-    size_t maxBytes = RGBbufferBytes <= m_frameBuffer.size() ? RGBbufferBytes : m_frameBuffer.size();
-    if (maxBytes != 0)
+    // pin the most recent frame so the capture thread
+    // can continue decoding into another slot while
+    // we are copying. No lock is held during the copy.
+    FrameSlot *slot = m_framePool.acquireLatest();
+    if (slot == nullptr)
     {
-        memcpy(RGBbufferPtr, &m_frameBuffer[0], maxBytes);
+        // no frame has been captured yet, return a black frame
+        size_t maxBytes = m_width*m_height*getBytesPerPixel(m_outputFormat);
+        maxBytes = RGBbufferBytes <= maxBytes ? RGBbufferBytes : maxBytes;
+        memset(RGBbufferPtr, 0, maxBytes);
+    }
+    else
+    {
+        ensureConverted(slot);
+
+        // native frames are copied as they are
+        const uint32_t rowBytes = slot->m_width*getBytesPerPixel(slot->m_fourcc);
+        if ((rowBytes == 0) || (slot->m_stride == rowBytes))
+        {
+            size_t maxBytes = RGBbufferBytes <= slot->m_bytes ? RGBbufferBytes : slot->m_bytes;
+            if (maxBytes != 0)
+            {
+                memcpy(RGBbufferPtr, slot->m_data, maxBytes);
+            }
+        }
+        else
+        {
+            // the rows of the frame are padded, copy row by row
+            // so the application gets a packed frame.
+            const uint8_t *src = slot->m_data;
+            uint32_t bytesLeft = RGBbufferBytes;
+            for(uint32_t y=0; (y < slot->m_height) && (bytesLeft != 0); y++)
+            {
+                uint32_t n = bytesLeft <= rowBytes ? bytesLeft : rowBytes;
+                memcpy(RGBbufferPtr, src, n);
+                RGBbufferPtr += n;
+                bytesLeft -= n;
+                src += slot->m_stride;
+            }
+        }
+        updateReadInfo(slot, getCursor(cursor));
+        m_framePool.release(slot);
     }
-    m_newFrame = false;
-    m_bufferMutex.unlock();
+    return true;
+}
+
+bool Stream::acquireFrame(CapFrameLease *lease, FrameCursor *cursor)
+{
+    if ((!m_isOpen) || (lease == nullptr)) return false;
+
+    FrameSlot *slot = m_framePool.acquireLatest();
+    if (slot == nullptr)
+    {
+        return false;
+    }
+
+    ensureConverted(slot);
+    fillLease(slot, lease);
+    updateReadInfo(slot, getCursor(cursor));
+    return true;
+}
+
+bool Stream::acquireFrameAfter(uint64_t timestamp, CapFrameLease *lease, CapFrameInfo *info)
+{
+    if ((!m_isOpen) || (lease == nullptr)) return false;
+    return leaseHistoryFrame(m_framePool.acquireAfter(timestamp), lease, info);
+}
+
+bool Stream::acquireFrameBySequence(uint32_t sequence, CapFrameLease *lease, CapFrameInfo *info)
+{
+    if ((!m_isOpen) || (lease == nullptr)) return false;
+    return leaseHistoryFrame(m_framePool.acquireBySequence(sequence), lease, info);
+}
+
+bool Stream::acquireSettledFrame(uint32_t afterSequence, float threshold, 
+    CapFrameLease *lease, CapFrameInfo *info)
+{
+    if ((!m_isOpen) || (lease == nullptr)) return false;
+    return leaseHistoryFrame(m_framePool.acquireFirst([=](const FrameSlot *slot)
+    {
+        return (slot->m_sequence > afterSequence) && (slot->m_difference >= 0.0f) &&
+            (slot->m_difference < threshold) && ((slot->m_flags & CAPFRAMEFLAG_ERROR) == 0);
+    }), lease, info);
+}
+
+bool Stream::hasSettledFrame(uint32_t afterSequence, float threshold)
+{
+    if (!m_isOpen) return false;
+    return m_framePool.hasFrame([=](const FrameSlot *slot)
+    {
+        return (slot->m_sequence > afterSequence) && (slot->m_difference >= 0.0f) &&
+            (slot->m_difference < threshold) && ((slot->m_flags & CAPFRAMEFLAG_ERROR) == 0);
+    });
+}
+
+bool Stream::leaseHistoryFrame(FrameSlot *slot, CapFrameLease *lease, CapFrameInfo *info)
+{
+    if (slot == nullptr)
+    {
+        return false;
+    }
+
+    // with lazy conversion the history holds the undecoded
+    // frames, so only the frame that is asked for is decoded.
+    ensureConverted(slot);
+    fillLease(slot, lease);
+    updateReadInfo(slot, m_cursor);
+
+    if (info != nullptr)
+    {
+        // the frame is not necessarily the one following the
+        // previously read frame, so no losses are reported.
+        info->sequence        = slot->m_sequence;
+        info->deviceSequence  = slot->m_deviceSequence;
+        info->timestamp       = slot->m_timestamp;
+        info->deviceTimestamp = slot->m_deviceTimestamp;
+        info->flags           = slot->m_flags;
+        info->deviceFlags     = slot->m_deviceFlags;
+        info->dropped         = 0;
+        info->overwritten     = 0;
+        info->roiX            = slot->m_roiX;
+        info->roiY            = slot->m_roiY;
+    }
+    return true;
+}
+
+void Stream::recordStart()
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    m_startTime = getTimestamp();
+    m_stats.starts++;
+    m_stats.startLatency = 0;
+    m_stats.warmupFrames = 0;
+    m_awaitFirstFrame = true;
+}
+
+void Stream::recordOpen()
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_openTime = getTimestamp();
+    m_awaitOpenFrame = true;
+}
+
+void Stream::recordWarmupFrame()
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    m_stats.warmupFrames++;
+}
+
+void Stream::recordCorruptFrame(bool partial)
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    if (partial)
+    {
+        m_stats.partialFrames++;
+    }
+    else
+    {
+        m_stats.corruptFrames++;
+    }
+}
+
+void Stream::getStats(CapStreamStats *stats)
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    *stats = m_stats;
+}
+
+uint64_t Stream::getTimestamp()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Stream::ensureConverted(FrameSlot *slot)
+{
+    if (!slot->m_pending.load())
+    {
+        return;
+    }
+
+    // the lock makes consumers that read the same frame wait for
+    // the first one to convert it. The producer does not touch
+    // pinned slots, so the conversion runs without blocking it.
+    std::lock_guard<std::mutex> lock(m_lazyMutex);
+    if (slot->m_pending.load())
+    {
+        if (!convertPendingFrame(slot))
+        {
+            LOG(LOG_WARNING, "Stream::ensureConverted could not convert frame %d\n", slot->m_sequence);
+            memset(slot->m_storage, 0, slot->m_bytes);
+            slot->m_flags |= CAPFRAMEFLAG_ERROR;
+        }
+        slot->m_pending = false;
+    }
+}
+
+void Stream::fillLease(const FrameSlot *slot, CapFrameLease *lease) const
+{
+    lease->data      = slot->m_data;
+    lease->bytes     = static_cast<uint32_t>(slot->m_bytes);
+    lease->width     = slot->m_width;
+    lease->height    = slot->m_height;
+    lease->stride    = slot->m_stride;
+    lease->fourcc    = slot->m_fourcc;
+    lease->timestamp = slot->m_timestamp;
+    lease->leaseID   = m_framePool.indexOf(slot);
+}
+
+bool Stream::releaseFrame(const CapFrameLease *lease)
+{
+    if (lease == nullptr) return false;
+    return m_framePool.release(lease->leaseID);
+}
+
+bool Stream::retainFrame(const CapFrameLease *lease)
+{
+    if (lease == nullptr) return false;
+    return m_framePool.retainLeased(lease->leaseID);
+}
+
+void Stream::setFrameCallback(int32_t streamID, CapFrameCallback callback, void *userData)
+{
+    // when called from within the callback, the
+    // lock is already held by this thread.
+    std::unique_lock<std::mutex> lock(m_callbackMutex, std::defer_lock);
+    if (m_callbackThread.load() != std::this_thread::get_id())
+    {
+        // waits for a running callback to return
+        lock.lock();
+    }
+
+    m_callback = callback;
+    m_callbackUserData = userData;
+    m_callbackStreamID = streamID;
+    m_hasCallback = (callback != nullptr);
+}
+
+void Stream::invokeFrameCallback(FrameSlot *slot)
+{
+    std::lock_guard<std::mutex> lock(m_callbackMutex);
+    if (m_callback == nullptr)
+    {
+        return;
+    }
+
+    // the lease keeps the frame valid when the callback 
+    // retains it, and protects it from being overwritten
+    // by a future frame while the callback runs.
+    m_framePool.retain(slot);
+    ensureConverted(slot);
+
+    CapFrameLease lease;
+    fillLease(slot, &lease);
+
+    CapFrameInfo info;
+    info.sequence        = slot->m_sequence;
+    info.deviceSequence  = slot->m_deviceSequence;
+    info.timestamp       = slot->m_timestamp;
+    info.deviceTimestamp = slot->m_deviceTimestamp;
+    info.flags           = slot->m_flags;
+    info.deviceFlags     = slot->m_deviceFlags;
+    info.dropped         = slot->m_dropped - m_callbackDropped;
+    info.overwritten     = 0;
+    info.roiX            = slot->m_roiX;
+    info.roiY            = slot->m_roiY;
+    if ((m_callbackSequence != 0) && (slot->m_sequence > m_callbackSequence + 1))
+    {
+        // frames published before the callback was registered
+        info.overwritten = slot->m_sequence - m_callbackSequence - 1;
+    }
+    m_callbackDropped  = slot->m_dropped;
+    m_callbackSequence = slot->m_sequence;
+
+    m_callbackThread = std::this_thread::get_id();
+    uint32_t action = m_callback(m_callbackStreamID, &lease, &info, m_callbackUserData);
+    m_callbackThread = std::thread::id();
+
+    if (action != CAPCALLBACK_RETAIN)
+    {
+        m_framePool.release(slot);
+    }
+}
+
+bool Stream::setOutputFormat(uint32_t fourcc)
+{
+    if (fourcc != CAPFOURCC_RGB24)
+    {
+        return false;
+    }
+    m_outputFormat = fourcc;
+    return true;
+}
+
+uint32_t Stream::getBytesPerPixel(uint32_t fourcc)
+{
+    switch(fourcc)
+    {
+    case CAPFOURCC_RGB24:
+    case CAPFOURCC_BGR24:
+        return 3;
+    case CAPFOURCC_RGBA32:
+        return 4;
+    case CAPFOURCC_GRAY8:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+FrameSlot* Stream::beginFrame(uint32_t fourcc, uint32_t stride, size_t bytes,
+    uint32_t width, uint32_t height)
+{
+    FrameSlot *slot = m_framePool.beginWrite();
+    if (slot == nullptr)
+    {
+        LOG(LOG_VERBOSE, "Stream::beginFrame all frame slots are leased - dropping frame\n");
+        m_droppedFrames++;
+        return nullptr;
+    }
+
+    slot->m_width  = (width != 0) ? width : m_width;
+    slot->m_height = (height != 0) ? height : m_height;
+    slot->m_stride = stride;
+    slot->m_fourcc = fourcc;
+    slot->m_bytes  = bytes;
+    slot->m_roiX   = 0;
+    slot->m_roiY   = 0;
+    if ((stride == 0) && (bytes == 0))
+    {
+        slot->m_stride = slot->m_width*getBytesPerPixel(fourcc);
+        slot->m_bytes  = slot->m_stride*slot->m_height;
+    }
+    if (!m_openOptions.m_exportFrames || !allocateSharedStorage(slot, slot->m_bytes))
+    {
+        slot->m_buffer.resize(slot->m_bytes);
+        slot->m_storage = slot->m_buffer.empty() ? nullptr : &slot->m_buffer[0];
+    }
+    slot->m_data   = slot->m_storage;
+    slot->m_pending = false;
+    return slot;
+}
+
+void Stream::commitFrame(FrameSlot *slot)
+{
+    slot->m_timestamp = getTimestamp();
+    if (m_awaitFirstFrame.exchange(false))
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        m_stats.startLatency = static_cast<uint32_t>(slot->m_timestamp - m_startTime);
+    }
+    if (m_awaitOpenFrame.exchange(false))
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        m_stats.openLatency = static_cast<uint32_t>(slot->m_timestamp - m_openTime);
+    }
+
+    slot->m_deviceTimestamp = m_deviceTimestamp;
+    slot->m_deviceSequence  = m_deviceSequence;
+    slot->m_flags           = m_frameFlags;
+    slot->m_dropped         = m_droppedFrames;
+
+    // the signature costs a partial decode of compressed
+    // frames, so it is only computed when it is needed.
+    if (m_settleWaiters.load() != 0)
+    {
+        updateSignature(slot);
+    }
+    else
+    {
+        slot->m_difference = -1.0f;
+        m_hasPrevSignature = false;
+    }
+
+    // the frame counter is only incremented by the
+    // capture thread, so it can be assigned before
+    // the slot is published.
+    slot->m_sequence = m_frames.load() + 1;
+    m_framePool.commitWrite(slot);
+    m_frames = slot->m_sequence;
+
+    if (m_owner != nullptr)
+    {
+        m_owner->notifyNewFrame();
+    }
+
+    if (m_hasSink.load())
+    {
+        std::lock_guard<std::mutex> lock(m_sinkMutex);
+        if (m_sink != nullptr)
+        {
+            m_framePool.retain(slot);
+            ensureConverted(slot);
+            m_sink->publishFrame(slot);
+            m_framePool.release(slot);
+        }
+    }
+
+    if (m_hasCallback.load())
+    {
+        invokeFrameCallback(slot);
+    }
+}
+
+void Stream::updateSignature(FrameSlot *slot)
+{
+    // converted frames are sampled directly, undecoded
+    // frames are left to the platform.
+    LumaSignature signature;
+    bool valid = false;
+    if (slot->m_pending.load())
+    {
+        valid = !slot->m_rawBuffer.empty() && 
+            computeNativeSignature(&slot->m_rawBuffer[0], slot->m_rawBuffer.size(), signature);
+    }
+    else if (getBytesPerPixel(slot->m_fourcc) != 0)
+    {
+        valid = (slot->m_data != nullptr) && 
+            signature.fromFrame(slot->m_data, slot->m_width, slot->m_height, slot->m_stride, slot->m_fourcc);
+    }
+    else if (slot->m_data != nullptr)
+    {
+        valid = computeNativeSignature(slot->m_data, slot->m_bytes, signature);
+    }
+
+    slot->m_difference = -1.0f;
+    if (valid && m_hasPrevSignature)
+    {
+        slot->m_difference = signature.difference(m_prevSignature);
+    }
+    if (valid)
+    {
+        m_prevSignature = signature;
+    }
+    m_hasPrevSignature = valid;
+}
+
+void Stream::setFrameSink(FrameSink *sink)
+{
+    // waits for a running publishFrame to return
+    std::lock_guard<std::mutex> lock(m_sinkMutex);
+    m_sink = sink;
+    m_hasSink = (sink != nullptr);
+}
+
+void Stream::convertRowBands(uint32_t rows, uint32_t rowAlign, 
+    const std::function<void(uint32_t firstRow, uint32_t lastRow)> &convert)
+{
+    // bands smaller than this aren't worth the 
+    // overhead of handing them to another thread.
+    const uint32_t minBandRows = 16;
+
+    WorkerPool *pool = (m_owner != nullptr) ? m_owner->getWorkerPool() : nullptr;
+    uint32_t bands = (pool != nullptr) ? pool->getThreadCount() + 1 : 1;
+    if (bands > rows / minBandRows)
+    {
+        bands = rows / minBandRows;
+    }
+
+    if (bands <= 1)
+    {
+        convert(0, rows);
+        return;
+    }
+
+    uint32_t bandRows = (rows + bands - 1) / bands;
+    bandRows = ((bandRows + rowAlign - 1) / rowAlign) * rowAlign;
+
+    pool->parallelFor(bands, [&](uint32_t band)
+    {
+        const uint32_t firstRow = band * bandRows;
+        const uint32_t lastRow  = std::min(firstRow + bandRows, rows);
+        if (firstRow < lastRow)
+        {
+            convert(firstRow, lastRow);
+        }
+    });
+}
+
+void Stream::abortFrame(FrameSlot *slot)
+{
+    m_framePool.abortWrite(slot);
+    m_droppedFrames++;
+}
+
+void Stream::setDeviceFrameInfo(uint64_t timestamp, uint32_t sequence, uint32_t flags, uint32_t deviceFlags)
+{
+    m_deviceTimestamp = timestamp;
+    m_deviceSequence  = sequence;
+    m_frameFlags      = flags;
+    m_deviceFlags     = deviceFlags;
+}
+
+void Stream::updateReadInfo(const FrameSlot *slot, FrameCursor &cursor)
+{
+    std::lock_guard<std::mutex> lock(cursor.m_readInfoMutex);
+    CapFrameInfo &readInfo = cursor.m_readInfo;
+    if (slot->m_sequence < readInfo.sequence)
+    {
+        // another thread of this consumer has already read a newer frame
+        return;
+    }
+
+    // Frames that were published between the previously read
+    // frame and this one have been overwritten. Dropped frames
+    // were never published, their count is kept separately.
+    // Reading the same frame again loses no frames.
+    const uint32_t previous = readInfo.sequence;
+    readInfo.dropped     = slot->m_dropped - cursor.m_readDropped;
+    readInfo.overwritten = 0;
+    if (slot->m_sequence > previous + 1)
+    {
+        readInfo.overwritten = slot->m_sequence - previous - 1;
+    }
+    readInfo.sequence        = slot->m_sequence;
+    readInfo.deviceSequence  = slot->m_deviceSequence;
+    readInfo.timestamp       = slot->m_timestamp;
+    readInfo.deviceTimestamp = slot->m_deviceTimestamp;
+    readInfo.flags           = slot->m_flags;
+    readInfo.deviceFlags     = slot->m_deviceFlags;
+    readInfo.roiX            = slot->m_roiX;
+    readInfo.roiY            = slot->m_roiY;
+    cursor.m_readDropped   = slot->m_dropped;
+    cursor.m_lastReadFrame = slot->m_sequence;
+}
+
+bool Stream::getFrameInfo(CapFrameInfo *info, FrameCursor *cursor)
+{
+    if (info == nullptr) return false;
+
+    FrameCursor &c = getCursor(cursor);
+    std::lock_guard<std::mutex> lock(c.m_readInfoMutex);
+    if (c.m_readInfo.sequence == 0)
+    {
+        return false;   // no frame has been read yet
+    }
+    *info = c.m_readInfo;
     return true;
 }
 
@@ -79,13 +817,6 @@ void Stream::submitBuffer(const uint8_t *ptr, size_t bytes)
     {
         return;
     }
-    
-    m_bufferMutex.lock();
-    
-    if (m_frameBuffer.size() == 0)
-    {
-        LOG(LOG_ERR,"Stream::m_frameBuffer size is 0 - cant store frame buffers!\n");
-    }
 
     // Generate warning every 100 frames if the frame buffer is not
     // the expected size. 
@@ -96,11 +827,16 @@ void Stream::submitBuffer(const uint8_t *ptr, size_t bytes)
         LOG(LOG_WARNING, "Warning: captureFrame received incorrect buffer size (got %d want %d)\n", bytes, wantSize);
     }
 
-    if (m_frameBuffer.size() >= bytes)
+    if (bytes > wantSize)
+    {
+        m_droppedFrames++;
+        return;
+    }
+
+    FrameSlot *slot = beginFrame();
+    if (slot != nullptr)
     {
-        memcpy(&m_frameBuffer[0], ptr, bytes);
-        m_newFrame = true; 
-        m_frames++;
+        memcpy(slot->m_storage, ptr, bytes);
+        commitFrame(slot);
     }
-    m_bufferMutex.unlock();
 }
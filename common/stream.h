@@ -29,15 +29,97 @@
 #define stream_h
 
 #include <stdint.h>
+#include <string.h>
 #include <vector>
+#include <atomic>
+#include <functional>
 #include <mutex>
+#include <thread>
+#include "openpnp-capture.h"
 #include "logging.h"
+#include "framepool.h"
+#include "lumasignature.h"
 
 class Context;      // pre-declaration
 class deviceInfo;   // pre-declaration
 class Stream;       // pre-declaration
 
 
+/** Receives every frame a stream publishes, for example to
+    share the frames with other processes. */
+class FrameSink
+{
+public:
+    virtual ~FrameSink() {}
+
+    /** Called by the capture thread with each new, converted
+        frame. The slot is only valid during the call and must
+        not be modified. */
+    virtual void publishFrame(const FrameSlot *slot) = 0;
+};
+
+/** The read state of one consumer of a stream: which frame
+    it read last and the information about that frame. Each
+    consumer has its own new-frame state and drop counters,
+    while the frames themselves are shared. */
+struct FrameCursor
+{
+    FrameCursor() :
+        m_lastReadFrame(0),
+        m_readDropped(0)
+    {
+        memset(&m_readInfo, 0, sizeof(m_readInfo));
+    }
+
+    std::atomic<uint32_t> m_lastReadFrame;  ///< frame number of the frame last read
+    std::mutex  m_readInfoMutex;            ///< protects m_readInfo and m_readDropped
+    CapFrameInfo m_readInfo;                ///< information about the frame most recently read
+    uint32_t    m_readDropped;              ///< m_dropped of the frame most recently read
+};
+
+/** Options that are set before a stream is opened, see CAPSTREAMOPT_xxx */
+struct StreamOptions
+{
+    StreamOptions() :
+        m_bufferCount(8),
+        m_latestOnly(false),
+        m_lazyConversion(false),
+        m_ioMethod(CAPIOMETHOD_AUTO),
+        m_exportFrames(false),
+        m_historyFrames(1),
+        m_triggerMode(false),
+        m_warmupFrames(0),
+        m_startPaused(false),
+        m_decodeScale(1),
+        m_cropX(0),
+        m_cropY(0),
+        m_cropWidth(0),
+        m_cropHeight(0),
+        m_binning(1),
+        m_decodeErrors(CAPDECODEERRORS_IGNORE),
+        m_decodeQueue(0)
+    {
+    }
+
+    uint32_t    m_bufferCount;  ///< number of buffers the driver captures into
+    bool        m_latestOnly;   ///< only convert the newest captured frame
+    bool        m_lazyConversion;   ///< convert frames when they are read
+    uint32_t    m_ioMethod;     ///< CAPIOMETHOD_xxx
+    bool        m_exportFrames; ///< keep frames in shared memory that can be exported
+    uint32_t    m_historyFrames;///< number of recent frames kept for acquireFrameAfter
+    bool        m_triggerMode;  ///< only stream while triggered frames are captured
+    uint32_t    m_warmupFrames; ///< number of frames discarded after streaming starts
+    bool        m_startPaused;  ///< open the stream without streaming
+    uint32_t    m_decodeScale;  ///< compressed frames are decoded at 1/m_decodeScale of their size
+    uint32_t    m_cropX;        ///< left edge of the sensor area to capture
+    uint32_t    m_cropY;        ///< top edge of the sensor area to capture
+    uint32_t    m_cropWidth;    ///< width of the sensor area to capture, 0 for the full sensor
+    uint32_t    m_cropHeight;   ///< height of the sensor area to capture, 0 for the full sensor
+    uint32_t    m_binning;      ///< the sensor area is captured at 1/m_binning of its size
+    uint32_t    m_decodeErrors; ///< CAPDECODEERRORS_xxx
+    uint32_t    m_decodeQueue;  ///< number of frames waiting for the decode thread, 0 for none
+};
+
 /** The stream class handles the capturing of a single device */
 class Stream
 {
@@ -54,23 +136,203 @@ public:
     /** Close a capture stream */
     virtual void close() {};
 
+    /** Set an option (CAPSTREAMOPT_xxx) before the stream is opened.
+        Returns false if the option or its value is invalid.
+    */
+    bool setOpenOption(uint32_t optionID, int32_t value);
+
+    /** Get the value of an option (CAPSTREAMOPT_xxx).
+        Returns false if the option is unknown. */
+    bool getOpenOption(uint32_t optionID, int32_t &outValue) const;
+
+    /** Return the options set before the stream was opened */
+    const StreamOptions& getOpenOptions() const
+    {
+        return m_openOptions;
+    }
+
     /** Returns true if a new frame is available for reading using 'captureFrame'. 
-        The internal new frame flag is reset by captureFrame.
+        A frame is no longer new once it has been read by captureFrame
+        or acquireFrame. The read functions use the read state of 
+        'cursor', or that of the stream itself if it is nullptr.
     */
-    bool hasNewFrame();
+    bool hasNewFrame(FrameCursor *cursor = nullptr);
 
     /** Retrieve the most recently captured frame and copy it in a
         buffer pointed to by RGBbufferPtr. The maximum buffer size 
         must be supplied in RGBbufferBytes.
     */
-    bool captureFrame(uint8_t *RGBbufferPtr, uint32_t RGBbufferBytes);
+    bool captureFrame(uint8_t *RGBbufferPtr, uint32_t RGBbufferBytes, FrameCursor *cursor = nullptr);
+
+    /** Pin the most recently captured frame and return a read-only
+        view of it in 'lease'. The frame will not be overwritten
+        until it is handed back with releaseFrame.
+        Returns false if no frame has been captured yet.
+    */
+    bool acquireFrame(CapFrameLease *lease, FrameCursor *cursor = nullptr);
+
+    /** Pin the first frame that was captured at or after 
+        'timestamp' (microseconds on the steady clock) and
+        return it like acquireFrame. Only the frames in the
+        history are searched, so if the first such frame has
+        been dropped from the history, a later one is returned.
+        Returns false if no such frame has been captured yet.
+    */
+    bool acquireFrameAfter(uint64_t timestamp, CapFrameLease *lease, CapFrameInfo *info);
+
+    /** Pin the frame with library sequence number 'sequence' 
+        if it is still in the history, like acquireFrameAfter. */
+    bool acquireFrameBySequence(uint32_t sequence, CapFrameLease *lease, CapFrameInfo *info);
+
+    /** List the frames in the history, oldest first */
+    void getHistory(std::vector<FrameRef> &frames)
+    {
+        if (m_isOpen)
+        {
+            m_framePool.getHistory(frames);
+        }
+        else
+        {
+            frames.clear();
+        }
+    }
+
+    /** Returns true if acquireFrameAfter would find a frame */
+    bool hasFrameAfter(uint64_t timestamp)
+    {
+        return m_isOpen && m_framePool.hasFrameAfter(timestamp);
+    }
+
+    /** Pin the first frame in the history with a sequence number
+        above 'afterSequence' whose luminance differs less than
+        'threshold' from the frame before it, like acquireFrameAfter.
+        Returns false if there is no such frame.
+    */
+    bool acquireSettledFrame(uint32_t afterSequence, float threshold, 
+        CapFrameLease *lease, CapFrameInfo *info);
+
+    /** Returns true if acquireSettledFrame would find a frame */
+    bool hasSettledFrame(uint32_t afterSequence, float threshold);
+
+    /** Called before and after waiting for a settled frame.
+        The luminance signatures are only computed while at 
+        least one consumer waits. */
+    void beginSettleWait()
+    {
+        m_settleWaiters++;
+    }
+
+    void endSettleWait()
+    {
+        m_settleWaiters--;
+    }
+
+    /** Return the current time in microseconds on the clock
+        used to timestamp the frames. */
+    static uint64_t getTimestamp();
+
+    /** Hand back a frame obtained with acquireFrame. */
+    bool releaseFrame(const CapFrameLease *lease);
+
+    /** Add a lease to a frame that is leased. */
+    bool retainFrame(const CapFrameLease *lease);
+
+    /** Return a file descriptor for the memory of a leased frame.
+        The base class does not support exporting frames. */
+    virtual bool exportFrame(const CapFrameLease *lease, CapFrameExport *exportInfo)
+    {
+        return false;
+    }
+
+    /** Register a callback that is called by the capture thread
+        for each new frame, or unregister it with nullptr. Waits
+        until a running call of the previous callback has 
+        returned, unless called from within the callback.
+    */
+    void setFrameCallback(int32_t streamID, CapFrameCallback callback, void *userData);
+
+    /** Share the frames of this stream with client contexts
+        in other processes, under 'name'. The base class does
+        not support brokering. */
+    virtual bool startBroker(const char *name)
+    {
+        LOG(LOG_ERR, "Frame brokering is not supported on this platform\n");
+        return false;
+    }
+
+    /** Stop sharing the frames of this stream */
+    virtual void stopBroker() {}
+
+    /** Attach a sink that receives every new frame, or detach 
+        it with nullptr. Waits until a running call of the 
+        previous sink has returned. */
+    void setFrameSink(FrameSink *sink);
+
+    /** Get information about the frame most recently read by
+        captureFrame or acquireFrame. Returns false if no
+        frame has been read yet.
+    */
+    bool getFrameInfo(CapFrameInfo *info, FrameCursor *cursor = nullptr);
     
+    /** Select the pixel layout of the frames handed to the 
+        application (CAPFOURCC_xxx). The base class only 
+        supports 24-bit RGB. Returns false if the format is
+        not supported.
+    */
+    virtual bool setOutputFormat(uint32_t fourcc);
+
+    /** Return the pixel layout of the frames handed to the application */
+    uint32_t getOutputFormat() const
+    {
+        return m_outputFormat.load();
+    }
+
+    /** Convert only the region of 'width' x 'height' pixels at
+        column x and row y of the frames, from the next frame on.
+        A width or height of 0 selects the full frame again. The
+        base class does not support regions. */
+    virtual bool setROI(uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+    {
+        LOG(LOG_ERR, "Regions of interest are not supported on this platform\n");
+        return false;
+    }
+
     /** Set the frame rate of this stream.
         Returns false if the camera does not support the desired
         frame rate.
     */
     virtual bool setFrameRate(uint32_t fps) = 0;
 
+    /** Start capturing 'frames' frames on a stream opened in 
+        trigger mode. The base class does not support triggering. */
+    virtual bool triggerCapture(uint32_t frames)
+    {
+        LOG(LOG_ERR, "Triggered capture is not supported on this platform\n");
+        return false;
+    }
+
+    /** Stop streaming but keep the device open. The base class
+        does not support pausing. */
+    virtual bool pause()
+    {
+        LOG(LOG_ERR, "Pausing streams is not supported on this platform\n");
+        return false;
+    }
+
+    /** Start streaming again after pause() */
+    virtual bool resume()
+    {
+        LOG(LOG_ERR, "Pausing streams is not supported on this platform\n");
+        return false;
+    }
+
+    /** Get the streaming statistics of the stream */
+    void getStats(CapStreamStats *stats);
+
+    /** Called before the stream is opened, to measure the
+        time until the first frame is committed */
+    void recordOpen();
+
     /** Returns true if the stream is open and capturing */
     bool isOpen() const
     {
@@ -80,12 +342,10 @@ public:
     /** Return the FOURCC media type of the stream */
     virtual uint32_t getFOURCC() = 0;
 
-    /** Return the number of frames captured.
-        FIXME: protect by mutex 
-    */
+    /** Return the number of frames captured. */
     uint32_t getFrameCount() const
     {
-        return m_frames;
+        return m_frames.load();
     }
 
     /** get the limits of a camera/stream property (exposure, zoom etc) */
@@ -115,16 +375,170 @@ protected:
     */
     virtual void submitBuffer(const uint8_t* ptr, size_t bytes);
 
+    /** Obtain a frame slot of m_width x m_height pixels, or
+        width x height pixels if given, to decode the next 
+        frame into. The slot buffer is sized for the pixel 
+        layout 'fourcc'. For layouts that are not produced by 
+        the library, such as native camera frames, the row
+        stride and frame size must be given.
+        Returns nullptr if all slots are leased, in which case
+        the frame must be dropped.
+    */
+    FrameSlot* beginFrame(uint32_t fourcc = CAPFOURCC_RGB24, uint32_t stride = 0, size_t bytes = 0,
+        uint32_t width = 0, uint32_t height = 0);
+
+    /** Return the number of bytes per pixel of a pixel layout
+        produced by the library, or 0 for other (native) layouts */
+    static uint32_t getBytesPerPixel(uint32_t fourcc);
+
+    /** Publish a slot obtained by beginFrame or one that refers
+        to platform memory as the most recent frame. The device
+        information set by setDeviceFrameInfo is attached to 
+        the frame. */
+    void commitFrame(FrameSlot *slot);
+
+    /** Hand back a slot obtained by beginFrame because the frame
+        could not be decoded. The frame is counted as dropped. */
+    void abortFrame(FrameSlot *slot);
+
+    /** Called by the capture thread before submitting a frame to
+        pass on the information the device reported about it.
+        'timestamp' is in microseconds on the steady clock or 0 
+        if unknown. Frames the device reports as lost should be
+        added to m_droppedFrames. */
+    void setDeviceFrameInfo(uint64_t timestamp, uint32_t sequence, uint32_t flags, uint32_t deviceFlags);
+
+    /** Allocate 'bytes' of shared memory that can be exported
+        as the storage of a slot, or keep the current storage if
+        it is large enough. Returns false if not supported, in 
+        which case the slot uses m_buffer. */
+    virtual bool allocateSharedStorage(FrameSlot *slot, size_t bytes)
+    {
+        return false;
+    }
+
+    /** Convert a slot that was published with m_pending set, 
+        from m_rawBuffer into the frame buffer of the slot.
+        Called by the consumers with m_lazyMutex held.
+        Returns false if the frame could not be converted.
+    */
+    virtual bool convertPendingFrame(FrameSlot *slot)
+    {
+        return false;
+    }
+
+    /** Called when the device starts streaming, to measure the
+        time until the first frame is committed */
+    void recordStart();
+
+    /** Called by the capture thread for each frame that is
+        discarded because the device is warming up */
+    void recordWarmupFrame();
+
+    /** Called for each frame that is found to be truncated
+        ('partial') or otherwise corrupt */
+    void recordCorruptFrame(bool partial);
+
+    /** Compute the luminance signature of an undecoded camera
+        frame, for frames that are not converted by the capture
+        thread. Called by the capture thread. Returns false if 
+        the format is not supported, which is the default. */
+    virtual bool computeNativeSignature(const uint8_t *frame, size_t bytes, LumaSignature &signature)
+    {
+        return false;
+    }
+
+    /** Compute the signature of a slot that is about to be 
+        published and its difference to the previous frame */
+    void updateSignature(FrameSlot *slot);
+
+    /** Make sure a pinned slot holds a converted frame,
+        called by the consumers before reading a slot. */
+    void ensureConverted(FrameSlot *slot);
+
+    /** Fill in the read-only view of a frame slot */
+    void fillLease(const FrameSlot *slot, CapFrameLease *lease) const;
+
+    /** Hand a slot pinned from the history to the application */
+    bool leaseHistoryFrame(FrameSlot *slot, CapFrameLease *lease, CapFrameInfo *info);
+
+    /** Call the frame callback for a slot that has just been 
+        published, called by the capture thread. */
+    void invokeFrameCallback(FrameSlot *slot);
+
+    /** Record which frame was read by a consumer */
+    void updateReadInfo(const FrameSlot *slot, FrameCursor &cursor);
+
+    /** return 'cursor' or, if nullptr, the read state of the stream */
+    FrameCursor& getCursor(FrameCursor *cursor)
+    {
+        return (cursor != nullptr) ? *cursor : m_cursor;
+    }
+
+    /** Split the 'rows' rows of a frame into bands and call
+        'convert' for each band, in parallel when the context
+        has worker threads. The first row of each band is a 
+        multiple of 'rowAlign', e.g. 2 for formats with 
+        vertically subsampled chroma.
+    */
+    void convertRowBands(uint32_t rows, uint32_t rowAlign, 
+        const std::function<void(uint32_t firstRow, uint32_t lastRow)> &convert);
+
+    /** Return the number of frame slots to allocate: one to
+        write into, the frames in the history, the newest of 
+        which is the most recent frame, and two for leases. */
+    virtual uint32_t getFrameSlotCount() const
+    {
+        return 3 + m_openOptions.m_historyFrames;
+    }
+
     Context*    m_owner;                    ///< The context object associated with this stream
 
     uint32_t    m_width;                    ///< The width of the frame in pixels
     uint32_t    m_height;                   ///< The height of the frame in pixels
     bool        m_isOpen;
 
-    std::mutex  m_bufferMutex;              ///< mutex to protect m_frameBuffer and m_newFrame
-    bool        m_newFrame;                 ///< new frame buffer flag
-    std::vector<uint8_t> m_frameBuffer;     ///< raw frame buffer
-    uint32_t    m_frames;                   ///< number of frames captured
+    StreamOptions m_openOptions;            ///< options set before the stream was opened
+    FramePool   m_framePool;                ///< frame buffers shared with the application
+    std::atomic<uint32_t> m_frames;         ///< number of frames captured
+    std::atomic<uint32_t> m_outputFormat;   ///< pixel layout of the frames handed to the application
+
+    // only accessed by the capture thread, or by the thread
+    // that publishes frames when the platform decodes them on
+    // a thread of their own. Both count dropped frames.
+    uint64_t    m_deviceTimestamp;          ///< device timestamp of the frame being submitted
+    uint32_t    m_deviceSequence;           ///< device sequence number of the frame being submitted
+    uint32_t    m_deviceFlags;              ///< platform buffer flags of the frame being submitted
+    uint32_t    m_frameFlags;               ///< CAPFRAMEFLAG_xxx of the frame being submitted
+    std::atomic<uint32_t> m_droppedFrames;  ///< total number of frames dropped by the device or library
+    LumaSignature m_prevSignature;          ///< signature of the previously published frame
+    bool        m_hasPrevSignature;         ///< true if m_prevSignature is valid
+    std::atomic<uint32_t> m_settleWaiters;  ///< number of consumers waiting for a settled frame
+
+    // only accessed by the consumers
+    FrameCursor m_cursor;                   ///< read state of the stream ID itself
+
+    std::mutex  m_lazyMutex;                ///< serializes lazy conversions by the consumers
+
+    std::mutex  m_callbackMutex;            ///< held while the frame callback runs
+    CapFrameCallback m_callback;            ///< frame callback or nullptr, protected by m_callbackMutex
+    void*       m_callbackUserData;         ///< user data for the frame callback
+    int32_t     m_callbackStreamID;         ///< stream ID passed to the frame callback
+    uint32_t    m_callbackDropped;          ///< m_dropped of the frame last passed to the callback
+    uint32_t    m_callbackSequence;         ///< sequence of the frame last passed to the callback
+    std::atomic<bool> m_hasCallback;        ///< true if a callback is registered
+    std::atomic<std::thread::id> m_callbackThread;  ///< thread running the callback
+
+    std::mutex  m_statsMutex;               ///< protects m_stats, m_startTime and m_openTime
+    CapStreamStats m_stats;                 ///< streaming statistics
+    uint64_t    m_startTime;                ///< time the device most recently started streaming
+    uint64_t    m_openTime;                 ///< time the stream was opened
+    std::atomic<bool> m_awaitFirstFrame;    ///< true until a frame is committed after the most recent start
+    std::atomic<bool> m_awaitOpenFrame;     ///< true until the first frame after opening is committed
+
+    std::mutex  m_sinkMutex;                ///< held while the frame sink runs
+    FrameSink*  m_sink;                     ///< frame sink or nullptr, protected by m_sinkMutex
+    std::atomic<bool> m_hasSink;            ///< true if a frame sink is attached
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,3 @@
+#ifndef __LIBVER__
+#define __LIBVER__ "-128-NOTFOUND"
+#endif
@@ -0,0 +1,143 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Platform independent pool of worker threads.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+    
+*/
+
+
+#include <algorithm>
+#include "workerpool.h"
+#include "logging.h"
+
+WorkerPool::WorkerPool(uint32_t threads) :
+    m_quit(false)
+{
+    for(uint32_t i=0; i<threads; i++)
+    {
+        m_threads.push_back(std::thread(&WorkerPool::workerThread, this));
+    }
+    LOG(LOG_DEBUG, "WorkerPool created with %d threads\n", threads);
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_workAvailable.notify_all();
+
+    for(uint32_t i=0; i<m_threads.size(); i++)
+    {
+        m_threads[i].join();
+    }
+    LOG(LOG_DEBUG, "WorkerPool destroyed\n");
+}
+
+void WorkerPool::runBatch(Batch *batch, std::unique_lock<std::mutex> &lock)
+{
+    // the jobs themselves run without holding the lock
+    while(batch->m_next < batch->m_jobs)
+    {
+        uint32_t index = batch->m_next++;
+        if (batch->m_next == batch->m_jobs)
+        {
+            // All jobs have been started, no need for other
+            // threads to look at this batch. Batches of other
+            // parallelFor calls can be queued in front of it, 
+            // and the batch must be gone before its owner
+            // returns.
+            std::deque<Batch*>::iterator it = std::find(m_queue.begin(), m_queue.end(), batch);
+            if (it != m_queue.end())
+            {
+                m_queue.erase(it);
+            }
+        }
+        lock.unlock();
+        (*batch->m_job)(index);
+        lock.lock();
+        batch->m_finished++;
+    }
+}
+
+void WorkerPool::workerThread()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true)
+    {
+        m_workAvailable.wait(lock, [this]{ return m_quit || !m_queue.empty(); });
+        if (m_quit)
+        {
+            return;
+        }
+
+        // runBatch removes a batch once its last job has been
+        // started, so the batch in front always has jobs left.
+        Batch *batch = m_queue.front();
+        if (batch->m_next == batch->m_jobs)
+        {
+            m_queue.pop_front();
+            continue;
+        }
+        batch->m_users++;
+        runBatch(batch, lock);
+        batch->m_users--;
+        m_batchDone.notify_all();
+    }
+}
+
+void WorkerPool::parallelFor(uint32_t jobs, const std::function<void(uint32_t)> &job)
+{
+    if (jobs == 0)
+    {
+        return;
+    }
+
+    if ((jobs == 1) || m_threads.empty())
+    {
+        for(uint32_t i=0; i<jobs; i++)
+        {
+            job(i);
+        }
+        return;
+    }
+
+    Batch batch;
+    batch.m_job      = &job;
+    batch.m_jobs     = jobs;
+    batch.m_next     = 0;
+    batch.m_finished = 0;
+    batch.m_users    = 0;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_queue.push_back(&batch);
+    m_workAvailable.notify_all();
+
+    runBatch(&batch, lock);
+
+    // wait until the jobs taken by the workers have finished 
+    // and no worker refers to the batch anymore.
+    m_batchDone.wait(lock, [&batch]{ return (batch.m_finished == batch.m_jobs) && (batch.m_users == 0); });
+}
@@ -0,0 +1,91 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Platform independent pool of worker threads.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#ifndef workerpool_h
+#define workerpool_h
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/** A pool of worker threads shared by all streams of a context.
+    
+    Streams use it to split the conversion or decoding of a 
+    single frame into independent jobs, such as bands of rows, 
+    so a single high resolution stream can use more than one
+    core. Several streams can submit work at the same time.
+*/
+class WorkerPool
+{
+public:
+    /** create a pool with 'threads' worker threads */
+    WorkerPool(uint32_t threads);
+    virtual ~WorkerPool();
+
+    /** return the number of worker threads */
+    uint32_t getThreadCount() const
+    {
+        return static_cast<uint32_t>(m_threads.size());
+    }
+
+    /** Call job(0) .. job(jobs-1) in parallel and return when 
+        all jobs have finished. The calling thread executes 
+        jobs as well, so it is best to submit one job more than
+        the number of worker threads. */
+    void parallelFor(uint32_t jobs, const std::function<void(uint32_t)> &job);
+
+protected:
+    /** bookkeeping for a single parallelFor call */
+    struct Batch
+    {
+        const std::function<void(uint32_t)> *m_job;
+        uint32_t m_jobs;        ///< total number of jobs
+        uint32_t m_next;        ///< index of the next job to start
+        uint32_t m_finished;    ///< number of finished jobs
+        uint32_t m_users;       ///< number of worker threads executing jobs of this batch
+    };
+
+    /** execute jobs of a batch until there are none left */
+    void runBatch(Batch *batch, std::unique_lock<std::mutex> &lock);
+
+    /** worker thread main loop */
+    void workerThread();
+
+    std::vector<std::thread>    m_threads;
+    std::mutex                  m_mutex;        ///< protects m_queue and the batches
+    std::condition_variable     m_workAvailable;///< signalled when a batch is queued or m_quit is set
+    std::condition_variable     m_batchDone;    ///< signalled when a worker leaves a batch
+    std::deque<Batch*>          m_queue;        ///< batches with jobs left to start
+    bool                        m_quit;
+};
+
+#endif
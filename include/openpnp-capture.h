@@ -71,6 +71,8 @@
 
 typedef void*    CapContext;    ///< an opaque pointer to the internal Context*
 typedef int32_t  CapStream;     ///< a stream identifier (normally >=0, <0 for error)
+typedef int32_t  CapConsumer;   ///< a consumer identifier (normally >=0, <0 for error)
+typedef int32_t  CapGroup;      ///< a capture group identifier (normally >=0, <0 for error)
 typedef uint32_t CapResult;     ///< result defined by CAPRESULT_xxx
 typedef uint32_t CapDeviceID;   ///< unique device ID
 typedef uint32_t CapFormatID;   ///< format identifier 0 .. numFormats
@@ -102,11 +104,130 @@ typedef struct
     uint32_t bpp;       ///< bits per pixel
 } CapFormatInfo;
 
+/** build a FOURCC code from four characters */
+#define CAPFOURCC(a,b,c,d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+// pixel layouts of frames returned by the library:
+#define CAPFOURCC_RGB24 CAPFOURCC('R','G','B','3')  ///< 24-bit RGB, R first
+#define CAPFOURCC_BGR24 CAPFOURCC('B','G','R','3')  ///< 24-bit BGR, B first
+#define CAPFOURCC_RGBA32 CAPFOURCC('A','B','2','4') ///< 32-bit RGBA, R first, alpha is 255
+#define CAPFOURCC_GRAY8 CAPFOURCC('G','R','E','Y')  ///< 8-bit luminance
+#define CAPFOURCC_NATIVE 0                          ///< frames as delivered by the camera, e.g. YUYV or MJPG
+
+/** a read-only view of a captured frame, see Cap_acquireFrame */
+typedef struct
+{
+    const uint8_t *data;    ///< pointer to the first byte of the frame
+    uint32_t bytes;         ///< size of the frame in bytes
+    uint32_t width;         ///< width in pixels
+    uint32_t height;        ///< height in pixels
+    uint32_t stride;        ///< number of bytes between the start of two rows
+    uint32_t fourcc;        ///< pixel layout of the frame (CAPFOURCC_xxx)
+    uint64_t timestamp;     ///< capture time in microseconds (monotonic clock)
+    uint32_t leaseID;       ///< internal identifier, do not modify
+} CapFrameLease;
+
+#define CAPEXPORT_DMABUF 1  ///< the file descriptor is a DMA buffer exported by the driver
+#define CAPEXPORT_MEMFD  2  ///< the file descriptor refers to shared memory (memfd)
+
+/** a file descriptor that refers to the memory of a frame, see Cap_exportFrame */
+typedef struct
+{
+    int32_t  fd;        ///< file descriptor, owned by the caller who must close it
+    uint32_t type;      ///< CAPEXPORT_xxx
+    uint32_t offset;    ///< offset of the first byte of the frame
+    uint32_t size;      ///< size of the memory that can be mapped, at least offset plus the frame size
+} CapFrameExport;
+
+#define CAPFRAMEFLAG_ERROR           1  ///< the device reported that the frame might be corrupt
+#define CAPFRAMEFLAG_DEVICETIMESTAMP 2  ///< deviceTimestamp is valid and uses the same clock as timestamp
+
+/** information about a captured frame, see Cap_getFrameInfo */
+typedef struct
+{
+    uint32_t sequence;          ///< frame number assigned by the library, equal to the frame count after capture
+    uint32_t deviceSequence;    ///< frame number assigned by the device driver, if supported
+    uint64_t timestamp;         ///< time the frame was received by the library in microseconds (monotonic clock)
+    uint64_t deviceTimestamp;   ///< time the frame was captured according to the device driver in microseconds, 0 if unknown
+    uint32_t flags;             ///< CAPFRAMEFLAG_xxx
+    uint32_t deviceFlags;       ///< platform dependent buffer flags, e.g. V4L2_BUF_FLAG_xxx on Linux
+    uint32_t dropped;           ///< number of frames the device or library dropped since the previously read frame
+    uint32_t overwritten;       ///< number of frames that were replaced by a newer frame before they were read
+    uint32_t roiX;              ///< column of the full image where the frame starts, see Cap_setROI
+    uint32_t roiY;              ///< row of the full image where the frame starts, see Cap_setROI
+} CapFrameInfo;
+
+/** streaming statistics of a stream, see Cap_getStreamStats */
+typedef struct
+{
+    uint32_t starts;            ///< number of times the device started streaming
+    uint32_t startLatency;      ///< microseconds from the most recent start to the first frame after it, 0 if none arrived yet
+    uint32_t openLatency;       ///< microseconds from the call to Cap_openStream to the first frame, 0 if none arrived yet
+    uint32_t warmupFrames;      ///< number of frames discarded after the most recent start
+    uint32_t corruptFrames;     ///< number of MJPEG frames found corrupt since the stream was opened
+    uint32_t partialFrames;     ///< number of MJPEG frames found truncated since the stream was opened
+} CapStreamStats;
+
+/** Frame callback, see Cap_setFrameCallback. Called from the capture
+    thread for each new frame with a read-only view of the frame and 
+    its metadata. Return CAPCALLBACK_RETAIN to keep the frame leased
+    after the callback returns; it must then be handed back with
+    Cap_releaseFrame, using a copy of the lease.
+*/
+typedef uint32_t (*CapFrameCallback)(CapStream stream, const CapFrameLease *frame, 
+    const CapFrameInfo *info, void *userData);
+
+#define CAPCALLBACK_RELEASE 0   ///< the frame is no longer needed after the callback returns
+#define CAPCALLBACK_RETAIN  1   ///< the frame stays leased until Cap_releaseFrame is called
+
 #define CAPRESULT_OK  0
 #define CAPRESULT_ERR 1
 #define CAPRESULT_DEVICENOTFOUND 2
 #define CAPRESULT_FORMATNOTSUPPORTED 3
 #define CAPRESULT_PROPERTYNOTSUPPORTED 4
+#define CAPRESULT_TIMEOUT 5
+
+#define CAPCTXOPT_WORKERTHREADS 1   ///< number of worker threads used to convert and decode frames (default 0)
+#define CAPCTXOPT_CAPTURETHREADS 2  ///< number of threads shared by all streams to capture frames, 0 = one thread per stream (default 0, Linux only)
+
+typedef uint32_t CapContextOptionID; ///< context option ID, see CAPCTXOPT_xxx
+
+#define CAPSTREAMOPT_BUFFERCOUNT 1  ///< number of buffers the driver captures into, 2 .. 32 (default 8)
+#define CAPSTREAMOPT_LATESTONLY  2  ///< 1: only convert the newest captured frame and skip older ones (default 0)
+#define CAPSTREAMOPT_LAZYCONVERSION 3   ///< 1: convert frames only when the application reads them (default 0)
+#define CAPSTREAMOPT_IOMETHOD    4  ///< how frames are transferred from the driver, CAPIOMETHOD_xxx (default CAPIOMETHOD_AUTO)
+#define CAPSTREAMOPT_EXPORTFRAMES 5 ///< 1: keep converted frames in shared memory so they can be exported (default 0, Linux only)
+#define CAPSTREAMOPT_HISTORYFRAMES 6    ///< number of recent frames kept for Cap_acquireFrameAfter, 1 .. 32 (default 1)
+#define CAPSTREAMOPT_TRIGGERMODE 7  ///< 1: only stream while frames requested with Cap_triggerCapture are captured (default 0, Linux only)
+#define CAPSTREAMOPT_WARMUPFRAMES 8 ///< number of frames discarded each time the device starts streaming, 0 .. 30 (default 0, Linux only)
+#define CAPSTREAMOPT_STARTPAUSED 9  ///< 1: open the stream paused, see Cap_resumeStream (default 0, Linux only)
+#define CAPSTREAMOPT_DECODESCALE 10 ///< decode MJPEG frames at 1/value of their size, 1, 2, 4 or 8 (default 1, Linux only)
+#define CAPSTREAMOPT_CROPX      11  ///< left edge of the sensor area to capture, in sensor pixels (default 0, Linux only)
+#define CAPSTREAMOPT_CROPY      12  ///< top edge of the sensor area to capture, in sensor pixels (default 0, Linux only)
+#define CAPSTREAMOPT_CROPWIDTH  13  ///< width of the sensor area to capture, 0 = the full sensor (default 0, Linux only)
+#define CAPSTREAMOPT_CROPHEIGHT 14  ///< height of the sensor area to capture, 0 = the full sensor (default 0, Linux only)
+#define CAPSTREAMOPT_BINNING    15  ///< capture the sensor area at 1/value of its size, 1, 2 or 4 (default 1, Linux only)
+#define CAPSTREAMOPT_DECODEERRORS 16 ///< which MJPEG frames the decoder reports problems with are dropped, CAPDECODEERRORS_xxx (default CAPDECODEERRORS_IGNORE, Linux only)
+#define CAPSTREAMOPT_DECODEQUEUE 17  ///< number of frames waiting for a separate decode thread, 0 = decode on the capture thread, 0 .. 16 (default 0, Linux only)
+
+#define CAPIOMETHOD_AUTO    0   ///< let the library choose
+#define CAPIOMETHOD_MMAP    1   ///< memory mapped driver buffers (Linux)
+#define CAPIOMETHOD_USERPTR 2   ///< library allocated buffers the driver writes into (Linux)
+#define CAPIOMETHOD_DMABUF  3   ///< DMA heap buffers imported by the driver (Linux)
+#define CAPIOMETHOD_READ    4   ///< read() calls, for drivers without streaming support (Linux)
+
+#define CAPDECODEERRORS_IGNORE   0  ///< publish frames whatever the decoder reports
+#define CAPDECODEERRORS_FATAL    1  ///< drop frames the decoder cannot decode
+#define CAPDECODEERRORS_WARNINGS 2  ///< also drop frames the decoder warns about, e.g. corrupt entropy coded data
+
+typedef uint32_t CapStreamOptionID; ///< stream option ID, see CAPSTREAMOPT_xxx
+
+/** a stream option passed to Cap_openStreamWithOptions */
+typedef struct
+{
+    CapStreamOptionID id;   ///< CAPSTREAMOPT_xxx
+    int32_t value;          ///< value of the option
+} CapStreamOption;
 
 /********************************************************************************** 
      CONTEXT CREATION AND DEVICE ENUMERATION
@@ -123,6 +244,57 @@ DLLPUBLIC CapContext Cap_createContext(void);
 */
 DLLPUBLIC CapResult Cap_releaseContext(CapContext ctx);
 
+/** Create a context that reads the frames of a stream shared
+    by another process with Cap_startBroker, instead of opening
+    cameras. The context has a single device, the brokered
+    stream, with a single format. Open it with Cap_openStream
+    and read frames as usual; any number of processes can do
+    so without adding conversion work to the broker process.
+    Camera properties and the frame rate can only be changed
+    by the broker process. Only supported on Linux.
+
+    @param brokerName The name passed to Cap_startBroker.
+    @return The context ID or NULL if the broker cannot be reached.
+*/
+DLLPUBLIC CapContext Cap_createClientContext(const char *brokerName);
+
+/** Set a context wide option.
+
+    CAPCTXOPT_WORKERTHREADS sets the number of worker threads
+    that the streams of the context use to split the colour 
+    conversion and MJPEG decoding of a frame into parallel 
+    jobs. The capture thread of a stream always takes part in
+    the work, so a value of 0 (the default) converts frames 
+    on the capture thread only. This option can only be 
+    changed while the context has no open streams.
+
+    CAPCTXOPT_CAPTURETHREADS replaces the capture thread of 
+    each stream by a fixed number of threads that wait for
+    all streams of the context at once and convert the frames
+    of whichever stream is ready. A value of 0 (the default)
+    uses one capture thread per stream. This option is only 
+    supported on Linux and can only be changed while the 
+    context has no open streams.
+
+    @param ctx The ID of the context.
+    @param optionID The ID of the option (CAPCTXOPT_xxx).
+    @param value The new value of the option.
+    @return CAPRESULT_OK if successful.
+            CAPRESULT_PROPERTYNOTSUPPORTED if the option is unknown.
+            CAPRESULT_ERR otherwise.
+*/
+DLLPUBLIC CapResult Cap_setContextOption(CapContext ctx, CapContextOptionID optionID, int32_t value);
+
+/** Get the value of a context wide option.
+    @param ctx The ID of the context.
+    @param optionID The ID of the option (CAPCTXOPT_xxx).
+    @param outValue pointer to an int32_t that receives the value.
+    @return CAPRESULT_OK if successful.
+            CAPRESULT_PROPERTYNOTSUPPORTED if the option is unknown.
+            CAPRESULT_ERR otherwise.
+*/
+DLLPUBLIC CapResult Cap_getContextOption(CapContext ctx, CapContextOptionID optionID, int32_t *outValue);
+
 /** Get the number of capture devices on the system.
     note: this can change dynamically due to the
     pluggin and unplugging of USB devices.
@@ -192,7 +364,8 @@ DLLPUBLIC CapResult Cap_getFormatInfo(CapContext ctx, CapDeviceID index, CapForm
 /** Open a capture stream to a device with specific format requirements 
 
     Although the (internal) frame buffer format is set via the fourCC ID,
-    the frames returned by Cap_captureFrame are always 24-bit RGB.
+    the frames returned by Cap_captureFrame are 24-bit RGB unless
+    another output format is selected with Cap_setOutputFormat.
 
     @param ctx The ID of the context.
     @param index The device index of the capture device.
@@ -201,6 +374,126 @@ DLLPUBLIC CapResult Cap_getFormatInfo(CapContext ctx, CapDeviceID index, CapForm
 */
 DLLPUBLIC CapStream Cap_openStream(CapContext ctx, CapDeviceID index, CapFormatID formatID);
 
+/** Open a capture stream like Cap_openStream, with options that
+    can only be set before capturing starts.
+
+    CAPSTREAMOPT_BUFFERCOUNT sets the number of frame buffers the
+    driver captures into. Fewer buffers use less memory and reduce
+    latency, more buffers make dropped frames less likely.
+
+    CAPSTREAMOPT_LATESTONLY makes the stream skip frames that are
+    queued behind a newer one, so only the freshest frame is
+    converted. Skipped frames are reported as dropped.
+
+    CAPSTREAMOPT_LAZYCONVERSION keeps the undecoded camera frame
+    and converts or decodes it only when it is read, so frames
+    that are never read cost no conversion time. The first read
+    of a frame takes the conversion time, later reads of the same
+    frame are not converted again. A frame that cannot be decoded 
+    is returned black with CAPFRAMEFLAG_ERROR set.
+
+    CAPSTREAMOPT_IOMETHOD selects how the driver hands frames to
+    the library. CAPIOMETHOD_AUTO uses memory mapped buffers when
+    the driver supports streaming and read() otherwise. Opening
+    the stream fails if the driver does not support the selected
+    method. Use Cap_getStreamOption to find out which method was
+    chosen.
+
+    CAPSTREAMOPT_HISTORYFRAMES keeps the given number of most 
+    recent frames, so Cap_acquireFrameAfter can return a frame
+    that has already been replaced by a newer one. Each frame 
+    in the history takes a frame buffer. Together with 
+    CAPSTREAMOPT_LAZYCONVERSION the history holds the undecoded
+    frames, e.g. MJPEG, and only the frame that is read is decoded.
+
+    CAPSTREAMOPT_TRIGGERMODE opens the stream with its buffers 
+    allocated but without streaming, so the camera does not use 
+    any USB bandwidth. Cap_triggerCapture starts streaming until
+    the requested number of frames has been captured.
+
+    CAPSTREAMOPT_WARMUPFRAMES discards the given number of frames
+    each time the device starts streaming, e.g. the dark or badly
+    exposed first frames of many USB cameras.
+
+    CAPSTREAMOPT_STARTPAUSED opens the stream like Cap_pauseStream
+    would leave it, so it can be started with Cap_resumeStream 
+    without the cost of opening the device.
+
+    CAPSTREAMOPT_DECODESCALE decodes MJPEG frames at a half, a
+    quarter or an eighth of their width and height, e.g. for a
+    preview. The decoder scales while transforming the DCT
+    coefficients, so this is much faster than decoding the full
+    frame and scaling it down. The leases and frame callbacks 
+    report the scaled size. Other camera formats and native 
+    frames are not scaled.
+
+    CAPSTREAMOPT_CROPX, CAPSTREAMOPT_CROPY, CAPSTREAMOPT_CROPWIDTH
+    and CAPSTREAMOPT_CROPHEIGHT make the camera itself send only 
+    a rectangle of its sensor, and CAPSTREAMOPT_BINNING makes it 
+    bin or scale the rectangle (or the full sensor) down, so less
+    data crosses the bus and less needs to be converted. The frame
+    size of the format is then replaced by the size of the 
+    rectangle divided by the binning factor. The camera can adjust
+    the rectangle to its alignment; Cap_getStreamOption returns 
+    the rectangle and binning factor in use. Cameras that do not 
+    support cropping capture the format as usual and report a 
+    width and height of 0 and a binning factor of 1.
+
+    MJPEG frames are checked before they are decoded: frames that
+    do not start with a JPEG header, whose headers do not fit in
+    the frame or do not match the format, or that end before the
+    end of image marker are dropped and counted in the corrupt 
+    and partial frames of Cap_getStreamStats. The check only 
+    reads the headers and the end of the frame. Frames that pass
+    can still hold corrupt compressed data, which the decoder 
+    reports as a warning, or that it cannot decode. By default 
+    these frames are published anyway, because many cameras 
+    produce slightly incorrect data that decodes fine. 
+    CAPSTREAMOPT_DECODEERRORS drops them instead and counts them
+    as corrupt. With CAPDECODEERRORS_WARNINGS the decoder stops
+    at the first warning. Frames that are decoded lazily are
+    returned black with CAPFRAMEFLAG_ERROR set instead.
+
+    CAPSTREAMOPT_DECODEQUEUE decodes and converts the frames on a 
+    thread of their own. The capture thread copies each frame 
+    into one of the given number of queue buffers and hands the
+    driver buffer back right away, so a slow decode no longer 
+    leaves the driver without buffers at high frame rates. When
+    the queue is full the new frame is dropped. With 
+    CAPSTREAMOPT_LATESTONLY the decode thread skips to the newest
+    frame in the queue. The queue is not used together with 
+    CAPSTREAMOPT_LAZYCONVERSION or CAPSTREAMOPT_TRIGGERMODE. 
+    Frames that need no conversion, in native output format or
+    RGB24 frames of the full sensor area, bypass the queue once
+    it is empty and are handed out without copying as before.
+    Frames still queued when the stream is closed count as 
+    dropped.
+
+    Options that are not supported by the platform are ignored.
+
+    @param ctx The ID of the context.
+    @param index The device index of the capture device.
+    @param formatID The index/ID of the frame buffer format.
+    @param options Pointer to an array of options, may be NULL if count is 0.
+    @param count The number of options in the array.
+    @return The stream ID or -1 if the device does not exist, the stream
+            format ID is incorrect or an option is invalid.
+*/
+DLLPUBLIC CapStream Cap_openStreamWithOptions(CapContext ctx, CapDeviceID index, CapFormatID formatID,
+    const CapStreamOption *options, uint32_t count);
+
+/** Get the value of a stream option (CAPSTREAMOPT_xxx). For
+    CAPSTREAMOPT_IOMETHOD this returns the method in use, never 
+    CAPIOMETHOD_AUTO.
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param optionID The ID of the option.
+    @param outValue pointer to an int32_t that receives the value.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_getStreamOption(CapContext ctx, CapStream stream, CapStreamOptionID optionID, 
+    int32_t *outValue);
+
 /** Close a capture stream 
     @param ctx The ID of the context.
     @param stream The stream ID.
@@ -215,18 +508,468 @@ DLLPUBLIC CapResult Cap_closeStream(CapContext ctx, CapStream stream);
 */
 DLLPUBLIC uint32_t Cap_isOpenStream(CapContext ctx, CapStream stream);
 
+/** Capture a burst of frames on a stream opened with 
+    CAPSTREAMOPT_TRIGGERMODE. The device starts streaming, the
+    CAPSTREAMOPT_WARMUPFRAMES frames and frames the device 
+    reports as corrupt are discarded, and once 'frames' frames 
+    have been captured the device stops streaming again. Read
+    the frames like those of any other stream, e.g. with 
+    Cap_waitForFrame and Cap_acquireFrame, and keep a history
+    with CAPSTREAMOPT_HISTORYFRAMES to read all frames of a burst.
+    Triggering a stream that is still capturing a burst restarts
+    the count. Called from a frame callback of the stream, the
+    new burst starts after the frame passed to the callback.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param frames The number of frames to capture, at least 1.
+    @return CAPRESULT_OK if streaming was started, CAPRESULT_ERR if the stream
+            is invalid or was not opened in trigger mode.
+*/
+DLLPUBLIC CapResult Cap_triggerCapture(CapContext ctx, CapStream stream, uint32_t frames);
+
+/** Stop streaming on a stream while keeping the device open, 
+    with its format and buffers, so the camera uses no USB 
+    bandwidth. Resuming is much faster than opening the stream 
+    again. Frames that are leased stay valid. Pausing a stream 
+    in trigger mode ends the burst being captured. Called from a
+    frame callback of the stream, streaming stops after the 
+    callback returns.
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @return CAPRESULT_OK if the stream is paused, CAPRESULT_ERR if the stream
+            is invalid or the platform does not support pausing.
+*/
+DLLPUBLIC CapResult Cap_pauseStream(CapContext ctx, CapStream stream);
+
+/** Start streaming again on a stream that was paused with 
+    Cap_pauseStream or opened with CAPSTREAMOPT_STARTPAUSED. 
+    Resuming a stream that is streaming does nothing. Streams in
+    trigger mode are started with Cap_triggerCapture instead.
+    Resuming from a frame callback only undoes a pause from the
+    same callback.
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @return CAPRESULT_OK if the stream is streaming, CAPRESULT_ERR otherwise.
+*/
+DLLPUBLIC CapResult Cap_resumeStream(CapContext ctx, CapStream stream);
+
+/** Get the streaming statistics of a stream, e.g. the time from
+    Cap_triggerCapture or Cap_resumeStream to the first frame. The
+    open latency of a stream opened paused includes the time it 
+    was paused.
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param stats pointer to a CapStreamStats structure that receives the statistics.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_getStreamStats(CapContext ctx, CapStream stream, CapStreamStats *stats);
+
+/** Select the pixel layout of the frames returned by a stream.
+
+    The default is CAPFOURCC_RGB24. The frames are converted or
+    decoded directly into the selected layout:
+
+    CAPFOURCC_RGB24  : 24-bit RGB.
+    CAPFOURCC_BGR24  : 24-bit BGR, as used by OpenCV.
+    CAPFOURCC_RGBA32 : 32-bit RGBA with an opaque alpha channel.
+    CAPFOURCC_GRAY8  : 8-bit luminance, taken directly from the
+                       Y channel of YUV and MJPEG frames.
+    CAPFOURCC_NATIVE : the frames as delivered by the camera without
+                       any conversion. The frame size and format 
+                       are reported by Cap_acquireFrame.
+
+    The new format applies to the next captured frame. 
+    Not all platforms support all formats.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param fourcc The output format (CAPFOURCC_xxx).
+    @return CAPRESULT_OK if successful.
+            CAPRESULT_FORMATNOTSUPPORTED if the format is not supported.
+            CAPRESULT_ERR if the context or stream is invalid.
+*/
+DLLPUBLIC CapResult Cap_setOutputFormat(CapContext ctx, CapStream stream, uint32_t fourcc);
+
+/** Convert only a region of interest of the frames of a stream, 
+    e.g. the area around a part or fiducial. Only the pixels of
+    the region are converted and the frames hold just the region,
+    so the leases report its size and Cap_getFrameInfo reports 
+    where it starts in the full image (roiX, roiY). MJPEG frames
+    are only decoded as far as needed to produce the region.
+
+    The region is given in pixels of the frames the stream 
+    returns, i.e. after CAPSTREAMOPT_DECODESCALE, and must lie
+    within them. For YUV camera formats x and width must be even.
+    The region applies from the next captured frame on. A width
+    or height of 0 returns to full frames. Frames captured with 
+    CAPFOURCC_NATIVE output are never cropped.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param x The first column of the region.
+    @param y The first row of the region.
+    @param width The width of the region in pixels, or 0.
+    @param height The height of the region in pixels, or 0.
+    @return CAPRESULT_OK if the region was set, CAPRESULT_ERR if the stream is
+            invalid, the region does not fit or the platform does not support it.
+*/
+DLLPUBLIC CapResult Cap_setROI(CapContext ctx, CapStream stream, uint32_t x, uint32_t y, 
+    uint32_t width, uint32_t height);
+
 /********************************************************************************** 
      FRAME CAPTURING / INFO
 **********************************************************************************/
 
 /** this function copies the most recent RGB frame data
-    to the given buffer.
+    to the given buffer. If another output format was selected
+    with Cap_setOutputFormat, the frame is copied in that format.
 */
 DLLPUBLIC CapResult Cap_captureFrame(CapContext ctx, CapStream stream, void *RGBbufferPtr, uint32_t RGBbufferBytes);
 
+/** Pin the most recent frame and return a read-only view of it
+    without copying the frame data. The frame stays valid and will 
+    not be overwritten until it is handed back with Cap_releaseFrame.
+
+    Every acquired frame must be released, and all frames must be
+    released before the stream is closed. While frames are leased, 
+    the library has fewer buffers to capture into, so keep the 
+    lease short to avoid dropping frames.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param lease pointer to a CapFrameLease structure to be filled with data.
+    @return CAPRESULT_OK if a frame was acquired, CAPRESULT_ERR if no frame is available yet
+            or the context/stream is invalid.
+*/
+DLLPUBLIC CapResult Cap_acquireFrame(CapContext ctx, CapStream stream, CapFrameLease *lease);
+
+/** Pin the first frame that was captured at or after a given 
+    time and return a read-only view of it, like Cap_acquireFrame.
+    
+    This answers "give me the first frame taken after the machine
+    stopped moving": take the time with Cap_getTimestamp when the
+    motion has completed, and pass it here. The frame may already
+    have been captured, in which case it is taken from the history
+    (see CAPSTREAMOPT_HISTORYFRAMES), or the call waits until it 
+    is captured. If the first such frame has already left the 
+    history, the oldest later frame that is still kept is returned.
+
+    The capture time of a frame is its deviceTimestamp when 
+    CAPFRAMEFLAG_DEVICETIMESTAMP is set, and its timestamp 
+    otherwise. The frame counts as read for Cap_hasNewFrame.
+    Hand the frame back with Cap_releaseFrame.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param timestamp The time in microseconds, on the clock of Cap_getTimestamp.
+    @param timeoutMs The maximum time to wait for the frame in milliseconds.
+    @param lease pointer to a CapFrameLease structure to be filled with data.
+    @param info pointer to a CapFrameInfo structure that receives the information
+           about the frame, or NULL. The dropped and overwritten counts are 0.
+    @return CAPRESULT_OK if a frame was acquired.
+            CAPRESULT_TIMEOUT if no such frame was captured in time.
+            CAPRESULT_ERR if the context or stream is invalid.
+*/
+DLLPUBLIC CapResult Cap_acquireFrameAfter(CapContext ctx, CapStream stream, uint64_t timestamp, 
+    uint32_t timeoutMs, CapFrameLease *lease, CapFrameInfo *info);
+
+/** Pin a frame by its sequence number (see CapFrameInfo), if it 
+    is still in the history of the stream. Otherwise like 
+    Cap_acquireFrameAfter, without waiting.
+    @return CAPRESULT_OK if a frame was acquired, CAPRESULT_ERR otherwise.
+*/
+DLLPUBLIC CapResult Cap_acquireFrameBySequence(CapContext ctx, CapStream stream, uint32_t sequence, 
+    CapFrameLease *lease, CapFrameInfo *info);
+
+/** Wait until the image of a stream has stopped changing, e.g.
+    after the camera or the machine in view has moved, and pin
+    the first settled frame like Cap_acquireFrame.
+
+    While the call waits, the capture thread computes a small
+    luminance signature of every frame: a 32 x 24 grid of average
+    brightness values. A frame is settled when the mean absolute
+    difference between its signature and that of the frame before
+    it is below 'threshold'. Only frames captured after the call 
+    are considered, and the first of them has no frame to compare
+    with. Streams without a waiting call skip the signatures. The deviceTimestamp or timestamp of the frame 
+    (see CapFrameInfo) tells exactly when it was taken.
+
+    Converted frames are sampled directly. Native and lazily 
+    converted frames are sampled from the camera frame; for 
+    MJPEG only the DC coefficients are decoded. Frames of an
+    unsupported format have no signature, so the call times out.
+    If frames arrive faster than the caller wakes up, the first
+    settled frame may already have been replaced by a newer one;
+    keep a few frames with CAPSTREAMOPT_HISTORYFRAMES to avoid
+    that. Hand the frame back with Cap_releaseFrame.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param threshold The largest mean difference in luminance levels (0 .. 255)
+           that counts as settled, e.g. 1.5.
+    @param timeoutMs The maximum time to wait in milliseconds.
+    @param lease pointer to a CapFrameLease structure to be filled with data.
+    @param info pointer to a CapFrameInfo structure that receives the information
+           about the frame, or NULL. The dropped and overwritten counts are 0.
+    @return CAPRESULT_OK if a settled frame was acquired.
+            CAPRESULT_TIMEOUT if the image did not settle in time.
+            CAPRESULT_ERR if the context or stream is invalid.
+*/
+DLLPUBLIC CapResult Cap_waitForSettle(CapContext ctx, CapStream stream, float threshold, 
+    uint32_t timeoutMs, CapFrameLease *lease, CapFrameInfo *info);
+
+/** Return the current time in microseconds on the monotonic 
+    clock used for the frame timestamps. */
+DLLPUBLIC uint64_t Cap_getTimestamp(void);
+
+/** Hand back a frame obtained with Cap_acquireFrame.
+    The data pointer in the lease must not be used after this call.
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param lease pointer to the CapFrameLease filled in by Cap_acquireFrame.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_releaseFrame(CapContext ctx, CapStream stream, CapFrameLease *lease);
+
+/** Register a callback that is invoked from the capture thread 
+    for each new frame, as an alternative to polling with 
+    Cap_hasNewFrame and copying with Cap_captureFrame.
+
+    The callback delays the capture of the next frame, so it should 
+    return quickly or retain the frame and process it elsewhere. 
+    Frames delivered to the callback do not affect Cap_hasNewFrame 
+    or Cap_getFrameInfo.
+
+    Pass NULL as callback to unregister. When this function returns,
+    the previous callback is not running and will not be called 
+    again, unless it is called from within the callback itself. 
+    Frames retained by the callback stay valid until released.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param callback The function to call or NULL.
+    @param userData Pointer passed to the callback.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_setFrameCallback(CapContext ctx, CapStream stream, 
+    CapFrameCallback callback, void *userData);
+
+/** Add a lease to a frame obtained with Cap_acquireFrame or a 
+    frame callback, for example for each process the frame is 
+    passed to. Every Cap_retainFrame must be balanced by a 
+    Cap_releaseFrame; the frame is only reused when all leases 
+    have been released.
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param lease pointer to a CapFrameLease of a frame that is leased.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_retainFrame(CapContext ctx, CapStream stream, const CapFrameLease *lease);
+
+/** Export the memory of a leased frame as a file descriptor that 
+    can be mapped with mmap or passed to another process over a 
+    Unix domain socket, without copying the frame.
+
+    Frames that are handed out as delivered by the driver (native 
+    output, or RGB24 cameras) are exported as the driver buffer.
+    Converted frames can only be exported if the stream was opened
+    with CAPSTREAMOPT_EXPORTFRAMES.
+
+    The descriptor stays valid after the frame is released, but its
+    contents are overwritten by a later frame once every lease has
+    been released. Hold a lease (see Cap_retainFrame) for as long 
+    as the memory is in use. Only supported on Linux.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param lease pointer to a CapFrameLease of a frame that is leased.
+    @param exportInfo pointer to a CapFrameExport structure to be filled in.
+    @return CAPRESULT_OK if successful, CAPRESULT_ERR if the frame cannot be exported.
+*/
+DLLPUBLIC CapResult Cap_exportFrame(CapContext ctx, CapStream stream, const CapFrameLease *lease, 
+    CapFrameExport *exportInfo);
+
+/** Share the frames of a stream with client contexts in other
+    processes (see Cap_createClientContext), for cameras that
+    can only be opened by one process. Each frame is converted
+    once and copied into a ring in shared memory, from which
+    the clients copy it without ever blocking this process.
+    A client that falls more than three frames behind loses
+    frames, which it reports as dropped. Brokering stops when
+    the stream is closed. Only supported on Linux.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param name A name for the broker, unique on the system, e.g. "top-camera".
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_startBroker(CapContext ctx, CapStream stream, const char *name);
+
+/** Stop sharing the frames of a stream. Connected clients 
+    stop receiving frames.
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_stopBroker(CapContext ctx, CapStream stream);
+
+/** Wait until a stream has a new frame, i.e. until Cap_hasNewFrame
+    would return 1, without polling.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param timeoutMs The maximum time to wait in milliseconds.
+    @return CAPRESULT_OK if a new frame is available.
+            CAPRESULT_TIMEOUT if no new frame arrived in time.
+            CAPRESULT_ERR if the context or stream is invalid or the stream was closed.
+*/
+DLLPUBLIC CapResult Cap_waitForFrame(CapContext ctx, CapStream stream, uint32_t timeoutMs);
+
+/** Wait until any of a set of streams has a new frame.
+
+    @param ctx The ID of the context.
+    @param streams Pointer to an array of stream IDs.
+    @param count The number of stream IDs in the array.
+    @param timeoutMs The maximum time to wait in milliseconds.
+    @param readyIndex Pointer to an uint32_t that receives the array index 
+           of a stream with a new frame. May be NULL.
+    @return CAPRESULT_OK if a new frame is available.
+            CAPRESULT_TIMEOUT if no new frame arrived in time.
+            CAPRESULT_ERR if the context or a stream is invalid or a stream was closed.
+*/
+DLLPUBLIC CapResult Cap_waitForAnyFrame(CapContext ctx, const CapStream *streams, uint32_t count, 
+    uint32_t timeoutMs, uint32_t *readyIndex);
+
+/** Get information about the frame that was most recently read
+    from the stream with Cap_captureFrame or Cap_acquireFrame.
+
+    The information includes the capture time and sequence 
+    number reported by the device driver and the number of 
+    frames that were lost between the previously read frame 
+    and this one. Frames are either dropped, because the device
+    or library could not keep up, or overwritten, because the
+    application did not read them before a newer frame arrived.
+
+    When CAPFRAMEFLAG_DEVICETIMESTAMP is set, timestamp minus 
+    deviceTimestamp is the delay between capture and the frame
+    being available to the application.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param info Pointer to a CapFrameInfo structure that receives the information.
+    @return CAPRESULT_OK if successful.
+            CAPRESULT_ERR if the context or stream is invalid or no frame was read yet.
+*/
+DLLPUBLIC CapResult Cap_getFrameInfo(CapContext ctx, CapStream stream, CapFrameInfo *info);
+
 /** returns 1 if a new frame has been captured, 0 otherwise */
 DLLPUBLIC uint32_t Cap_hasNewFrame(CapContext ctx, CapStream stream);
 
+/********************************************************************************** 
+     STREAM CONSUMERS
+**********************************************************************************/
+
+/** Open a consumer of a stream. Reading a frame with 
+    Cap_captureFrame or Cap_acquireFrame marks it as read for
+    every thread that uses the stream ID. Threads that each 
+    want to see every new frame, for example a preview, a 
+    vision pipeline and a recorder, should each open their 
+    own consumer: it has its own new-frame state and its own
+    frame information, including the number of frames that
+    were overwritten before that consumer read them. The
+    frames are shared and decoded only once.
+
+    A consumer is closed with Cap_closeConsumer or when its
+    stream is closed.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @return The consumer ID or -1 if the stream does not exist.
+*/
+DLLPUBLIC CapConsumer Cap_openConsumer(CapContext ctx, CapStream stream);
+
+/** Close a consumer opened with Cap_openConsumer. Frames the
+    consumer has acquired must be released first. */
+DLLPUBLIC CapResult Cap_closeConsumer(CapContext ctx, CapConsumer consumer);
+
+/** returns 1 if the consumer has not read the newest frame of its stream, 0 otherwise */
+DLLPUBLIC uint32_t Cap_consumerHasNewFrame(CapContext ctx, CapConsumer consumer);
+
+/** Like Cap_captureFrame, for a consumer */
+DLLPUBLIC CapResult Cap_consumerCaptureFrame(CapContext ctx, CapConsumer consumer, 
+    void *RGBbufferPtr, uint32_t RGBbufferBytes);
+
+/** Like Cap_acquireFrame, for a consumer. Hand the frame back 
+    with Cap_consumerReleaseFrame. */
+DLLPUBLIC CapResult Cap_consumerAcquireFrame(CapContext ctx, CapConsumer consumer, CapFrameLease *lease);
+
+/** Hand back a frame obtained with Cap_consumerAcquireFrame */
+DLLPUBLIC CapResult Cap_consumerReleaseFrame(CapContext ctx, CapConsumer consumer, CapFrameLease *lease);
+
+/** Like Cap_getFrameInfo, for the frame most recently read by a consumer */
+DLLPUBLIC CapResult Cap_consumerGetFrameInfo(CapContext ctx, CapConsumer consumer, CapFrameInfo *info);
+
+/** Like Cap_waitForFrame: wait until Cap_consumerHasNewFrame 
+    would return 1 or the timeout expires.
+    @return CAPRESULT_OK, CAPRESULT_TIMEOUT or CAPRESULT_ERR if the 
+            consumer is invalid or was closed.
+*/
+DLLPUBLIC CapResult Cap_consumerWaitForFrame(CapContext ctx, CapConsumer consumer, uint32_t timeoutMs);
+
+/********************************************************************************** 
+     CAPTURE GROUPS
+**********************************************************************************/
+
+/** Create a group of streams whose frames are read together, for
+    example the cameras looking at the same part. 
+    
+    Cap_captureGroup returns one frame of each stream in a single
+    call, chosen such that all frames were captured within a 
+    tolerance window. The capture time of a frame is its 
+    deviceTimestamp when CAPFRAMEFLAG_DEVICETIMESTAMP is set,
+    and its timestamp otherwise. The frames are chosen from the 
+    frame histories of the streams, so open the streams with 
+    CAPSTREAMOPT_HISTORYFRAMES of a few frames when the cameras
+    are not triggered together.
+
+    @param ctx The ID of the context.
+    @param streams Pointer to an array of stream IDs.
+    @param count The number of stream IDs in the array.
+    @return The group ID or -1 if a stream does not exist.
+*/
+DLLPUBLIC CapGroup Cap_openGroup(CapContext ctx, const CapStream *streams, uint32_t count);
+
+/** Delete a group created with Cap_openGroup. Frames captured
+    with Cap_captureGroup must be released first. */
+DLLPUBLIC CapResult Cap_closeGroup(CapContext ctx, CapGroup group);
+
+/** Pin one frame of each stream of a group and return read-only
+    views of them, like Cap_acquireFrame. The newest set of frames 
+    whose capture times differ at most toleranceUs is returned,
+    waiting for the streams to capture one if needed. Each set 
+    only contains frames that are newer than those of the set 
+    the previous call returned. The capture times of the frames
+    are returned in 'infos'.
+
+    @param ctx The ID of the context.
+    @param group The group ID.
+    @param toleranceUs The largest difference between the capture times in microseconds.
+    @param timeoutMs The maximum time to wait in milliseconds.
+    @param leases pointer to an array of CapFrameLease structures, one for
+           each stream in the order passed to Cap_openGroup.
+    @param infos pointer to an array of CapFrameInfo structures, one for each
+           stream, or NULL. The dropped and overwritten counts are 0.
+    @return CAPRESULT_OK if a set of frames was acquired.
+            CAPRESULT_TIMEOUT if no set was captured in time.
+            CAPRESULT_ERR if the context, group or one of its streams is invalid.
+*/
+DLLPUBLIC CapResult Cap_captureGroup(CapContext ctx, CapGroup group, uint32_t toleranceUs, 
+    uint32_t timeoutMs, CapFrameLease *leases, CapFrameInfo *infos);
+
+/** Hand back the frames obtained with Cap_captureGroup */
+DLLPUBLIC CapResult Cap_releaseGroup(CapContext ctx, CapGroup group, CapFrameLease *leases);
+
 /** returns the number of frames captured during the lifetime of the stream. 
     For debugging purposes */
 DLLPUBLIC uint32_t Cap_getStreamFrameCount(CapContext ctx, CapStream stream);
@@ -0,0 +1,235 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux capture reactor: a fixed number of threads that
+    service the V4L2 devices of all streams of a context.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "../common/logging.h"
+#include "platformstream.h"
+#include "capturereactor.h"
+
+CaptureReactor::CaptureReactor(uint32_t threads) :
+    m_epollFd(-1),
+    m_quitFd(-1),
+    m_nextKey(1)
+{
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_quitFd  = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if ((m_epollFd < 0) || (m_quitFd < 0))
+    {
+        LOG(LOG_ERR, "CaptureReactor: could not create epoll instance (errno=%d)\n", errno);
+        return;
+    }
+
+    // the quit event is level triggered so it
+    // wakes up every thread.
+    epoll_event ev;
+    ev.events   = EPOLLIN;
+    ev.data.u64 = 0;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_quitFd, &ev) == -1)
+    {
+        LOG(LOG_ERR, "CaptureReactor: could not add the quit event (errno=%d)\n", errno);
+        return;
+    }
+
+    for(uint32_t i=0; i<threads; i++)
+    {
+        m_threads.emplace_back(&CaptureReactor::threadFunction, this);
+    }
+    LOG(LOG_DEBUG, "CaptureReactor started with %d threads\n", threads);
+}
+
+CaptureReactor::~CaptureReactor()
+{
+    if (!m_entries.empty())
+    {
+        LOG(LOG_WARNING, "CaptureReactor destroyed while streams are registered\n");
+    }
+
+    if (m_quitFd >= 0)
+    {
+        uint64_t one = 1;
+        if (::write(m_quitFd, &one, sizeof(one)) != sizeof(one))
+        {
+            LOG(LOG_ERR, "CaptureReactor: could not signal the threads to quit\n");
+        }
+    }
+
+    for(auto &thread : m_threads)
+    {
+        thread.join();
+    }
+
+    if (m_quitFd >= 0) ::close(m_quitFd);
+    if (m_epollFd >= 0) ::close(m_epollFd);
+}
+
+bool CaptureReactor::addStream(PlatformStream *stream, int fd)
+{
+    if ((m_epollFd < 0) || (m_threads.empty()))
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const uint64_t key = m_nextKey++;
+
+    epoll_event ev;
+    ev.events   = EPOLLIN | EPOLLONESHOT;
+    ev.data.u64 = key;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &ev) == -1)
+    {
+        LOG(LOG_ERR, "CaptureReactor: could not add stream (errno=%d)\n", errno);
+        return false;
+    }
+
+    Entry &entry = m_entries[key];
+    entry.m_stream  = stream;
+    entry.m_fd      = fd;
+    entry.m_busy    = false;
+    entry.m_removed = false;
+    return true;
+}
+
+void CaptureReactor::removeStream(PlatformStream *stream)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(auto iter = m_entries.begin(); iter != m_entries.end(); ++iter)
+    {
+        Entry &entry = iter->second;
+        if (entry.m_stream != stream)
+        {
+            continue;
+        }
+
+        // a thread that has already been handed the event
+        // ignores it once it finds the entry removed.
+        entry.m_removed = true;
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, entry.m_fd, nullptr);
+        m_entryIdle.wait(lock, [&entry]{ return !entry.m_busy; });
+        m_entries.erase(iter);
+        return;
+    }
+}
+
+void CaptureReactor::resumeStream(PlatformStream *stream)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(auto &item : m_entries)
+    {
+        Entry &entry = item.second;
+        
+        // a thread that is servicing the stream checks 
+        // whether it is streaming when it is done, and
+        // re-arms the descriptor itself.
+        if ((entry.m_stream != stream) || entry.m_busy || entry.m_removed)
+        {
+            continue;
+        }
+
+        epoll_event rearm;
+        rearm.events   = EPOLLIN | EPOLLONESHOT;
+        rearm.data.u64 = item.first;
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_MOD, entry.m_fd, &rearm) == -1)
+        {
+            LOG(LOG_ERR, "CaptureReactor: could not resume stream (errno=%d)\n", errno);
+        }
+    }
+}
+
+void CaptureReactor::threadFunction()
+{
+    while(true)
+    {
+        epoll_event ev;
+        int result = epoll_wait(m_epollFd, &ev, 1, -1);
+        if (result == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            LOG(LOG_ERR, "CaptureReactor: epoll_wait failed (errno=%d)\n", errno);
+            return;
+        }
+        else if (result == 0)
+        {
+            continue;
+        }
+
+        if (ev.data.u64 == 0)
+        {
+            return; // quit event
+        }
+
+        PlatformStream *stream = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto iter = m_entries.find(ev.data.u64);
+            if ((iter == m_entries.end()) || (iter->second.m_removed))
+            {
+                continue;
+            }
+            iter->second.m_busy = true;
+            stream = iter->second.m_stream;
+        }
+
+        // EPOLLONESHOT keeps other threads away from this
+        // stream until its descriptor is re-armed below.
+        // Taking the lock before and after servicing makes
+        // the stream state written by one reactor thread
+        // visible to the next.
+        const bool ok = stream->threadServiceBuffer();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Entry &entry = m_entries[ev.data.u64];
+        entry.m_busy = false;
+        if (entry.m_removed)
+        {
+            m_entryIdle.notify_all();
+        }
+        else if (ok && stream->isStreaming())
+        {
+            epoll_event rearm;
+            rearm.events   = EPOLLIN | EPOLLONESHOT;
+            rearm.data.u64 = ev.data.u64;
+            if (epoll_ctl(m_epollFd, EPOLL_CTL_MOD, entry.m_fd, &rearm) == -1)
+            {
+                LOG(LOG_ERR, "CaptureReactor: could not re-arm stream (errno=%d)\n", errno);
+            }
+        }
+        else if (!ok)
+        {
+            // like the capture thread, stop servicing
+            // a stream after a device error.
+            LOG(LOG_ERR, "CaptureReactor: stopped servicing a stream after an error\n");
+        }
+        // a stream that stopped streaming is re-armed by resumeStream
+    }
+}
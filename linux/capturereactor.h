@@ -0,0 +1,103 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux capture reactor: a fixed number of threads that
+    service the V4L2 devices of all streams of a context.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef linux_capturereactor_h
+#define linux_capturereactor_h
+
+#include <stdint.h>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class PlatformStream;   // pre-declaration
+
+/** The capture reactor replaces the capture thread of each
+    stream by a fixed number of threads that wait for the
+    device file descriptors of all streams with a single
+    epoll instance.
+
+    A descriptor is registered with EPOLLONESHOT, so a ready
+    stream is handed to exactly one reactor thread, which
+    dequeues and converts a buffer and then re-arms the
+    descriptor. A stream is therefore never serviced by two
+    threads at the same time, and the number of cores used
+    depends on the amount of decoding work, not on the number
+    of streams.
+*/
+class CaptureReactor
+{
+public:
+    /** create a reactor with 'threads' threads */
+    CaptureReactor(uint32_t threads);
+    virtual ~CaptureReactor();
+
+    /** return the number of reactor threads */
+    uint32_t getThreadCount() const
+    {
+        return static_cast<uint32_t>(m_threads.size());
+    }
+
+    /** Start servicing a stream that has started streaming
+        on device file descriptor 'fd'. Returns false if the
+        descriptor could not be added. */
+    bool addStream(PlatformStream *stream, int fd);
+
+    /** Stop servicing a stream. When this returns, no reactor
+        thread uses the stream anymore. */
+    void removeStream(PlatformStream *stream);
+
+    /** Service a registered stream again after it has started 
+        streaming. A stream that is not streaming is not re-armed
+        after it has been serviced, so it stays idle until this
+        is called. */
+    void resumeStream(PlatformStream *stream);
+
+protected:
+    struct Entry
+    {
+        PlatformStream* m_stream;
+        int             m_fd;
+        bool            m_busy;     ///< a reactor thread is servicing the stream
+        bool            m_removed;  ///< removeStream is waiting for the stream
+    };
+
+    /** reactor thread main loop */
+    void threadFunction();
+
+    int                         m_epollFd;
+    int                         m_quitFd;       ///< eventfd that wakes all threads to quit
+    std::vector<std::thread>    m_threads;
+    std::mutex                  m_mutex;        ///< protects m_entries
+    std::condition_variable     m_entryIdle;    ///< signalled when a thread is done with a stream
+    std::map<uint64_t, Entry>   m_entries;      ///< registered streams by epoll key
+    uint64_t                    m_nextKey;      ///< next epoll key, 0 is the quit event
+};
+
+#endif
@@ -0,0 +1,149 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux client context: reads the frames of a stream that
+    is shared by a frame broker in another process.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "../common/logging.h"
+#include "clientcontext.h"
+#include "clientstream.h"
+
+ClientContext::ClientContext(const char *name) :
+    Context(),
+    m_name((name != nullptr) ? name : "")
+{
+    LOG(LOG_DEBUG, "Client context created\n");
+    enumerateDevices();
+}
+
+ClientContext::~ClientContext()
+{
+    // the streams read from the rings of the devices
+    closeAllStreams();
+}
+
+bool ClientContext::enumerateDevices()
+{
+    sockaddr_un addr;
+    socklen_t addrLen;
+    if (!SharedFrameRing::getSocketAddress(m_name.c_str(), addr, addrLen))
+    {
+        return false;
+    }
+
+    int socketFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (socketFd < 0)
+    {
+        LOG(LOG_ERR, "ClientContext: could not create socket (errno=%d)\n", errno);
+        return false;
+    }
+
+    if (connect(socketFd, reinterpret_cast<sockaddr*>(&addr), addrLen) == -1)
+    {
+        LOG(LOG_ERR, "ClientContext: could not connect to broker %s (errno=%d)\n", m_name.c_str(), errno);
+        ::close(socketFd);
+        return false;
+    }
+
+    int ringFd = receiveRing(socketFd);
+    ::close(socketFd);
+    if (ringFd < 0)
+    {
+        return false;
+    }
+
+    clientDeviceInfo *device = new clientDeviceInfo();
+    if (!device->m_ring.attach(ringFd))
+    {
+        delete device;
+        return false;
+    }
+
+    const SharedRingHeader *header = device->m_ring.getHeader();
+    device->m_name     = header->m_deviceName;
+    device->m_uniqueID = header->m_uniqueID;
+    device->m_formats.push_back(header->m_format);
+    m_devices.push_back(device);
+
+    LOG(LOG_INFO, "Attached to broker %s (%s)\n", m_name.c_str(), device->m_name.c_str());
+    return true;
+}
+
+int ClientContext::receiveRing(int socketFd)
+{
+    uint32_t version = 0;
+    iovec iov;
+    iov.iov_base = &version;
+    iov.iov_len  = sizeof(version);
+
+    union
+    {
+        char    buffer[CMSG_SPACE(sizeof(int))];
+        cmsghdr align;
+    } control;
+
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    if (recvmsg(socketFd, &msg, MSG_CMSG_CLOEXEC) != sizeof(version))
+    {
+        LOG(LOG_ERR, "ClientContext: no reply from broker %s\n", m_name.c_str());
+        return -1;
+    }
+
+    int fd = -1;
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if ((cmsg != nullptr) && (cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS) &&
+        (cmsg->cmsg_len == CMSG_LEN(sizeof(int))))
+    {
+        memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+
+    if (version != SHAREDRING_VERSION)
+    {
+        LOG(LOG_ERR, "ClientContext: broker %s uses an unsupported version (%d)\n", m_name.c_str(), version);
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+
+    if (fd < 0)
+    {
+        LOG(LOG_ERR, "ClientContext: broker %s did not send the frame ring\n", m_name.c_str());
+    }
+    return fd;
+}
+
+Stream* ClientContext::createStream()
+{
+    return new ClientStream();
+}
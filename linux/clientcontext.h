@@ -0,0 +1,82 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux client context: reads the frames of a stream that
+    is shared by a frame broker in another process.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef linux_clientcontext_h
+#define linux_clientcontext_h
+
+#include <string>
+#include <stdint.h>
+
+#include "openpnp-capture.h"
+#include "../common/context.h"
+#include "../common/deviceinfo.h"
+#include "sharedframering.h"
+
+/** the device of a client context: the stream shared by a broker */
+class clientDeviceInfo : public deviceInfo
+{
+public:
+    clientDeviceInfo() : deviceInfo()
+    {
+    }
+
+    virtual ~clientDeviceInfo()
+    {
+    }
+
+    SharedFrameRing m_ring;     ///< frames shared by the broker
+};
+
+/** A context that does not open cameras itself, but attaches
+    to a FrameBroker in another process. It has one device,
+    the brokered stream, with one format. Streams opened on
+    it copy the frames from the shared frame ring; camera 
+    properties and frame rates cannot be changed.
+*/
+class ClientContext : public Context
+{
+public:
+    /** connect to the broker called 'name' */
+    ClientContext(const char *name);
+    virtual ~ClientContext();
+
+protected:
+    /** receive the frame ring from the broker and describe
+        the brokered stream as the only device */
+    virtual bool enumerateDevices() override;
+
+    /** create a ClientStream */
+    virtual Stream* createStream() override;
+
+    /** receive the file descriptor of the frame ring, or -1 */
+    int receiveRing(int socketFd);
+
+    std::string m_name;     ///< name of the broker
+};
+
+#endif
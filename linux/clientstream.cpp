@@ -0,0 +1,208 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux client stream: copies the frames of a brokered
+    stream from shared memory.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <chrono>
+#include "../common/logging.h"
+#include "clientcontext.h"
+#include "clientstream.h"
+
+ClientStream::ClientStream() :
+    Stream(),
+    m_ring(nullptr),
+    m_fourcc(0),
+    m_thread(nullptr),
+    m_quitThread(false),
+    m_haveFrame(false),
+    m_lastIndex(0),
+    m_lastDropped(0)
+{
+}
+
+ClientStream::~ClientStream()
+{
+    close();
+}
+
+bool ClientStream::open(Context *owner, deviceInfo *device, uint32_t width, uint32_t height, 
+    uint32_t fourCC, uint32_t fps)
+{
+    if (m_isOpen)
+    {
+        LOG(LOG_INFO,"open() was called on an active stream.\n");
+        close();
+    }
+
+    clientDeviceInfo *dinfo = dynamic_cast<clientDeviceInfo*>(device);
+    if ((owner == nullptr) || (dinfo == nullptr))
+    {
+        LOG(LOG_CRIT, "ClientStream: open() needs a client context device\n");
+        return false;
+    }
+
+    m_owner  = owner;
+    m_ring   = &dinfo->m_ring;
+    m_width  = width;
+    m_height = height;
+    m_fourcc = fourCC;
+    m_frames = 0;
+    m_cursor.m_lastReadFrame = 0;
+    m_haveFrame = false;
+    m_framePool.init(getFrameSlotCount(), m_openOptions.m_historyFrames);
+
+    m_quitThread = false;
+    m_thread = new std::thread(&ClientStream::threadFunction, this);
+    m_isOpen = true;
+    return true;
+}
+
+void ClientStream::close()
+{
+    m_isOpen = false;
+    m_quitThread = true;
+    if (m_thread != nullptr)
+    {
+        m_thread->join();
+        delete m_thread;
+        m_thread = nullptr;
+    }
+    m_framePool.clear();
+    m_owner = nullptr;
+}
+
+void ClientStream::threadFunction()
+{
+    bool closedLogged = false;
+
+    // start with the newest frame the broker has
+    uint32_t seen = m_ring->getPublishedCount();
+    if (seen > 0)
+    {
+        seen--;
+    }
+
+    while(!m_quitThread)
+    {
+        const uint32_t published = m_ring->getPublishedCount();
+        if (published == seen)
+        {
+            if (m_ring->isClosed())
+            {
+                if (!closedLogged)
+                {
+                    LOG(LOG_WARNING, "ClientStream: the broker has stopped\n");
+                    closedLogged = true;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            else
+            {
+                m_ring->waitForFrame(seen, 100);
+            }
+            continue;
+        }
+
+        // older frames are skipped; if the newest one is 
+        // overwritten while it is copied, the next attempt
+        // picks up its successor.
+        if (threadCopyFrame(published - 1))
+        {
+            seen = published;
+        }
+    }
+}
+
+bool ClientStream::threadCopyFrame(uint32_t index)
+{
+    SharedFrameInfo info;
+    if (!m_ring->readInfo(index, info))
+    {
+        return false;
+    }
+
+    // frames skipped by this client and frames the broker dropped
+    if (m_haveFrame)
+    {
+        m_droppedFrames += (info.m_index - m_lastIndex - 1) + (info.m_dropped - m_lastDropped);
+    }
+    m_haveFrame   = true;
+    m_lastIndex   = info.m_index;
+    m_lastDropped = info.m_dropped;
+
+    FrameSlot *slot = beginFrame(info.m_fourcc, info.m_stride, info.m_bytes);
+    if (slot == nullptr)
+    {
+        return true;    // counted as dropped by beginFrame
+    }
+
+    slot->m_width  = info.m_width;
+    slot->m_height = info.m_height;
+    slot->m_roiX   = info.m_roiX;
+    slot->m_roiY   = info.m_roiY;
+    if (!m_ring->readData(info, slot->m_storage))
+    {
+        abortFrame(slot);
+        return false;
+    }
+
+    setDeviceFrameInfo(info.m_deviceTimestamp, info.m_deviceSequence, info.m_flags, info.m_deviceFlags);
+    commitFrame(slot);
+    return true;
+}
+
+bool ClientStream::setFrameRate(uint32_t fps)
+{
+    LOG(LOG_ERR, "ClientStream: the frame rate is set by the broker\n");
+    return false;
+}
+
+bool ClientStream::getPropertyLimits(uint32_t propID, int32_t *min, int32_t *max, int32_t *dValue)
+{
+    return false;
+}
+
+bool ClientStream::setProperty(uint32_t propID, int32_t value)
+{
+    LOG(LOG_ERR, "ClientStream: camera properties are set by the broker\n");
+    return false;
+}
+
+bool ClientStream::setAutoProperty(uint32_t propID, bool enabled)
+{
+    LOG(LOG_ERR, "ClientStream: camera properties are set by the broker\n");
+    return false;
+}
+
+bool ClientStream::getProperty(uint32_t propID, int32_t &outValue)
+{
+    return false;
+}
+
+bool ClientStream::getAutoProperty(uint32_t propID, bool &enable)
+{
+    return false;
+}
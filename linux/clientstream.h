@@ -0,0 +1,89 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux client stream: copies the frames of a brokered
+    stream from shared memory.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef linux_clientstream_h
+#define linux_clientstream_h
+
+#include <stdint.h>
+#include <thread>
+#include <atomic>
+#include "../common/stream.h"
+
+class SharedFrameRing;  // pre-declaration
+
+/** A stream of a ClientContext. A thread waits for frames 
+    published by the broker and copies the newest one into
+    the frame pool, so the frames can be read with the usual
+    calls. The frames keep the pixel layout the broker 
+    stream produces. Frames the client was too slow to copy
+    are counted as dropped.
+*/
+class ClientStream : public Stream
+{
+public:
+    ClientStream();
+    virtual ~ClientStream();
+
+    virtual bool open(Context *owner, deviceInfo *device, uint32_t width, uint32_t height, 
+        uint32_t fourCC, uint32_t fps) override;
+
+    virtual void close() override;
+
+    /** Return the FOURCC media type of the brokered stream */
+    virtual uint32_t getFOURCC() override
+    {
+        return m_fourcc;
+    }
+
+    /** Camera settings belong to the broker process and 
+        cannot be read or changed by clients. */
+    virtual bool setFrameRate(uint32_t fps) override;
+    virtual bool getPropertyLimits(uint32_t propID, int32_t *min, int32_t *max, int32_t *dValue) override;
+    virtual bool setProperty(uint32_t propID, int32_t value) override;
+    virtual bool setAutoProperty(uint32_t propID, bool enabled) override;
+    virtual bool getProperty(uint32_t propID, int32_t &outValue) override;
+    virtual bool getAutoProperty(uint32_t propID, bool &enable) override;
+
+protected:
+    /** copy frames from the ring until the stream is closed */
+    void threadFunction();
+
+    /** copy frame 'index' from the ring, returns false if it
+        was overwritten before it could be copied */
+    bool threadCopyFrame(uint32_t index);
+
+    SharedFrameRing*        m_ring;         ///< ring of the brokered device
+    uint32_t                m_fourcc;       ///< FOURCC of the brokered stream
+    std::thread*            m_thread;       ///< thread copying the frames
+    std::atomic<bool>       m_quitThread;   ///< if true, threadFunction should return
+    bool                    m_haveFrame;    ///< true after the first frame has been copied
+    uint32_t                m_lastIndex;    ///< publication number of the last frame copied
+    uint32_t                m_lastDropped;  ///< frames the broker dropped before the last frame copied
+};
+
+#endif
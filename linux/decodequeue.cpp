@@ -0,0 +1,107 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux decode queue: hands copies of camera frames from
+    the thread that dequeues them to the thread that decodes them.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "decodequeue.h"
+
+DecodeQueue::DecodeQueue() :
+    m_depth(0),
+    m_head(0),
+    m_tail(0),
+    m_closed(false)
+{
+}
+
+void DecodeQueue::init(uint32_t depth)
+{
+    // the counters wrap around, so the ring size must 
+    // be a power of two to divide 2^32 evenly.
+    uint32_t entries = 1;
+    while(entries < depth)
+    {
+        entries *= 2;
+    }
+    m_entries.clear();
+    m_entries.resize(entries);
+    m_depth = depth;
+    m_head = 0;
+    m_tail = 0;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_closed = false;
+}
+
+QueuedFrame* DecodeQueue::beginPush()
+{
+    const uint32_t tail = m_tail.load();
+    if (tail - m_head.load() >= m_depth)
+    {
+        return nullptr;
+    }
+    return &m_entries[tail & (m_entries.size() - 1)];
+}
+
+void DecodeQueue::commitPush()
+{
+    // publishing the new tail releases the frame
+    // written into the entry to the consumer.
+    m_tail.store(m_tail.load() + 1);
+
+    // taking the lock before signalling makes sure a 
+    // consumer that just found the queue empty is 
+    // already waiting and does not miss the frame.
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+    }
+    m_pushed.notify_one();
+}
+
+QueuedFrame* DecodeQueue::waitFront()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_pushed.wait(lock, [this]{ return m_closed || (m_tail.load() != m_head.load()); });
+    if (m_closed)
+    {
+        return nullptr;
+    }
+    return &m_entries[m_head.load() & (m_entries.size() - 1)];
+}
+
+void DecodeQueue::pop()
+{
+    // the producer may reuse the entry from now on
+    m_head.store(m_head.load() + 1);
+}
+
+void DecodeQueue::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+    }
+    m_pushed.notify_all();
+}
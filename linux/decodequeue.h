@@ -0,0 +1,119 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux decode queue: hands copies of camera frames from
+    the thread that dequeues them to the thread that decodes them.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef linux_decodequeue_h
+#define linux_decodequeue_h
+
+#include <stdint.h>
+#include <stdlib.h> // size_t
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+/** The information the device reported about a frame,
+    see Stream::setDeviceFrameInfo */
+struct DeviceFrameInfo
+{
+    uint64_t    m_timestamp;    ///< device timestamp in microseconds or 0
+    uint32_t    m_sequence;     ///< frame number reported by the device
+    uint32_t    m_flags;        ///< CAPFRAMEFLAG_xxx
+    uint32_t    m_deviceFlags;  ///< platform dependent buffer flags
+};
+
+/** A camera frame waiting to be decoded */
+struct QueuedFrame
+{
+    QueuedFrame() : m_bytes(0)
+    {
+    }
+
+    std::vector<uint8_t> m_buffer;  ///< copy of the frame, keeps its capacity between frames
+    size_t          m_bytes;        ///< number of valid bytes in m_buffer
+    DeviceFrameInfo m_info;         ///< what the device reported about the frame
+};
+
+/** A bounded queue between one producer, the thread that
+    dequeues frames from the driver, and one consumer, the
+    thread that decodes them. The queue owns a fixed number
+    of frame buffers that are reused, so after the first
+    frames no memory is allocated.
+
+    The producer never waits: when the queue is full
+    beginPush returns nullptr and the frame is dropped.
+    The entries are exchanged through the head and tail
+    counters, the mutex is only used to let the consumer
+    sleep while the queue is empty.
+*/
+class DecodeQueue
+{
+public:
+    DecodeQueue();
+
+    /** Allocate 'depth' entries and open the queue. Must
+        not be called while the consumer is running. */
+    void init(uint32_t depth);
+
+    /** Producer: return the entry to copy the next frame
+        into, or nullptr if the queue is full. */
+    QueuedFrame* beginPush();
+
+    /** Producer: hand the entry obtained by beginPush to
+        the consumer. */
+    void commitPush();
+
+    /** Consumer: wait for a frame and return the oldest one,
+        or nullptr once the queue has been closed. */
+    QueuedFrame* waitFront();
+
+    /** Consumer: hand the entry returned by waitFront back
+        to the producer. */
+    void pop();
+
+    /** return the number of frames in the queue */
+    uint32_t size() const
+    {
+        return m_tail.load() - m_head.load();
+    }
+
+    /** Wake up the consumer and make waitFront return
+        nullptr from now on. */
+    void close();
+
+protected:
+    std::vector<QueuedFrame> m_entries; ///< frame buffers, used as a ring
+    uint32_t              m_depth;      ///< maximum number of frames in the queue
+    std::atomic<uint32_t> m_head;       ///< number of frames popped by the consumer
+    std::atomic<uint32_t> m_tail;       ///< number of frames pushed by the producer
+
+    std::mutex              m_mutex;    ///< protects m_closed, lets the consumer sleep
+    std::condition_variable m_pushed;   ///< signalled when a frame is pushed or the queue is closed
+    bool                    m_closed;   ///< true after close()
+};
+
+#endif
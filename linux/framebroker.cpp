@@ -0,0 +1,194 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux frame broker: shares the frames of a stream with
+    client contexts in other processes.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include "../common/logging.h"
+#include "framebroker.h"
+
+/** number of frames in the ring: a client can be this
+    number minus one frames behind before it loses one */
+#define BROKER_RING_SLOTS 4
+
+FrameBroker::FrameBroker() :
+    m_listenFd(-1),
+    m_quitFd(-1),
+    m_thread(nullptr)
+{
+}
+
+FrameBroker::~FrameBroker()
+{
+    if (m_thread != nullptr)
+    {
+        uint64_t one = 1;
+        if (::write(m_quitFd, &one, sizeof(one)) != sizeof(one))
+        {
+            LOG(LOG_ERR, "FrameBroker: could not signal the thread to quit\n");
+        }
+        m_thread->join();
+        delete m_thread;
+    }
+
+    if (m_listenFd >= 0) ::close(m_listenFd);
+    if (m_quitFd >= 0) ::close(m_quitFd);
+
+    // connected clients keep their own mapping of the ring
+    m_ring.markClosed();
+    LOG(LOG_INFO, "Frame broker %s stopped\n", m_name.c_str());
+}
+
+bool FrameBroker::start(const char *name, const std::string &deviceName, const std::string &uniqueID,
+    const CapFormatInfo &format, size_t maxFrameBytes)
+{
+    sockaddr_un addr;
+    socklen_t addrLen;
+    if (!SharedFrameRing::getSocketAddress(name, addr, addrLen))
+    {
+        return false;
+    }
+    m_name = name;
+
+    if (!m_ring.create(BROKER_RING_SLOTS, maxFrameBytes, deviceName, uniqueID, format))
+    {
+        return false;
+    }
+
+    m_listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    m_quitFd   = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if ((m_listenFd < 0) || (m_quitFd < 0))
+    {
+        LOG(LOG_ERR, "FrameBroker: could not create socket (errno=%d)\n", errno);
+        return false;
+    }
+
+    if ((bind(m_listenFd, reinterpret_cast<sockaddr*>(&addr), addrLen) == -1) ||
+        (listen(m_listenFd, 8) == -1))
+    {
+        LOG(LOG_ERR, "FrameBroker: could not listen on %s (errno=%d)\n", name, errno);
+        return false;
+    }
+
+    m_thread = new std::thread(&FrameBroker::threadFunction, this);
+    LOG(LOG_INFO, "Frame broker %s started\n", name);
+    return true;
+}
+
+void FrameBroker::publishFrame(const FrameSlot *slot)
+{
+    m_ring.publish(slot);
+}
+
+void FrameBroker::threadFunction()
+{
+    while(true)
+    {
+        pollfd fds[2];
+        fds[0].fd = m_quitFd;
+        fds[0].events = POLLIN;
+        fds[1].fd = m_listenFd;
+        fds[1].events = POLLIN;
+
+        int result = poll(fds, 2, -1);
+        if (result == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            LOG(LOG_ERR, "FrameBroker: poll failed (errno=%d)\n", errno);
+            return;
+        }
+
+        if (fds[0].revents != 0)
+        {
+            return;
+        }
+
+        if ((fds[1].revents & POLLIN) != 0)
+        {
+            int clientFd = accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (clientFd >= 0)
+            {
+                serveClient(clientFd);
+                ::close(clientFd);
+            }
+        }
+    }
+}
+
+void FrameBroker::serveClient(int clientFd)
+{
+    // abstract sockets have no file permissions, so only
+    // processes of the same user get the frames.
+    ucred cred;
+    socklen_t credLen = sizeof(cred);
+    if ((getsockopt(clientFd, SOL_SOCKET, SO_PEERCRED, &cred, &credLen) == -1) ||
+        ((cred.uid != getuid()) && (cred.uid != 0)))
+    {
+        LOG(LOG_WARNING, "FrameBroker: refused a client of another user\n");
+        return;
+    }
+
+    uint32_t version = SHAREDRING_VERSION;
+    iovec iov;
+    iov.iov_base = &version;
+    iov.iov_len  = sizeof(version);
+
+    union
+    {
+        char    buffer[CMSG_SPACE(sizeof(int))];
+        cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+    const int fd = m_ring.getFd();
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    if (sendmsg(clientFd, &msg, MSG_NOSIGNAL) == -1)
+    {
+        LOG(LOG_ERR, "FrameBroker: could not send the frame ring to a client (errno=%d)\n", errno);
+        return;
+    }
+    LOG(LOG_INFO, "Frame broker %s: client (pid %d) attached\n", m_name.c_str(), cred.pid);
+}
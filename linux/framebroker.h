@@ -0,0 +1,79 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux frame broker: shares the frames of a stream with
+    client contexts in other processes.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef linux_framebroker_h
+#define linux_framebroker_h
+
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include "../common/stream.h"
+#include "sharedframering.h"
+
+/** The frame broker lets processes that cannot open the
+    camera themselves read the frames of a stream.
+
+    It is attached to the stream as a frame sink, so each
+    frame is converted once by the capture thread of the 
+    owning process and then copied into a SharedFrameRing.
+    A client context connects to the Unix domain socket of
+    the broker and receives the file descriptor of the ring;
+    from then on it reads frames without any help from the
+    broker, so the number of clients does not affect the
+    capture thread.
+*/
+class FrameBroker : public FrameSink
+{
+public:
+    FrameBroker();
+    virtual ~FrameBroker();
+
+    /** Create the frame ring and start accepting clients on
+        the socket called 'name'. 'maxFrameBytes' is the size
+        of the largest frame the stream can produce. */
+    bool start(const char *name, const std::string &deviceName, const std::string &uniqueID,
+        const CapFormatInfo &format, size_t maxFrameBytes);
+
+    /** copy a new frame into the ring, called by the capture thread */
+    virtual void publishFrame(const FrameSlot *slot) override;
+
+protected:
+    /** accept clients and hand them the ring until stopped */
+    void threadFunction();
+
+    /** send the file descriptor of the ring to a client */
+    void serveClient(int clientFd);
+
+    SharedFrameRing m_ring;         ///< frames shared with the clients
+    std::string     m_name;         ///< name of the broker socket
+    int             m_listenFd;     ///< listening Unix domain socket
+    int             m_quitFd;       ///< eventfd that stops the thread
+    std::thread*    m_thread;       ///< thread accepting clients
+};
+
+#endif
@@ -27,57 +27,578 @@
 
 */
 
+#include <algorithm>
+#include <atomic>
+#include <string.h>
 #include "mjpeghelper.h"
 #include "../common/logging.h"
+#include "../common/workerpool.h"
+
+tjhandle MJPEGHelper::createHandle()
+{
+    tjhandle handle = tj3Init(TJINIT_DECOMPRESS);
+    if (handle == nullptr)
+    {
+        LOG(LOG_ERR, "tj3Init failed: %s\n", tj3GetErrorStr(nullptr));
+        return nullptr;
+    }
+    tj3Set(handle, TJPARAM_FASTDCT, 1);
+    return handle;
+}
+
+MJPEGHelper::FrameCheck MJPEGHelper::checkFrame(const uint8_t *jpeg, size_t bytes, 
+    uint32_t width, uint32_t height)
+{
+    if (bytes < 2)
+    {
+        return FRAME_PARTIAL;
+    }
+    if ((jpeg[0] != 0xFF) || (jpeg[1] != 0xD8))
+    {
+        return FRAME_CORRUPT;
+    }
+
+    // walk the marker segments up to the start of scan
+    bool haveSOF = false;
+    size_t pos = 2;
+    while(true)
+    {
+        if (pos + 2 > bytes)
+        {
+            return FRAME_PARTIAL;
+        }
+        if (jpeg[pos] != 0xFF)
+        {
+            return FRAME_CORRUPT;
+        }
+
+        const uint8_t marker = jpeg[pos+1];
+        if (marker == 0xFF)
+        {
+            // fill byte
+            pos++;
+            continue;
+        }
+        else if ((marker == 0x00) || ((marker >= 0xD0) && (marker <= 0xD9)))
+        {
+            // stuffed zero, restart, start or end of image
+            // markers cannot appear before the scan
+            return FRAME_CORRUPT;
+        }
+
+        if (pos + 4 > bytes)
+        {
+            return FRAME_PARTIAL;
+        }
+        const size_t length = (jpeg[pos+2] << 8) | jpeg[pos+3];
+        if (length < 2)
+        {
+            return FRAME_CORRUPT;
+        }
+        if (pos + 2 + length > bytes)
+        {
+            return FRAME_PARTIAL;
+        }
+
+        if ((marker >= 0xC0) && (marker <= 0xCF) && 
+            (marker != 0xC4) && (marker != 0xC8) && (marker != 0xCC))
+        {
+            // frame header
+            if (length < 8)
+            {
+                return FRAME_CORRUPT;
+            }
+            const uint32_t frameHeight = (jpeg[pos+5] << 8) | jpeg[pos+6];
+            const uint32_t frameWidth  = (jpeg[pos+7] << 8) | jpeg[pos+8];
+            if ((width != 0) && ((frameWidth != width) || (frameHeight != height)))
+            {
+                return FRAME_CORRUPT;
+            }
+            haveSOF = true;
+        }
+        else if (marker == 0xDA)
+        {
+            // start of scan
+            if (!haveSOF)
+            {
+                return FRAME_CORRUPT;
+            }
+            pos += 2 + length;
+            break;
+        }
+        pos += 2 + length;
+    }
+
+    // The entropy coded data is not scanned, a frame that was
+    // cut off simply lacks the end of image marker. Drivers pad
+    // the frame with zeros and some cameras append a vendor
+    // trailer, so the last end of image marker is searched for
+    // backwards. Stuffing keeps FF D9 out of the scan data.
+    const size_t maxTrailer = 4096;
+    size_t end = bytes;
+    while((end > pos) && (jpeg[end-1] == 0x00))
+    {
+        end--;
+    }
+    const size_t first = (end > pos + maxTrailer) ? (end - maxTrailer) : pos;
+    for(; end >= first + 2; end--)
+    {
+        if ((jpeg[end-2] == 0xFF) && (jpeg[end-1] == 0xD9))
+        {
+            return FRAME_COMPLETE;
+        }
+    }
+    return FRAME_PARTIAL;
+}
+
+bool MJPEGHelper::acceptDecode(tjhandle handle, int result) const
+{
+    if ((result == 0) || (m_errorMode == CAPDECODEERRORS_IGNORE))
+    {
+        return true;
+    }
+
+    if ((tj3GetErrorCode(handle) == TJERR_WARNING) && (m_errorMode != CAPDECODEERRORS_WARNINGS))
+    {
+        return true;
+    }
+
+    LOG(LOG_DEBUG, "MJPEG frame rejected: %s\n", tj3GetErrorStr(handle));
+    return false;
+}
+
+bool MJPEGHelper::prepareDecode(const uint8_t *inBuffer, size_t inBytes, 
+    uint32_t jpegWidth, uint32_t jpegHeight, tjscalingfactor scale)
+{
+    if (m_decompressHandle == nullptr)
+    {
+        return false;
+    }
+
+    if (tj3DecompressHeader(m_decompressHandle, inBuffer, inBytes) != 0)
+    {
+        LOG(LOG_ERR, "tj3DecompressHeader failed: %s\n", tj3GetErrorStr(m_decompressHandle));
+        return false;
+    }
+
+    const int width  = tj3Get(m_decompressHandle, TJPARAM_JPEGWIDTH);
+    const int height = tj3Get(m_decompressHandle, TJPARAM_JPEGHEIGHT);
+    if ((width != static_cast<int>(jpegWidth)) || (height != static_cast<int>(jpegHeight)))
+    {
+        LOG(LOG_ERR, "MJPEG frame is %d x %d instead of %d x %d\n", width, height, jpegWidth, jpegHeight);
+        return false;
+    }
+    else
+    {
+        LOG(LOG_VERBOSE, "MJPG: %d %d size %d bytes\n", width, height, inBytes);
+    }
+
+    // the handle keeps the scaling factor and the cropping
+    // region, they are set for every frame because another
+    // decode might have changed them.
+    if ((tj3SetCroppingRegion(m_decompressHandle, TJUNCROPPED) != 0) ||
+        (tj3SetScalingFactor(m_decompressHandle, scale) != 0))
+    {
+        LOG(LOG_ERR, "MJPEG: could not set the scaling factor: %s\n", tj3GetErrorStr(m_decompressHandle));
+        return false;
+    }
+
+    // a frame that is rejected on a warning need 
+    // not be decoded any further.
+    tj3Set(m_decompressHandle, TJPARAM_STOPONWARNING, (m_errorMode == CAPDECODEERRORS_WARNINGS) ? 1 : 0);
+    return true;
+}
 
 bool MJPEGHelper::decompressFrame(const uint8_t *inBuffer,
     size_t inBytes, uint8_t *outBuffer,
-    uint32_t outBufWidth, uint32_t outBufHeight)
+    uint32_t jpegWidth, uint32_t jpegHeight,
+    int pixelFormat, WorkerPool *pool, tjscalingfactor scale)
+{
+    if (!prepareDecode(inBuffer, inBytes, jpegWidth, jpegHeight, scale))
+    {
+        return false;
+    }
+
+    bool accepted = true;
+    if ((pool != nullptr) && (pool->getThreadCount() > 0) &&
+        decompressBands(inBuffer, inBytes, outBuffer, pixelFormat, pool, scale, accepted))
+    {
+        return accepted;
+    }
+
+    // A lot of cameras produce incorrect but decodable JPEG data
+    // and produce warnings that fill the console,
+    // such as 'extraneous bytes before marker' etc.
+    //
+    // To avoid cluttering the console, the warnings and errors
+    // are not logged, and unless the error mode says otherwise
+    // the frame is used as far as it could be decoded.
+    const int result = tj3Decompress8(m_decompressHandle, inBuffer, inBytes, outBuffer, 0/*pitch*/, pixelFormat);
+    return acceptDecode(m_decompressHandle, result);
+}
+
+bool MJPEGHelper::decompressRegion(const uint8_t *inBuffer, size_t inBytes, 
+    uint8_t *outBuffer, uint32_t jpegWidth, uint32_t jpegHeight,
+    int pixelFormat, tjscalingfactor scale, const tjregion &region)
 {
-    // note: the jpeg-turbo library apparently uses a non-const
-    // buffer pointer to the incoming JPEG data.
-    // Hopefully, the lib does not change the JPEG data buffer.
-    // so, for now, we'll cast it to a non-const pointer.
-    // Yes, that is completely dirty... I'm not happy with it either.
-
-    uint8_t *jpegPtr = const_cast<uint8_t*>(inBuffer);
-    int32_t width, height, jpegSubsamp;
-    
-    tjDecompressHeader2(m_decompressHandle, jpegPtr, inBytes, &width, &height, &jpegSubsamp);    
-    if ((width != outBufWidth) || (height != outBufHeight))
-    {
-        LOG(LOG_ERR, "tjDecompressHeader2 failed: %s\n", tjGetErrorStr());
+    if (!prepareDecode(inBuffer, inBytes, jpegWidth, jpegHeight, scale))
+    {
+        return false;
+    }
+
+    const int scaledWidth  = TJSCALED(static_cast<int>(jpegWidth), scale);
+    const int scaledHeight = TJSCALED(static_cast<int>(jpegHeight), scale);
+    if ((region.x < 0) || (region.y < 0) || (region.w <= 0) || (region.h <= 0) ||
+        (region.x + region.w > scaledWidth) || (region.y + region.h > scaledHeight))
+    {
+        LOG(LOG_ERR, "MJPEG: the region does not fit in the %d x %d image\n", scaledWidth, scaledHeight);
         return false;
     }
+
+    // The decoder can only start a row at an MCU column. It 
+    // upsamples the chroma of the first and last column of 
+    // what it decodes without their outer neighbours, so a
+    // column is added on both sides, unless the region is at
+    // the edge of the image. Images with an unusual 
+    // subsampling are decoded in full.
+    const int subsamp = tj3Get(m_decompressHandle, TJPARAM_SUBSAMP);
+    tjregion crop = region;
+    if ((subsamp >= 0) && (subsamp < TJ_NUMSAMP))
+    {
+        const int left  = (region.x > 0) ? region.x - 1 : 0;
+        const int right = std::min(region.x + region.w + 1, scaledWidth);
+        crop.x = left - (left % TJSCALED(tjMCUWidth[subsamp], scale));
+        crop.w = right - crop.x;
+        if (tj3SetCroppingRegion(m_decompressHandle, crop) != 0)
+        {
+            LOG(LOG_ERR, "tj3SetCroppingRegion failed: %s\n", tj3GetErrorStr(m_decompressHandle));
+            return false;
+        }
+    }
     else
     {
-        LOG(LOG_VERBOSE, "MJPG: %d %d size %d bytes\n", width, height, inBytes);
+        crop.x = 0;
+        crop.y = 0;
+        crop.w = scaledWidth;
+        crop.h = scaledHeight;
+    }
+
+    const size_t pixelBytes = tjPixelSize[pixelFormat];
+    uint8_t *dst = outBuffer;
+    if ((crop.x != region.x) || (crop.w != region.w) || (crop.h != region.h))
+    {
+        m_regionBuffer.resize(static_cast<size_t>(crop.w)*crop.h*pixelBytes);
+        dst = &m_regionBuffer[0];
     }
 
-    if (tjDecompress2(m_decompressHandle, jpegPtr, inBytes, outBuffer, 
-        width, 0/*pitch*/, height, TJPF_RGB, TJFLAG_FASTDCT) != 0)
+    // see decompressFrame for warnings and errors
+    const int result = tj3Decompress8(m_decompressHandle, inBuffer, inBytes, dst, crop.w*pixelBytes, pixelFormat);
+    if (!acceptDecode(m_decompressHandle, result))
     {
-        // A lot of cameras produce incorrect but decodable JPEG data
-        // and produce warnings that fill the console,
-        // such as 'extraneous bytes before marker' etc.
-        //
-        // To avoid cluttering the console, we suppress the warnings
-        // and errors completely.. :-/
-        //
-        // FIXME: the following disabled code only works for
-        // very recent libjpeg-turbo libraries that aren't common on systems
-        // yet..
+        return false;
+    }
 
-        #if 0
-        if (tjGetErrorCode(m_decompressHandle)==TJERR_ERROR)
+    if (dst != outBuffer)
+    {
+        const size_t rowBytes = region.w*pixelBytes;
+        for(int row=0; row<region.h; row++)
+        {
+            memcpy(outBuffer + row*rowBytes, 
+                dst + ((row + region.y - crop.y)*static_cast<size_t>(crop.w) + region.x - crop.x)*pixelBytes, 
+                rowBytes);
+        }
+    }
+    return true;
+}
+
+bool MJPEGHelper::decompressDC(const uint8_t *inBuffer, size_t inBytes, 
+    std::vector<uint8_t> &outBuffer, uint32_t &outWidth, uint32_t &outHeight)
+{
+    if ((m_decompressHandle == nullptr) || 
+        (tj3DecompressHeader(m_decompressHandle, inBuffer, inBytes) != 0) ||
+        (tj3SetCroppingRegion(m_decompressHandle, TJUNCROPPED) != 0))
+    {
+        return false;
+    }
+
+    const tjscalingfactor eighth = {1, 8};
+    outWidth  = TJSCALED(tj3Get(m_decompressHandle, TJPARAM_JPEGWIDTH), eighth);
+    outHeight = TJSCALED(tj3Get(m_decompressHandle, TJPARAM_JPEGHEIGHT), eighth);
+    outBuffer.resize(static_cast<size_t>(outWidth)*outHeight);
+
+    // the 1/8 scaled decoder only uses the DC coefficients.
+    // Warnings about slightly corrupt data are always ignored,
+    // the signature of a damaged frame is still useful.
+    tj3SetScalingFactor(m_decompressHandle, eighth);
+    tj3Set(m_decompressHandle, TJPARAM_STOPONWARNING, 0);
+    tj3Decompress8(m_decompressHandle, inBuffer, inBytes, &outBuffer[0], 0/*pitch*/, TJPF_GRAY);
+    return true;
+}
+
+bool MJPEGHelper::parseLayout(const uint8_t *jpeg, size_t bytes, JPEGLayout &layout)
+{
+    layout.m_restartInterval = 0;
+    layout.m_intervalStart.clear();
+    layout.m_intervalEnd.clear();
+
+    if ((bytes < 4) || (jpeg[0] != 0xFF) || (jpeg[1] != 0xD8))
+    {
+        return false;
+    }
+
+    // walk the marker segments up to the start of scan
+    bool haveSOF = false;
+    uint32_t components = 0;
+    size_t pos = 2;
+    while(true)
+    {
+        if (pos + 4 > bytes)
+        {
+            return false;
+        }
+        if (jpeg[pos] != 0xFF)
         {
-            LOG(LOG_ERR, "tjDecompress2 failed: %s\n", tjGetErrorStr());
             return false;
         }
-        #endif
 
-        return true;
+        const uint8_t marker = jpeg[pos+1];
+        if (marker == 0xFF)
+        {
+            // fill byte
+            pos++;
+            continue;
+        }
+
+        const size_t length = (jpeg[pos+2] << 8) | jpeg[pos+3];
+        if ((length < 2) || (pos + 2 + length > bytes))
+        {
+            return false;
+        }
+
+        const uint8_t *segment = jpeg + pos + 4;
+        const size_t segmentBytes = length - 2;
+
+        if ((marker == 0xC0) || (marker == 0xC1))
+        {
+            // baseline or extended sequential DCT frame header
+            if (segmentBytes < 6)
+            {
+                return false;
+            }
+            components = segment[5];
+            if ((components == 0) || (segmentBytes < 6 + 3*components))
+            {
+                return false;
+            }
+
+            layout.m_sofHeightOffset = pos + 5;
+            layout.m_height = (segment[1] << 8) | segment[2];
+            layout.m_width  = (segment[3] << 8) | segment[4];
+
+            uint32_t hmax = 1;
+            uint32_t vmax = 1;
+            for(uint32_t i=0; i<components; i++)
+            {
+                hmax = std::max(hmax, (uint32_t)(segment[6 + 3*i + 1] >> 4));
+                vmax = std::max(vmax, (uint32_t)(segment[6 + 3*i + 1] & 15));
+            }
+
+            // a single component scan is not interleaved
+            // and uses one block per MCU.
+            layout.m_mcuWidth  = (components == 1) ? 8 : 8*hmax;
+            layout.m_mcuHeight = (components == 1) ? 8 : 8*vmax;
+            haveSOF = true;
+        }
+        else if ((marker >= 0xC2) && (marker <= 0xCF) && 
+            (marker != 0xC4) && (marker != 0xC8) && (marker != 0xCC))
+        {
+            // progressive, lossless or arithmetic coded
+            return false;
+        }
+        else if (marker == 0xDD)
+        {
+            // define restart interval
+            if (segmentBytes < 2)
+            {
+                return false;
+            }
+            layout.m_restartInterval = (segment[0] << 8) | segment[1];
+        }
+        else if (marker == 0xDA)
+        {
+            // start of scan, the scan must contain all components
+            if ((!haveSOF) || (segmentBytes < 1) || (segment[0] != components))
+            {
+                return false;
+            }
+            layout.m_scanOffset = pos + 2 + length;
+            break;
+        }
+        pos += 2 + length;
     }
 
+    if ((layout.m_restartInterval == 0) || (layout.m_width == 0) || (layout.m_height == 0))
+    {
+        return false;
+    }
+
+    // With vertically subsampled chroma (4:2:0) the decoder 
+    // interpolates the chroma of the rows next to a band edge
+    // as if it was the image edge. The result would differ 
+    // from a single decode, so these images are not split.
+    if ((components > 1) && (layout.m_mcuHeight > 8))
+    {
+        return false;
+    }
+
+    // locate the restart markers in the entropy coded data
+    size_t intervalStart = layout.m_scanOffset;
+    size_t p = layout.m_scanOffset;
+    while(p + 1 < bytes)
+    {
+        if (jpeg[p] == 0xFF)
+        {
+            const uint8_t marker = jpeg[p+1];
+            if (marker == 0x00)
+            {
+                // stuffed zero byte
+                p += 2;
+                continue;
+            }
+            else if (marker == 0xFF)
+            {
+                // fill byte
+                p++;
+                continue;
+            }
+            else if ((marker >= 0xD0) && (marker <= 0xD7))
+            {
+                layout.m_intervalStart.push_back(intervalStart);
+                layout.m_intervalEnd.push_back(p);
+                p += 2;
+                intervalStart = p;
+                continue;
+            }
+            
+            // EOI or another marker ends the scan
+            break;
+        }
+        p++;
+    }
+    layout.m_intervalStart.push_back(intervalStart);
+    layout.m_intervalEnd.push_back(std::min(p, bytes));
+
+    // a truncated or corrupt frame is left to the regular decoder
+    const uint32_t mcusPerRow = (layout.m_width + layout.m_mcuWidth - 1) / layout.m_mcuWidth;
+    const uint32_t mcuRows    = (layout.m_height + layout.m_mcuHeight - 1) / layout.m_mcuHeight;
+    const size_t   intervals  = (mcusPerRow*mcuRows + layout.m_restartInterval - 1) / layout.m_restartInterval;
+    return (layout.m_intervalStart.size() == intervals);
+}
+
+bool MJPEGHelper::decompressBands(const uint8_t *jpeg, size_t bytes, 
+    uint8_t *outBuffer, int pixelFormat, WorkerPool *pool, tjscalingfactor scale,
+    bool &accepted)
+{
+    if (!parseLayout(jpeg, bytes, m_layout))
+    {
+        return false;
+    }
+
+    // A band can only start at a restart interval that
+    // begins at the start of an MCU row. Choose evenly
+    // spaced intervals from these, one band per thread.
+    const uint32_t mcusPerRow = (m_layout.m_width + m_layout.m_mcuWidth - 1) / m_layout.m_mcuWidth;
+    const uint32_t mcuRows    = (m_layout.m_height + m_layout.m_mcuHeight - 1) / m_layout.m_mcuHeight;
+    const uint32_t maxBands   = std::min(pool->getThreadCount() + 1, mcuRows);
+    const uint32_t intervals  = static_cast<uint32_t>(m_layout.m_intervalStart.size());
+
+    std::vector<uint32_t> bandInterval;    // first restart interval of each band
+    std::vector<uint32_t> bandMCURow;      // first MCU row of each band
+    bandInterval.push_back(0);
+    bandMCURow.push_back(0);
+    for(uint32_t i=1; (i<intervals) && (bandInterval.size() < maxBands); i++)
+    {
+        const uint64_t mcu = (uint64_t)i * m_layout.m_restartInterval;
+        if ((mcu % mcusPerRow) != 0)
+        {
+            continue;
+        }
+        const uint32_t mcuRow = static_cast<uint32_t>(mcu / mcusPerRow);
+        if (mcuRow * maxBands >= bandInterval.size() * mcuRows)
+        {
+            bandInterval.push_back(i);
+            bandMCURow.push_back(mcuRow);
+        }
+    }
+
+    const uint32_t bands = static_cast<uint32_t>(bandInterval.size());
+    if (bands < 2)
+    {
+        return false;
+    }
+
+    // Build a stand-alone JPEG for each band: the original
+    // headers with the image height reduced to the band, 
+    // followed by the restart intervals of the band with
+    // the restart markers renumbered from zero.
+
+    m_chunks.resize(bands);
+    for(uint32_t b=0; b<bands; b++)
+    {
+        const uint32_t firstInterval = bandInterval[b];
+        const uint32_t lastInterval  = (b+1 < bands) ? bandInterval[b+1] : intervals;
+        const uint32_t firstRow      = bandMCURow[b] * m_layout.m_mcuHeight;
+        const uint32_t lastRow       = (b+1 < bands) ? bandMCURow[b+1] * m_layout.m_mcuHeight : m_layout.m_height;
+        const uint32_t rows          = lastRow - firstRow;
+
+        std::vector<uint8_t> &chunk = m_chunks[b];
+        chunk.assign(jpeg, jpeg + m_layout.m_scanOffset);
+        chunk[m_layout.m_sofHeightOffset]   = static_cast<uint8_t>(rows >> 8);
+        chunk[m_layout.m_sofHeightOffset+1] = static_cast<uint8_t>(rows & 0xFF);
+        for(uint32_t i=firstInterval; i<lastInterval; i++)
+        {
+            if (i != firstInterval)
+            {
+                chunk.push_back(0xFF);
+                chunk.push_back(static_cast<uint8_t>(0xD0 + ((i - firstInterval - 1) & 7)));
+            }
+            chunk.insert(chunk.end(), jpeg + m_layout.m_intervalStart[i], jpeg + m_layout.m_intervalEnd[i]);
+        }
+        chunk.push_back(0xFF);
+        chunk.push_back(0xD9);  // EOI
+    }
+
+    // each band needs its own decompressor
+    while(m_chunkHandles.size() + 1 < bands)
+    {
+        tjhandle handle = createHandle();
+        if (handle == nullptr)
+        {
+            return false;
+        }
+        m_chunkHandles.push_back(handle);
+    }
+
+    // A band starts at a multiple of 8 rows, which the 
+    // scaled decoder turns into a whole number of rows.
+    const uint32_t pitch = TJSCALED(m_layout.m_width, scale) * tjPixelSize[pixelFormat];
+    std::atomic<bool> bandsAccepted(true);
+    pool->parallelFor(bands, [&](uint32_t b)
+    {
+        const uint32_t firstRow = bandMCURow[b] * m_layout.m_mcuHeight;
+        tjhandle handle = (b == 0) ? m_decompressHandle : m_chunkHandles[b-1];
+
+        // errors and warnings are handled like for a regular decode
+        tj3SetScalingFactor(handle, scale);
+        tj3Set(handle, TJPARAM_STOPONWARNING, (m_errorMode == CAPDECODEERRORS_WARNINGS) ? 1 : 0);
+        const int result = tj3Decompress8(handle, &m_chunks[b][0], m_chunks[b].size(), 
+            outBuffer + TJSCALED(firstRow, scale) * pitch, pitch, pixelFormat);
+        if (!acceptDecode(handle, result))
+        {
+            bandsAccepted = false;
+        }
+    });
+
+    accepted = bandsAccepted;
     return true;
-}
\ No newline at end of file
+}
@@ -33,30 +33,153 @@
 #include <turbojpeg.h>
 #include <stdint.h>
 #include <stdlib.h> // size_t
+#include <vector>
+#include "openpnp-capture.h"
+
+class WorkerPool;   // pre-declaration
 
 class MJPEGHelper
 {
 public:
-    MJPEGHelper()
+    MJPEGHelper() : m_errorMode(CAPDECODEERRORS_IGNORE)
     {
-        m_decompressHandle = tjInitDecompress();
+        m_decompressHandle = createHandle();
     }
 
     virtual ~MJPEGHelper()
     {
-        tjDestroy(m_decompressHandle);
+        tj3Destroy(m_decompressHandle);
+        for(size_t i=0; i<m_chunkHandles.size(); i++)
+        {
+            tj3Destroy(m_chunkHandles[i]);
+        }
+    }
+
+    /** Result of checkFrame */
+    enum FrameCheck
+    {
+        FRAME_COMPLETE = 0, ///< the frame looks decodable
+        FRAME_PARTIAL,      ///< the frame was cut off
+        FRAME_CORRUPT       ///< the frame is not a JPEG of the expected size
+    };
+
+    /** Check the structure of a JPEG before it is decoded,
+        without decoding anything: the start of image marker,
+        the marker segments up to the start of scan, which must
+        fit in 'bytes', the image size, if 'width' and 'height'
+        are not 0, and the end of image marker, which may be
+        followed by zero padding and a vendor trailer of up to
+        4 KiB. Only the headers and the end of the frame are
+        read. */
+    static FrameCheck checkFrame(const uint8_t *jpeg, size_t bytes, 
+        uint32_t width, uint32_t height);
+
+    /** Select which frames the decode functions reject when
+        the decoder reports a problem, CAPDECODEERRORS_xxx. 
+        With CAPDECODEERRORS_IGNORE they only fail when the 
+        header cannot be read. */
+    void setErrorMode(uint32_t mode)
+    {
+        m_errorMode = mode;
     }
 
     /** Decompress a JPEG contained in the buffer. 
-        The width and height of the output buffer are for
-        sanity checking only. If the JPEG does not match
-        the buffer size, the function will return false.
+        'jpegWidth' and 'jpegHeight' are for sanity checking
+        only. If the JPEG does not have this size, the function
+        will return false.
+
+        The JPEG is decoded at its size multiplied by 'scale', 
+        see TJSCALED. Scaling by 1/2, 1/4 or 1/8 happens while
+        the DCT coefficients are transformed, so a scaled 
+        decode takes considerably less time than a full one.
+        The output buffer must hold the scaled image.
+
+        'pixelFormat' is the turbojpeg pixel format (TJPF_xxx)
+        of the output buffer, such as TJPF_RGB or TJPF_GRAY.
+
+        When a worker pool is given and the JPEG contains
+        restart markers at the start of MCU rows, the image
+        is split at these markers into bands that are 
+        decoded in parallel.
+
+        Returns false if the frame cannot be decoded or the
+        decoder reported a problem that setErrorMode rejects.
     */
     bool decompressFrame(const uint8_t *inBuffer, size_t inBytes, 
-        uint8_t *outBuffer, uint32_t outBufWidth, uint32_t outButHeight);
+        uint8_t *outBuffer, uint32_t jpegWidth, uint32_t jpegHeight,
+        int pixelFormat = TJPF_RGB, WorkerPool *pool = nullptr, 
+        tjscalingfactor scale = TJUNSCALED);
+
+    /** Decompress only the region 'region' of a JPEG, given in
+        pixels of the image scaled by 'scale', into a compact 
+        buffer of region.w x region.h pixels. The decoder skips
+        the MCU rows above and below the region and the MCU 
+        columns left and right of it. The MCU columns around
+        the region are decoded into m_regionBuffer and the 
+        region is copied from there, so it matches the same 
+        pixels of a full decode.
+        The other parameters are as for decompressFrame.
+    */
+    bool decompressRegion(const uint8_t *inBuffer, size_t inBytes, 
+        uint8_t *outBuffer, uint32_t jpegWidth, uint32_t jpegHeight,
+        int pixelFormat, tjscalingfactor scale, const tjregion &region);
+
+    /** Decode a JPEG into an 8-bit luminance image of one eighth
+        of its width and height (rounded up). At this scale the 
+        decoder only uses the DC coefficient of each block, which
+        skips the inverse DCT and colour conversion. The image and
+        its size are returned in outBuffer, outWidth and outHeight.
+    */
+    bool decompressDC(const uint8_t *inBuffer, size_t inBytes, 
+        std::vector<uint8_t> &outBuffer, uint32_t &outWidth, uint32_t &outHeight);
 
 protected:
+    /** Layout of a baseline JPEG, as far as needed to 
+        split it into independently decodable bands */
+    struct JPEGLayout
+    {
+        size_t   m_sofHeightOffset;     ///< offset of the image height in the SOF segment
+        size_t   m_scanOffset;          ///< offset of the entropy coded data
+        uint32_t m_width;               ///< image width in pixels
+        uint32_t m_height;              ///< image height in pixels
+        uint32_t m_mcuWidth;            ///< MCU width in pixels
+        uint32_t m_mcuHeight;           ///< MCU height in pixels
+        uint32_t m_restartInterval;     ///< MCUs per restart interval
+        std::vector<size_t> m_intervalStart;    ///< offset of the first byte of each restart interval
+        std::vector<size_t> m_intervalEnd;      ///< offset past the last byte of each restart interval
+    };
+
+    /** parse the JPEG markers and locate the restart intervals.
+        returns false if the JPEG cannot be split. */
+    bool parseLayout(const uint8_t *jpeg, size_t bytes, JPEGLayout &layout);
+
+    /** decode the JPEG in bands using the worker pool.
+        returns false if the JPEG cannot be split. 'accepted'
+        is set to false if a band was rejected, see acceptDecode. */
+    bool decompressBands(const uint8_t *jpeg, size_t bytes, 
+        uint8_t *outBuffer, int pixelFormat, WorkerPool *pool, tjscalingfactor scale,
+        bool &accepted);
+
+    /** returns false if 'result' of tj3Decompress8 on 'handle' 
+        is an error or warning that m_errorMode rejects */
+    bool acceptDecode(tjhandle handle, int result) const;
+
+    /** create a decompressor handle that uses the fast DCT */
+    static tjhandle createHandle();
+
+    /** read the JPEG header into m_decompressHandle and check
+        the image size, then select the scaling factor and 
+        clear the cropping region for the next decode */
+    bool prepareDecode(const uint8_t *inBuffer, size_t inBytes, uint32_t jpegWidth, 
+        uint32_t jpegHeight, tjscalingfactor scale);
+
     tjhandle m_decompressHandle;  ///< decompressor handle
+    uint32_t m_errorMode;         ///< CAPDECODEERRORS_xxx
+
+    JPEGLayout m_layout;                            ///< layout of the most recent frame
+    std::vector<tjhandle> m_chunkHandles;           ///< additional decompressor handles, one per band
+    std::vector<std::vector<uint8_t> > m_chunks;    ///< stand-alone JPEGs containing one band each
+    std::vector<uint8_t> m_regionBuffer;            ///< MCU aligned region, see decompressRegion
 };
 
 #endif
@@ -30,7 +30,6 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <sys/ioctl.h>
 #include <string>
 #include <memory.h>
 #include <linux/videodev2.h>
@@ -38,6 +37,9 @@
 #include "../common/logging.h"
 #include "platformstream.h"
 #include "platformcontext.h"
+#include "capturereactor.h"
+#include "clientcontext.h"
+#include "v4l2device.h"
 
 // a platform factory function needed by
 // libmain.cpp
@@ -46,8 +48,22 @@ Context* createPlatformContext()
     return new PlatformContext();
 }
 
+// a factory function needed by libmain.cpp
+Context* createClientContext(const char *brokerName)
+{
+    Context *ctx = new ClientContext(brokerName);
+    if (ctx->getDeviceCount() == 0)
+    {
+        // the broker could not be reached
+        delete ctx;
+        return nullptr;
+    }
+    return ctx;
+}
+
 PlatformContext::PlatformContext() :
-    Context()
+    Context(),
+    m_captureReactor(nullptr)
 {
     LOG(LOG_DEBUG, "Context created\n");
     enumerateDevices();
@@ -55,6 +71,46 @@ PlatformContext::PlatformContext() :
 
 PlatformContext::~PlatformContext()
 {
+    // the streams must stop using the reactor first
+    closeAllStreams();
+    delete m_captureReactor;
+}
+
+CapResult PlatformContext::setOption(uint32_t optionID, int32_t value)
+{
+    if (optionID != CAPCTXOPT_CAPTURETHREADS)
+    {
+        return Context::setOption(optionID, value);
+    }
+
+    if ((value < 0) || (value > 64))
+    {
+        LOG(LOG_ERR, "setOption: invalid number of capture threads (%d)\n", value);
+        return CAPRESULT_ERR;
+    }
+    if (!m_streams.empty())
+    {
+        LOG(LOG_ERR, "setOption: capture threads cannot be changed while streams are open\n");
+        return CAPRESULT_ERR;
+    }
+    delete m_captureReactor;
+    m_captureReactor = nullptr;
+    if (value > 0)
+    {
+        m_captureReactor = new CaptureReactor(static_cast<uint32_t>(value));
+    }
+    return CAPRESULT_OK;
+}
+
+CapResult PlatformContext::getOption(uint32_t optionID, int32_t &outValue) const
+{
+    if (optionID != CAPCTXOPT_CAPTURETHREADS)
+    {
+        return Context::getOption(optionID, outValue);
+    }
+
+    outValue = (m_captureReactor != nullptr) ? static_cast<int32_t>(m_captureReactor->getThreadCount()) : 0;
+    return CAPRESULT_OK;
 }
 
 bool PlatformContext::enumerateDevices()
@@ -78,7 +134,7 @@ bool PlatformContext::enumerateDevices()
             continue;
         }
 
-        if (ioctl(fd, VIDIOC_QUERYCAP, &video_cap) == -1)
+        if (xioctl(fd, VIDIOC_QUERYCAP, &video_cap) == -1)
         {
             ::close(fd);
             LOG(LOG_ERR, "enumerateDevices: Can't get capabilities\n");
@@ -123,6 +179,7 @@ bool PlatformContext::enumerateDevices()
             platformDeviceInfo* dinfo = new platformDeviceInfo();
             dinfo->m_name = std::string((const char*)video_cap.card);
             dinfo->m_devicePath = std::string(fname);
+            dinfo->m_deviceCaps = video_cap.device_caps;
             dinfo->m_uniqueID = dinfo->m_name + " ";
             dinfo->m_uniqueID.append((const char*)video_cap.bus_info);
             
@@ -140,7 +197,7 @@ bool PlatformContext::enumerateDevices()
             {
                 fmtdesc.index = index;
             
-                if (ioctl(fd, VIDIOC_ENUM_FMT, &fmtdesc) == -1)
+                if (xioctl(fd, VIDIOC_ENUM_FMT, &fmtdesc) == -1)
                 {
                     tryMore = false;
                 }
@@ -151,16 +208,7 @@ bool PlatformContext::enumerateDevices()
 
                     // .. then we enumerate all the frame buffer sizes for that
                     // pixel format type.
-                    uint32_t frmindex = 0;
-                    CapFormatInfo cinfo;
-                    cinfo.fourcc = fmtdesc.pixelformat;
-                    while(queryFrameSize(fd, frmindex, fmtdesc.pixelformat, &cinfo.width, &cinfo.height))
-                    {
-                        frmindex++;
-                        cinfo.fps = findMaxFrameRate(fd, fmtdesc.pixelformat, cinfo.width, cinfo.height);
-                        dinfo->m_formats.push_back(cinfo);
-                        LOG(LOG_VERBOSE, "  %d x %d\n", cinfo.width, cinfo.height);
-                    }
+                    enumerateFrameSizes(fd, fmtdesc.pixelformat, dinfo->m_formats);
                 }
                 index++;
             }
@@ -172,59 +220,3 @@ bool PlatformContext::enumerateDevices()
     }
     return true;
 }
-
-
-bool PlatformContext::queryFrameSize(int fd, uint32_t index, uint32_t pixelformat, uint32_t *width, uint32_t *height)
-{
-    v4l2_frmsizeenum frmSize;
-    memset(&frmSize, 0, sizeof(frmSize));
-    frmSize.index = index;
-    frmSize.pixel_format = pixelformat;
-    if (ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &frmSize) != -1)
-    {
-        if (frmSize.type == V4L2_FRMSIZE_TYPE_DISCRETE)
-        {
-            *width  = frmSize.discrete.width;
-            *height = frmSize.discrete.height;
-        }
-        else
-        {
-            LOG(LOG_WARNING, "queryFrameSize returned non-discrete frame size!\n");
-            *width = 0;
-            *height = 0;
-        }
-
-        return true;
-    }
-    return false;
-}
-
-uint32_t PlatformContext::findMaxFrameRate(int fd, uint32_t pixelformat, 
-    uint32_t width, uint32_t height)
-{
-    uint32_t fps = 0;
-
-    // now search the frame rates
-    v4l2_frmivalenum ivals;
-    memset(&ivals, 0, sizeof(ivals));
-    ivals.pixel_format = pixelformat;
-    ivals.width = width;
-    ivals.height = height;
-    ivals.index = 0;
-    LOG(LOG_VERBOSE,"Finding max frame rates: \n");
-    while (ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &ivals) != -1)
-    {
-        if (ivals.type == V4L2_FRMIVAL_TYPE_DISCRETE)
-        {
-            LOG(LOG_VERBOSE,"  FPS %d/%d\n", ivals.discrete.denominator, ivals.discrete.numerator);
-            uint32_t v = ivals.discrete.denominator/ivals.discrete.numerator;
-            if (fps < v)
-            {
-                fps = v;
-            }
-        }
-        ivals.index++;
-    }
-
-    return fps;
-}
@@ -44,6 +44,8 @@
 #include "platformdeviceinfo.h"
 #include "../common/context.h"
 
+class CaptureReactor;   // pre-declaration
+
 /** context base class keeps track of all the platform independent
     objects and information */
 
@@ -60,16 +62,27 @@ public:
     PlatformContext();
     virtual ~PlatformContext();
 
-protected:
-    bool queryFrameSize(int fd, uint32_t index, uint32_t pixelformat, uint32_t *width, uint32_t *height);
+    /** Handles CAPCTXOPT_CAPTURETHREADS and passes other options
+        to the Context. */
+    virtual CapResult setOption(uint32_t optionID, int32_t value) override;
+    virtual CapResult getOption(uint32_t optionID, int32_t &outValue) const override;
 
-    uint32_t findMaxFrameRate(int fd, uint32_t pixelformat, uint32_t width, uint32_t height);
+    /** Return the reactor that services all streams of this 
+        context, or nullptr if each stream has its own capture
+        thread. The reactor does not change while streams are open. */
+    CaptureReactor* getCaptureReactor() const
+    {
+        return m_captureReactor;
+    }
 
+protected:
     /** Enumerate V4L capture devices and put their 
         information into the m_devices array 
     */
     virtual bool enumerateDevices();
 
+    CaptureReactor* m_captureReactor;   ///< shared capture threads or nullptr
+
 };
 
 #endif
\ No newline at end of file
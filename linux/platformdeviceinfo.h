@@ -38,7 +38,8 @@
 class platformDeviceInfo : public deviceInfo
 {
 public:
-    platformDeviceInfo() : deviceInfo() 
+    platformDeviceInfo() : deviceInfo(),
+        m_deviceCaps(0)
     {
 
     }
@@ -49,6 +50,7 @@ public:
     }
 
     std::string     m_devicePath;   ///< unique device path
+    uint32_t        m_deviceCaps;   ///< V4L2_CAP_xxx flags of the device
 };
 
 #endif
\ No newline at end of file
@@ -36,14 +36,26 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/mman.h>
+#include <stdlib.h>
 #include <memory.h>
 #include <string>
-#include "scopedptr.h"
+#include <algorithm>
+
+#if defined(__has_include)
+#if __has_include(<linux/dma-heap.h>)
+#include <linux/dma-heap.h>
+#include <linux/dma-buf.h>
+#define HAVE_DMA_HEAP
+#endif
+#endif
 
 #include "platformdeviceinfo.h"
 #include "platformstream.h"
+#include "capturereactor.h"
+#include "framebroker.h"
 #include "platformcontext.h"
 #include "yuvconverters.h"
+#include "v4l2device.h"
 
 #define CLEAR(x) memset(&(x), 0, sizeof(x))
 
@@ -52,24 +64,11 @@ Stream* createPlatformStream()
     return new PlatformStream();
 }
 
-int xioctl(int fh, int request, void *arg)
-{
-    int r;
-
-    do 
-    {
-        r = ioctl(fh, request, arg);
-    } while ((r == -1) && (errno == EINTR));
-
-    return r;
-}
-
-
 // **********************************************************************
 //   PlatformStreamHelper functions
 // **********************************************************************
 
-bool PlatformStreamHelper::createAndMapBuffers(uint32_t nBuffers)
+bool PlatformStreamHelper::createBuffers(uint32_t nBuffers, size_t bufferSize)
 {
     v4l2_requestbuffers req;
 
@@ -77,68 +76,208 @@ bool PlatformStreamHelper::createAndMapBuffers(uint32_t nBuffers)
 
     req.count  = nBuffers;
     req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req.memory = V4L2_MEMORY_MMAP;
+    req.memory = m_memory;
 
     if (xioctl(m_fd, VIDIOC_REQBUFS, &req) == -1) 
     {
-        LOG(LOG_ERR, "createAndMapBuffers failed - no memory mapping support.\n");
+        LOG(LOG_ERR, "createBuffers failed - I/O method %s not supported (errno=%d).\n", 
+            getMemoryName(m_memory), errno);
         return false;
     }
 
     if (req.count < 2) 
     {
-        LOG(LOG_ERR, "createAndMapBuffers: need more than 1 buffer.\n");
+        LOG(LOG_ERR, "createBuffers: need more than 1 buffer.\n");
         return false;
     }
 
-    LOG(LOG_DEBUG, "Reserving %d mmap buffers\n", req.count);
+    LOG(LOG_DEBUG, "Reserving %d %s buffers\n", req.count, getMemoryName(m_memory));
 
     m_buffers.resize(req.count);
-
     for (uint32_t b = 0; b < req.count; ++b) 
     {
-        v4l2_buffer buf;
-
-        CLEAR(buf);
+        m_buffers[b].start  = nullptr;
+        m_buffers[b].length = 0;
+        m_buffers[b].fd = -1;
+    }
 
-        buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory      = V4L2_MEMORY_MMAP;
-        buf.index       = b;
+    // buffers provided by the library are page aligned
+    // and a whole number of pages long.
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    bufferSize = ((bufferSize + pageSize - 1) / pageSize) * pageSize;
 
-        if (xioctl(m_fd, VIDIOC_QUERYBUF, &buf) == -1)
+    int heapFd = -1;
+#ifdef HAVE_DMA_HEAP
+    if (m_memory == V4L2_MEMORY_DMABUF)
+    {
+        heapFd = ::open("/dev/dma_heap/system", O_RDONLY | O_CLOEXEC);
+        if (heapFd < 0)
         {
-            LOG(LOG_ERR, "createAndMapBuffers: VIDIOC_QUERYBUF failed.\n");
+            LOG(LOG_ERR, "createBuffers: cannot open /dev/dma_heap/system (errno=%d)\n", errno);
             return false;
         }
+    }
+#endif
 
-        m_buffers[b].length = buf.length;
-        m_buffers[b].start  = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, 
-            MAP_SHARED, m_fd, buf.m.offset);
-
-        if (m_buffers[b].start == MAP_FAILED)
+    bool ok = true;
+    for (uint32_t b = 0; (b < req.count) && ok; ++b) 
+    {
+        bufferInfo &info = m_buffers[b];
+        switch(m_memory)
         {
-            LOG(LOG_ERR, "createAndMapBuffers: mmap failed.\n");
-            return false;
+        case V4L2_MEMORY_MMAP:
+            {
+                v4l2_buffer buf;
+                CLEAR(buf);
+                buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                buf.memory      = V4L2_MEMORY_MMAP;
+                buf.index       = b;
+
+                if (xioctl(m_fd, VIDIOC_QUERYBUF, &buf) == -1)
+                {
+                    LOG(LOG_ERR, "createBuffers: VIDIOC_QUERYBUF failed.\n");
+                    ok = false;
+                    break;
+                }
+
+                void *start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, 
+                    MAP_SHARED, m_fd, buf.m.offset);
+                if (start == MAP_FAILED)
+                {
+                    LOG(LOG_ERR, "createBuffers: mmap failed.\n");
+                    ok = false;
+                    break;
+                }
+                info.start  = start;
+                info.length = buf.length;
+            }
+            break;
+        case V4L2_MEMORY_USERPTR:
+            {
+                // user pointer buffers are backed by a memfd so
+                // the frames can be exported without copying.
+                info.fd = memfd_create("openpnp-capture-buffer", MFD_CLOEXEC);
+                if ((info.fd < 0) || (ftruncate(info.fd, bufferSize) == -1))
+                {
+                    LOG(LOG_ERR, "createBuffers: could not allocate %d bytes (errno=%d).\n", bufferSize, errno);
+                    ok = false;
+                    break;
+                }
+
+                void *start = mmap(NULL, bufferSize, PROT_READ | PROT_WRITE, MAP_SHARED, info.fd, 0);
+                if (start == MAP_FAILED)
+                {
+                    LOG(LOG_ERR, "createBuffers: mmap of user pointer buffer failed.\n");
+                    ok = false;
+                    break;
+                }
+                info.start  = start;
+                info.length = bufferSize;
+            }
+            break;
+        case V4L2_MEMORY_DMABUF:
+#ifdef HAVE_DMA_HEAP
+            {
+                dma_heap_allocation_data alloc;
+                CLEAR(alloc);
+                alloc.len = bufferSize;
+                alloc.fd_flags = O_RDWR | O_CLOEXEC;
+                if (xioctl(heapFd, DMA_HEAP_IOCTL_ALLOC, &alloc) == -1)
+                {
+                    LOG(LOG_ERR, "createBuffers: DMA heap allocation failed (errno=%d).\n", errno);
+                    ok = false;
+                    break;
+                }
+                info.fd = static_cast<int>(alloc.fd);
+
+                // map the buffer so the CPU can convert the frames
+                void *start = mmap(NULL, bufferSize, PROT_READ, MAP_SHARED, info.fd, 0);
+                if (start == MAP_FAILED)
+                {
+                    LOG(LOG_ERR, "createBuffers: mmap of DMA buffer failed.\n");
+                    ok = false;
+                    break;
+                }
+                info.start  = start;
+                info.length = bufferSize;
+            }
+#else
+            LOG(LOG_ERR, "createBuffers: DMA heaps are not supported by this build.\n");
+            ok = false;
+#endif
+            break;
+        default:
+            ok = false;
+            break;
         }
-        else
+
+        if (ok)
         {
-            LOG(LOG_DEBUG, "Created mmap buffer of %d bytes\n", buf.length);
+            LOG(LOG_DEBUG, "Created %s buffer of %d bytes\n", getMemoryName(m_memory), info.length);
         }
-
     }
 
-    return true;
+    if (heapFd >= 0)
+    {
+        ::close(heapFd);
+    }
+    return ok;
 }
 
-void PlatformStreamHelper::unmapAndDeleteBuffers()
+void PlatformStreamHelper::deleteBuffers()
 {
     for(uint32_t i=0; i<m_buffers.size(); i++)
     {
-        munmap(m_buffers[i].start, m_buffers[i].length);
+        bufferInfo &info = m_buffers[i];
+        if (info.start != nullptr)
+        {
+            munmap(info.start, info.length);
+        }
+
+        if (info.fd >= 0)
+        {
+            ::close(info.fd);
+        }
     }
 
     m_buffers.clear();
-    LOG(LOG_DEBUG, "Mmap buffers deleted\n");
+    LOG(LOG_DEBUG, "%s buffers deleted\n", getMemoryName(m_memory));
+}
+
+const char* PlatformStreamHelper::getMemoryName(uint32_t memory)
+{
+    switch(memory)
+    {
+    case V4L2_MEMORY_MMAP:
+        return "mmap";
+    case V4L2_MEMORY_USERPTR:
+        return "userptr";
+    case V4L2_MEMORY_DMABUF:
+        return "dmabuf";
+    default:
+        return "unknown";
+    }
+}
+
+void PlatformStreamHelper::initBuffer(v4l2_buffer &buf, uint32_t index) const
+{
+    CLEAR(buf);
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = m_memory;
+    buf.index = index;
+    if (index < m_buffers.size())
+    {
+        if (m_memory == V4L2_MEMORY_USERPTR)
+        {
+            buf.m.userptr = reinterpret_cast<unsigned long>(m_buffers[index].start);
+            buf.length    = m_buffers[index].length;
+        }
+        else if (m_memory == V4L2_MEMORY_DMABUF)
+        {
+            buf.m.fd      = m_buffers[index].fd;
+            buf.length    = m_buffers[index].length;
+        }
+    }
 }
 
 bool PlatformStreamHelper::queueAllBuffers()
@@ -147,25 +286,72 @@ bool PlatformStreamHelper::queueAllBuffers()
     // create queue buffers
     // ****************************************
 
-    v4l2_buf_type bufferType;
     for (uint32_t i = 0; i < m_buffers.size(); ++i)
     {        
-        v4l2_buffer   buf;
-
-        CLEAR(buf);
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = i;
-
-        if (xioctl(m_fd, VIDIOC_QBUF, &buf) == -1)
+        if (!queueBuffer(i))
         {
-            LOG(LOG_ERR,"VIDIOC_QBUF failed (errno=%d)\n", errno);
             return false;
         }
     }
     return true;
 }
 
+bool PlatformStreamHelper::queueBuffer(uint32_t index)
+{
+    v4l2_buffer buf;
+    initBuffer(buf, index);
+
+    if (xioctl(m_fd, VIDIOC_QBUF, &buf) == -1)
+    {
+        LOG(LOG_ERR,"VIDIOC_QBUF failed (errno=%d)\n", errno);
+        return false;
+    }
+    return true;
+}
+
+void PlatformStreamHelper::syncBuffer(uint32_t index, bool start)
+{
+#ifdef HAVE_DMA_HEAP
+    // the CPU caches must be brought up to date before
+    // reading a DMA buffer the device has written to.
+    if ((m_memory == V4L2_MEMORY_DMABUF) && (index < m_buffers.size()) && (m_buffers[index].fd >= 0))
+    {
+        dma_buf_sync sync;
+        sync.flags = DMA_BUF_SYNC_READ | (start ? DMA_BUF_SYNC_START : DMA_BUF_SYNC_END);
+        xioctl(m_buffers[index].fd, DMA_BUF_IOCTL_SYNC, &sync);
+    }
+#endif
+}
+
+int PlatformStreamHelper::exportBuffer(uint32_t index)
+{
+    if (index >= m_buffers.size())
+    {
+        return -1;
+    }
+
+    if (m_memory == V4L2_MEMORY_MMAP)
+    {
+        v4l2_exportbuffer expbuf;
+        CLEAR(expbuf);
+        expbuf.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        expbuf.index = index;
+        expbuf.flags = O_RDONLY | O_CLOEXEC;
+        if (xioctl(m_fd, VIDIOC_EXPBUF, &expbuf) == -1)
+        {
+            LOG(LOG_ERR, "exportBuffer: VIDIOC_EXPBUF failed (errno=%d).\n", errno);
+            return -1;
+        }
+        return expbuf.fd;
+    }
+
+    if (m_buffers[index].fd < 0)
+    {
+        return -1;
+    }
+    return fcntl(m_buffers[index].fd, F_DUPFD_CLOEXEC, 0);
+}
+
 bool PlatformStreamHelper::streamOn()
 {
     v4l2_buf_type bufferType = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -199,70 +385,18 @@ bool PlatformStreamHelper::streamOff()
 //   Capture thread/function
 // **********************************************************************
 
-void captureThreadFunction(PlatformStream *stream, int fd, size_t bufferSizeBytes)
-{
-    if (stream == nullptr)
-    {
-        return;
-    }
-
-    LOG(LOG_DEBUG, "capture thread running (deviceHandle = %08X) ...\n", fd);
-
-    // create local frame buffer
-    std::vector<uint8_t> buffer(bufferSizeBytes);
-
-    // FIXME: For now, weĺl just rely on the read to fail
-    // when the PlatformStream closes the file
-    // descriptor. This doesn't feel very professional,
-    // but it should work :)
-    while(!stream->getThreadQuitState())
-    {
-        ssize_t actualBytesRead = ::read(fd, &buffer[0], bufferSizeBytes);
-        if (actualBytesRead < 0)
-        {
-            LOG(LOG_DEBUG, "capture thread exited (errno %d).\n", errno);
-            return; //exit thread
-        }
-
-        // read will only return complete buffers
-        stream->threadSubmitBuffer(&buffer[0], actualBytesRead);
-        LOG(LOG_INFO, "yay\n");
-    }
-}
-
-
-
-void captureThreadFunctionAsync(PlatformStream *stream, int fd, size_t bufferSizeBytes)
+void captureThreadFunction(PlatformStream *stream)
 {
     //https://linuxtv.org/downloads/v4l-dvb-apis/uapi/v4l/capture.c.html
-    const uint32_t nBuffers = 8;
-    
     if (stream == nullptr)
     {
         return;
     }
 
-    LOG(LOG_DEBUG, "captureThreadFunctionAsync started\n");
-
-    PlatformStreamHelper *pHelper = new PlatformStreamHelper(fd);
-    ScopedPtr<PlatformStreamHelper> helper(pHelper);
-
-    if (!helper->createAndMapBuffers(nBuffers))
-    {
-        return;
-    }
-    
-    if (!helper->queueAllBuffers())
-    {
-        return;
-    }
-    
-    if (!helper->streamOn())
-    {
-        return;
-    }
+    LOG(LOG_DEBUG, "captureThreadFunction started\n");
 
-    while(!stream->getThreadQuitState())
+    const int fd = stream->getDeviceHandle();
+    while(stream->threadWaitForStreaming())
     {
         fd_set fds;
         struct timeval tv;
@@ -291,50 +425,17 @@ void captureThreadFunctionAsync(PlatformStream *stream, int fd, size_t bufferSiz
             return;
         }
 
-        // ****************************************
-        // read the frame
-        // ****************************************
-        v4l2_buffer buf;
-        CLEAR(buf);
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-
-        if (xioctl(fd, VIDIOC_DQBUF, &buf) == -1)
-        {
-            switch (errno) 
-            {
-            case EAGAIN:
-                LOG(LOG_DEBUG, "VIDIOC_DQBUF returned EAGAIN\n");
-                //FIXME: what to do here?!?
-                continue;
-
-            case EIO:
-                /* Could ignore EIO, see spec. */
-
-                /* fall through */
-
-            default:
-                LOG(LOG_ERR, "VIDIOC_DQBUF error\n");
-                return;
-            }
-        }
-
-        //assert(buf.index < nBuffers);
-        stream->threadSubmitBuffer(helper->getBufferPointer(buf.index), buf.bytesused);
-
-        // re-queue the buffer
-        if (xioctl(fd, VIDIOC_QBUF, &buf) == -1)
+        if (!stream->threadServiceBuffer())
         {
-            LOG(LOG_ERR, "VIDIOC_DQBUF error\n");
-            return;    
+            return;
         }
     } // while  
 
     // Note: the destruction of the PlatformHelper 
-    // by the scoped pointer will automatically
+    // by PlatformStream::close will automatically
     // turn off streaming and remove the
     // memory mapped buffers from the system.
-    LOG(LOG_DEBUG, "captureThreadFunctionAsync exited\n");
+    LOG(LOG_DEBUG, "captureThreadFunction exited\n");
 }
 
 // **********************************************************************
@@ -343,10 +444,27 @@ void captureThreadFunctionAsync(PlatformStream *stream, int fd, size_t bufferSiz
 
 PlatformStream::PlatformStream() : 
     Stream(),
+    m_deviceHandle(-1),
     m_quitThread(false),
-    m_helperThread(nullptr)
+    m_helperThread(nullptr),
+    m_streamHelper(nullptr),
+    m_reactor(nullptr),
+    m_broker(nullptr),
+    m_device(nullptr),
+    m_maxPinned(0),
+    m_decodeThread(nullptr),
+    m_firstBuffer(true),
+    m_lastDeviceSequence(0),
+    m_streaming(false),
+    m_warmupLeft(0),
+    m_triggerFrames(0),
+    m_serviceThread(std::thread::id()),
+    m_deferredStop(false),
+    m_retriggered(false),
+    m_roi(TJUNCROPPED)
 {
     CLEAR(m_fmt);
+    CLEAR(m_frameInfo);
 }
 
 PlatformStream::~PlatformStream()
@@ -358,11 +476,22 @@ void PlatformStream::close()
 {
     LOG(LOG_INFO, "closing stream\n");
 
-    m_owner = nullptr;
-    m_width = 0;
-    m_height = 0;
+    stopBroker();
+
     m_isOpen = false; 
-    m_quitThread = true;
+
+    {
+        // wake up a capture thread that waits for streaming
+        std::lock_guard<std::mutex> lock(m_streamingMutex);
+        m_quitThread = true;
+    }
+    m_streamingChanged.notify_all();
+
+    if (m_reactor != nullptr)
+    {
+        m_reactor->removeStream(this);
+        m_reactor = nullptr;
+    }
 
     if (m_helperThread != nullptr)
     {
@@ -373,8 +502,42 @@ void PlatformStream::close()
         m_helperThread = nullptr;
     }
 
-    m_frameBuffer.resize(0);
-    ::close(m_deviceHandle);
+    // no more frames are queued once the capture
+    // thread has stopped, the rest are dropped.
+    if (m_decodeThread != nullptr)
+    {
+        m_decodeQueue.close();
+        m_decodeThread->join();
+        delete m_decodeThread;
+        m_decodeThread = nullptr;
+        m_droppedFrames += static_cast<uint32_t>(m_decodeQueue.size());
+    }
+
+    // the capture, reactor and decode threads use the owner 
+    // and the frame size until they have stopped.
+    m_owner = nullptr;
+    m_width = 0;
+    m_height = 0;
+
+    // release the frame slots before the memory mapped
+    // buffers they might refer to are removed.
+    for(uint32_t i=0; i<m_framePool.getSlotCount(); i++)
+    {
+        freeSharedStorage(m_framePool.getSlot(i));
+    }
+    m_framePool.clear();
+
+    if (m_streamHelper != nullptr)
+    {
+        delete m_streamHelper;
+        m_streamHelper = nullptr;
+    }
+    m_streaming = false;
+
+    if (m_deviceHandle >= 0)
+    {
+        ::close(m_deviceHandle);
+    }
 
     m_deviceHandle = -1;    
 }
@@ -412,7 +575,10 @@ bool PlatformStream::open(Context *owner, deviceInfo *device, uint32_t width, ui
     }
 
     m_owner = owner;
+    m_device = dinfo;
     m_frames = 0;
+    m_cursor.m_lastReadFrame = 0;
+    m_firstBuffer = true;
     m_width = 0;
     m_height = 0;    
 
@@ -438,7 +604,43 @@ bool PlatformStream::open(Context *owner, deviceInfo *device, uint32_t width, ui
     m_fmt.fmt.pix.sizeimage = 0;        // only set be the driver
     m_fmt.fmt.pix.priv = 0; 
 
-    if (xioctl(m_deviceHandle, VIDIOC_S_FMT, &m_fmt) == -1)
+    // let the camera crop and bin the sensor, if requested,
+    // so it only sends the pixels that are needed.
+    bool windowSet = false;
+    StreamOptions &options = m_openOptions;
+    if (((options.m_cropWidth != 0) && (options.m_cropHeight != 0)) || (options.m_binning > 1))
+    {
+        v4l2_rect crop;
+        crop.left   = static_cast<int32_t>(options.m_cropX);
+        crop.top    = static_cast<int32_t>(options.m_cropY);
+        crop.width  = options.m_cropWidth;
+        crop.height = options.m_cropHeight;
+        windowSet = setSensorWindow(m_deviceHandle, crop, options.m_binning, m_fmt);
+        if (windowSet)
+        {
+            options.m_cropX      = static_cast<uint32_t>(std::max(crop.left, 0));
+            options.m_cropY      = static_cast<uint32_t>(std::max(crop.top, 0));
+            options.m_cropWidth  = crop.width;
+            options.m_cropHeight = crop.height;
+            options.m_binning    = (m_fmt.fmt.pix.width != 0) ? std::max(1u, crop.width / m_fmt.fmt.pix.width) : 1;
+        }
+        else
+        {
+            LOG(LOG_WARNING, "The camera cannot crop its sensor, capturing the full frame\n");
+            m_fmt.fmt.pix.width  = width;
+            m_fmt.fmt.pix.height = height;
+        }
+    }
+    if (!windowSet)
+    {
+        options.m_cropX      = 0;
+        options.m_cropY      = 0;
+        options.m_cropWidth  = 0;
+        options.m_cropHeight = 0;
+        options.m_binning    = 1;
+    }
+
+    if (!windowSet && (xioctl(m_deviceHandle, VIDIOC_S_FMT, &m_fmt) == -1))
     {
         LOG(LOG_CRIT, "Could set the frame buffer format (errno = %d)\n", errno);
         close();
@@ -484,25 +686,68 @@ bool PlatformStream::open(Context *owner, deviceInfo *device, uint32_t width, ui
         return false;
     }    
 
-    // set the (max) size of the frame buffer in Stream class
+    // allocate the frame slots in Stream class
     //
     // Note: we only support 24-bit per pixel RGB
     // buffers for now!
-    m_frameBuffer.resize(m_width*m_height*3);
+    m_framePool.init(getFrameSlotCount(), m_openOptions.m_historyFrames);
+    m_mjpegHelper.setErrorMode(m_openOptions.m_decodeErrors);
+    m_lazyMJPEGHelper.setErrorMode(m_openOptions.m_decodeErrors);
+
+    // Frames are decoded on a thread of their own unless they
+    // are decoded when they are read, or the capture thread 
+    // must publish them itself to count the triggered frames.
+    if (m_openOptions.m_lazyConversion || m_openOptions.m_triggerMode)
+    {
+        m_openOptions.m_decodeQueue = 0;
+    }
+    if (m_openOptions.m_decodeQueue > 0)
+    {
+        m_decodeQueue.init(m_openOptions.m_decodeQueue);
+        m_decodeThread = new std::thread(&PlatformStream::threadDecodeFrames, this);
+    }
 
     m_isOpen = true;
 
     // create the helper thread to read from the device
     m_quitThread = false;
 
-    // for now, assume we always have streaming driver support
-#ifdef __V4L2_NO_STREAMNING_SUPPORT
-    m_helperThread = new std::thread(&captureThreadFunction, this,
-        m_deviceHandle, m_width*m_height*4);
-#else
-    m_helperThread = new std::thread(&captureThreadFunctionAsync, this,
-        m_deviceHandle, m_width*m_height*4);
-#endif
+    if (!selectIOMethod(dinfo->m_deviceCaps))
+    {
+        close();
+        return false;
+    }
+
+    if (m_openOptions.m_ioMethod != CAPIOMETHOD_READ)
+    {
+        m_streamHelper = new PlatformStreamHelper(m_deviceHandle, toV4L2Memory(m_openOptions.m_ioMethod));
+    }
+
+    if (!threadStartCapture())
+    {
+        LOG(LOG_ERR, "Could not start capturing\n");
+        close();
+        return false;
+    }
+
+    // use the shared reactor threads of the context, if 
+    // there are any, instead of a thread for this stream.
+    PlatformContext *context = dynamic_cast<PlatformContext*>(owner);
+    CaptureReactor *reactor = (context != nullptr) ? context->getCaptureReactor() : nullptr;
+    if (reactor != nullptr)
+    {
+        if (!reactor->addStream(this, m_deviceHandle))
+        {
+            LOG(LOG_ERR, "Could not start capturing\n");
+            close();
+            return false;
+        }
+        m_reactor = reactor;
+    }
+    else
+    {
+        m_helperThread = new std::thread(&captureThreadFunction, this);
+    }
 
     return true;
 }
@@ -528,75 +773,1132 @@ V4L2_PIX_FMT_SBGGR8  BA81
 
 //#define FRAMEDUMP
 
-void PlatformStream::threadSubmitBuffer(void *ptr, size_t bytes)
+/** returns true if the V4L2 pixel format is a compressed format */
+static bool isCompressedFormat(uint32_t pixelformat)
+{
+    return (pixelformat == V4L2_PIX_FMT_MJPEG) || (pixelformat == V4L2_PIX_FMT_JPEG);
+}
+
+/** translate an output format to the layout of the YUV converters */
+static PixelLayout toPixelLayout(uint32_t fourcc)
+{
+    switch(fourcc)
+    {
+    case CAPFOURCC_BGR24:
+        return PIXEL_LAYOUT_BGR24;
+    case CAPFOURCC_RGBA32:
+        return PIXEL_LAYOUT_RGBA32;
+    default:
+        return PIXEL_LAYOUT_RGB24;
+    }
+}
+
+/** translate an output format to a turbojpeg pixel format */
+static int toTurboJPEGFormat(uint32_t fourcc)
+{
+    switch(fourcc)
+    {
+    case CAPFOURCC_BGR24:
+        return TJPF_BGR;
+    case CAPFOURCC_RGBA32:
+        return TJPF_RGBA;
+    case CAPFOURCC_GRAY8:
+        return TJPF_GRAY;
+    default:
+        return TJPF_RGB;
+    }
+}
+
+bool PlatformStream::setOutputFormat(uint32_t fourcc)
+{
+    switch(fourcc)
+    {
+    case CAPFOURCC_RGB24:
+    case CAPFOURCC_BGR24:
+    case CAPFOURCC_RGBA32:
+    case CAPFOURCC_GRAY8:
+    case CAPFOURCC_NATIVE:
+        m_outputFormat = fourcc;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool PlatformStream::threadSubmitPlatformBuffer(void *ptr, size_t bytes, uint32_t index, uint32_t maxPinned)
 {
-    if (ptr != nullptr) 
+    if ((ptr == nullptr) || (bytes == 0))
     {
-        switch(m_fmt.fmt.pix.pixelformat)
+        return false;
+    }
+
+    // frames can only be handed out as-is when 
+    // no conversion is needed
+    const uint32_t output = m_outputFormat.load();
+    const uint32_t pixelformat = m_fmt.fmt.pix.pixelformat;
+    uint32_t stride = 0;
+    tjregion region;
+    if (output == CAPFOURCC_NATIVE)
+    {
+        stride = isCompressedFormat(pixelformat) ? 0 : m_fmt.fmt.pix.bytesperline;
+    }
+    else if ((output == CAPFOURCC_RGB24) && (pixelformat == V4L2_PIX_FMT_RGB24) && !getFrameRegion(region))
+    {
+        stride = m_fmt.fmt.pix.bytesperline;
+        if (stride < m_width*3)
         {
-        case V4L2_PIX_FMT_RGB24:
-            Stream::submitBuffer((uint8_t*)ptr, bytes);
-            break;
-        case V4L2_PIX_FMT_YUYV:
-            // here we implement our own ::submitBuffer replacement
-            // so we can decode the 16-bit YUYV frames and copy the 24-bit
-            // RGB pixels into m_frameBuffer
-            m_bufferMutex.lock();
-            YUYV2RGB((const uint8_t*)ptr, &m_frameBuffer[0], bytes);
-            m_newFrame = true;
-            m_frames++;
-            m_bufferMutex.unlock();
-            break;            
-        case V4L2_PIX_FMT_NV12:
-            // NV12 to RGB conversion
-            // NV12 has 1.5 bytes per pixel (12 bits), RGB has 3 bytes per pixel
-            m_bufferMutex.lock();
-            NV122RGB((const uint8_t*)ptr, &m_frameBuffer[0], m_width, m_height);
-            m_newFrame = true;
-            m_frames++;
-            m_bufferMutex.unlock();
-            break;
-        case V4L2_PIX_FMT_YUV420:
-            // YU12 to RGB conversion
-            // YU12 has 1.5 bytes per pixel (12 bits), RGB has 3 bytes per pixel
-            m_bufferMutex.lock();
-            YU122RGB((const uint8_t*)ptr, &m_frameBuffer[0], m_width, m_height);
-            m_newFrame = true;
-            m_frames++;
-            m_bufferMutex.unlock();
-            break;
-        case 0x47504A4D:    // MJPG
-            #ifdef FRAMEDUMP
-            {
-                static int32_t fcnt = 0;
-                char fname[100];
-                if (fcnt < 10)
-                {
-                    sprintf(fname,"frame_%d.dat", fcnt++);
-                    FILE *fout = fopen(fname, "wb");
-                    fwrite(ptr, 1, bytes, fout);
-                    fclose(fout);
-                }
-            }
-            #endif        
+            stride = m_width*3;
+        }
 
-            // here we implement our own ::submitBuffer replacement
-            // so we can decode the MJEG frames and copy the 24-bit
-            // RGB pixels into m_frameBuffer
-            m_bufferMutex.lock();
-            if (m_mjpegHelper.decompressFrame((uint8_t*)ptr, bytes, &m_frameBuffer[0], m_width, m_height))
-            {
-                m_newFrame = true; 
-                m_frames++;
-            }
-            m_bufferMutex.unlock();
-            break;
-        default:
-            LOG(LOG_DEBUG, "ThreadSubmitBuffer: unsupported format %s (%08X)\n", fourCCToString(m_fmt.fmt.pix.pixelformat).c_str(),
-                m_fmt.fmt.pix.pixelformat);
-            break;
-        }        
+        if ((m_height == 0) || (bytes < (stride*(m_height-1) + m_width*3)))
+        {
+            return false;   // incomplete frame, let the regular path handle it
+        }
     }
+    else
+    {
+        return false;
+    }
+
+    if (m_framePool.externalCount() >= maxPinned)
+    {
+        return false;
+    }
+
+    FrameSlot *slot = m_framePool.beginWrite();
+    if (slot == nullptr)
+    {
+        return false;
+    }
+
+    slot->m_data   = (const uint8_t*)ptr;
+    slot->m_bytes  = bytes;
+    slot->m_width  = m_width;
+    slot->m_height = m_height;
+    slot->m_stride = stride;
+    slot->m_fourcc = (output == CAPFOURCC_NATIVE) ? pixelformat : CAPFOURCC_RGB24;
+    slot->m_externalIndex = static_cast<int32_t>(index);
+    commitFrame(slot);
+    return true;
+}
+
+bool PlatformStream::selectIOMethod(uint32_t deviceCaps)
+{
+    const bool streaming = (deviceCaps & V4L2_CAP_STREAMING) != 0;
+    const bool readwrite = (deviceCaps & V4L2_CAP_READWRITE) != 0;
+
+    uint32_t method = m_openOptions.m_ioMethod;
+    if (method == CAPIOMETHOD_AUTO)
+    {
+        method = streaming ? CAPIOMETHOD_MMAP : CAPIOMETHOD_READ;
+    }
+
+    if (((method == CAPIOMETHOD_READ) && !readwrite) || 
+        ((method != CAPIOMETHOD_READ) && !streaming))
+    {
+        LOG(LOG_ERR, "The device does not support I/O method %d\n", method);
+        return false;
+    }
+
+    LOG(LOG_INFO, "I/O method = %s\n", (method == CAPIOMETHOD_READ) ? "read" : 
+        PlatformStreamHelper::getMemoryName(toV4L2Memory(method)));
+
+    m_openOptions.m_ioMethod = method;
+    return true;
+}
+
+uint32_t PlatformStream::toV4L2Memory(uint32_t ioMethod)
+{
+    switch(ioMethod)
+    {
+    case CAPIOMETHOD_USERPTR:
+        return V4L2_MEMORY_USERPTR;
+    case CAPIOMETHOD_DMABUF:
+        return V4L2_MEMORY_DMABUF;
+    default:
+        return V4L2_MEMORY_MMAP;
+    }
+}
+
+bool PlatformStream::threadStartCapture()
+{
+    // the driver reports the largest possible frame size
+    size_t frameBytes = m_fmt.fmt.pix.sizeimage;
+    if (frameBytes == 0)
+    {
+        frameBytes = m_width*m_height*4;
+    }
+
+    if (m_streamHelper == nullptr)
+    {
+        // read() needs no set-up, the driver 
+        // starts capturing on the first read.
+        m_readBuffer.resize(frameBytes);
+    }
+    else
+    {
+        const uint32_t nBuffers = m_openOptions.m_bufferCount;
+        if (!m_streamHelper->createBuffers(nBuffers, frameBytes))
+        {
+            return false;
+        }
+
+        // always leave at least two buffers with the driver
+        // when frames are handed out without copying.
+        m_maxPinned = static_cast<uint32_t>(m_streamHelper->m_buffers.size()) - 2;
+    }
+
+    // in trigger mode the buffers stay allocated, but the
+    // device only streams when frames are requested.
+    m_triggerFrames = 0;
+    return m_openOptions.m_triggerMode || m_openOptions.m_startPaused || startStreaming();
+}
+
+bool PlatformStream::startStreaming()
+{
+    if (isServiceThread())
+    {
+        // the device is streaming while the callback runs,
+        // only a pause from the same callback is undone.
+        m_deferredStop = false;
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_streamingMutex);
+        if (m_streaming)
+        {
+            return true;
+        }
+
+        if (m_streamHelper != nullptr)
+        {
+            // STREAMOFF hands all buffers back, so queue all
+            // of them except the ones still held as frames.
+            m_reclaimed.clear();
+            threadReclaimPlatformBuffers(m_reclaimed);
+            std::vector<bool> held(m_streamHelper->m_buffers.size(), false);
+            for(uint32_t i=0; i<m_framePool.getSlotCount(); i++)
+            {
+                const int32_t index = m_framePool.getSlot(i)->m_externalIndex;
+                if ((index >= 0) && (static_cast<size_t>(index) < held.size()))
+                {
+                    held[index] = true;
+                }
+            }
+
+            for(uint32_t i=0; i<held.size(); i++)
+            {
+                if (!held[i] && !m_streamHelper->queueBuffer(i))
+                {
+                    return false;
+                }
+            }
+
+            if (!m_streamHelper->streamOn())
+            {
+                return false;
+            }
+        }
+
+        // the driver restarts its sequence numbers
+        m_firstBuffer = true;
+        m_warmupLeft  = m_openOptions.m_warmupFrames;
+        recordStart();
+        m_streaming = true;
+    }
+
+    m_streamingChanged.notify_all();
+    if (m_reactor != nullptr)
+    {
+        m_reactor->resumeStream(this);
+    }
+    return true;
+}
+
+bool PlatformStream::stopStreamingLocked()
+{
+    if (!m_streaming)
+    {
+        return true;
+    }
+
+    m_streaming = false;
+    return (m_streamHelper == nullptr) || m_streamHelper->streamOff();
+}
+
+bool PlatformStream::triggerCapture(uint32_t frames)
+{
+    if (!m_isOpen || !m_openOptions.m_triggerMode)
+    {
+        LOG(LOG_ERR, "triggerCapture: the stream was not opened in trigger mode\n");
+        return false;
+    }
+
+    if (isServiceThread())
+    {
+        // the lock is held by this thread, the burst starts
+        // after the frame that is being published.
+        m_triggerFrames = frames;
+        m_retriggered = true;
+        m_deferredStop = false;
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_streamingMutex);
+        m_triggerFrames = frames;
+    }
+    return startStreaming();
+}
+
+bool PlatformStream::pause()
+{
+    if (!m_isOpen)
+    {
+        LOG(LOG_ERR, "pause: the stream is not open\n");
+        return false;
+    }
+
+    if (isServiceThread())
+    {
+        // the lock is held by this thread, streaming stops
+        // once the frame has been published.
+        m_triggerFrames = 0;
+        m_deferredStop = true;
+        return true;
+    }
+
+    // a capture thread waiting for the device wakes up
+    // and then waits for streaming to start again.
+    std::lock_guard<std::mutex> lock(m_streamingMutex);
+    m_triggerFrames = 0;
+    return stopStreamingLocked();
+}
+
+bool PlatformStream::resume()
+{
+    if (!m_isOpen)
+    {
+        LOG(LOG_ERR, "resume: the stream is not open\n");
+        return false;
+    }
+
+    if (m_openOptions.m_triggerMode)
+    {
+        LOG(LOG_ERR, "resume: use triggerCapture to start a stream in trigger mode\n");
+        return false;
+    }
+    return startStreaming();
+}
+
+bool PlatformStream::threadWaitForStreaming()
+{
+    std::unique_lock<std::mutex> lock(m_streamingMutex);
+    m_streamingChanged.wait(lock, [this]{ return m_streaming.load() || m_quitThread; });
+    return !m_quitThread;
+}
+
+bool PlatformStream::threadAcceptFrame(const void *frame, size_t bytes, bool corrupt)
+{
+    if (m_warmupLeft > 0)
+    {
+        m_warmupLeft--;
+        recordWarmupFrame();
+        return false;
+    }
+
+    // a triggered burst only publishes complete frames,
+    // the ones the device could not deliver are dropped.
+    if (m_openOptions.m_triggerMode && (corrupt || (bytes == 0)))
+    {
+        m_droppedFrames++;
+        return false;
+    }
+
+    // a damaged (M)JPEG frame is dropped before it costs a
+    // decode, or is handed to the application as-is.
+    if (isCompressedFormat(m_fmt.fmt.pix.pixelformat))
+    {
+        const MJPEGHelper::FrameCheck check = MJPEGHelper::checkFrame(
+            static_cast<const uint8_t*>(frame), bytes, m_width, m_height);
+        if (check != MJPEGHelper::FRAME_COMPLETE)
+        {
+            LOG(LOG_VERBOSE, "Dropped a %s JPEG frame of %d bytes\n", 
+                (check == MJPEGHelper::FRAME_PARTIAL) ? "truncated" : "corrupt", bytes);
+            recordCorruptFrame(check == MJPEGHelper::FRAME_PARTIAL);
+            m_droppedFrames++;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PlatformStream::threadReadFrame()
+{
+    // read() returns one complete frame per call
+    ssize_t bytes = ::read(m_deviceHandle, &m_readBuffer[0], m_readBuffer.size());
+    if (bytes < 0)
+    {
+        if ((errno == EAGAIN) || (errno == EINTR))
+        {
+            return true;
+        }
+        LOG(LOG_ERR, "read failed (errno=%d)\n", errno);
+        return false;
+    }
+
+    if (!threadAcceptFrame(&m_readBuffer[0], static_cast<size_t>(bytes), false))
+    {
+        return true;
+    }
+
+    // the driver does not report frame information, so
+    // only the library's own timestamp is available.
+    CLEAR(m_frameInfo);
+    threadDeliverFrame(&m_readBuffer[0], static_cast<size_t>(bytes), -1);
+    return true;
+}
+
+bool PlatformStream::threadServiceBuffer()
+{
+    std::lock_guard<std::mutex> lock(m_streamingMutex);
+    if (!m_streaming)
+    {
+        // streaming stopped while the thread waited for
+        // the device, there is nothing to dequeue.
+        return true;
+    }
+
+    // The frame callback runs on this thread with the lock
+    // held. Pausing or triggering the stream from it is
+    // recorded and applied below instead of taking the lock.
+    const uint32_t frames = m_frames.load();
+    m_deferredStop = false;
+    m_retriggered  = false;
+    m_serviceThread = std::this_thread::get_id();
+    const bool ok = (m_streamHelper != nullptr) ? threadDequeueBuffer() : threadReadFrame();
+    m_serviceThread = std::thread::id();
+
+    // in trigger mode, stop streaming once the requested
+    // number of frames has been published. A burst that was
+    // triggered while the frame was published starts after it.
+    bool stop = m_deferredStop;
+    if (ok && m_openOptions.m_triggerMode && !m_retriggered && (m_frames.load() != frames) && 
+        (m_triggerFrames > 0) && (--m_triggerFrames == 0))
+    {
+        stop = true;
+    }
+
+    if (stop)
+    {
+        return stopStreamingLocked() && ok;
+    }
+    return ok;
+}
+
+bool PlatformStream::threadDequeueBuffer()
+{
+    const int fd = m_deviceHandle;
+
+    // ****************************************
+    // read the frame
+    // ****************************************
+    v4l2_buffer buf;
+    CLEAR(buf);
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = m_streamHelper->m_memory;
+
+    if (xioctl(fd, VIDIOC_DQBUF, &buf) == -1)
+    {
+        switch (errno) 
+        {
+        case EAGAIN:
+            LOG(LOG_DEBUG, "VIDIOC_DQBUF returned EAGAIN\n");
+            //FIXME: what to do here?!?
+            return true;
+
+        case EIO:
+            /* Could ignore EIO, see spec. */
+
+            /* fall through */
+
+        default:
+            LOG(LOG_ERR, "VIDIOC_DQBUF error\n");
+            return false;
+        }
+    }
+
+    if (m_openOptions.m_latestOnly)
+    {
+        // Drain the queue: as long as the driver has newer 
+        // frames, hand the older buffer back without decoding 
+        // it. The descriptor is non-blocking, so DQBUF fails 
+        // with EAGAIN when no more frames are waiting. The 
+        // skipped frames show up as a sequence gap and are 
+        // counted as dropped.
+        v4l2_buffer next;
+        while(true)
+        {
+            CLEAR(next);
+            next.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            next.memory = m_streamHelper->m_memory;
+            if (xioctl(fd, VIDIOC_DQBUF, &next) == -1)
+            {
+                break;
+            }
+
+            if (xioctl(fd, VIDIOC_QBUF, &buf) == -1)
+            {
+                LOG(LOG_ERR, "VIDIOC_QBUF error\n");
+                return false;
+            }
+            buf = next;
+        }
+    }
+
+    threadSetFrameInfo(buf);
+    void *bufferPtr = m_streamHelper->getBufferPointer(buf.index);
+    m_streamHelper->syncBuffer(buf.index, true);
+    const bool held = threadAcceptFrame(bufferPtr, buf.bytesused, (buf.flags & V4L2_BUF_FLAG_ERROR) != 0) &&
+        threadDeliverFrame(bufferPtr, buf.bytesused, static_cast<int32_t>(buf.index));
+    m_streamHelper->syncBuffer(buf.index, false);
+
+    // re-queue the buffer, unless it is held as a frame
+    if (!held && (xioctl(fd, VIDIOC_QBUF, &buf) == -1))
+    {
+        LOG(LOG_ERR, "VIDIOC_QBUF error\n");
+        return false;
+    }
+
+    // re-queue the buffers that were handed out without
+    // copying and are no longer in use.
+    m_reclaimed.clear();
+    threadReclaimPlatformBuffers(m_reclaimed);
+    for(uint32_t i=0; i<m_reclaimed.size(); i++)
+    {
+        if (!m_streamHelper->queueBuffer(m_reclaimed[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PlatformStream::threadSetFrameInfo(const v4l2_buffer &buf)
+{
+    // the driver increments the sequence number for every
+    // frame, including the ones it could not deliver.
+    const uint32_t gap = buf.sequence - m_lastDeviceSequence - 1;
+    if ((!m_firstBuffer) && (gap != 0) && (gap < 0x80000000))
+    {
+        m_droppedFrames += gap;
+    }
+    m_firstBuffer = false;
+    m_lastDeviceSequence = buf.sequence;
+
+    // monotonic V4L2 timestamps use CLOCK_MONOTONIC, like
+    // std::chrono::steady_clock, so no conversion is needed.
+    uint32_t flags = 0;
+    const uint64_t timestamp = static_cast<uint64_t>(buf.timestamp.tv_sec)*1000000 + buf.timestamp.tv_usec;
+    if (((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) && (timestamp != 0))
+    {
+        flags |= CAPFRAMEFLAG_DEVICETIMESTAMP;
+    }
+    if ((buf.flags & V4L2_BUF_FLAG_ERROR) != 0)
+    {
+        flags |= CAPFRAMEFLAG_ERROR;
+    }
+
+    m_frameInfo.m_timestamp   = timestamp;
+    m_frameInfo.m_sequence    = buf.sequence;
+    m_frameInfo.m_flags       = flags;
+    m_frameInfo.m_deviceFlags = buf.flags;
+}
+
+void PlatformStream::threadReclaimPlatformBuffers(std::vector<int32_t> &indices)
+{
+    m_framePool.reclaimExternal(indices);
+}
+
+bool PlatformStream::startBroker(const char *name)
+{
+    if (!m_isOpen || (m_device == nullptr))
+    {
+        LOG(LOG_ERR, "startBroker: stream is not open\n");
+        return false;
+    }
+
+    stopBroker();
+
+    CapFormatInfo format;
+    format.width  = m_width;
+    format.height = m_height;
+    format.fourcc = m_fmt.fmt.pix.pixelformat;
+    format.fps    = 0;
+    format.bpp    = 0;
+    for(auto const &f : m_device->m_formats)
+    {
+        if ((f.width == format.width) && (f.height == format.height) && (f.fourcc == format.fourcc))
+        {
+            format = f;
+            break;
+        }
+    }
+
+    // room for the largest output layout or a native frame
+    const size_t maxFrameBytes = std::max(static_cast<size_t>(m_width*m_height*4), 
+        static_cast<size_t>(m_fmt.fmt.pix.sizeimage));
+
+    FrameBroker *broker = new FrameBroker();
+    if (!broker->start(name, m_device->m_name, m_device->m_uniqueID, format, maxFrameBytes))
+    {
+        delete broker;
+        return false;
+    }
+
+    m_broker = broker;
+    setFrameSink(m_broker);
+    return true;
+}
+
+void PlatformStream::stopBroker()
+{
+    if (m_broker != nullptr)
+    {
+        // waits until the capture thread has left the broker
+        setFrameSink(nullptr);
+        delete m_broker;
+        m_broker = nullptr;
+    }
+}
+
+bool PlatformStream::exportFrame(const CapFrameLease *lease, CapFrameExport *exportInfo)
+{
+    if ((lease == nullptr) || (exportInfo == nullptr))
+    {
+        return false;
+    }
+
+    // the slot cannot change while the caller holds a lease
+    FrameSlot *slot = m_framePool.getSlot(lease->leaseID);
+    if ((slot == nullptr) || (slot->m_leases.load() == 0))
+    {
+        LOG(LOG_ERR, "exportFrame: frame is not leased\n");
+        return false;
+    }
+
+    ensureConverted(slot);
+
+    int fd = -1;
+    const uint8_t *base = nullptr;
+    size_t size = 0;
+    if ((slot->m_externalIndex >= 0) && (m_streamHelper != nullptr))
+    {
+        const uint32_t index = static_cast<uint32_t>(slot->m_externalIndex);
+        fd   = m_streamHelper->exportBuffer(index);
+        base = static_cast<const uint8_t*>(m_streamHelper->getBufferPointer(index));
+        size = m_streamHelper->m_buffers[index].length;
+        exportInfo->type = (m_streamHelper->m_memory == V4L2_MEMORY_USERPTR) ? CAPEXPORT_MEMFD : CAPEXPORT_DMABUF;
+    }
+    else if (slot->m_storageFd >= 0)
+    {
+        fd   = fcntl(slot->m_storageFd, F_DUPFD_CLOEXEC, 0);
+        base = slot->m_storage;
+        size = slot->m_storageSize;
+        exportInfo->type = CAPEXPORT_MEMFD;
+    }
+    else
+    {
+        LOG(LOG_ERR, "exportFrame: frame is not in shared memory, open the stream with CAPSTREAMOPT_EXPORTFRAMES\n");
+        return false;
+    }
+
+    if (fd < 0)
+    {
+        LOG(LOG_ERR, "exportFrame: could not export frame %d\n", slot->m_sequence);
+        return false;
+    }
+
+    exportInfo->fd     = fd;
+    exportInfo->offset = static_cast<uint32_t>(slot->m_data - base);
+    exportInfo->size   = static_cast<uint32_t>(size);
+    return true;
+}
+
+bool PlatformStream::allocateSharedStorage(FrameSlot *slot, size_t bytes)
+{
+    if ((slot->m_storageFd >= 0) && (slot->m_storageSize >= bytes))
+    {
+        return true;
+    }
+
+    freeSharedStorage(slot);
+
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t size = std::max(pageSize, ((bytes + pageSize - 1) / pageSize) * pageSize);
+    int fd = memfd_create("openpnp-capture-frame", MFD_CLOEXEC);
+    if ((fd < 0) || (ftruncate(fd, size) == -1))
+    {
+        LOG(LOG_ERR, "allocateSharedStorage: could not allocate %d bytes (errno=%d)\n", size, errno);
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+
+    void *storage = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (storage == MAP_FAILED)
+    {
+        LOG(LOG_ERR, "allocateSharedStorage: mmap failed (errno=%d)\n", errno);
+        ::close(fd);
+        return false;
+    }
+
+    slot->m_storage     = static_cast<uint8_t*>(storage);
+    slot->m_storageFd   = fd;
+    slot->m_storageSize = size;
+    return true;
+}
+
+void PlatformStream::freeSharedStorage(FrameSlot *slot)
+{
+    if ((slot == nullptr) || (slot->m_storageFd < 0))
+    {
+        return;
+    }
+
+    munmap(slot->m_storage, slot->m_storageSize);
+    ::close(slot->m_storageFd);
+    slot->m_storage     = nullptr;
+    slot->m_storageFd   = -1;
+    slot->m_storageSize = 0;
+}
+
+bool PlatformStream::threadDeliverFrame(void *ptr, size_t bytes, int32_t index)
+{
+    // A frame that needs no conversion skips the decode queue
+    // unless older frames are still waiting in it. The publish
+    // lock keeps the frame pool to one producer; when the 
+    // decode thread holds it, a frame is in flight anyway.
+    std::unique_lock<std::mutex> lock(m_publishMutex, std::defer_lock);
+    if ((m_decodeThread != nullptr) && 
+        (!isPassThrough() || !lock.try_lock() || (m_decodeQueue.size() != 0)))
+    {
+        if (lock.owns_lock())
+        {
+            lock.unlock();
+        }
+        return threadQueueFrame(ptr, bytes);
+    }
+
+    setDeviceFrameInfo(m_frameInfo.m_timestamp, m_frameInfo.m_sequence, 
+        m_frameInfo.m_flags, m_frameInfo.m_deviceFlags);
+    if ((index >= 0) && threadSubmitPlatformBuffer(ptr, bytes, static_cast<uint32_t>(index), m_maxPinned))
+    {
+        return true;
+    }
+    threadSubmitBuffer(ptr, bytes);
+    return false;
+}
+
+bool PlatformStream::isPassThrough()
+{
+    const uint32_t output = m_outputFormat.load();
+    if (output == CAPFOURCC_NATIVE)
+    {
+        return true;
+    }
+
+    tjregion region;
+    return (output == CAPFOURCC_RGB24) && (m_fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_RGB24) && 
+        !getFrameRegion(region);
+}
+
+bool PlatformStream::threadQueueFrame(const void *ptr, size_t bytes)
+{
+    // Copy the frame so the driver gets its buffer back right
+    // away. A compressed frame is small compared to the time
+    // it takes to decode it. When the decode thread falls 
+    // behind, the new frame is dropped rather than waiting.
+    QueuedFrame *frame = m_decodeQueue.beginPush();
+    if (frame == nullptr)
+    {
+        LOG(LOG_VERBOSE, "Decode queue full, frame dropped\n");
+        m_droppedFrames++;
+        return false;
+    }
+
+    if (frame->m_buffer.size() < bytes)
+    {
+        frame->m_buffer.resize(bytes);
+    }
+    if (bytes != 0)
+    {
+        memcpy(&frame->m_buffer[0], ptr, bytes);
+    }
+    frame->m_bytes = bytes;
+    frame->m_info  = m_frameInfo;
+    m_decodeQueue.commitPush();
+    return false;
+}
+
+void PlatformStream::threadDecodeFrames()
+{
+    LOG(LOG_DEBUG, "decode thread started\n");
+
+    QueuedFrame *frame;
+    while((frame = m_decodeQueue.waitFront()) != nullptr)
+    {
+        // in latest-only mode the older frames that waited
+        // behind a newer one are skipped, like the driver 
+        // buffers are skipped by threadDequeueBuffer.
+        if (m_openOptions.m_latestOnly && (m_decodeQueue.size() > 1))
+        {
+            m_decodeQueue.pop();
+            m_droppedFrames++;
+            continue;
+        }
+
+        // the frame leaves the queue only once it has been
+        // published, see threadDeliverFrame.
+        std::lock_guard<std::mutex> lock(m_publishMutex);
+        setDeviceFrameInfo(frame->m_info.m_timestamp, frame->m_info.m_sequence, 
+            frame->m_info.m_flags, frame->m_info.m_deviceFlags);
+        threadSubmitBuffer(frame->m_buffer.data(), frame->m_bytes);
+        m_decodeQueue.pop();
+    }
+
+    LOG(LOG_DEBUG, "decode thread exited\n");
+}
+
+void PlatformStream::threadSubmitBuffer(void *ptr, size_t bytes)
+{
+    if (ptr == nullptr) 
+    {
+        return;
+    }
+
+    const uint32_t output = m_outputFormat.load();
+    const uint32_t pixelformat = m_fmt.fmt.pix.pixelformat;
+    FrameSlot *slot = nullptr;
+
+    if (output == CAPFOURCC_NATIVE)
+    {
+        // copy the frame as delivered by the camera
+        if (bytes != 0)
+        {
+            slot = beginFrame(pixelformat, isCompressedFormat(pixelformat) ? 0 : m_fmt.fmt.pix.bytesperline, bytes);
+            if (slot != nullptr)
+            {
+                memcpy(slot->m_storage, ptr, bytes);
+                commitFrame(slot);
+            }
+        }
+        return;
+    }
+
+    const uint8_t *src = (const uint8_t*)ptr;
+    tjregion region;
+    const bool cropped = getFrameRegion(region);
+    if ((pixelformat == V4L2_PIX_FMT_RGB24) && (output == CAPFOURCC_RGB24) && !cropped)
+    {
+        Stream::submitBuffer(src, bytes);
+        return;
+    }
+
+    slot = beginFrame(output, 0, 0, region.w, region.h);
+    if (slot == nullptr)
+    {
+        return;
+    }
+    slot->m_roiX = region.x;
+    slot->m_roiY = region.y;
+
+    if (m_openOptions.m_lazyConversion)
+    {
+        // keep the camera frame, it is converted by 
+        // convertPendingFrame when it is read.
+        slot->m_rawBuffer.assign(src, src + bytes);
+        slot->m_pending = true;
+        commitFrame(slot);
+        return;
+    }
+
+    if (convertFrame(src, bytes, slot, m_mjpegHelper))
+    {
+        commitFrame(slot);
+    }
+    else
+    {
+        abortFrame(slot);
+    }
+}
+
+bool PlatformStream::convertPendingFrame(FrameSlot *slot)
+{
+    if (slot->m_rawBuffer.empty())
+    {
+        return false;
+    }
+    return convertFrame(&slot->m_rawBuffer[0], slot->m_rawBuffer.size(), slot, m_lazyMJPEGHelper);
+}
+
+bool PlatformStream::computeNativeSignature(const uint8_t *frame, size_t bytes, LumaSignature &signature)
+{
+    const uint32_t pixelformat = m_fmt.fmt.pix.pixelformat;
+    const uint32_t stride = m_fmt.fmt.pix.bytesperline;
+    switch(pixelformat)
+    {
+    case V4L2_PIX_FMT_RGB24:
+        if (bytes < (size_t)m_width*m_height*3)
+        {
+            return false;
+        }
+        return signature.fromFrame(frame, m_width, m_height, std::max(stride, m_width*3), CAPFOURCC_RGB24);
+    case V4L2_PIX_FMT_YUYV:
+        if (bytes < (size_t)m_width*m_height*2)
+        {
+            return false;
+        }
+        return signature.fromLuma(frame, m_width, m_height, std::max(stride, m_width*2), 2);
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_YUV420:
+        // the full resolution Y plane comes first
+        if (bytes < (size_t)m_width*m_height)
+        {
+            return false;
+        }
+        return signature.fromLuma(frame, m_width, m_height, m_width);
+    case V4L2_PIX_FMT_MJPEG:
+    case V4L2_PIX_FMT_JPEG:
+    {
+        // each DC coefficient is the average of an 8x8 block,
+        // which is all the detail a signature needs.
+        uint32_t width, height;
+        if (!m_mjpegHelper.decompressDC(frame, bytes, m_dcBuffer, width, height))
+        {
+            return false;
+        }
+        return signature.fromLuma(&m_dcBuffer[0], width, height, width);
+    }
+    default:
+        return false;
+    }
+}
+
+tjscalingfactor PlatformStream::getDecodeScale() const
+{
+    if (!isCompressedFormat(m_fmt.fmt.pix.pixelformat))
+    {
+        return TJUNSCALED;
+    }
+
+    const tjscalingfactor scale = {1, static_cast<int>(m_openOptions.m_decodeScale)};
+    return scale;
+}
+
+bool PlatformStream::getFrameRegion(tjregion &region)
+{
+    std::lock_guard<std::mutex> lock(m_roiMutex);
+    if ((m_roi.w != 0) && (m_roi.h != 0))
+    {
+        region = m_roi;
+        return true;
+    }
+
+    const tjscalingfactor scale = getDecodeScale();
+    region.x = 0;
+    region.y = 0;
+    region.w = TJSCALED(static_cast<int>(m_width), scale);
+    region.h = TJSCALED(static_cast<int>(m_height), scale);
+    return false;
+}
+
+bool PlatformStream::setROI(uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+    if (!m_isOpen)
+    {
+        LOG(LOG_ERR, "setROI: the stream is not open\n");
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_roiMutex);
+    if ((width == 0) || (height == 0))
+    {
+        m_roi = TJUNCROPPED;
+        return true;
+    }
+
+    const tjscalingfactor scale = getDecodeScale();
+    const uint32_t frameWidth  = TJSCALED(static_cast<int>(m_width), scale);
+    const uint32_t frameHeight = TJSCALED(static_cast<int>(m_height), scale);
+    if ((x >= frameWidth) || (width > frameWidth - x) || (y >= frameHeight) || (height > frameHeight - y))
+    {
+        LOG(LOG_ERR, "setROI: the region does not fit in the %d x %d frame\n", frameWidth, frameHeight);
+        return false;
+    }
+
+    // YUV pixels come in pairs that share their chroma
+    const uint32_t pixelformat = m_fmt.fmt.pix.pixelformat;
+    if (((pixelformat == V4L2_PIX_FMT_YUYV) || (pixelformat == V4L2_PIX_FMT_NV12) || 
+        (pixelformat == V4L2_PIX_FMT_YUV420)) && (((x | width) & 1) != 0))
+    {
+        LOG(LOG_ERR, "setROI: x and width must be even for YUV frames\n");
+        return false;
+    }
+
+    m_roi.x = static_cast<int>(x);
+    m_roi.y = static_cast<int>(y);
+    m_roi.w = static_cast<int>(width);
+    m_roi.h = static_cast<int>(height);
+    return true;
+}
+
+bool PlatformStream::convertFrame(const uint8_t *src, size_t bytes, FrameSlot *slot, MJPEGHelper &mjpegHelper)
+{
+    // the converters write the output layout directly
+    const uint32_t output = slot->m_fourcc;
+    const uint32_t pixelformat = m_fmt.fmt.pix.pixelformat;
+    const PixelLayout layout = toPixelLayout(output);
+    const bool gray = (output == CAPFOURCC_GRAY8);
+    uint8_t *dst = slot->m_storage;
+
+    // the slot holds the region of the frame that is converted
+    const uint32_t x = slot->m_roiX;
+    const uint32_t y = slot->m_roiY;
+    const uint32_t columns = slot->m_width;
+    const tjscalingfactor scale = getDecodeScale();
+    const bool cropped = (columns != TJSCALED(m_width, scale)) || (slot->m_height != TJSCALED(m_height, scale));
+
+    switch(pixelformat)
+    {
+    case V4L2_PIX_FMT_RGB24:
+    {
+        // rows can be padded to bytesperline
+        const size_t srcStride = std::max<uint32_t>(m_fmt.fmt.pix.bytesperline, m_width*3);
+        convertRowBands(slot->m_height, 1, [&](uint32_t firstRow, uint32_t lastRow)
+        {
+            for(uint32_t row=firstRow; row<lastRow; row++)
+            {
+                // the driver might deliver a short frame
+                const size_t firstByte = (size_t)(y + row) * srcStride + x*3;
+                const size_t lastByte  = std::min(bytes, firstByte + columns*3);
+                const size_t pixels = (firstByte < lastByte) ? (lastByte - firstByte) / 3 : 0;
+                if (pixels == 0)
+                {
+                    break;
+                }
+                if (gray)
+                {
+                    RGB2GRAY(src + firstByte, dst + row*slot->m_stride, pixels);
+                }
+                else
+                {
+                    RGB2Layout(src + firstByte, dst + row*slot->m_stride, pixels, layout);
+                }
+            }
+        });
+        return true;
+    }
+    case V4L2_PIX_FMT_YUYV:
+    {
+        // decode the 16-bit YUYV frames directly
+        // into the frame slot, rows can be padded
+        const size_t srcStride = std::max<uint32_t>(m_fmt.fmt.pix.bytesperline, m_width*2);
+        convertRowBands(slot->m_height, 1, [&](uint32_t firstRow, uint32_t lastRow)
+        {
+            for(uint32_t row=firstRow; row<lastRow; row++)
+            {
+                // the driver might deliver a short frame
+                const size_t firstByte = (size_t)(y + row) * srcStride + x*2;
+                const size_t lastByte  = std::min(bytes, firstByte + columns*2);
+                if (firstByte >= lastByte)
+                {
+                    break;
+                }
+                if (gray)
+                {
+                    YUYV2GRAY(src + firstByte, dst + row*slot->m_stride, lastByte - firstByte);
+                }
+                else
+                {
+                    YUYV2RGB(src + firstByte, dst + row*slot->m_stride, lastByte - firstByte, layout);
+                }
+            }
+        });
+        return true;
+    }
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_YUV420:
+        // NV12 and YU12 to RGB conversion
+        // both have 1.5 bytes per pixel (12 bits) with a full
+        // resolution luminance plane followed by the chroma
+        if (bytes < (size_t)m_width*m_height*3/2)
+        {
+            return false;
+        }
+        convertRowBands(slot->m_height, 2, [&](uint32_t firstRow, uint32_t lastRow)
+        {
+            if (gray)
+            {
+                for(uint32_t row=firstRow; row<lastRow; row++)
+                {
+                    memcpy(dst + row*columns, src + (y + row)*m_width + x, columns);
+                }
+            }
+            else if (pixelformat == V4L2_PIX_FMT_NV12)
+            {
+                NV122RGBRegion(src, dst, m_width, m_height, x, y, columns, firstRow, lastRow, layout);
+            }
+            else
+            {
+                YU122RGBRegion(src, dst, m_width, m_height, x, y, columns, firstRow, lastRow, layout);
+            }
+        });
+        return true;
+    case 0x47504A4D:    // MJPG
+        #ifdef FRAMEDUMP
+        {
+            static int32_t fcnt = 0;
+            char fname[100];
+            if (fcnt < 10)
+            {
+                sprintf(fname,"frame_%d.dat", fcnt++);
+                FILE *fout = fopen(fname, "wb");
+                fwrite(src, 1, bytes, fout);
+                fclose(fout);
+            }
+        }
+        #endif        
+
+        // decode the MJPEG frames directly 
+        // into the frame slot
+        if (cropped)
+        {
+            tjregion region;
+            region.x = static_cast<int>(x);
+            region.y = static_cast<int>(y);
+            region.w = static_cast<int>(columns);
+            region.h = static_cast<int>(slot->m_height);
+            if (!mjpegHelper.decompressRegion(src, bytes, dst, m_width, m_height,
+                toTurboJPEGFormat(output), scale, region))
+            {
+                recordCorruptFrame(false);
+                return false;
+            }
+        }
+        else if (!mjpegHelper.decompressFrame(src, bytes, dst, m_width, m_height,
+            toTurboJPEGFormat(output), (m_owner != nullptr) ? m_owner->getWorkerPool() : nullptr,
+            scale))
+        {
+            recordCorruptFrame(false);
+            return false;
+        }
+        return true;
+    default:
+        LOG(LOG_DEBUG, "convertFrame: unsupported format %s (%08X)\n", fourCCToString(pixelformat).c_str(),
+            pixelformat);
+        return false;
+    }        
 }
 
 bool PlatformStream::setFrameRate(uint32_t fps)
@@ -33,24 +33,34 @@
 
 #include <stdint.h>
 #include <vector>
+#include <atomic>
 #include <mutex>
 #include <thread>
+#include <condition_variable>
 #include <linux/videodev2.h>
 #include "../common/logging.h"
 #include "../common/stream.h"
 #include "mjpeghelper.h"
+#include "decodequeue.h"
 
 
 class Context;          // pre-declaration
-class PlatformStream;  // pre-declaration
+class PlatformStream;   // pre-declaration
+class CaptureReactor;   // pre-declaration
+class FrameBroker;      // pre-declaration
+class platformDeviceInfo;   // pre-declaration
 
 
 /** A helper class to take care of allocation and
-    de-allocation of memory mapped V4L2 buffers */
+    de-allocation of V4L2 streaming buffers. Depending on
+    the memory type, the buffers are memory mapped driver
+    buffers (V4L2_MEMORY_MMAP), memfd backed library buffers
+    (V4L2_MEMORY_USERPTR) or DMA heap buffers imported by 
+    the driver (V4L2_MEMORY_DMABUF). */
 class PlatformStreamHelper
 {
 public:
-    PlatformStreamHelper(int fd) : m_fd(fd)
+    PlatformStreamHelper(int fd, uint32_t memory) : m_fd(fd), m_memory(memory)
     {
         LOG(LOG_DEBUG, "PlatformStreamHelper created.\n");
     }
@@ -60,20 +70,39 @@ public:
         if (m_buffers.size() != 0)
         {
             streamOff();
-            unmapAndDeleteBuffers();
+            deleteBuffers();
         }
         LOG(LOG_DEBUG, "PlatformStreamHelper deleted.\n");
     }
 
-    /** remove the memory mapped buffers from the system */
-    void unmapAndDeleteBuffers();
+    /** remove the buffers from the system */
+    void deleteBuffers();
 
-    /** create a number of memory mapped buffers */
-    bool createAndMapBuffers(uint32_t nBuffers);
+    /** create a number of buffers. 'bufferSize' is the size 
+        of the buffers the library allocates, memory mapped 
+        buffers are sized by the driver. */
+    bool createBuffers(uint32_t nBuffers, size_t bufferSize);
+
+    /** fill in a v4l2_buffer to queue the buffer with a certain index */
+    void initBuffer(v4l2_buffer &buf, uint32_t index) const;
+
+    /** start (true) or end (false) CPU access to a DMA buffer */
+    void syncBuffer(uint32_t index, bool start);
+
+    /** Return a new file descriptor for the buffer with a 
+        certain index, or -1 if it cannot be exported. Memory 
+        mapped driver buffers are exported with VIDIOC_EXPBUF. */
+    int exportBuffer(uint32_t index);
+
+    /** return a name for a V4L2 memory type */
+    static const char* getMemoryName(uint32_t memory);
 
     /** queue all the buffer for use by V4L2 */
     bool queueAllBuffers();
 
+    /** hand a single buffer back to V4L2 */
+    bool queueBuffer(uint32_t index);
+
     /** tell V4L2 to start frame capturing */
     bool streamOn();
 
@@ -98,10 +127,12 @@ public:
     {
         void*   start;      // pointer to start of buffer
         size_t  length;     // length of buffer in bytes
+        int     fd;         // DMA buffer or memfd file descriptor or -1
     };
 
     std::vector<bufferInfo> m_buffers;
     int m_fd; 
+    uint32_t m_memory;      ///< V4L2_MEMORY_xxx
 };
 
 
@@ -134,6 +165,52 @@ public:
 
     virtual bool setFrameRate(uint32_t fps) override;
 
+    /** Select the pixel layout of the frames handed to the 
+        application. Supports RGB24, BGR24, RGBA32, GRAY8 and
+        native frames. */
+    virtual bool setOutputFormat(uint32_t fourcc) override;
+
+    /** Convert only a region of the frames. The region is in
+        pixels of the decoded frames and, for YUV formats, x and
+        width must be even so no chroma pair is split. */
+    virtual bool setROI(uint32_t x, uint32_t y, uint32_t width, uint32_t height) override;
+
+    /** return the V4L2 device handle */
+    int getDeviceHandle() const
+    {
+        return m_deviceHandle;
+    }
+
+    /** called on open to create the V4L2 buffers and, unless
+        the stream is in trigger mode, start streaming. */
+    bool threadStartCapture();
+
+    /** called by the capture thread or a capture reactor thread
+        when the device is readable, to dequeue, submit and 
+        re-queue a buffer, or to read a frame when the read()
+        I/O method is used. Returns false after a device error. */
+    bool threadServiceBuffer();
+
+    /** called by the capture thread to wait until the device
+        is streaming. Returns false if the thread should quit. */
+    bool threadWaitForStreaming();
+
+    /** returns true while the device is streaming */
+    bool isStreaming() const
+    {
+        return m_streaming.load();
+    }
+
+    /** Start streaming until 'frames' frames have been 
+        published, on a stream opened in trigger mode */
+    virtual bool triggerCapture(uint32_t frames) override;
+
+    /** Stop streaming, keeping the device and its buffers */
+    virtual bool pause() override;
+
+    /** Start streaming again after pause() */
+    virtual bool resume() override;
+
     /** called by the capture thread/function to query if it
         should quit */
     bool getThreadQuitState() const
@@ -146,12 +223,148 @@ public:
         conversion to RGB output buffers, if necessary */
     void threadSubmitBuffer(void *ptr, size_t bytes);
 
+    /** called by the capture thread to publish a V4L2 buffer
+        as a frame without copying it. This is only possible
+        when no conversion is needed (RGB24 or native output)
+        and less than 'maxPinned' buffers are already held. Returns true if the buffer 
+        is now held by the stream; it must not be re-queued 
+        until it is returned by threadReclaimPlatformBuffers. */
+    bool threadSubmitPlatformBuffer(void *ptr, size_t bytes, uint32_t index, uint32_t maxPinned);
+
+    /** called by the capture thread with each dequeued V4L2 
+        buffer, before it is submitted, to record the 
+        timestamp, sequence number and flags of the frame
+        in m_frameInfo */
+    void threadSetFrameInfo(const v4l2_buffer &buf);
+
+    /** called by the capture thread to pass on a frame the
+        device delivered: copy it into the decode queue, or 
+        publish the V4L2 buffer 'index' without copying, or 
+        convert it. 'index' is -1 for frames read with read().
+        Returns true if the buffer is now held by the stream,
+        see threadSubmitPlatformBuffer. */
+    bool threadDeliverFrame(void *ptr, size_t bytes, int32_t index);
+
+    /** Returns true if the frames are published as delivered
+        by the device, in which case they bypass the decode queue */
+    bool isPassThrough();
+
+    /** called by the capture thread to copy a frame into
+        m_decodeQueue. Always returns false. */
+    bool threadQueueFrame(const void *ptr, size_t bytes);
+
+    /** the decode thread: converts and publishes the frames
+        in m_decodeQueue until the queue is closed */
+    void threadDecodeFrames();
+
+    /** share the frames with client contexts through a FrameBroker */
+    virtual bool startBroker(const char *name) override;
+
+    /** stop the FrameBroker, if any */
+    virtual void stopBroker() override;
+
+    /** export a leased frame as a dmabuf or memfd file descriptor */
+    virtual bool exportFrame(const CapFrameLease *lease, CapFrameExport *exportInfo) override;
+
+    /** called by the capture thread to collect the indices of
+        V4L2 buffers that are no longer held and can be re-queued */
+    void threadReclaimPlatformBuffers(std::vector<int32_t> &indices);
+
 protected:
+    /** resolve the CAPIOMETHOD_xxx open option against the 
+        capabilities of the device. Returns false if the device
+        does not support the requested method. */
+    bool selectIOMethod(uint32_t deviceCaps);
+
+    /** translate a streaming CAPIOMETHOD_xxx to a V4L2_MEMORY_xxx type */
+    static uint32_t toV4L2Memory(uint32_t ioMethod);
+
+    /** read and submit a frame using read() */
+    bool threadReadFrame();
+
+    /** dequeue, submit and re-queue a V4L2 buffer */
+    bool threadDequeueBuffer();
+
+    /** Returns false if a frame the device delivered must be
+        discarded: while warming up after streaming started,
+        in trigger mode when the frame is incomplete, and for
+        MJPEG frames that fail MJPEGHelper::checkFrame. */
+    bool threadAcceptFrame(const void *frame, size_t bytes, bool corrupt);
+
+    /** queue the V4L2 buffers that are not held as frames and
+        start streaming, unless the device is already streaming */
+    bool startStreaming();
+
+    /** stop streaming, m_streamingMutex must be held */
+    bool stopStreamingLocked();
+
+    /** Returns true if called from a frame callback or sink
+        that threadServiceBuffer runs with m_streamingMutex 
+        held. Changes to the streaming state are then deferred
+        until the buffer has been serviced. */
+    bool isServiceThread() const
+    {
+        return m_serviceThread.load() == std::this_thread::get_id();
+    }
+
+    /** back a slot with a memfd so its frames can be exported */
+    virtual bool allocateSharedStorage(FrameSlot *slot, size_t bytes) override;
+
+    /** unmap and close the memfd of a slot, if any */
+    void freeSharedStorage(FrameSlot *slot);
+
+    /** convert a frame kept by the lazy conversion mode */
+    virtual bool convertPendingFrame(FrameSlot *slot) override;
+
+    /** sample the luminance of a YUV, RGB or MJPEG camera frame */
+    virtual bool computeNativeSignature(const uint8_t *frame, size_t bytes, LumaSignature &signature) override;
+
+    /** return the factor compressed camera frames are scaled
+        by when they are decoded */
+    tjscalingfactor getDecodeScale() const;
+
+    /** return the part of the decoded frame that is converted,
+        the region of interest or the full frame. Returns true 
+        if a region of interest is set. */
+    bool getFrameRegion(tjregion &region);
+
+    /** convert or decode a camera frame into a slot obtained 
+        by beginFrame, using the output layout of the slot. 
+        Returns false if the frame could not be converted. */
+    bool convertFrame(const uint8_t *src, size_t bytes, FrameSlot *slot, MJPEGHelper &mjpegHelper);
+
     int         m_deviceHandle;     ///< V4L2 device handle
     v4l2_format m_fmt;              ///< V4L2 frame format
     bool        m_quitThread;       ///< if true, captureThreadFunction should return
     std::thread *m_helperThread;    ///< helper object threading control
+    PlatformStreamHelper *m_streamHelper;   ///< V4L2 streaming buffers or nullptr for read()
+    std::vector<uint8_t> m_readBuffer;  ///< frame buffer for the read() I/O method
+    CaptureReactor *m_reactor;      ///< reactor servicing this stream instead of m_helperThread, or nullptr
+    FrameBroker *m_broker;          ///< broker sharing the frames with other processes, or nullptr
+    const platformDeviceInfo *m_device; ///< the device the stream was opened on, owned by the context
+    uint32_t    m_maxPinned;        ///< maximum number of V4L2 buffers handed out without copying
+    std::vector<int32_t> m_reclaimed;   ///< V4L2 buffers to re-queue, used by threadServiceBuffer
     MJPEGHelper m_mjpegHelper;      ///< helper to convert MJPEG stream to RGB
+    MJPEGHelper m_lazyMJPEGHelper;  ///< MJPEG helper used by the consumers in lazy conversion mode
+    std::vector<uint8_t> m_dcBuffer;    ///< DC image of the most recent MJPEG frame, used for signatures
+    DeviceFrameInfo m_frameInfo;    ///< device information of the frame being dequeued
+    DecodeQueue m_decodeQueue;      ///< frames waiting for m_decodeThread
+    std::thread *m_decodeThread;    ///< thread decoding the frames in m_decodeQueue, or nullptr
+    std::mutex  m_publishMutex;     ///< held while publishing a frame when m_decodeThread runs
+    bool        m_firstBuffer;      ///< true until the first V4L2 buffer has been dequeued
+    uint32_t    m_lastDeviceSequence;   ///< sequence number of the previous V4L2 buffer
+
+    std::mutex  m_streamingMutex;   ///< held while a buffer is serviced and while streaming starts or stops
+    std::condition_variable m_streamingChanged; ///< signalled when streaming starts or the thread must quit
+    std::atomic<bool> m_streaming;  ///< true while the device is streaming
+    uint32_t    m_warmupLeft;       ///< number of frames still to discard after streaming started
+    uint32_t    m_triggerFrames;    ///< number of frames still to publish in trigger mode
+    std::atomic<std::thread::id> m_serviceThread;   ///< thread servicing a buffer with m_streamingMutex held
+    bool        m_deferredStop;     ///< a frame callback paused the stream, see threadServiceBuffer
+    bool        m_retriggered;      ///< a frame callback started a new burst, see threadServiceBuffer
+
+    std::mutex  m_roiMutex;         ///< protects m_roi
+    tjregion    m_roi;              ///< region of interest in decoded pixels, w and h are 0 for the full frame
 };
 
 #endif
\ No newline at end of file
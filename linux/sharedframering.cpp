@@ -0,0 +1,371 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux shared-memory frame ring used to share the
+    frames of a stream with other processes.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <stddef.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "../common/logging.h"
+#include "../common/framepool.h"
+#include "sharedframering.h"
+
+static long futex(std::atomic<uint32_t> *word, int op, uint32_t value, const timespec *timeout)
+{
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), op, value, timeout, nullptr, 0);
+}
+
+SharedFrameRing::SharedFrameRing() :
+    m_fd(-1),
+    m_base(nullptr),
+    m_size(0),
+    m_header(nullptr),
+    m_slotCount(0),
+    m_slotSize(0),
+    m_slotOffset(0),
+    m_dataOffset(0),
+    m_published(0)
+{
+}
+
+SharedFrameRing::~SharedFrameRing()
+{
+    release();
+}
+
+void SharedFrameRing::release()
+{
+    if (m_base != nullptr)
+    {
+        munmap(m_base, m_size);
+    }
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+    }
+    m_fd = -1;
+    m_base = nullptr;
+    m_size = 0;
+    m_header = nullptr;
+    m_slotCount = 0;
+    m_slotSize = 0;
+    m_slotOffset = 0;
+    m_dataOffset = 0;
+    m_published = 0;
+}
+
+bool SharedFrameRing::create(uint32_t slotCount, size_t slotSize, const std::string &deviceName,
+    const std::string &uniqueID, const CapFormatInfo &format)
+{
+    release();
+
+    if (slotCount < 2)
+    {
+        LOG(LOG_ERR, "SharedFrameRing: need at least 2 slots\n");
+        return false;
+    }
+
+    // the frame data of each slot starts on a page
+    const size_t pageSize   = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t slotOffset = ((sizeof(SharedRingHeader) + 63) / 64) * 64;
+    const size_t dataOffset = ((slotOffset + slotCount*sizeof(SharedRingSlot) + pageSize - 1) / pageSize) * pageSize;
+    slotSize = ((slotSize + pageSize - 1) / pageSize) * pageSize;
+    const size_t totalSize = dataOffset + slotCount*slotSize;
+
+    m_fd = memfd_create("openpnp-capture-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if ((m_fd < 0) || (ftruncate(m_fd, totalSize) == -1))
+    {
+        LOG(LOG_ERR, "SharedFrameRing: could not allocate %d bytes (errno=%d)\n", totalSize, errno);
+        release();
+        return false;
+    }
+
+    // a reader must not be able to shrink the memory
+    // under the writer.
+    if (fcntl(m_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1)
+    {
+        LOG(LOG_WARNING, "SharedFrameRing: could not seal the shared memory (errno=%d)\n", errno);
+    }
+
+    void *base = mmap(NULL, totalSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (base == MAP_FAILED)
+    {
+        LOG(LOG_ERR, "SharedFrameRing: mmap failed (errno=%d)\n", errno);
+        base = nullptr;
+        release();
+        return false;
+    }
+    m_base = static_cast<uint8_t*>(base);
+    m_size = totalSize;
+    m_slotCount  = slotCount;
+    m_slotSize   = slotSize;
+    m_slotOffset = slotOffset;
+    m_dataOffset = dataOffset;
+
+    m_header = new (m_base) SharedRingHeader();
+    m_header->m_magic       = SHAREDRING_MAGIC;
+    m_header->m_version     = SHAREDRING_VERSION;
+    m_header->m_slotCount   = slotCount;
+    m_header->m_slotSize    = slotSize;
+    m_header->m_slotOffset  = slotOffset;
+    m_header->m_dataOffset  = dataOffset;
+    m_header->m_totalSize   = totalSize;
+    m_header->m_format      = format;
+    strncpy(m_header->m_deviceName, deviceName.c_str(), sizeof(m_header->m_deviceName)-1);
+    strncpy(m_header->m_uniqueID, uniqueID.c_str(), sizeof(m_header->m_uniqueID)-1);
+
+    for(uint32_t i=0; i<slotCount; i++)
+    {
+        new (getSlot(i)) SharedRingSlot();
+    }
+
+    LOG(LOG_DEBUG, "SharedFrameRing: created %d slots of %d bytes\n", slotCount, slotSize);
+    return true;
+}
+
+bool SharedFrameRing::attach(int fd)
+{
+    release();
+    m_fd = fd;
+
+    struct stat st;
+    if ((fstat(m_fd, &st) == -1) || (static_cast<size_t>(st.st_size) < sizeof(SharedRingHeader)))
+    {
+        LOG(LOG_ERR, "SharedFrameRing: invalid shared memory\n");
+        release();
+        return false;
+    }
+
+    // readers write to m_waiters only
+    void *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (base == MAP_FAILED)
+    {
+        LOG(LOG_ERR, "SharedFrameRing: mmap failed (errno=%d)\n", errno);
+        release();
+        return false;
+    }
+    m_base = static_cast<uint8_t*>(base);
+    m_size = st.st_size;
+    m_header = reinterpret_cast<SharedRingHeader*>(m_base);
+
+    if ((m_header->m_magic != SHAREDRING_MAGIC) || (m_header->m_version != SHAREDRING_VERSION))
+    {
+        LOG(LOG_ERR, "SharedFrameRing: unsupported shared memory version\n");
+        release();
+        return false;
+    }
+
+    // another client can change the header at any time, the
+    // layout is checked and used as read here.
+    const uint64_t slotCount  = m_header->m_slotCount;
+    const uint64_t slotSize   = m_header->m_slotSize;
+    const uint64_t slotOffset = m_header->m_slotOffset;
+    const uint64_t dataOffset = m_header->m_dataOffset;
+    const uint64_t totalSize  = m_header->m_totalSize;
+    if ((slotCount < 2) || (totalSize > m_size) || (slotSize > totalSize) || (dataOffset > totalSize) ||
+        (slotOffset + slotCount*sizeof(SharedRingSlot) > dataOffset) ||
+        (dataOffset + slotCount*slotSize > totalSize))
+    {
+        LOG(LOG_ERR, "SharedFrameRing: inconsistent shared memory layout\n");
+        release();
+        return false;
+    }
+
+    m_slotCount  = static_cast<uint32_t>(slotCount);
+    m_slotSize   = static_cast<size_t>(slotSize);
+    m_slotOffset = static_cast<size_t>(slotOffset);
+    m_dataOffset = static_cast<size_t>(dataOffset);
+    return true;
+}
+
+bool SharedFrameRing::publish(const FrameSlot *slot)
+{
+    if (m_header == nullptr)
+    {
+        return false;
+    }
+
+    if (slot->m_bytes > m_slotSize)
+    {
+        LOG(LOG_VERBOSE, "SharedFrameRing: frame of %d bytes does not fit\n", slot->m_bytes);
+        return false;
+    }
+
+    const uint32_t index = m_published++;
+    const uint32_t slotIndex = index % m_slotCount;
+    SharedRingSlot *ring = getSlot(slotIndex);
+
+    const uint32_t seqlock = ring->m_seqlock.load(std::memory_order_relaxed);
+    ring->m_seqlock.store(seqlock + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    ring->m_index           = index;
+    ring->m_bytes           = static_cast<uint32_t>(slot->m_bytes);
+    ring->m_width           = slot->m_width;
+    ring->m_height          = slot->m_height;
+    ring->m_stride          = slot->m_stride;
+    ring->m_fourcc          = slot->m_fourcc;
+    ring->m_sequence        = slot->m_sequence;
+    ring->m_deviceSequence  = slot->m_deviceSequence;
+    ring->m_flags           = slot->m_flags;
+    ring->m_deviceFlags     = slot->m_deviceFlags;
+    ring->m_dropped         = slot->m_dropped;
+    ring->m_roiX            = slot->m_roiX;
+    ring->m_roiY            = slot->m_roiY;
+    ring->m_timestamp       = slot->m_timestamp;
+    ring->m_deviceTimestamp = slot->m_deviceTimestamp;
+    memcpy(getSlotData(slotIndex), slot->m_data, slot->m_bytes);
+
+    ring->m_seqlock.store(seqlock + 2, std::memory_order_release);
+
+    // the counter is stored before the waiters are checked and
+    // a reader registers before it checks the counter, so 
+    // one of the two always sees the other.
+    m_header->m_published.store(index + 1);
+    if (m_header->m_waiters.load() != 0)
+    {
+        futex(&m_header->m_published, FUTEX_WAKE, INT_MAX, nullptr);
+    }
+    return true;
+}
+
+void SharedFrameRing::markClosed()
+{
+    if (m_header != nullptr)
+    {
+        m_header->m_closed = 1;
+        futex(&m_header->m_published, FUTEX_WAKE, INT_MAX, nullptr);
+    }
+}
+
+uint32_t SharedFrameRing::getPublishedCount() const
+{
+    return (m_header != nullptr) ? m_header->m_published.load() : 0;
+}
+
+bool SharedFrameRing::isClosed() const
+{
+    return (m_header == nullptr) || (m_header->m_closed.load() != 0);
+}
+
+void SharedFrameRing::waitForFrame(uint32_t seen, uint32_t timeoutMs)
+{
+    if (m_header == nullptr)
+    {
+        return;
+    }
+
+    timespec timeout;
+    timeout.tv_sec  = timeoutMs / 1000;
+    timeout.tv_nsec = (timeoutMs % 1000) * 1000000;
+
+    m_header->m_waiters++;
+    if ((m_header->m_published.load() == seen) && (m_header->m_closed.load() == 0))
+    {
+        // returns immediately if the counter has changed
+        futex(&m_header->m_published, FUTEX_WAIT, seen, &timeout);
+    }
+    m_header->m_waiters--;
+}
+
+bool SharedFrameRing::readInfo(uint32_t index, SharedFrameInfo &info) const
+{
+    if (m_header == nullptr)
+    {
+        return false;
+    }
+
+    const SharedRingSlot *ring = getSlot(index % m_slotCount);
+    const uint32_t seqlock = ring->m_seqlock.load(std::memory_order_acquire);
+    if ((seqlock & 1) != 0)
+    {
+        return false;
+    }
+
+    info.m_seqlock          = seqlock;
+    info.m_index            = ring->m_index;
+    info.m_bytes            = ring->m_bytes;
+    info.m_width            = ring->m_width;
+    info.m_height           = ring->m_height;
+    info.m_stride           = ring->m_stride;
+    info.m_fourcc           = ring->m_fourcc;
+    info.m_sequence         = ring->m_sequence;
+    info.m_deviceSequence   = ring->m_deviceSequence;
+    info.m_flags            = ring->m_flags;
+    info.m_deviceFlags      = ring->m_deviceFlags;
+    info.m_dropped          = ring->m_dropped;
+    info.m_roiX             = ring->m_roiX;
+    info.m_roiY             = ring->m_roiY;
+    info.m_timestamp        = ring->m_timestamp;
+    info.m_deviceTimestamp  = ring->m_deviceTimestamp;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return (ring->m_seqlock.load(std::memory_order_relaxed) == seqlock) && 
+        (info.m_bytes <= m_slotSize);
+}
+
+bool SharedFrameRing::readData(const SharedFrameInfo &info, uint8_t *dst) const
+{
+    if ((m_header == nullptr) || (info.m_bytes > m_slotSize))
+    {
+        return false;
+    }
+
+    const uint32_t slotIndex = info.m_index % m_slotCount;
+    memcpy(dst, getSlotData(slotIndex), info.m_bytes);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return getSlot(slotIndex)->m_seqlock.load(std::memory_order_relaxed) == info.m_seqlock;
+}
+
+bool SharedFrameRing::getSocketAddress(const char *name, sockaddr_un &addr, socklen_t &addrLen)
+{
+    const char prefix[] = "openpnp-capture/";
+    const size_t nameLen = (name != nullptr) ? strlen(name) : 0;
+
+    // the leading zero byte selects the abstract 
+    // namespace, which needs no socket file.
+    if ((nameLen == 0) || (1 + sizeof(prefix)-1 + nameLen > sizeof(addr.sun_path)))
+    {
+        LOG(LOG_ERR, "SharedFrameRing: invalid broker name\n");
+        return false;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(&addr.sun_path[1], prefix, sizeof(prefix)-1);
+    memcpy(&addr.sun_path[sizeof(prefix)], name, nameLen);
+    addrLen = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + sizeof(prefix) + nameLen);
+    return true;
+}
@@ -0,0 +1,212 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux shared-memory frame ring used to share the
+    frames of a stream with other processes.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef linux_sharedframering_h
+#define linux_sharedframering_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "openpnp-capture.h"
+
+struct FrameSlot;   // pre-declaration
+
+#define SHAREDRING_MAGIC    0x5243504F  ///< 'OPCR'
+#define SHAREDRING_VERSION  2
+
+/** Header at the start of the shared memory. Only the
+    broker writes to it, except for m_waiters. Every client
+    can write to the memory, so neither side uses the layout
+    fields after create() or attach() has checked them. */
+struct SharedRingHeader
+{
+    uint32_t    m_magic;            ///< SHAREDRING_MAGIC
+    uint32_t    m_version;          ///< SHAREDRING_VERSION
+    uint32_t    m_slotCount;        ///< number of frame slots
+    uint32_t    m_reserved;
+    uint64_t    m_slotSize;         ///< maximum number of bytes of a frame
+    uint64_t    m_slotOffset;       ///< offset of the first SharedRingSlot
+    uint64_t    m_dataOffset;       ///< offset of the frame data of the first slot
+    uint64_t    m_totalSize;        ///< size of the shared memory
+    CapFormatInfo m_format;         ///< format the brokered stream was opened with
+    char        m_deviceName[256];  ///< name of the brokered device
+    char        m_uniqueID[256];    ///< unique ID of the brokered device
+
+    std::atomic<uint32_t> m_published;  ///< number of frames published, also the futex word
+    std::atomic<uint32_t> m_waiters;    ///< number of readers waiting for m_published to change
+    std::atomic<uint32_t> m_closed;     ///< set to 1 when the broker stops
+};
+
+/** Description of the frame in a slot. The broker makes
+    m_seqlock odd while it writes the slot, so readers can
+    detect a frame that changed while it was copied. */
+struct SharedRingSlot
+{
+    std::atomic<uint32_t> m_seqlock;    ///< odd while the slot is being written
+    uint32_t    m_index;            ///< publication number of the frame, starting at 0
+    uint32_t    m_bytes;
+    uint32_t    m_width;
+    uint32_t    m_height;
+    uint32_t    m_stride;
+    uint32_t    m_fourcc;
+    uint32_t    m_sequence;         ///< frame number assigned by the broker
+    uint32_t    m_deviceSequence;
+    uint32_t    m_flags;
+    uint32_t    m_deviceFlags;
+    uint32_t    m_dropped;          ///< total number of frames the broker dropped
+    uint32_t    m_roiX;             ///< position of a region of interest in the full image
+    uint32_t    m_roiY;
+    uint64_t    m_timestamp;        ///< capture time in microseconds (monotonic clock)
+    uint64_t    m_deviceTimestamp;
+};
+
+/** A copy of the description of a slot, see SharedFrameRing::readInfo */
+struct SharedFrameInfo
+{
+    uint32_t    m_seqlock;          ///< value of the seqlock when the description was read
+    uint32_t    m_index;
+    uint32_t    m_bytes;
+    uint32_t    m_width;
+    uint32_t    m_height;
+    uint32_t    m_stride;
+    uint32_t    m_fourcc;
+    uint32_t    m_sequence;
+    uint32_t    m_deviceSequence;
+    uint32_t    m_flags;
+    uint32_t    m_deviceFlags;
+    uint32_t    m_dropped;
+    uint32_t    m_roiX;
+    uint32_t    m_roiY;
+    uint64_t    m_timestamp;
+    uint64_t    m_deviceTimestamp;
+};
+
+/** A ring of frame slots in shared memory (a memfd) with
+    a single writer, the broker, and any number of readers
+    in other processes.
+
+    The writer fills the slots in turn and never waits for
+    a reader. Each slot is protected by a sequence lock: a
+    reader copies a frame and then checks that the slot 
+    was not rewritten in the meantime, which can only 
+    happen when the reader is more than m_slotCount-1 
+    frames behind. Readers wait for new frames with a 
+    futex on the publication counter, which the writer 
+    only wakes when a reader is waiting.
+*/
+class SharedFrameRing
+{
+public:
+    SharedFrameRing();
+    virtual ~SharedFrameRing();
+
+    /** Writer: create the shared memory for 'slotCount' frames
+        of at most 'slotSize' bytes. */
+    bool create(uint32_t slotCount, size_t slotSize, const std::string &deviceName,
+        const std::string &uniqueID, const CapFormatInfo &format);
+
+    /** Reader: map the shared memory received from the writer.
+        Takes ownership of the file descriptor. */
+    bool attach(int fd);
+
+    /** Writer: copy a frame into the next slot and wake the 
+        readers. Returns false if the frame does not fit. */
+    bool publish(const FrameSlot *slot);
+
+    /** Writer: tell the readers no more frames will follow */
+    void markClosed();
+
+    /** return the file descriptor of the shared memory or -1 */
+    int getFd() const
+    {
+        return m_fd;
+    }
+
+    /** return the header or nullptr if not created/attached */
+    const SharedRingHeader* getHeader() const
+    {
+        return m_header;
+    }
+
+    /** Reader: return the number of frames published so far */
+    uint32_t getPublishedCount() const;
+
+    /** Reader: returns true if the writer has stopped */
+    bool isClosed() const;
+
+    /** Reader: wait until the number of published frames is no
+        longer 'seen', the writer stops or the timeout expires. */
+    void waitForFrame(uint32_t seen, uint32_t timeoutMs);
+
+    /** Reader: read a consistent description of the slot that
+        holds frame 'index'. Returns false if the slot is being
+        written. The slot might hold a newer frame than 'index'. */
+    bool readInfo(uint32_t index, SharedFrameInfo &info) const;
+
+    /** Reader: copy the frame described by 'info' to 'dst'.
+        Returns false if the frame was overwritten while it 
+        was copied, in which case 'dst' holds garbage. */
+    bool readData(const SharedFrameInfo &info, uint8_t *dst) const;
+
+    /** Return the address of the Unix domain socket of the 
+        broker called 'name', in the abstract namespace. */
+    static bool getSocketAddress(const char *name, sockaddr_un &addr, socklen_t &addrLen);
+
+protected:
+    /** unmap and close the shared memory */
+    void release();
+
+    /** return the description of slot 'slotIndex' */
+    SharedRingSlot* getSlot(uint32_t slotIndex) const
+    {
+        return reinterpret_cast<SharedRingSlot*>(m_base + m_slotOffset) + slotIndex;
+    }
+
+    /** return the frame data of slot 'slotIndex' */
+    uint8_t* getSlotData(uint32_t slotIndex) const
+    {
+        return m_base + m_dataOffset + slotIndex*m_slotSize;
+    }
+
+    int                 m_fd;       ///< memfd of the shared memory
+    uint8_t*            m_base;     ///< start of the mapped shared memory
+    size_t              m_size;     ///< size of the mapping
+    SharedRingHeader*   m_header;   ///< header at m_base
+
+    // private copy of the layout, see SharedRingHeader
+    uint32_t            m_slotCount;    ///< number of frame slots
+    size_t              m_slotSize;     ///< maximum number of bytes of a frame
+    size_t              m_slotOffset;   ///< offset of the first SharedRingSlot
+    size_t              m_dataOffset;   ///< offset of the frame data of the first slot
+    uint32_t            m_published;    ///< writer: number of frames published
+};
+
+#endif
@@ -0,0 +1,382 @@
+/*
+
+    openpnp frame broker test application
+
+    Checks the shared frame ring: frames are read back
+    intact while the writer keeps publishing, a reader 
+    detects a frame that was overwritten while it was 
+    copied, and a client context receives the frames of
+    a broker over its Unix domain socket. The client
+    streams are also used to check the settle detection
+    and capture groups.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "../sharedframering.h"
+#include "../framebroker.h"
+#include "../clientcontext.h"
+#include "../../common/framepool.h"
+#include "testhelpers.h"
+
+// the client context does not open platform streams
+Stream* createPlatformStream()
+{
+    return nullptr;
+}
+
+/** fill a slot with a frame where every byte is 'value' */
+static void makeFrame(FrameSlot &slot, std::vector<uint8_t> &buffer, uint32_t width, uint32_t height, uint8_t value)
+{
+    buffer.assign(width*height*3, value);
+    slot.m_data     = &buffer[0];
+    slot.m_bytes    = buffer.size();
+    slot.m_width    = width;
+    slot.m_height   = height;
+    slot.m_stride   = width*3;
+    slot.m_fourcc   = CAPFOURCC_RGB24;
+    slot.m_sequence = value;
+}
+
+static bool isUniform(const uint8_t *data, size_t bytes)
+{
+    for(size_t i=1; i<bytes; i++)
+    {
+        if (data[i] != data[0])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/** a client rewrites the layout in the shared header, the
+    writer and the other readers keep using their own copy */
+static void testHostileHeader()
+{
+    const uint32_t width = 64;
+    const uint32_t height = 48;
+    CapFormatInfo format = {width, height, CAPFOURCC_RGB24, 30, 24};
+
+    SharedFrameRing writer;
+    if (!writer.create(4, width*height*3, "test device", "test:0", format))
+    {
+        check(false, "create ring");
+        return;
+    }
+
+    SharedFrameRing reader;
+    SharedFrameRing hostile;
+    check(reader.attach(dup(writer.getFd())) && hostile.attach(dup(writer.getFd())), "attach ring");
+
+    SharedRingHeader *header = const_cast<SharedRingHeader*>(hostile.getHeader());
+    header->m_slotCount  = 1;
+    header->m_slotSize   = 1ULL << 40;
+    header->m_slotOffset = 1ULL << 40;
+    header->m_dataOffset = 1ULL << 40;
+
+    FrameSlot slot;
+    std::vector<uint8_t> buffer;
+    std::vector<uint8_t> frame(width*height*3);
+    bool ok = true;
+    for(uint32_t i=0; i<10; i++)
+    {
+        makeFrame(slot, buffer, width, height, static_cast<uint8_t>(i));
+        ok &= writer.publish(&slot);
+
+        SharedFrameInfo info;
+        ok &= reader.readInfo(i, info) && reader.readData(info, &frame[0]);
+        ok &= isUniform(&frame[0], info.m_bytes) && (frame[0] == static_cast<uint8_t>(i));
+    }
+    check(ok, "writer ignores a rewritten header");
+
+    SharedFrameRing late;
+    check(!late.attach(dup(writer.getFd())), "reject a rewritten header");
+}
+
+static void testConcurrentReaders()
+{
+    const uint32_t width = 64;
+    const uint32_t height = 48;
+    CapFormatInfo format = {width, height, CAPFOURCC_RGB24, 30, 24};
+
+    SharedFrameRing writer;
+    if (!writer.create(4, width*height*3, "test device", "test:0", format))
+    {
+        check(false, "create ring");
+        return;
+    }
+
+    SharedFrameRing reader;
+    check(reader.attach(dup(writer.getFd())), "attach ring");
+
+    std::atomic<bool> stop(false);
+    std::atomic<uint32_t> torn(0);
+    std::atomic<uint32_t> reads(0);
+    std::atomic<uint32_t> overwritten(0);
+    std::vector<std::thread> readers;
+    for(uint32_t r=0; r<3; r++)
+    {
+        readers.emplace_back([&]()
+        {
+            std::vector<uint8_t> frame(width*height*3);
+            uint32_t seen = 0;
+            while(!stop)
+            {
+                reader.waitForFrame(seen, 10);
+                seen = reader.getPublishedCount();
+                SharedFrameInfo info;
+                if ((seen == 0) || !reader.readInfo(seen-1, info))
+                {
+                    continue;
+                }
+                if (!reader.readData(info, &frame[0]))
+                {
+                    overwritten++;
+                    continue;
+                }
+                if (!isUniform(&frame[0], info.m_bytes) || (frame[0] != static_cast<uint8_t>(info.m_sequence)))
+                {
+                    torn++;
+                }
+                reads++;
+            }
+        });
+    }
+
+    FrameSlot slot;
+    std::vector<uint8_t> buffer;
+    for(uint32_t i=0; i<20000; i++)
+    {
+        makeFrame(slot, buffer, width, height, static_cast<uint8_t>(i));
+        writer.publish(&slot);
+    }
+    stop = true;
+    for(auto &t : readers)
+    {
+        t.join();
+    }
+
+    printf("  %d frames read, %d overwritten while copying\n", reads.load(), overwritten.load());
+    check(reader.getPublishedCount() == 20000, "published count");
+    check((reads > 0) && (torn == 0), "concurrent reads are intact");
+}
+
+static void testOverwriteDetection()
+{
+    CapFormatInfo format = {8, 8, CAPFOURCC_RGB24, 30, 24};
+    SharedFrameRing ring;
+    ring.create(4, 8*8*3, "test device", "test:0", format);
+
+    FrameSlot slot;
+    std::vector<uint8_t> buffer;
+    makeFrame(slot, buffer, 8, 8, 1);
+    ring.publish(&slot);
+
+    SharedFrameInfo info;
+    bool ok = ring.readInfo(0, info);
+
+    // lap the ring so slot 0 is rewritten
+    for(uint32_t i=2; i<=5; i++)
+    {
+        makeFrame(slot, buffer, 8, 8, static_cast<uint8_t>(i));
+        ring.publish(&slot);
+    }
+
+    std::vector<uint8_t> frame(8*8*3);
+    check(ok && !ring.readData(info, &frame[0]), "overwritten frame is detected");
+    check(ring.readInfo(4, info) && (info.m_sequence == 5) && ring.readData(info, &frame[0]) && 
+        (frame[0] == 5), "newest frame is readable");
+
+    makeFrame(slot, buffer, 8, 8, 6);
+    slot.m_roiX = 16;
+    slot.m_roiY = 8;
+    ring.publish(&slot);
+    check(ring.readInfo(5, info) && (info.m_roiX == 16) && (info.m_roiY == 8), 
+        "region position is shared");
+}
+
+static void testClientContext()
+{
+    char name[64];
+    sprintf(name, "brokertest-%d", getpid());
+
+    const uint32_t width = 32;
+    const uint32_t height = 16;
+    CapFormatInfo format = {width, height, CAPFOURCC('Y','U','Y','V'), 30, 16};
+    FrameBroker *broker = new FrameBroker();
+    check(broker->start(name, "test device", "test:0", format, width*height*4), "start broker");
+
+    ClientContext *client = new ClientContext(name);
+    check((client->getDeviceCount() == 1) && (strcmp(client->getDeviceName(0), "test device") == 0), 
+        "client sees brokered device");
+
+    CapFormatInfo clientFormat;
+    check(client->getFormatInfo(0, 0, &clientFormat) && (clientFormat.fourcc == format.fourcc), 
+        "client sees brokered format");
+
+    int32_t streamID = client->openStream(0, 0, nullptr, 0);
+    check(streamID >= 0, "open client stream");
+
+    FrameSlot slot;
+    std::vector<uint8_t> buffer;
+    bool received = false;
+    for(uint32_t i=1; (i<50) && !received; i++)
+    {
+        makeFrame(slot, buffer, width, height, static_cast<uint8_t>(i));
+        broker->publishFrame(&slot);
+
+        CapResult result = client->waitForFrame(&streamID, 1, 100, nullptr);
+        CapFrameLease lease;
+        if ((result == CAPRESULT_OK) && client->acquireFrame(streamID, &lease))
+        {
+            received = (lease.bytes == width*height*3) && (lease.fourcc == CAPFOURCC_RGB24) && 
+                isUniform(lease.data, lease.bytes);
+            client->releaseFrame(streamID, &lease);
+        }
+    }
+    check(received, "client receives frames");
+
+    CapStreamStats stats;
+    check(client->getStreamStats(streamID, &stats) && (stats.openLatency != 0), 
+        "open latency is measured");
+    check(!client->pauseStream(streamID), "client streams cannot be paused");
+
+    delete broker;
+    delete client;
+
+    ClientContext missing(name);
+    check(missing.getDeviceCount() == 0, "stopped broker cannot be reached");
+}
+
+static void testSettle()
+{
+    char name[64];
+    sprintf(name, "settletest-%d", getpid());
+
+    const uint32_t width = 64;
+    const uint32_t height = 48;
+    CapFormatInfo format = {width, height, CAPFOURCC_RGB24, 30, 24};
+    FrameBroker broker;
+    broker.start(name, "test device", "test:0", format, width*height*4);
+
+    ClientContext client(name);
+    int32_t streamID = client.openStream(0, 0, nullptr, 0);
+    check(streamID >= 0, "open settle stream");
+
+    // the image changes three times and then stays the same
+    const uint8_t values[] = {10, 60, 110, 200, 200, 200, 200};
+    std::thread publisher([&]()
+    {
+        FrameSlot slot;
+        std::vector<uint8_t> buffer;
+        for(uint32_t i=0; i<sizeof(values); i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(30));
+            makeFrame(slot, buffer, width, height, values[i]);
+            slot.m_sequence = i+1;
+            broker.publishFrame(&slot);
+        }
+    });
+
+    CapFrameLease lease;
+    CapFrameInfo info;
+    CapResult result = client.waitForSettle(streamID, 1.0f, 2000, &lease, &info);
+    check(result == CAPRESULT_OK, "image settles");
+    if (result == CAPRESULT_OK)
+    {
+        // the first 200 frame still differs from the one before it
+        check((lease.data[0] == 200) && (info.sequence == 5), "first settled frame is returned");
+        client.releaseFrame(streamID, &lease);
+    }
+    publisher.join();
+
+    // let the client stream receive the remaining frames
+    for(uint32_t i=0; (i<50) && (client.getStreamFrameCount(streamID) < sizeof(values)); i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    check(client.waitForSettle(streamID, 1.0f, 50, &lease, &info) == CAPRESULT_TIMEOUT, 
+        "settle waits for new frames");
+    client.closeStream(streamID);
+}
+
+static void testCaptureGroup()
+{
+    char name[64];
+    sprintf(name, "grouptest-%d", getpid());
+
+    const uint32_t width = 16;
+    const uint32_t height = 8;
+    CapFormatInfo format = {width, height, CAPFOURCC_RGB24, 30, 24};
+    FrameBroker broker;
+    broker.start(name, "test device", "test:0", format, width*height*4);
+
+    // two streams of the same broker receive the same 
+    // frames at nearly the same time
+    ClientContext client(name);
+    CapStreamOption option = {CAPSTREAMOPT_HISTORYFRAMES, 4};
+    int32_t streamIDs[2];
+    streamIDs[0] = client.openStream(0, 0, &option, 1);
+    streamIDs[1] = client.openStream(0, 0, &option, 1);
+    int32_t groupID = client.openGroup(streamIDs, 2);
+    check(groupID >= 0, "open capture group");
+
+    std::thread publisher([&]()
+    {
+        FrameSlot slot;
+        std::vector<uint8_t> buffer;
+        for(uint32_t i=1; i<=3; i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(30));
+            makeFrame(slot, buffer, width, height, static_cast<uint8_t>(i));
+            broker.publishFrame(&slot);
+        }
+    });
+
+    // every set is newer than the previous one
+    bool matched = true;
+    uint32_t previous = 0;
+    for(uint32_t i=0; i<2; i++)
+    {
+        CapFrameLease leases[2];
+        CapFrameInfo infos[2];
+        if (client.captureGroup(groupID, 20000, 1000, leases, infos) != CAPRESULT_OK)
+        {
+            matched = false;
+            break;
+        }
+        matched = matched && (leases[0].data[0] == leases[1].data[0]) && (leases[0].data[0] > previous);
+        previous = leases[0].data[0];
+        client.releaseGroup(groupID, leases);
+    }
+    check(matched, "capture group returns matching sets");
+    publisher.join();
+
+    client.closeStream(streamIDs[1]);
+    CapFrameLease leases[2];
+    check(client.captureGroup(groupID, 20000, 10, leases, nullptr) == CAPRESULT_ERR, 
+        "capture group with a closed stream fails");
+    client.closeGroup(groupID);
+}
+
+int main(int argc, char*argv[])
+{
+    printf("OpenPNP Capture frame broker test\n");
+
+    testOverwriteDetection();
+    testConcurrentReaders();
+    testHostileHeader();
+    testClientContext();
+    testSettle();
+    testCaptureGroup();
+
+    return testResult();
+}
@@ -0,0 +1,359 @@
+/*
+
+    openpnp conversion benchmark
+
+    Measures how the throughput of the YUV converters and
+    the MJPEG decoder scales with the number of worker
+    threads, using the same band splitting as the streams.
+
+    usage: openpnp-capture-bench [max threads]
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <turbojpeg.h>
+
+#include "../yuvconverters.h"
+#include "../mjpeghelper.h"
+#include "../../common/workerpool.h"
+
+struct FrameSize
+{
+    uint32_t width;
+    uint32_t height;
+};
+
+static const FrameSize frameSizes[] =
+{
+    {1280, 720},
+    {1920, 1080},
+    {3840, 2160}
+};
+
+enum BenchType
+{
+    BENCH_YUYV = 0,
+    BENCH_NV12,
+    BENCH_MJPEG,
+    BENCH_COUNT
+};
+
+/** the same band split as Stream::convertRowBands */
+static void convertRowBands(WorkerPool *pool, uint32_t height, uint32_t rowAlign,
+    const std::function<void(uint32_t firstRow, uint32_t lastRow)> &convert)
+{
+    const uint32_t minBandRows = 16;
+    uint32_t bands = (pool != nullptr) ? pool->getThreadCount() + 1 : 1;
+    bands = std::min(bands, height / minBandRows);
+    if (bands <= 1)
+    {
+        convert(0, height);
+        return;
+    }
+
+    uint32_t bandRows = (height + bands - 1) / bands;
+    bandRows = ((bandRows + rowAlign - 1) / rowAlign) * rowAlign;
+    pool->parallelFor(bands, [&](uint32_t band)
+    {
+        const uint32_t firstRow = band * bandRows;
+        const uint32_t lastRow  = std::min(firstRow + bandRows, height);
+        if (firstRow < lastRow)
+        {
+            convert(firstRow, lastRow);
+        }
+    });
+}
+
+/** generate a camera-like test image: gradients with some noise */
+static void generateImage(std::vector<uint8_t> &rgb, uint32_t width, uint32_t height)
+{
+    rgb.resize(width*height*3);
+    for(uint32_t y=0; y<height; y++)
+    {
+        for(uint32_t x=0; x<width; x++)
+        {
+            uint8_t *p = &rgb[(y*width + x)*3];
+            p[0] = static_cast<uint8_t>((x*255)/width + (rand() & 15));
+            p[1] = static_cast<uint8_t>((y*255)/height + (rand() & 15));
+            p[2] = static_cast<uint8_t>(((x+y)*127)/(width+height) + (rand() & 31));
+        }
+    }
+}
+
+/** compress an image to a 4:2:2 JPEG with a restart marker
+    at the start of every MCU row, like many UVC cameras do */
+static bool compressImage(const std::vector<uint8_t> &rgb, uint32_t width, uint32_t height,
+    std::vector<uint8_t> &jpeg)
+{
+    tjhandle handle = tj3Init(TJINIT_COMPRESS);
+    if (handle == nullptr)
+    {
+        return false;
+    }
+
+    tj3Set(handle, TJPARAM_SUBSAMP, TJSAMP_422);
+    tj3Set(handle, TJPARAM_QUALITY, 85);
+    tj3Set(handle, TJPARAM_RESTARTROWS, 1);
+
+    unsigned char *buffer = nullptr;
+    size_t bytes = 0;
+    bool ok = (tj3Compress8(handle, &rgb[0], width, 0, height, TJPF_RGB, &buffer, &bytes) == 0);
+    if (ok)
+    {
+        jpeg.assign(buffer, buffer + bytes);
+    }
+    tj3Free(buffer);
+    tj3Destroy(handle);
+    return ok;
+}
+
+int main(int argc, char*argv[])
+{
+    uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    if (argc > 1)
+    {
+        maxThreads = std::max(1, atoi(argv[1]));
+    }
+
+    srand(1234);
+    printf("OpenPNP Capture conversion benchmark\n");
+    printf("YUV kernels: %s\n\n", getYUVKernelSetName(getYUVKernelSet()));
+
+    for(uint32_t s=0; s<sizeof(frameSizes)/sizeof(frameSizes[0]); s++)
+    {
+        const uint32_t width  = frameSizes[s].width;
+        const uint32_t height = frameSizes[s].height;
+
+        std::vector<uint8_t> image;
+        std::vector<uint8_t> jpeg;
+        generateImage(image, width, height);
+        if (!compressImage(image, width, height, jpeg))
+        {
+            printf("Could not compress the test image\n");
+            return 1;
+        }
+
+        std::vector<uint8_t> yuv(width*height*2);
+        for(size_t i=0; i<yuv.size(); i++)
+        {
+            yuv[i] = static_cast<uint8_t>(rand() & 0xFF);
+        }
+
+        std::vector<uint8_t> reference(width*height*3);
+        std::vector<uint8_t> rgb(width*height*3);
+        MJPEGHelper referenceHelper;
+        referenceHelper.decompressFrame(&jpeg[0], jpeg.size(), &reference[0], width, height);
+
+        printf("%d x %d (MJPEG %d bytes)\n", width, height, static_cast<uint32_t>(jpeg.size()));
+        printf("  threads   YUYV fps         NV12 fps         MJPEG fps        MJPEG diff\n");
+
+        double baseline[BENCH_COUNT] = {0.0, 0.0, 0.0};
+        for(uint32_t threads=1; threads<=maxThreads; threads++)
+        {
+            // the calling thread takes part in the work
+            WorkerPool *pool = (threads > 1) ? new WorkerPool(threads-1) : nullptr;
+            MJPEGHelper helper;
+            double fps[BENCH_COUNT];
+
+            for(uint32_t b=0; b<BENCH_COUNT; b++)
+            {
+                const uint32_t frames = (b == BENCH_MJPEG) ? 20 : 50;
+                auto tstart = std::chrono::steady_clock::now();
+                for(uint32_t f=0; f<frames; f++)
+                {
+                    switch(b)
+                    {
+                    case BENCH_YUYV:
+                        convertRowBands(pool, height, 1, [&](uint32_t firstRow, uint32_t lastRow)
+                        {
+                            YUYV2RGB(&yuv[firstRow*width*2], &rgb[firstRow*width*3], (lastRow-firstRow)*width*2);
+                        });
+                        break;
+                    case BENCH_NV12:
+                        convertRowBands(pool, height, 2, [&](uint32_t firstRow, uint32_t lastRow)
+                        {
+                            NV122RGBRows(&yuv[0], &rgb[0], width, height, firstRow, lastRow);
+                        });
+                        break;
+                    case BENCH_MJPEG:
+                        helper.decompressFrame(&jpeg[0], jpeg.size(), &rgb[0], width, height, TJPF_RGB, pool);
+                        break;
+                    }
+                }
+                auto tend = std::chrono::steady_clock::now();
+                fps[b] = frames / std::chrono::duration<double>(tend - tstart).count();
+                if (threads == 1)
+                {
+                    baseline[b] = fps[b];
+                }
+            }
+
+            // the last decoded frame is compared with a
+            // decode on a single thread.
+            uint32_t maxDiff = 0;
+            for(size_t i=0; i<rgb.size(); i++)
+            {
+                maxDiff = std::max(maxDiff, static_cast<uint32_t>(abs(rgb[i] - reference[i])));
+            }
+
+            printf("  %7d   %7.1f (%3.1fx)  %7.1f (%3.1fx)  %7.1f (%3.1fx)  %d\n", threads,
+                fps[BENCH_YUYV], fps[BENCH_YUYV] / baseline[BENCH_YUYV],
+                fps[BENCH_NV12], fps[BENCH_NV12] / baseline[BENCH_NV12],
+                fps[BENCH_MJPEG], fps[BENCH_MJPEG] / baseline[BENCH_MJPEG],
+                maxDiff);
+
+            delete pool;
+        }
+
+        // scaled MJPEG decoding, checked against a scaled
+        // decode on a single thread.
+        printf("  scale     MJPEG fps        MJPEG diff (%d threads)\n", maxThreads);
+        WorkerPool *pool = (maxThreads > 1) ? new WorkerPool(maxThreads-1) : nullptr;
+        for(int denom=2; denom<=8; denom*=2)
+        {
+            const tjscalingfactor scale = {1, denom};
+            const size_t scaledBytes = static_cast<size_t>(TJSCALED(width, scale))*TJSCALED(height, scale)*3;
+            std::vector<uint8_t> scaled(scaledBytes);
+            std::vector<uint8_t> banded(scaledBytes);
+
+            MJPEGHelper helper;
+            const uint32_t frames = 50;
+            auto tstart = std::chrono::steady_clock::now();
+            for(uint32_t f=0; f<frames; f++)
+            {
+                helper.decompressFrame(&jpeg[0], jpeg.size(), &scaled[0], width, height, TJPF_RGB, nullptr, scale);
+            }
+            auto tend = std::chrono::steady_clock::now();
+            const double fps = frames / std::chrono::duration<double>(tend - tstart).count();
+
+            helper.decompressFrame(&jpeg[0], jpeg.size(), &banded[0], width, height, TJPF_RGB, pool, scale);
+            uint32_t maxDiff = 0;
+            for(size_t i=0; i<scaledBytes; i++)
+            {
+                maxDiff = std::max(maxDiff, static_cast<uint32_t>(abs(banded[i] - scaled[i])));
+            }
+
+            printf("    1/%d   %7.1f (%3.1fx)  %d\n", denom, fps, fps / baseline[BENCH_MJPEG], maxDiff);
+        }
+        delete pool;
+
+        // partial MJPEG decoding of a region of interest, checked
+        // against the same pixels of a full decode. The aligned
+        // region starts and ends at MCU columns, the unaligned 
+        // region does not.
+        printf("  region          MJPEG fps        MJPEG diff\n");
+        for(uint32_t r=0; r<2; r++)
+        {
+            tjregion region;
+            region.x = static_cast<int>(width/4 - (width/4) % 16) + ((r == 0) ? 0 : 5);
+            region.y = static_cast<int>(height/4) + 3;
+            region.w = static_cast<int>(width/2);
+            region.h = static_cast<int>(height/2);
+            std::vector<uint8_t> cropped(static_cast<size_t>(region.w)*region.h*3);
+
+            MJPEGHelper helper;
+            const uint32_t frames = 50;
+            auto tstart = std::chrono::steady_clock::now();
+            for(uint32_t f=0; f<frames; f++)
+            {
+                helper.decompressRegion(&jpeg[0], jpeg.size(), &cropped[0], width, height, TJPF_RGB, 
+                    TJUNSCALED, region);
+            }
+            auto tend = std::chrono::steady_clock::now();
+            const double fps = frames / std::chrono::duration<double>(tend - tstart).count();
+
+            uint32_t maxDiff = 0;
+            for(int row=0; row<region.h; row++)
+            {
+                for(int i=0; i<region.w*3; i++)
+                {
+                    const uint8_t full = reference[((region.y + row)*width + region.x)*3 + i];
+                    maxDiff = std::max(maxDiff, static_cast<uint32_t>(abs(cropped[row*region.w*3 + i] - full)));
+                }
+            }
+
+            printf("    %-9s   %7.1f (%3.1fx)  %d\n", (r == 0) ? "aligned" : "unaligned", fps, 
+                fps / baseline[BENCH_MJPEG], maxDiff);
+        }
+
+        // the check of damaged frames before decoding, and how
+        // the decoder error modes treat a frame that was cut off
+        // in the middle of its entropy coded data.
+        static const char *checkNames[] = {"complete", "partial", "corrupt"};
+        static const char *modeNames[]  = {"ignore", "fatal", "warnings"};
+        printf("  frame           check (us)  result     decode fps  ");
+        for(uint32_t mode=CAPDECODEERRORS_IGNORE; mode<=CAPDECODEERRORS_WARNINGS; mode++)
+        {
+            printf("%-9s", modeNames[mode]);
+        }
+        printf("\n");
+        for(uint32_t d=0; d<5; d++)
+        {
+            std::vector<uint8_t> damaged(jpeg);
+            const char *name = "intact";
+            uint32_t checkWidth = width;
+            switch(d)
+            {
+            case 1:
+                name = "truncated";
+                damaged.resize(jpeg.size()/2);
+                break;
+            case 2:
+                name = "no header";
+                damaged[1] = 0;
+                break;
+            case 3:
+                name = "other size";
+                checkWidth = width/2;
+                break;
+            case 4:
+                name = "trailer";
+                damaged.insert(damaged.end(), {0x55, 0xAA, 0xFF, 0x01, 0x00, 0x00});
+                break;
+            }
+
+            const uint32_t checks = 10000;
+            MJPEGHelper::FrameCheck check = MJPEGHelper::FRAME_COMPLETE;
+            auto tstart = std::chrono::steady_clock::now();
+            for(uint32_t i=0; i<checks; i++)
+            {
+                check = MJPEGHelper::checkFrame(&damaged[0], damaged.size(), checkWidth, height);
+            }
+            auto tend = std::chrono::steady_clock::now();
+            const double us = std::chrono::duration<double, std::micro>(tend - tstart).count() / checks;
+
+            printf("    %-11s   %10.2f  %-9s", name, us, checkNames[check]);
+            if ((d == 2) || (d == 3))
+            {
+                printf("\n");
+                continue;
+            }
+
+            MJPEGHelper helper;
+            const uint32_t frames = 20;
+            tstart = std::chrono::steady_clock::now();
+            for(uint32_t f=0; f<frames; f++)
+            {
+                helper.decompressFrame(&damaged[0], damaged.size(), &rgb[0], width, height);
+            }
+            tend = std::chrono::steady_clock::now();
+            printf("  %10.1f  ", frames / std::chrono::duration<double>(tend - tstart).count());
+
+            for(uint32_t mode=CAPDECODEERRORS_IGNORE; mode<=CAPDECODEERRORS_WARNINGS; mode++)
+            {
+                helper.setErrorMode(mode);
+                const bool ok = helper.decompressFrame(&damaged[0], damaged.size(), &rgb[0], width, height);
+                printf("%-9s", ok ? "kept" : "dropped");
+            }
+            printf("\n");
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,142 @@
+/*
+
+    openpnp decode queue test application
+
+    Passes frames of varying size from a producer thread
+    to a consumer thread through the DecodeQueue, like the
+    capture and decode threads of a stream, and checks that
+    every frame that was not dropped arrives intact and in
+    order.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "../decodequeue.h"
+#include "testhelpers.h"
+
+/** fill a frame with a pattern that depends on its number */
+static size_t makeFrame(uint32_t number, std::vector<uint8_t> &frame)
+{
+    const size_t bytes = 16 + (number * 7919) % 4096;
+    frame.resize(bytes);
+    for(size_t i=0; i<bytes; i++)
+    {
+        frame[i] = static_cast<uint8_t>(number + i);
+    }
+    return bytes;
+}
+
+static void testFull()
+{
+    DecodeQueue queue;
+    queue.init(3);
+
+    uint32_t pushed = 0;
+    QueuedFrame *frame;
+    while((frame = queue.beginPush()) != nullptr)
+    {
+        frame->m_info.m_sequence = pushed++;
+        queue.commitPush();
+    }
+    check((pushed == 3) && (queue.size() == 3), "a full queue refuses frames");
+
+    frame = queue.waitFront();
+    check((frame != nullptr) && (frame->m_info.m_sequence == 0), "the oldest frame comes first");
+    queue.pop();
+    check(queue.beginPush() != nullptr, "a popped entry can be reused");
+
+    queue.close();
+    check(queue.waitFront() == nullptr, "a closed queue returns no frames");
+}
+
+static void testThreads()
+{
+    const uint32_t frames = 20000;
+    DecodeQueue queue;
+    queue.init(4);
+
+    uint32_t received = 0;
+    uint32_t corrupt  = 0;
+    uint32_t outOfOrder = 0;
+    std::thread consumer([&]()
+    {
+        std::vector<uint8_t> expected;
+        int64_t last = -1;
+        QueuedFrame *frame;
+        while((frame = queue.waitFront()) != nullptr)
+        {
+            const uint32_t number = frame->m_info.m_sequence;
+            const size_t bytes = makeFrame(number, expected);
+            if ((frame->m_bytes != bytes) || (memcmp(frame->m_buffer.data(), &expected[0], bytes) != 0))
+            {
+                corrupt++;
+            }
+            if (static_cast<int64_t>(number) <= last)
+            {
+                outOfOrder++;
+            }
+            last = number;
+            received++;
+
+            // a slow frame now and then, so the queue fills up
+            if ((number % 1000) == 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+            queue.pop();
+        }
+    });
+
+    std::vector<uint8_t> frame;
+    uint32_t dropped = 0;
+    for(uint32_t i=0; i<frames; i++)
+    {
+        // wait a little for the consumer before dropping
+        QueuedFrame *entry = queue.beginPush();
+        for(uint32_t retry=0; (entry == nullptr) && (retry < 100); retry++)
+        {
+            std::this_thread::yield();
+            entry = queue.beginPush();
+        }
+        if (entry == nullptr)
+        {
+            dropped++;
+            continue;
+        }
+        const size_t bytes = makeFrame(i, frame);
+        entry->m_buffer.resize(std::max(entry->m_buffer.size(), bytes));
+        memcpy(&entry->m_buffer[0], &frame[0], bytes);
+        entry->m_bytes = bytes;
+        entry->m_info.m_sequence = i;
+        queue.commitPush();
+    }
+
+    // let the consumer empty the queue before closing it
+    while(queue.size() != 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    queue.close();
+    consumer.join();
+
+    printf("%d frames received, %d dropped\n", received, dropped);
+    check(received + dropped == frames, "every frame is received or dropped");
+    check(corrupt == 0, "frames arrive intact");
+    check(outOfOrder == 0, "frames arrive in order");
+}
+
+int main(int argc, char*argv[])
+{
+    printf("OpenPNP Capture decode queue test\n");
+
+    testFull();
+    testThreads();
+
+    return testResult();
+}
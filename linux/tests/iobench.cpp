@@ -0,0 +1,151 @@
+/*
+
+    openpnp I/O method benchmark
+
+    Opens the same device with each V4L2 I/O method and
+    measures the frame rate and the CPU time the library
+    spends per frame, while the frames are read with
+    Cap_acquireFrame like an application would.
+
+    usage: openpnp-capture-iobench [device] [format] [seconds] [rgb|native] [decode queue]
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "openpnp-capture.h"
+
+struct IOMethod
+{
+    int32_t     method;
+    const char *name;
+};
+
+static const IOMethod ioMethods[] =
+{
+    {CAPIOMETHOD_MMAP,    "mmap"},
+    {CAPIOMETHOD_USERPTR, "userptr"},
+    {CAPIOMETHOD_DMABUF,  "dmabuf"},
+    {CAPIOMETHOD_READ,    "read"}
+};
+
+/** return the CPU time used by the process in microseconds */
+static uint64_t getCPUTime()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)*1000000 +
+        usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+int main(int argc, char*argv[])
+{
+    CapDeviceID deviceID = 0;
+    CapFormatID formatID = 0;
+    uint32_t seconds = 5;
+    bool native = false;
+    int32_t decodeQueue = 0;
+
+    if (argc > 1) deviceID = atoi(argv[1]);
+    if (argc > 2) formatID = atoi(argv[2]);
+    if (argc > 3) seconds  = atoi(argv[3]);
+    if (argc > 4) native   = (strcmp(argv[4], "native") == 0);
+    if (argc > 5) decodeQueue = atoi(argv[5]);
+
+    printf("OpenPNP Capture I/O method benchmark\n");
+    Cap_setLogLevel(3);
+
+    CapContext ctx = Cap_createContext();
+    if (Cap_getDeviceCount(ctx) <= deviceID)
+    {
+        printf("Device %d not found\n", deviceID);
+        Cap_releaseContext(ctx);
+        return 1;
+    }
+
+    CapFormatInfo finfo;
+    if (Cap_getFormatInfo(ctx, deviceID, formatID, &finfo) != CAPRESULT_OK)
+    {
+        printf("Format %d not found\n", formatID);
+        Cap_releaseContext(ctx);
+        return 1;
+    }
+
+    printf("%s: %d x %d %c%c%c%c, %s output, %d seconds per method, decode queue %d\n\n", 
+        Cap_getDeviceName(ctx, deviceID), finfo.width, finfo.height, finfo.fourcc & 0xFF, 
+        (finfo.fourcc >> 8) & 0xFF, (finfo.fourcc >> 16) & 0xFF, (finfo.fourcc >> 24) & 0xFF, 
+        native ? "native" : "RGB", seconds, decodeQueue);
+    printf("  method     fps      CPU us/frame   dropped\n");
+
+    for(uint32_t m=0; m<sizeof(ioMethods)/sizeof(ioMethods[0]); m++)
+    {
+        CapStreamOption options[2] =
+        {
+            {CAPSTREAMOPT_IOMETHOD, ioMethods[m].method},
+            {CAPSTREAMOPT_DECODEQUEUE, decodeQueue}
+        };
+
+        CapStream stream = Cap_openStreamWithOptions(ctx, deviceID, formatID, options, 2);
+        if (stream < 0)
+        {
+            printf("  %-8s   not supported\n", ioMethods[m].name);
+            continue;
+        }
+
+        if (native)
+        {
+            Cap_setOutputFormat(ctx, stream, CAPFOURCC_NATIVE);
+        }
+
+        // let the camera settle before measuring
+        auto tsettle = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while(std::chrono::steady_clock::now() < tsettle)
+        {
+            Cap_waitForFrame(ctx, stream, 100);
+            CapFrameLease lease;
+            if (Cap_acquireFrame(ctx, stream, &lease) == CAPRESULT_OK)
+            {
+                Cap_releaseFrame(ctx, stream, &lease);
+            }
+        }
+
+        CapFrameInfo info;
+        uint32_t dropped = 0;
+        const uint32_t fstart = Cap_getStreamFrameCount(ctx, stream);
+        const uint64_t cpuStart = getCPUTime();
+        auto tstart = std::chrono::steady_clock::now();
+        auto tend = tstart + std::chrono::seconds(seconds);
+        while(std::chrono::steady_clock::now() < tend)
+        {
+            if (Cap_waitForFrame(ctx, stream, 100) != CAPRESULT_OK)
+            {
+                continue;
+            }
+
+            CapFrameLease lease;
+            if (Cap_acquireFrame(ctx, stream, &lease) == CAPRESULT_OK)
+            {
+                Cap_releaseFrame(ctx, stream, &lease);
+                if (Cap_getFrameInfo(ctx, stream, &info) == CAPRESULT_OK)
+                {
+                    dropped += info.dropped;
+                }
+            }
+        }
+        const uint64_t cpuTime = getCPUTime() - cpuStart;
+        const uint32_t frames = Cap_getStreamFrameCount(ctx, stream) - fstart;
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - tstart).count();
+
+        printf("  %-8s %6.1f   %10.0f     %6d\n", ioMethods[m].name, frames / elapsed,
+            (frames != 0) ? static_cast<double>(cpuTime) / frames : 0.0, dropped);
+
+        Cap_closeStream(ctx, stream);
+    }
+
+    Cap_releaseContext(ctx);
+    return 0;
+}
@@ -60,6 +60,18 @@ void estimateFrameRate(CapContext ctx, int32_t streamID)
     printf("Measured fps=%5.2f\n", 1000.0f*frames/static_cast<float>(d.count()));
 } 
 
+/** frame callback used by the 'c' key, prints a line every 30 frames */
+uint32_t frameCallback(CapStream stream, const CapFrameLease *frame, 
+    const CapFrameInfo *info, void *userData)
+{
+    if ((info->sequence % 30) == 0)
+    {
+        printf("Callback: frame %d (%d x %d) dropped=%d\n", info->sequence,
+            frame->width, frame->height, info->dropped);
+    }
+    return CAPCALLBACK_RELEASE;
+}
+
 int main(int argc, char*argv[])
 {    
     uint32_t deviceFormatID = 0;
@@ -226,11 +238,16 @@ int main(int argc, char*argv[])
     printf("  a/s    : change the gain\n");
     printf("  p      : estimate the frame rate\n");
     printf("  w      : write one frame to a PPM file\n");
+    printf("  i      : show the timing information of a frame\n");
+    printf("  c      : turn the frame callback on/off\n");
+    printf("  b      : share the stream with other processes on/off\n");
     printf("  q      : quit\n");
 
     char c = 0;
     int32_t v = 0;
     uint32_t frameWriteCounter=0;    
+    bool callbackEnabled = false;
+    bool brokerEnabled = false;
     while((c != 'q') && (c != 'Q'))
     {
         c = getchar();
@@ -298,7 +315,45 @@ int main(int argc, char*argv[])
             printf("Estimating frame rate..\n");
             estimateFrameRate(ctx, streamID);
             break;            
+        case 'i':
+            if (Cap_captureFrame(ctx, streamID, &m_buffer[0], m_buffer.size()) == CAPRESULT_OK)
+            {
+                CapFrameInfo info;
+                if (Cap_getFrameInfo(ctx, streamID, &info) == CAPRESULT_OK)
+                {
+                    printf("Frame %d (device %d) dropped=%d overwritten=%d flags=%08X\n", 
+                        info.sequence, info.deviceSequence, info.dropped, info.overwritten, info.flags);
+                    if (info.flags & CAPFRAMEFLAG_DEVICETIMESTAMP)
+                    {
+                        printf("  capture to delivery latency = %d us\n", 
+                            static_cast<int32_t>(info.timestamp - info.deviceTimestamp));
+                    }
+                }
+            }
+            break;
+        case 'c':
+            callbackEnabled = !callbackEnabled;
+            Cap_setFrameCallback(ctx, streamID, callbackEnabled ? frameCallback : NULL, NULL);
+            printf("Frame callback %s\n", callbackEnabled ? "on" : "off");
+            break;
+        case 'b':
+            if (!brokerEnabled)
+            {
+                brokerEnabled = (Cap_startBroker(ctx, streamID, "openpnp-capture-test") == CAPRESULT_OK);
+                printf("Broker %s\n", brokerEnabled ? "openpnp-capture-test started" : "could not be started");
+            }
+            else
+            {
+                Cap_stopBroker(ctx, streamID);
+                brokerEnabled = false;
+                printf("Broker stopped\n");
+            }
+            break;
         case 'w':
+            if (Cap_waitForFrame(ctx, streamID, 1000) == CAPRESULT_TIMEOUT)
+            {
+                printf("No new frame within 1 second\n");
+            }
             if (Cap_captureFrame(ctx, streamID, &m_buffer[0], m_buffer.size()) == CAPRESULT_OK)
             {
                 if (writeBufferAsPPM(frameWriteCounter, 
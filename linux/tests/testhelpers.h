@@ -0,0 +1,42 @@
+/*
+
+    openpnp test helpers
+
+    The pass/fail bookkeeping shared by the test
+    applications: check() reports a single result and
+    testResult() prints the summary returned by main().
+
+*/
+#ifndef testhelpers_h
+#define testhelpers_h
+
+#include <stdio.h>
+#include <stdint.h>
+
+/** number of failed checks */
+static uint32_t failures = 0;
+
+/** report the result of a single check */
+inline void check(bool ok, const char *name)
+{
+    printf("%-40s : %s\n", name, ok ? "OK" : "FAILED");
+    if (!ok)
+    {
+        failures++;
+    }
+}
+
+/** print the summary, returns the exit code for main() */
+inline int testResult()
+{
+    if (failures != 0)
+    {
+        printf("%d test(s) failed!\n", failures);
+        return 1;
+    }
+
+    printf("All tests passed.\n");
+    return 0;
+}
+
+#endif
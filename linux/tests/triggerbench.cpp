@@ -0,0 +1,116 @@
+/*
+
+    openpnp triggered capture benchmark
+
+    Opens a device in trigger mode and repeatedly captures
+    a burst of frames, to measure the time from the trigger
+    to the first frame for a number of warm-up frames.
+
+    usage: openpnp-capture-triggerbench [device] [format] [burst] [triggers]
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+#include "openpnp-capture.h"
+
+static const int32_t warmupFrames[] = {0, 1, 2, 4};
+
+int main(int argc, char*argv[])
+{
+    CapDeviceID deviceID = 0;
+    CapFormatID formatID = 0;
+    uint32_t burst = 1;
+    uint32_t triggers = 5;
+
+    if (argc > 1) deviceID = atoi(argv[1]);
+    if (argc > 2) formatID = atoi(argv[2]);
+    if (argc > 3) burst    = atoi(argv[3]);
+    if (argc > 4) triggers = atoi(argv[4]);
+
+    printf("OpenPNP Capture triggered capture benchmark\n");
+    Cap_setLogLevel(3);
+
+    CapContext ctx = Cap_createContext();
+    if (Cap_getDeviceCount(ctx) <= deviceID)
+    {
+        printf("Device %d not found\n", deviceID);
+        Cap_releaseContext(ctx);
+        return 1;
+    }
+
+    printf("%s: bursts of %d frames, %d triggers per setting\n\n", Cap_getDeviceName(ctx, deviceID),
+        burst, triggers);
+    printf("  warm-up   trigger to first frame (ms)   burst time (ms)\n");
+
+    for(uint32_t w=0; w<sizeof(warmupFrames)/sizeof(warmupFrames[0]); w++)
+    {
+        CapStreamOption options[3] =
+        {
+            {CAPSTREAMOPT_TRIGGERMODE, 1},
+            {CAPSTREAMOPT_WARMUPFRAMES, warmupFrames[w]},
+            {CAPSTREAMOPT_HISTORYFRAMES, static_cast<int32_t>((burst < 32) ? burst : 32)}
+        };
+
+        CapStream stream = Cap_openStreamWithOptions(ctx, deviceID, formatID, options, 3);
+        if (stream < 0)
+        {
+            printf("Could not open the stream in trigger mode\n");
+            break;
+        }
+
+        double latency = 0.0;
+        double burstTime = 0.0;
+        uint32_t completed = 0;
+        for(uint32_t t=0; t<triggers; t++)
+        {
+            const uint32_t fstart = Cap_getStreamFrameCount(ctx, stream);
+            auto tstart = std::chrono::steady_clock::now();
+            if (Cap_triggerCapture(ctx, stream, burst) != CAPRESULT_OK)
+            {
+                printf("Cap_triggerCapture failed\n");
+                break;
+            }
+
+            auto tend = tstart + std::chrono::seconds(5);
+            while((Cap_getStreamFrameCount(ctx, stream) - fstart < burst) &&
+                (std::chrono::steady_clock::now() < tend))
+            {
+                Cap_waitForFrame(ctx, stream, 100);
+                CapFrameLease lease;
+                if (Cap_acquireFrame(ctx, stream, &lease) == CAPRESULT_OK)
+                {
+                    Cap_releaseFrame(ctx, stream, &lease);
+                }
+            }
+
+            CapStreamStats stats;
+            if ((Cap_getStreamFrameCount(ctx, stream) - fstart >= burst) &&
+                (Cap_getStreamStats(ctx, stream, &stats) == CAPRESULT_OK))
+            {
+                latency += stats.startLatency / 1000.0;
+                burstTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tstart).count();
+                completed++;
+            }
+
+            // leave the bus idle for a moment, like between placements
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+
+        if (completed != 0)
+        {
+            printf("  %7d   %27.1f   %15.1f\n", warmupFrames[w], latency / completed, burstTime / completed);
+        }
+        else
+        {
+            printf("  %7d   no frames captured\n", warmupFrames[w]);
+        }
+
+        Cap_closeStream(ctx, stream);
+    }
+
+    Cap_releaseContext(ctx);
+    return 0;
+}
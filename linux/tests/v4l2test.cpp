@@ -0,0 +1,265 @@
+/*
+
+    openpnp V4L2 device helper test application
+
+    Replaces the ioctl layer with a mock camera that has
+    stepwise, continuous and discrete frame sizes and a
+    sensor that can be cropped and binned, to check the
+    frame size enumeration and the crop/binning negotiation
+    without a camera.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <vector>
+#include <algorithm>
+
+#include "../v4l2device.h"
+#include "testhelpers.h"
+
+/** the state of the mock camera */
+static struct
+{
+    bool        m_selection;    ///< true if the sensor can be cropped
+    uint32_t    m_interrupts;   ///< number of ioctls still to fail with EINTR
+    v4l2_rect   m_crop;         ///< current crop rectangle
+    uint32_t    m_width;        ///< current frame width
+    uint32_t    m_height;       ///< current frame height
+} mock;
+
+static const v4l2_rect sensorBounds = {0, 0, 2592, 1944};
+
+/** Frame sizes: YUYV is stepwise, MJPG continuous and RGB3
+    discrete. Frames larger than 1920 pixels run at 15 fps,
+    smaller ones at any rate up to 30 fps. */
+static int mockEnumFrameSizes(v4l2_frmsizeenum *frmSize)
+{
+    switch(frmSize->pixel_format)
+    {
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_MJPEG:
+        if (frmSize->index != 0)
+        {
+            break;
+        }
+        if (frmSize->pixel_format == V4L2_PIX_FMT_YUYV)
+        {
+            frmSize->type = V4L2_FRMSIZE_TYPE_STEPWISE;
+            frmSize->stepwise = {160, 2592, 16, 120, 1944, 8};
+        }
+        else
+        {
+            frmSize->type = V4L2_FRMSIZE_TYPE_CONTINUOUS;
+            frmSize->stepwise = {1, 1280, 1, 1, 720, 1};
+        }
+        return 0;
+    case V4L2_PIX_FMT_RGB24:
+        if (frmSize->index > 1)
+        {
+            break;
+        }
+        frmSize->type = V4L2_FRMSIZE_TYPE_DISCRETE;
+        frmSize->discrete.width  = (frmSize->index == 0) ? 640 : 320;
+        frmSize->discrete.height = (frmSize->index == 0) ? 480 : 240;
+        return 0;
+    default:
+        break;
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+static int mockEnumFrameIntervals(v4l2_frmivalenum *ivals)
+{
+    if (ivals->width > 1920)
+    {
+        if (ivals->index > 1)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        ivals->type = V4L2_FRMIVAL_TYPE_DISCRETE;
+        ivals->discrete.numerator   = 1;
+        ivals->discrete.denominator = (ivals->index == 0) ? 10 : 15;
+        return 0;
+    }
+
+    if (ivals->index != 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    ivals->type = V4L2_FRMIVAL_TYPE_CONTINUOUS;
+    ivals->stepwise.min  = {1, 30};
+    ivals->stepwise.max  = {1, 1};
+    ivals->stepwise.step = {1, 1};
+    return 0;
+}
+
+/** The sensor crops at even positions, 16 pixel wide and
+    8 pixel high steps, and bins by 1 or 2. */
+static int mockSelection(unsigned long request, v4l2_selection *sel)
+{
+    if (!mock.m_selection)
+    {
+        errno = ENOTTY;
+        return -1;
+    }
+
+    if (request == VIDIOC_G_SELECTION)
+    {
+        sel->r = (sel->target == V4L2_SEL_TGT_CROP) ? mock.m_crop : sensorBounds;
+        return 0;
+    }
+
+    v4l2_rect r = sel->r;
+    r.left   = std::max(0, r.left & ~1);
+    r.top    = std::max(0, r.top & ~1);
+    r.width  = std::max(16u, std::min(r.width & ~15u, sensorBounds.width - r.left));
+    r.height = std::max(8u, std::min(r.height & ~7u, sensorBounds.height - r.top));
+    mock.m_crop = r;
+    mock.m_width  = r.width;
+    mock.m_height = r.height;
+    sel->r = r;
+    return 0;
+}
+
+static int mockFormat(unsigned long request, v4l2_format *fmt)
+{
+    if (request == VIDIOC_S_FMT)
+    {
+        // pick the binning factor that comes closest
+        const bool binned = (fmt->fmt.pix.width <= mock.m_crop.width*3/4);
+        mock.m_width  = binned ? mock.m_crop.width/2 : mock.m_crop.width;
+        mock.m_height = binned ? mock.m_crop.height/2 : mock.m_crop.height;
+    }
+    fmt->fmt.pix.width  = mock.m_width;
+    fmt->fmt.pix.height = mock.m_height;
+    fmt->fmt.pix.bytesperline = mock.m_width*2;
+    return 0;
+}
+
+static int mockIoctl(int fd, unsigned long request, void *arg)
+{
+    if (mock.m_interrupts > 0)
+    {
+        mock.m_interrupts--;
+        errno = EINTR;
+        return -1;
+    }
+
+    switch(request)
+    {
+    case VIDIOC_ENUM_FRAMESIZES:
+        return mockEnumFrameSizes(static_cast<v4l2_frmsizeenum*>(arg));
+    case VIDIOC_ENUM_FRAMEINTERVALS:
+        return mockEnumFrameIntervals(static_cast<v4l2_frmivalenum*>(arg));
+    case VIDIOC_G_SELECTION:
+    case VIDIOC_S_SELECTION:
+        return mockSelection(request, static_cast<v4l2_selection*>(arg));
+    case VIDIOC_G_FMT:
+    case VIDIOC_S_FMT:
+        return mockFormat(request, static_cast<v4l2_format*>(arg));
+    default:
+        errno = ENOTTY;
+        return -1;
+    }
+}
+
+static void resetMock(bool selection)
+{
+    mock.m_selection  = selection;
+    mock.m_interrupts = 0;
+    mock.m_crop   = sensorBounds;
+    mock.m_width  = sensorBounds.width;
+    mock.m_height = sensorBounds.height;
+}
+
+static bool hasSize(const std::vector<CapFormatInfo> &formats, uint32_t width, uint32_t height)
+{
+    for(size_t i=0; i<formats.size(); i++)
+    {
+        if ((formats[i].width == width) && (formats[i].height == height))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void testFrameSizes()
+{
+    std::vector<CapFormatInfo> formats;
+    resetMock(true);
+    enumerateFrameSizes(0, V4L2_PIX_FMT_YUYV, formats);
+
+    bool onSteps = !formats.empty();
+    for(size_t i=0; i<formats.size(); i++)
+    {
+        onSteps &= (formats[i].width >= 160) && (((formats[i].width - 160) % 16) == 0);
+        onSteps &= (formats[i].height >= 120) && (((formats[i].height - 120) % 8) == 0);
+        onSteps &= (formats[i].fourcc == V4L2_PIX_FMT_YUYV);
+    }
+    check(onSteps, "stepwise sizes lie on the steps");
+    check(hasSize(formats, 640, 480) && hasSize(formats, 1920, 1080) &&
+        (formats.back().width == 2592) && (formats.back().height == 1944),
+        "stepwise sizes include common and max");
+    check((formats.front().fps == 30) && (formats.back().fps == 15), "frame rates of stepwise sizes");
+
+    formats.clear();
+    enumerateFrameSizes(0, V4L2_PIX_FMT_MJPEG, formats);
+    check((formats.size() == 4) && hasSize(formats, 320, 240) && hasSize(formats, 800, 600) &&
+        hasSize(formats, 1280, 720) && !hasSize(formats, 1024, 768), "continuous sizes fit the range");
+
+    formats.clear();
+    enumerateFrameSizes(0, V4L2_PIX_FMT_RGB24, formats);
+    check((formats.size() == 2) && (formats[0].width == 640) && (formats[1].width == 320),
+        "discrete sizes are listed as-is");
+
+    formats.clear();
+    enumerateFrameSizes(0, V4L2_PIX_FMT_GREY, formats);
+    check(formats.empty(), "unsupported format has no sizes");
+}
+
+static void testSensorWindow()
+{
+    v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+
+    // the sensor aligns the rectangle inside the requested one
+    resetMock(true);
+    v4l2_rect crop = {101, 51, 1001, 605};
+    check(setSensorWindow(0, crop, 2, fmt) && (crop.left == 100) && (crop.top == 50) &&
+        (crop.width == 992) && (crop.height == 600), "crop rectangle is aligned");
+    check((fmt.fmt.pix.width == 496) && (fmt.fmt.pix.height == 300), "cropped frame is binned");
+
+    // the full sensor, the driver only bins by 2
+    resetMock(true);
+    crop = {0, 0, 0, 0};
+    check(setSensorWindow(0, crop, 4, fmt) && (crop.width == 2592) && (fmt.fmt.pix.width == 1296),
+        "driver adjusts the binning");
+
+    resetMock(false);
+    crop = {0, 0, 640, 480};
+    check(!setSensorWindow(0, crop, 1, fmt), "cameras without cropping are detected");
+
+    resetMock(true);
+    mock.m_interrupts = 3;
+    crop = {0, 0, 640, 480};
+    check(setSensorWindow(0, crop, 1, fmt) && (fmt.fmt.pix.width == 640), "interrupted ioctls are retried");
+}
+
+int main(int argc, char*argv[])
+{
+    printf("OpenPNP Capture V4L2 device helper test\n");
+    setIoctlHandler(&mockIoctl);
+
+    testFrameSizes();
+    testSensorWindow();
+
+    setIoctlHandler(nullptr);
+    return testResult();
+}
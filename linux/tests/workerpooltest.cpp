@@ -0,0 +1,106 @@
+/*
+
+    openpnp worker pool test application
+
+    Runs parallelFor calls of several threads at the same
+    time, like the streams and decode threads of a context
+    sharing one pool, and checks that every job runs exactly
+    once and that every call returns.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "../../common/workerpool.h"
+#include "testhelpers.h"
+
+/** a slow batch is started first, a fast batch of a second
+    thread runs out of jobs while the slow one is still at
+    the front of the queue. */
+static void testOverlappingBatches()
+{
+    WorkerPool pool(1);
+    bool ok = true;
+    for(uint32_t n=0; n<50; n++)
+    {
+        std::atomic<uint32_t> slowRuns[3];
+        std::atomic<uint32_t> fastRuns[2];
+        for(uint32_t i=0; i<3; i++) slowRuns[i] = 0;
+        for(uint32_t i=0; i<2; i++) fastRuns[i] = 0;
+
+        std::thread slow([&]
+        {
+            pool.parallelFor(3, [&](uint32_t index)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                slowRuns[index]++;
+            });
+        });
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        std::thread fast([&]
+        {
+            pool.parallelFor(2, [&](uint32_t index)
+            {
+                fastRuns[index]++;
+            });
+        });
+        fast.join();
+        slow.join();
+
+        for(uint32_t i=0; i<3; i++) ok &= (slowRuns[i] == 1);
+        for(uint32_t i=0; i<2; i++) ok &= (fastRuns[i] == 1);
+    }
+    check(ok, "overlapping batches");
+}
+
+/** several threads submit small batches as fast as they can */
+static void testConcurrentCallers()
+{
+    WorkerPool pool(3);
+    const uint32_t callers = 4;
+    const uint32_t calls = 500;
+    const uint32_t jobs = 5;
+    std::vector<uint32_t> errors(callers, 0);
+    std::vector<std::thread> threads;
+    for(uint32_t t=0; t<callers; t++)
+    {
+        threads.push_back(std::thread([&, t]
+        {
+            for(uint32_t c=0; c<calls; c++)
+            {
+                std::atomic<uint32_t> runs[jobs];
+                for(uint32_t i=0; i<jobs; i++) runs[i] = 0;
+                pool.parallelFor(jobs, [&](uint32_t index)
+                {
+                    runs[index]++;
+                });
+                for(uint32_t i=0; i<jobs; i++)
+                {
+                    errors[t] += (runs[i] != 1) ? 1 : 0;
+                }
+            }
+        }));
+    }
+
+    uint32_t total = 0;
+    for(uint32_t t=0; t<callers; t++)
+    {
+        threads[t].join();
+        total += errors[t];
+    }
+    check(total == 0, "concurrent callers");
+}
+
+int main(int argc, char*argv[])
+{
+    printf("OpenPNP Capture worker pool test\n");
+
+    testOverlappingBatches();
+    testConcurrentCallers();
+
+    return testResult();
+}
@@ -0,0 +1,213 @@
+/*
+
+    openpnp YUV converter test application
+
+    Converts random YUYV, NV12 and I420 frames to every 
+    pixel layout with every kernel set supported by the CPU
+    and checks that the results are identical to the scalar
+    reference kernels.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+
+#include "../yuvconverters.h"
+#include "testhelpers.h"
+
+struct FrameSize
+{
+    uint32_t width;
+    uint32_t height;
+};
+
+// include sizes that are not a multiple of the SIMD width
+static const FrameSize frameSizes[] =
+{
+    {16, 2},
+    {18, 4},
+    {34, 6},
+    {62, 2},
+    {320, 240},
+    {642, 482},
+    {1920, 1080}
+};
+
+enum ConverterType
+{
+    CONV_YUYV = 0,
+    CONV_NV12,
+    CONV_I420,
+    CONV_COUNT
+};
+
+static const char *converterNames[CONV_COUNT] = {"YUYV", "NV12", "I420"};
+static const char *layoutNames[PIXEL_LAYOUT_COUNT] = {"RGB24", "BGR24", "RGBA32"};
+
+static void fillRandom(std::vector<uint8_t> &buffer)
+{
+    for(size_t i=0; i<buffer.size(); i++)
+    {
+        buffer[i] = static_cast<uint8_t>(rand() & 0xFF);
+    }
+}
+
+static uint32_t inputBytes(ConverterType conv, uint32_t width, uint32_t height)
+{
+    if (conv == CONV_YUYV)
+    {
+        return width*height*2;
+    }
+    return width*height + 2*((width/2)*(height/2)) + width;
+}
+
+static void convert(ConverterType conv, const std::vector<uint8_t> &in, std::vector<uint8_t> &out, 
+    uint32_t width, uint32_t height, PixelLayout layout)
+{
+    switch(conv)
+    {
+    case CONV_YUYV:
+        YUYV2RGB(&in[0], &out[0], width*height*2, layout);
+        break;
+    case CONV_NV12:
+        NV122RGB(&in[0], &out[0], width, height, layout);
+        break;
+    case CONV_I420:
+        YU122RGB(&in[0], &out[0], width, height, layout);
+        break;
+    default:
+        break;
+    }
+}
+
+int main(int argc, char*argv[])
+{
+    srand(1234);
+
+    printf("OpenPNP Capture YUV converter test\n");
+
+    for(uint32_t s=0; s<sizeof(frameSizes)/sizeof(frameSizes[0]); s++)
+    {
+        const uint32_t width  = frameSizes[s].width;
+        const uint32_t height = frameSizes[s].height;
+
+        for(uint32_t c=0; c<CONV_COUNT; c++)
+        for(uint32_t l=0; l<PIXEL_LAYOUT_COUNT; l++)
+        {
+            ConverterType conv = static_cast<ConverterType>(c);
+            PixelLayout layout = static_cast<PixelLayout>(l);
+            const uint32_t outBytes = width*height*pixelLayoutBytes(layout);
+            std::vector<uint8_t> in(inputBytes(conv, width, height));
+            std::vector<uint8_t> reference(outBytes);
+            std::vector<uint8_t> result(outBytes);
+            fillRandom(in);
+
+            setYUVKernelSet(YUV_KERNELS_SCALAR);
+            convert(conv, in, reference, width, height, layout);
+
+            for(uint32_t k=0; k<YUV_KERNELS_COUNT; k++)
+            {
+                YUVKernelSet set = static_cast<YUVKernelSet>(k);
+                if (!setYUVKernelSet(set))
+                {
+                    continue;
+                }
+
+                // fill the output with a pattern so untouched
+                // pixels are detected too
+                memset(&result[0], 0xA5, result.size());
+
+                auto tstart = std::chrono::steady_clock::now();
+                convert(conv, in, result, width, height, layout);
+                auto tend = std::chrono::steady_clock::now();
+                double us = std::chrono::duration<double, std::micro>(tend - tstart).count();
+
+                bool ok = (memcmp(&reference[0], &result[0], result.size()) == 0);
+                if (!ok)
+                {
+                    failures++;
+                }
+
+                printf("%s %4d x %4d %-6s %-6s : %s (%.1f us)\n", converterNames[c], width, height,
+                    layoutNames[l], getYUVKernelSetName(set), ok ? "OK" : "MISMATCH", us);
+            }
+        }
+    }
+
+    // check the layouts against each other using the scalar kernels
+    {
+        const uint32_t width  = 64;
+        const uint32_t height = 2;
+        std::vector<uint8_t> in(inputBytes(CONV_NV12, width, height));
+        std::vector<uint8_t> rgb(width*height*3);
+        std::vector<uint8_t> bgr(width*height*3);
+        std::vector<uint8_t> rgba(width*height*4);
+        fillRandom(in);
+
+        setYUVKernelSet(YUV_KERNELS_SCALAR);
+        convert(CONV_NV12, in, rgb, width, height, PIXEL_LAYOUT_RGB24);
+        convert(CONV_NV12, in, bgr, width, height, PIXEL_LAYOUT_BGR24);
+        convert(CONV_NV12, in, rgba, width, height, PIXEL_LAYOUT_RGBA32);
+
+        bool ok = true;
+        for(uint32_t i=0; i<width*height; i++)
+        {
+            ok &= (rgb[3*i+0] == bgr[3*i+2]) && (rgb[3*i+1] == bgr[3*i+1]) && (rgb[3*i+2] == bgr[3*i+0]);
+            ok &= (rgb[3*i+0] == rgba[4*i+0]) && (rgb[3*i+1] == rgba[4*i+1]) && (rgb[3*i+2] == rgba[4*i+2]);
+            ok &= (rgba[4*i+3] == 255);
+        }
+        if (!ok)
+        {
+            failures++;
+        }
+        printf("Layout consistency : %s\n", ok ? "OK" : "MISMATCH");
+    }
+
+    // a region must match the same pixels of the full frame
+    {
+        const uint32_t width  = 642;
+        const uint32_t height = 482;
+        const uint32_t x = 34, y = 17, columns = 302, rows = 201;
+        std::vector<uint8_t> in(inputBytes(CONV_NV12, width, height));
+        std::vector<uint8_t> full(width*height*3);
+        std::vector<uint8_t> region(columns*rows*3);
+        fillRandom(in);
+
+        for(uint32_t c=CONV_NV12; c<CONV_COUNT; c++)
+        for(uint32_t k=0; k<YUV_KERNELS_COUNT; k++)
+        {
+            YUVKernelSet set = static_cast<YUVKernelSet>(k);
+            if (!setYUVKernelSet(set))
+            {
+                continue;
+            }
+
+            ConverterType conv = static_cast<ConverterType>(c);
+            convert(conv, in, full, width, height, PIXEL_LAYOUT_RGB24);
+            memset(&region[0], 0xA5, region.size());
+            if (conv == CONV_NV12)
+            {
+                NV122RGBRegion(&in[0], &region[0], width, height, x, y, columns, 0, rows);
+            }
+            else
+            {
+                YU122RGBRegion(&in[0], &region[0], width, height, x, y, columns, 0, rows);
+            }
+
+            bool ok = true;
+            for(uint32_t row=0; row<rows; row++)
+            {
+                ok &= (memcmp(&region[row*columns*3], &full[((y + row)*width + x)*3], columns*3) == 0);
+            }
+            if (!ok)
+            {
+                failures++;
+            }
+            printf("%s region %-6s : %s\n", converterNames[c], getYUVKernelSetName(set), ok ? "OK" : "MISMATCH");
+        }
+    }
+
+    return testResult();
+}
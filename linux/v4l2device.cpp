@@ -0,0 +1,249 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux V4L2 device helpers: ioctl dispatch, frame size
+    enumeration and sensor crop/binning negotiation.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include "../common/logging.h"
+#include "v4l2device.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+static IoctlHandler ioctlHandler = nullptr;
+
+int xioctl(int fd, unsigned long request, void *arg)
+{
+    int r;
+
+    do 
+    {
+        r = (ioctlHandler != nullptr) ? ioctlHandler(fd, request, arg) : ioctl(fd, request, arg);
+    } while ((r == -1) && (errno == EINTR));
+
+    return r;
+}
+
+IoctlHandler setIoctlHandler(IoctlHandler handler)
+{
+    IoctlHandler previous = ioctlHandler;
+    ioctlHandler = handler;
+    return previous;
+}
+
+/** common sensor sizes, reported for stepwise 
+    and continuous frame size ranges */
+static const struct
+{
+    uint32_t width;
+    uint32_t height;
+} commonSizes[] =
+{
+    {320, 240},
+    {640, 480},
+    {800, 600},
+    {1024, 768},
+    {1280, 720},
+    {1280, 960},
+    {1600, 1200},
+    {1920, 1080},
+    {2048, 1536},
+    {2592, 1944},
+    {3840, 2160},
+    {4096, 3072}
+};
+
+/** returns true if 'value' is within a stepwise range and on one of its steps */
+static bool onStep(uint32_t value, uint32_t minValue, uint32_t maxValue, uint32_t step)
+{
+    if ((value < minValue) || (value > maxValue))
+    {
+        return false;
+    }
+    return (step <= 1) || (((value - minValue) % step) == 0);
+}
+
+static void addFrameSize(int fd, uint32_t pixelformat, uint32_t width, uint32_t height,
+    std::vector<CapFormatInfo> &formats)
+{
+    CapFormatInfo cinfo;
+    cinfo.fourcc = pixelformat;
+    cinfo.width  = width;
+    cinfo.height = height;
+    cinfo.fps    = findMaxFrameRate(fd, pixelformat, width, height);
+    cinfo.bpp    = 0;
+    formats.push_back(cinfo);
+    LOG(LOG_VERBOSE, "  %d x %d\n", width, height);
+}
+
+void enumerateFrameSizes(int fd, uint32_t pixelformat, std::vector<CapFormatInfo> &formats)
+{
+    v4l2_frmsizeenum frmSize;
+    CLEAR(frmSize);
+    frmSize.pixel_format = pixelformat;
+    while(xioctl(fd, VIDIOC_ENUM_FRAMESIZES, &frmSize) != -1)
+    {
+        if (frmSize.type == V4L2_FRMSIZE_TYPE_DISCRETE)
+        {
+            addFrameSize(fd, pixelformat, frmSize.discrete.width, frmSize.discrete.height, formats);
+            frmSize.index++;
+            continue;
+        }
+
+        // A stepwise or continuous range is the only entry. 
+        // The application picks a format from a list, so 
+        // the sizes it is most likely to want are listed.
+        const v4l2_frmsize_stepwise &range = frmSize.stepwise;
+        const bool continuous = (frmSize.type == V4L2_FRMSIZE_TYPE_CONTINUOUS);
+        const uint32_t stepWidth  = continuous ? 1 : range.step_width;
+        const uint32_t stepHeight = continuous ? 1 : range.step_height;
+        LOG(LOG_VERBOSE, "  %s %d x %d .. %d x %d, step %d x %d\n", continuous ? "continuous" : "stepwise",
+            range.min_width, range.min_height, range.max_width, range.max_height, stepWidth, stepHeight);
+
+        bool added = false;
+        for(uint32_t i=0; i<sizeof(commonSizes)/sizeof(commonSizes[0]); i++)
+        {
+            const uint32_t width  = commonSizes[i].width;
+            const uint32_t height = commonSizes[i].height;
+            if (onStep(width, range.min_width, range.max_width, stepWidth) &&
+                onStep(height, range.min_height, range.max_height, stepHeight) &&
+                ((width != range.max_width) || (height != range.max_height)))
+            {
+                addFrameSize(fd, pixelformat, width, height, formats);
+                added = true;
+            }
+        }
+
+        if (!added && ((range.min_width != range.max_width) || (range.min_height != range.max_height)))
+        {
+            addFrameSize(fd, pixelformat, range.min_width, range.min_height, formats);
+        }
+        addFrameSize(fd, pixelformat, range.max_width, range.max_height, formats);
+        return;
+    }
+}
+
+uint32_t findMaxFrameRate(int fd, uint32_t pixelformat, uint32_t width, uint32_t height)
+{
+    uint32_t fps = 0;
+
+    // now search the frame rates
+    v4l2_frmivalenum ivals;
+    CLEAR(ivals);
+    ivals.pixel_format = pixelformat;
+    ivals.width = width;
+    ivals.height = height;
+    ivals.index = 0;
+    LOG(LOG_VERBOSE,"Finding max frame rates: \n");
+    while (xioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &ivals) != -1)
+    {
+        // the shortest interval of a stepwise or
+        // continuous range is its minimum.
+        const v4l2_fract &interval = (ivals.type == V4L2_FRMIVAL_TYPE_DISCRETE) ? 
+            ivals.discrete : ivals.stepwise.min;
+        if (interval.numerator != 0)
+        {
+            LOG(LOG_VERBOSE,"  FPS %d/%d\n", interval.denominator, interval.numerator);
+            uint32_t v = interval.denominator/interval.numerator;
+            if (fps < v)
+            {
+                fps = v;
+            }
+        }
+
+        if (ivals.type != V4L2_FRMIVAL_TYPE_DISCRETE)
+        {
+            break;  // a range is the only entry
+        }
+        ivals.index++;
+    }
+
+    return fps;
+}
+
+bool setSensorWindow(int fd, v4l2_rect &crop, uint32_t binning, v4l2_format &fmt)
+{
+    if (binning == 0)
+    {
+        binning = 1;
+    }
+
+    v4l2_selection sel;
+    CLEAR(sel);
+    sel.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    sel.target = V4L2_SEL_TGT_CROP_DEFAULT;
+    if (xioctl(fd, VIDIOC_G_SELECTION, &sel) == -1)
+    {
+        LOG(LOG_WARNING, "setSensorWindow: the device does not support cropping (errno = %d)\n", errno);
+        return false;
+    }
+
+    const v4l2_rect defaultCrop = sel.r;
+    if ((crop.width != 0) && (crop.height != 0))
+    {
+        sel.r = crop;
+    }
+
+    // the driver adjusts the rectangle to what the sensor
+    // can deliver, keeping it inside the requested one
+    // where possible.
+    sel.target = V4L2_SEL_TGT_CROP;
+    sel.flags  = V4L2_SEL_FLAG_LE;
+    if (xioctl(fd, VIDIOC_S_SELECTION, &sel) == -1)
+    {
+        LOG(LOG_WARNING, "setSensorWindow: could not set the crop rectangle (errno = %d)\n", errno);
+        return false;
+    }
+
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width  = sel.r.width / binning;
+    fmt.fmt.pix.height = sel.r.height / binning;
+    fmt.fmt.pix.bytesperline = 0;
+    fmt.fmt.pix.sizeimage = 0;
+    if (xioctl(fd, VIDIOC_S_FMT, &fmt) == -1)
+    {
+        LOG(LOG_ERR, "setSensorWindow: could not set a %d x %d format (errno = %d)\n", 
+            fmt.fmt.pix.width, fmt.fmt.pix.height, errno);
+
+        // leave the sensor uncropped for the regular format
+        sel.r = defaultCrop;
+        sel.flags = 0;
+        xioctl(fd, VIDIOC_S_SELECTION, &sel);
+        return false;
+    }
+
+    // setting the format can change the crop rectangle
+    sel.target = V4L2_SEL_TGT_CROP;
+    if (xioctl(fd, VIDIOC_G_SELECTION, &sel) == -1)
+    {
+        return false;
+    }
+    crop = sel.r;
+    LOG(LOG_INFO, "Sensor window %d x %d at (%d, %d), frame %d x %d\n", crop.width, crop.height, 
+        crop.left, crop.top, fmt.fmt.pix.width, fmt.fmt.pix.height);
+    return true;
+}
@@ -0,0 +1,74 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux V4L2 device helpers: ioctl dispatch, frame size
+    enumeration and sensor crop/binning negotiation.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef linux_v4l2device_h
+#define linux_v4l2device_h
+
+#include <stdint.h>
+#include <vector>
+#include <linux/videodev2.h>
+
+#include "openpnp-capture.h"
+
+/** A function that performs an ioctl on a V4L2 device, see setIoctlHandler */
+typedef int (*IoctlHandler)(int fd, unsigned long request, void *arg);
+
+/** Perform an ioctl on a V4L2 device and retry it when it 
+    is interrupted by a signal. */
+int xioctl(int fd, unsigned long request, void *arg);
+
+/** Replace the function xioctl uses to reach the devices, so
+    tests can emulate a device. nullptr selects ioctl() again.
+    Returns the previous handler. Not thread safe, install the
+    handler before any device is used. */
+IoctlHandler setIoctlHandler(IoctlHandler handler);
+
+/** Append the frame sizes a device supports for a pixel format
+    to 'formats', each with its maximum frame rate. Stepwise and 
+    continuous ranges are reported as their largest size and the
+    common sizes within the range that lie on its steps. */
+void enumerateFrameSizes(int fd, uint32_t pixelformat, std::vector<CapFormatInfo> &formats);
+
+/** Return the highest frame rate a device supports for a pixel
+    format and frame size, or 0 if it does not report one. */
+uint32_t findMaxFrameRate(int fd, uint32_t pixelformat, uint32_t width, uint32_t height);
+
+/** Make the sensor deliver only the rectangle 'crop', or its 
+    full default area if crop is all zeros, at 1/binning of its
+    size. The crop rectangle is set with VIDIOC_S_SELECTION and
+    the frame size with VIDIOC_S_FMT, so the driver bins or 
+    scales the rectangle to the frame size. 'fmt' holds the 
+    requested pixel format and field, and receives the format the
+    driver selected. 'crop' receives the rectangle the driver 
+    selected, which can be adjusted to the sensor's alignment.
+    Returns false if the device does not support cropping or 
+    the format could not be set.
+*/
+bool setSensorWindow(int fd, v4l2_rect &crop, uint32_t binning, v4l2_format &fmt);
+
+#endif
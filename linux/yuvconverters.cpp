@@ -28,7 +28,10 @@
     
 */
 
+#include <atomic>
 #include "yuvconverters.h"
+#include "yuvkernels.h"
+#include "../common/logging.h"
 
 static inline uint8_t clamp(int16_t v)
 {
@@ -37,6 +40,38 @@ static inline uint8_t clamp(int16_t v)
     return v;
 }
 
+/** write one pixel in the requested layout and advance
+    the output pointer */
+static inline void storePixel(uint8_t *&out, PixelLayout layout, uint8_t r, uint8_t g, uint8_t b)
+{
+    switch(layout)
+    {
+    case PIXEL_LAYOUT_BGR24:
+        out[0] = b;
+        out[1] = g;
+        out[2] = r;
+        out += 3;
+        break;
+    case PIXEL_LAYOUT_RGBA32:
+        out[0] = r;
+        out[1] = g;
+        out[2] = b;
+        out[3] = 255;
+        out += 4;
+        break;
+    default:
+        out[0] = r;
+        out[1] = g;
+        out[2] = b;
+        out += 3;
+        break;
+    }
+}
+
+// **********************************************************************
+//   Scalar reference kernels
+// **********************************************************************
+
 /*
     In the YUYV2/YUV2 pixel, the order of the fields is:
     Y0 | Cr | Y1 | Cb ... repeating, which encode two 24-bit pixels.
@@ -54,9 +89,9 @@ static inline uint8_t clamp(int16_t v)
     B = Y + 1.770U'
 
 */
-void YUYV2RGB(const uint8_t *yuv, uint8_t *rgb, uint32_t bytes)
+void YUYVRow_scalar(const uint8_t *yuv, uint8_t *rgb, uint32_t pixels, PixelLayout layout)
 {
-    while(bytes > 3)
+    while(pixels > 1)
     {
         int16_t y0 = *yuv++;    // Y0
         int16_t cr = *yuv++;    // Cr (aka U)
@@ -65,13 +100,15 @@ void YUYV2RGB(const uint8_t *yuv, uint8_t *rgb, uint32_t bytes)
 
         int16_t yy0 = 19*(y0 - 16); 
         int16_t yy1 = 19*(y1 - 16); 
-        *rgb++ = clamp((yy0                 + 32*(cb - 128)) >> 4);
-        *rgb++ = clamp((yy0 - 13*(cr - 128) -  6*(cb - 128)) >> 4);
-        *rgb++ = clamp((yy0 + 26*(cr - 128)                ) >> 4);
-        *rgb++ = clamp((yy1                 + 32*(cb - 128)) >> 4);
-        *rgb++ = clamp((yy1 - 13*(cr - 128) -  6*(cb - 128)) >> 4);
-        *rgb++ = clamp((yy1 + 26*(cr - 128)                ) >> 4);
-        bytes -= 4;
+        storePixel(rgb, layout,
+            clamp((yy0                 + 32*(cb - 128)) >> 4),
+            clamp((yy0 - 13*(cr - 128) -  6*(cb - 128)) >> 4),
+            clamp((yy0 + 26*(cr - 128)                ) >> 4));
+        storePixel(rgb, layout,
+            clamp((yy1                 + 32*(cb - 128)) >> 4),
+            clamp((yy1 - 13*(cr - 128) -  6*(cb - 128)) >> 4),
+            clamp((yy1 + 26*(cr - 128)                ) >> 4));
+        pixels -= 2;
     }
 }
 
@@ -90,37 +127,26 @@ void YUYV2RGB(const uint8_t *yuv, uint8_t *rgb, uint32_t bytes)
 
     Each 2x2 Y block shares one U,V pair.
 */
-void NV122RGB(const uint8_t *nv12, uint8_t *rgb, uint32_t width, uint32_t height)
+void NV12Row_scalar(const uint8_t *y_row, const uint8_t *uv_row, uint8_t *rgb, uint32_t width, PixelLayout layout)
 {
-    const uint8_t *y_plane = nv12;
-    const uint8_t *uv_plane = nv12 + (width * height);
-
-    for (uint32_t row = 0; row < height; row++)
+    for (uint32_t col = 0; col < width; col++)
     {
-        for (uint32_t col = 0; col < width; col++)
-        {
-            // Get Y value for current pixel
-            int16_t y = y_plane[row * width + col];
+        // Get Y value for current pixel
+        int16_t y = y_row[col];
 
-            // Get U,V values (shared by 2x2 pixel blocks)
-            uint32_t uv_row = row / 2;
-            uint32_t uv_col = col / 2;
-            uint32_t uv_index = uv_row * width + uv_col * 2;
+        // Get U,V values (shared by 2x2 pixel blocks)
+        uint32_t uv_index = (col / 2) * 2;
 
-            int16_t u = uv_plane[uv_index];      // Cb
-            int16_t v = uv_plane[uv_index + 1];  // Cr
+        int16_t u = uv_row[uv_index];      // Cb
+        int16_t v = uv_row[uv_index + 1];  // Cr
 
-            // Convert YUV to RGB using the same coefficients as YUYV
-            int16_t yy = 19 * (y - 16);
+        // Convert YUV to RGB using the same coefficients as YUYV
+        int16_t yy = 19 * (y - 16);
 
-            // Calculate RGB index
-            uint32_t rgb_index = (row * width + col) * 3;
-
-            // R, G, B order (RGB24)
-            rgb[rgb_index]     = clamp((yy + 26 * (v - 128)) >> 4);
-            rgb[rgb_index + 1] = clamp((yy - 13 * (v - 128) - 6 * (u - 128)) >> 4);
-            rgb[rgb_index + 2] = clamp((yy + 32 * (u - 128)) >> 4);
-        }
+        storePixel(rgb, layout,
+            clamp((yy + 26 * (v - 128)) >> 4),
+            clamp((yy - 13 * (v - 128) - 6 * (u - 128)) >> 4),
+            clamp((yy + 32 * (u - 128)) >> 4));
     }
 }
 
@@ -142,37 +168,235 @@ void NV122RGB(const uint8_t *nv12, uint8_t *rgb, uint32_t width, uint32_t height
 
     Each 2x2 Y block shares one U and one V value.
 */
-void YU122RGB(const uint8_t *yu12, uint8_t *rgb, uint32_t width, uint32_t height)
+void I420Row_scalar(const uint8_t *y_row, const uint8_t *u_row, const uint8_t *v_row, uint8_t *rgb, uint32_t width, PixelLayout layout)
 {
-    const uint8_t *y_plane = yu12;
-    const uint8_t *u_plane = yu12 + (width * height);
-    const uint8_t *v_plane = u_plane + (width * height / 4);
+    for (uint32_t col = 0; col < width; col++)
+    {
+        // Get Y value for current pixel
+        int16_t y = y_row[col];
+
+        // Get U,V values (shared by 2x2 pixel blocks)
+        int16_t u = u_row[col / 2];  // Cb
+        int16_t v = v_row[col / 2];  // Cr
+
+        // Convert YUV to RGB using the same coefficients as YUYV
+        int16_t yy = 19 * (y - 16);
+
+        storePixel(rgb, layout,
+            clamp((yy + 26 * (v - 128)) >> 4),
+            clamp((yy - 13 * (v - 128) - 6 * (u - 128)) >> 4),
+            clamp((yy + 32 * (u - 128)) >> 4));
+    }
+}
+
+// **********************************************************************
+//   Run-time kernel selection
+// **********************************************************************
+
+static const YUVKernels g_scalarKernels =
+{
+    YUYVRow_scalar,
+    NV12Row_scalar,
+    I420Row_scalar
+};
+
+static const YUVKernels* lookupKernels(YUVKernelSet set)
+{
+    switch(set)
+    {
+    case YUV_KERNELS_SCALAR:
+        return &g_scalarKernels;
+    case YUV_KERNELS_SSE2:
+#if defined(__x86_64__) || defined(__i386__)
+        if (__builtin_cpu_supports("sse2"))
+        {
+            return getSSE2Kernels();
+        }
+#endif
+        return nullptr;
+    case YUV_KERNELS_AVX2:
+#if defined(__x86_64__) || defined(__i386__)
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return getAVX2Kernels();
+        }
+#endif
+        return nullptr;
+    case YUV_KERNELS_NEON:
+        return getNEONKernels();
+    default:
+        return nullptr;
+    }
+}
 
-    for (uint32_t row = 0; row < height; row++)
+static YUVKernelSet findBestKernelSet()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+#endif
+
+    static const YUVKernelSet preference[] = 
+    {
+        YUV_KERNELS_AVX2,
+        YUV_KERNELS_NEON,
+        YUV_KERNELS_SSE2
+    };
+
+    for(uint32_t i=0; i<sizeof(preference)/sizeof(preference[0]); i++)
     {
-        for (uint32_t col = 0; col < width; col++)
+        if (lookupKernels(preference[i]) != nullptr)
         {
-            // Get Y value for current pixel
-            int16_t y = y_plane[row * width + col];
+            return preference[i];
+        }
+    }
+    return YUV_KERNELS_SCALAR;
+}
 
-            // Get U,V values (shared by 2x2 pixel blocks)
-            uint32_t uv_row = row / 2;
-            uint32_t uv_col = col / 2;
-            uint32_t uv_index = uv_row * (width / 2) + uv_col;
+static std::atomic<int32_t> g_kernelSet(-1);
 
-            int16_t u = u_plane[uv_index];  // Cb
-            int16_t v = v_plane[uv_index];  // Cr
+static const YUVKernels* activeKernels()
+{
+    int32_t set = g_kernelSet.load(std::memory_order_relaxed);
+    if (set < 0)
+    {
+        set = findBestKernelSet();
+        g_kernelSet = set;
+        LOG(LOG_INFO, "Using %s YUV conversion kernels\n", getYUVKernelSetName(static_cast<YUVKernelSet>(set)));
+    }
+    return lookupKernels(static_cast<YUVKernelSet>(set));
+}
 
-            // Convert YUV to RGB using the same coefficients as YUYV
-            int16_t yy = 19 * (y - 16);
+bool isYUVKernelSetSupported(YUVKernelSet set)
+{
+    return lookupKernels(set) != nullptr;
+}
 
-            // Calculate RGB index
-            uint32_t rgb_index = (row * width + col) * 3;
+bool setYUVKernelSet(YUVKernelSet set)
+{
+    if (!isYUVKernelSetSupported(set))
+    {
+        return false;
+    }
+    g_kernelSet = set;
+    return true;
+}
 
-            // R, G, B order (RGB24)
-            rgb[rgb_index]     = clamp((yy + 26 * (v - 128)) >> 4);
-            rgb[rgb_index + 1] = clamp((yy - 13 * (v - 128) - 6 * (u - 128)) >> 4);
-            rgb[rgb_index + 2] = clamp((yy + 32 * (u - 128)) >> 4);
-        }
+YUVKernelSet getYUVKernelSet()
+{
+    activeKernels();
+    return static_cast<YUVKernelSet>(g_kernelSet.load());
+}
+
+const char* getYUVKernelSetName(YUVKernelSet set)
+{
+    switch(set)
+    {
+    case YUV_KERNELS_SCALAR:
+        return "scalar";
+    case YUV_KERNELS_SSE2:
+        return "SSE2";
+    case YUV_KERNELS_AVX2:
+        return "AVX2";
+    case YUV_KERNELS_NEON:
+        return "NEON";
+    default:
+        return "unknown";
+    }
+}
+
+// **********************************************************************
+//   Frame converters
+// **********************************************************************
+
+void YUYV2RGB(const uint8_t *yuv, uint8_t *rgb, uint32_t bytes, PixelLayout layout)
+{
+    activeKernels()->yuyvRow(yuv, rgb, (bytes / 4) * 2, layout);
+}
+
+void NV122RGB(const uint8_t *nv12, uint8_t *rgb, uint32_t width, uint32_t height, PixelLayout layout)
+{
+    NV122RGBRows(nv12, rgb, width, height, 0, height, layout);
+}
+
+void YU122RGB(const uint8_t *yu12, uint8_t *rgb, uint32_t width, uint32_t height, PixelLayout layout)
+{
+    YU122RGBRows(yu12, rgb, width, height, 0, height, layout);
+}
+
+void NV122RGBRows(const uint8_t *nv12, uint8_t *rgb, uint32_t width, uint32_t height,
+    uint32_t firstRow, uint32_t lastRow, PixelLayout layout)
+{
+    NV122RGBRegion(nv12, rgb, width, height, 0, 0, width, firstRow, lastRow, layout);
+}
+
+void YU122RGBRows(const uint8_t *yu12, uint8_t *rgb, uint32_t width, uint32_t height,
+    uint32_t firstRow, uint32_t lastRow, PixelLayout layout)
+{
+    YU122RGBRegion(yu12, rgb, width, height, 0, 0, width, firstRow, lastRow, layout);
+}
+
+void NV122RGBRegion(const uint8_t *nv12, uint8_t *rgb, uint32_t width, uint32_t height,
+    uint32_t x, uint32_t y, uint32_t columns, uint32_t firstRow, uint32_t lastRow, 
+    PixelLayout layout)
+{
+    const YUVKernels *kernels = activeKernels();
+    const uint8_t *y_plane = nv12;
+    const uint8_t *uv_plane = nv12 + (width * height);
+    const uint32_t rowBytes = columns * pixelLayoutBytes(layout);
+
+    // the interleaved chroma of a pixel pair starts 
+    // at the same offset as its luminance
+    for (uint32_t row = firstRow; row < lastRow; row++)
+    {
+        kernels->nv12Row(y_plane + (y + row) * width + x, 
+            uv_plane + ((y + row) / 2) * width + x,
+            rgb + row * rowBytes, columns, layout);
+    }
+}
+
+void YU122RGBRegion(const uint8_t *yu12, uint8_t *rgb, uint32_t width, uint32_t height,
+    uint32_t x, uint32_t y, uint32_t columns, uint32_t firstRow, uint32_t lastRow, 
+    PixelLayout layout)
+{
+    const YUVKernels *kernels = activeKernels();
+    const uint8_t *y_plane = yu12;
+    const uint8_t *u_plane = yu12 + (width * height);
+    const uint8_t *v_plane = u_plane + (width * height / 4);
+    const uint32_t rowBytes = columns * pixelLayoutBytes(layout);
+
+    for (uint32_t row = firstRow; row < lastRow; row++)
+    {
+        const uint32_t uv_offset = ((y + row) / 2) * (width / 2) + x / 2;
+        kernels->i420Row(y_plane + (y + row) * width + x,
+            u_plane + uv_offset, v_plane + uv_offset,
+            rgb + row * rowBytes, columns, layout);
+    }
+}
+
+void YUYV2GRAY(const uint8_t *yuv, uint8_t *gray, uint32_t bytes)
+{
+    const uint32_t pixels = bytes / 2;
+    for (uint32_t i = 0; i < pixels; i++)
+    {
+        gray[i] = yuv[2*i];
+    }
+}
+
+void RGB2Layout(const uint8_t *rgb, uint8_t *out, uint32_t pixels, PixelLayout layout)
+{
+    for (uint32_t i = 0; i < pixels; i++)
+    {
+        storePixel(out, layout, rgb[0], rgb[1], rgb[2]);
+        rgb += 3;
+    }
+}
+
+void RGB2GRAY(const uint8_t *rgb, uint8_t *gray, uint32_t pixels)
+{
+    for (uint32_t i = 0; i < pixels; i++)
+    {
+        // Y = 0.299 R + 0.587 G + 0.114 B
+        *gray++ = static_cast<uint8_t>((77*rgb[0] + 150*rgb[1] + 29*rgb[2] + 128) >> 8);
+        rgb += 3;
     }
 }
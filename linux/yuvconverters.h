@@ -33,8 +33,79 @@
 
 #include <stdint.h>
 
-void YUYV2RGB(const uint8_t *yuv, uint8_t *rgb, uint32_t bytes);
-void NV122RGB(const uint8_t *nv12, uint8_t *rgb, uint32_t width, uint32_t height);
-void YU122RGB(const uint8_t *yu12, uint8_t *rgb, uint32_t width, uint32_t height);
-    
+/** Pixel layouts the colour converters can write directly */
+enum PixelLayout
+{
+    PIXEL_LAYOUT_RGB24 = 0,     ///< R, G, B
+    PIXEL_LAYOUT_BGR24,         ///< B, G, R
+    PIXEL_LAYOUT_RGBA32,        ///< R, G, B, 255
+    PIXEL_LAYOUT_COUNT
+};
+
+/** return the number of bytes per pixel of a layout */
+inline uint32_t pixelLayoutBytes(PixelLayout layout)
+{
+    return (layout == PIXEL_LAYOUT_RGBA32) ? 4 : 3;
+}
+
+void YUYV2RGB(const uint8_t *yuv, uint8_t *rgb, uint32_t bytes, PixelLayout layout = PIXEL_LAYOUT_RGB24);
+void NV122RGB(const uint8_t *nv12, uint8_t *rgb, uint32_t width, uint32_t height, PixelLayout layout = PIXEL_LAYOUT_RGB24);
+void YU122RGB(const uint8_t *yu12, uint8_t *rgb, uint32_t width, uint32_t height, PixelLayout layout = PIXEL_LAYOUT_RGB24);
+
+/** Convert only the rows firstRow .. lastRow-1 of a frame.
+    Each row is converted independently, so bands of rows 
+    of the same frame can be converted in parallel. */
+void NV122RGBRows(const uint8_t *nv12, uint8_t *rgb, uint32_t width, uint32_t height,
+    uint32_t firstRow, uint32_t lastRow, PixelLayout layout = PIXEL_LAYOUT_RGB24);
+void YU122RGBRows(const uint8_t *yu12, uint8_t *rgb, uint32_t width, uint32_t height,
+    uint32_t firstRow, uint32_t lastRow, PixelLayout layout = PIXEL_LAYOUT_RGB24);
+
+/** Convert only the 'columns' pixels starting at column 'x' 
+    of the rows y+firstRow .. y+lastRow-1 of a frame into a
+    compact region 'columns' pixels wide. Row 0 of the output 
+    is frame row y. x must be even. */
+void NV122RGBRegion(const uint8_t *nv12, uint8_t *rgb, uint32_t width, uint32_t height,
+    uint32_t x, uint32_t y, uint32_t columns, uint32_t firstRow, uint32_t lastRow, 
+    PixelLayout layout = PIXEL_LAYOUT_RGB24);
+void YU122RGBRegion(const uint8_t *yu12, uint8_t *rgb, uint32_t width, uint32_t height,
+    uint32_t x, uint32_t y, uint32_t columns, uint32_t firstRow, uint32_t lastRow, 
+    PixelLayout layout = PIXEL_LAYOUT_RGB24);
+
+/** Extract the luminance of packed YUYV pixels as 8-bit gray.
+    The planar formats store luminance as a separate 
+    8-bit plane, which can be copied as-is. */
+void YUYV2GRAY(const uint8_t *yuv, uint8_t *gray, uint32_t bytes);
+
+/** Rearrange packed 24-bit RGB pixels into another layout */
+void RGB2Layout(const uint8_t *rgb, uint8_t *out, uint32_t pixels, PixelLayout layout);
+
+/** Convert packed 24-bit RGB pixels to 8-bit gray using
+    the BT.601 luminance weights */
+void RGB2GRAY(const uint8_t *rgb, uint8_t *gray, uint32_t pixels);
+
+/** The converters above use the fastest set of kernels the
+    CPU supports, which is determined at run time. All kernel
+    sets produce bit-exact results compared to the scalar one. */
+enum YUVKernelSet
+{
+    YUV_KERNELS_SCALAR = 0,
+    YUV_KERNELS_SSE2,
+    YUV_KERNELS_AVX2,
+    YUV_KERNELS_NEON,
+    YUV_KERNELS_COUNT
+};
+
+/** returns true if the CPU supports a kernel set */
+bool isYUVKernelSetSupported(YUVKernelSet set);
+
+/** force the use of a specific kernel set, 
+    returns false if the CPU does not support it */
+bool setYUVKernelSet(YUVKernelSet set);
+
+/** return the kernel set currently in use */
+YUVKernelSet getYUVKernelSet();
+
+/** return a human readable name of a kernel set */
+const char* getYUVKernelSetName(YUVKernelSet set);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,556 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux platform code
+    SIMD YUV to RGB row conversion kernels
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+    
+*/
+
+/*
+    All kernels below compute exactly the same 16-bit integer 
+    expressions as the scalar kernels in yuvconverters.cpp:
+
+        yy = 19*(Y - 16)
+        c0 = (yy + 26*V') >> 4
+        c1 = (yy - 13*V' - 6*U') >> 4
+        c2 = (yy + 32*U') >> 4
+
+    with U' = U - 128 and V' = V - 128. None of the intermediate
+    values exceed the range of an int16_t and the final clamp to 
+    0..255 is done by a saturating pack, so the results are 
+    bit-exact.
+
+    The kernels are compiled with per-function target attributes
+    so the library itself does not need to be built for a 
+    specific CPU; yuvconverters.cpp selects the kernel set at 
+    run time.
+*/
+
+#include "yuvkernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+// **********************************************************************
+//   SSE2 kernels, 16 pixels per iteration
+// **********************************************************************
+
+/** compute the three output channels of 8 pixels */
+static inline TARGET_SSE2 void sse2Pixels(__m128i y, __m128i u, __m128i v, 
+    __m128i &c0, __m128i &c1, __m128i &c2)
+{
+    const __m128i k16  = _mm_set1_epi16(16);
+    const __m128i k128 = _mm_set1_epi16(128);
+
+    __m128i yy = _mm_mullo_epi16(_mm_sub_epi16(y, k16), _mm_set1_epi16(19));
+    u = _mm_sub_epi16(u, k128);
+    v = _mm_sub_epi16(v, k128);
+
+    c0 = _mm_srai_epi16(_mm_add_epi16(yy, _mm_mullo_epi16(v, _mm_set1_epi16(26))), 4);
+    c1 = _mm_srai_epi16(_mm_sub_epi16(_mm_sub_epi16(yy, 
+            _mm_mullo_epi16(v, _mm_set1_epi16(13))), 
+            _mm_mullo_epi16(u, _mm_set1_epi16(6))), 4);
+    c2 = _mm_srai_epi16(_mm_add_epi16(yy, _mm_slli_epi16(u, 5)), 4);
+}
+
+/** write 16 pixels of three channels as packed 24-bit pixels.
+    SSE2 has no byte shuffle, so the channels are interleaved
+    through a small buffer. */
+static inline TARGET_SSE2 void sse2Store(uint8_t *rgb, __m128i c0, __m128i c1, __m128i c2)
+{
+    alignas(16) uint8_t ch[3][16];
+    _mm_store_si128((__m128i*)ch[0], c0);
+    _mm_store_si128((__m128i*)ch[1], c1);
+    _mm_store_si128((__m128i*)ch[2], c2);
+    for(uint32_t i=0; i<16; i++)
+    {
+        *rgb++ = ch[0][i];
+        *rgb++ = ch[1][i];
+        *rgb++ = ch[2][i];
+    }
+}
+
+/** write 16 pixels of three channels as 32-bit pixels with
+    an opaque alpha channel */
+static inline TARGET_SSE2 void sse2Store4(uint8_t *rgba, __m128i c0, __m128i c1, __m128i c2)
+{
+    const __m128i alpha = _mm_set1_epi8((char)0xFF);
+    __m128i lo01 = _mm_unpacklo_epi8(c0, c1);
+    __m128i hi01 = _mm_unpackhi_epi8(c0, c1);
+    __m128i lo2a = _mm_unpacklo_epi8(c2, alpha);
+    __m128i hi2a = _mm_unpackhi_epi8(c2, alpha);
+    _mm_storeu_si128((__m128i*)(rgba +  0), _mm_unpacklo_epi16(lo01, lo2a));
+    _mm_storeu_si128((__m128i*)(rgba + 16), _mm_unpackhi_epi16(lo01, lo2a));
+    _mm_storeu_si128((__m128i*)(rgba + 32), _mm_unpacklo_epi16(hi01, hi2a));
+    _mm_storeu_si128((__m128i*)(rgba + 48), _mm_unpackhi_epi16(hi01, hi2a));
+}
+
+/** write 16 pixels in the requested layout, c0 is red */
+static inline TARGET_SSE2 void sse2StoreLayout(uint8_t *out, PixelLayout layout, __m128i c0, __m128i c1, __m128i c2)
+{
+    switch(layout)
+    {
+    case PIXEL_LAYOUT_BGR24:
+        sse2Store(out, c2, c1, c0);
+        break;
+    case PIXEL_LAYOUT_RGBA32:
+        sse2Store4(out, c0, c1, c2);
+        break;
+    default:
+        sse2Store(out, c0, c1, c2);
+        break;
+    }
+}
+
+static TARGET_SSE2 void YUYVRow_sse2(const uint8_t *yuyv, uint8_t *rgb, uint32_t pixels, PixelLayout layout)
+{
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    const uint32_t bpp = pixelLayoutBytes(layout);
+    uint32_t done = 0;
+    for(; done + 16 <= pixels; done += 16)
+    {
+        __m128i c[2][3];
+        for(uint32_t half=0; half<2; half++)
+        {
+            // Y0 P0 Y1 Q0 ... -> Y as 16-bit values and the
+            // shared chroma values duplicated for each pixel
+            __m128i in = _mm_loadu_si128((const __m128i*)(yuyv + 2*done + 16*half));
+            __m128i y  = _mm_and_si128(in, lowBytes);
+            __m128i pq = _mm_srli_epi16(in, 8);
+            __m128i p  = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pq, _MM_SHUFFLE(2,2,0,0)), _MM_SHUFFLE(2,2,0,0));
+            __m128i q  = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pq, _MM_SHUFFLE(3,3,1,1)), _MM_SHUFFLE(3,3,1,1));
+
+            // the YUYV converter uses the second chroma byte as U
+            // and writes the channels in reverse order.
+            sse2Pixels(y, q, p, c[half][2], c[half][1], c[half][0]);
+        }
+        sse2StoreLayout(rgb + bpp*done, layout,
+            _mm_packus_epi16(c[0][0], c[1][0]),
+            _mm_packus_epi16(c[0][1], c[1][1]),
+            _mm_packus_epi16(c[0][2], c[1][2]));
+    }
+    YUYVRow_scalar(yuyv + 2*done, rgb + bpp*done, pixels - done, layout);
+}
+
+static TARGET_SSE2 void NV12Row_sse2(const uint8_t *y, const uint8_t *uv, uint8_t *rgb, uint32_t width, PixelLayout layout)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    const uint32_t bpp = pixelLayoutBytes(layout);
+    uint32_t done = 0;
+    for(; done + 16 <= width; done += 16)
+    {
+        __m128i yin  = _mm_loadu_si128((const __m128i*)(y + done));
+        __m128i uvin = _mm_loadu_si128((const __m128i*)(uv + done));
+        __m128i u = _mm_and_si128(uvin, lowBytes);
+        __m128i v = _mm_srli_epi16(uvin, 8);
+
+        __m128i lo[3], hi[3];
+        sse2Pixels(_mm_unpacklo_epi8(yin, zero), _mm_unpacklo_epi16(u, u), _mm_unpacklo_epi16(v, v), lo[0], lo[1], lo[2]);
+        sse2Pixels(_mm_unpackhi_epi8(yin, zero), _mm_unpackhi_epi16(u, u), _mm_unpackhi_epi16(v, v), hi[0], hi[1], hi[2]);
+        sse2StoreLayout(rgb + bpp*done, layout,
+            _mm_packus_epi16(lo[0], hi[0]),
+            _mm_packus_epi16(lo[1], hi[1]),
+            _mm_packus_epi16(lo[2], hi[2]));
+    }
+    NV12Row_scalar(y + done, uv + done, rgb + bpp*done, width - done, layout);
+}
+
+static TARGET_SSE2 void I420Row_sse2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *rgb, uint32_t width, PixelLayout layout)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const uint32_t bpp = pixelLayoutBytes(layout);
+    uint32_t done = 0;
+    for(; done + 16 <= width; done += 16)
+    {
+        __m128i yin = _mm_loadu_si128((const __m128i*)(y + done));
+        __m128i uin = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(u + done/2)), zero);
+        __m128i vin = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(v + done/2)), zero);
+
+        __m128i lo[3], hi[3];
+        sse2Pixels(_mm_unpacklo_epi8(yin, zero), _mm_unpacklo_epi16(uin, uin), _mm_unpacklo_epi16(vin, vin), lo[0], lo[1], lo[2]);
+        sse2Pixels(_mm_unpackhi_epi8(yin, zero), _mm_unpackhi_epi16(uin, uin), _mm_unpackhi_epi16(vin, vin), hi[0], hi[1], hi[2]);
+        sse2StoreLayout(rgb + bpp*done, layout,
+            _mm_packus_epi16(lo[0], hi[0]),
+            _mm_packus_epi16(lo[1], hi[1]),
+            _mm_packus_epi16(lo[2], hi[2]));
+    }
+    I420Row_scalar(y + done, u + done/2, v + done/2, rgb + bpp*done, width - done, layout);
+}
+
+// **********************************************************************
+//   AVX2 kernels, 16 pixels per iteration in 16-bit lanes
+// **********************************************************************
+
+/** byte shuffle masks to interleave three 16-byte channels
+    into 48 bytes of packed 24-bit pixels, indexed by output
+    block and channel. */
+alignas(16) static const uint8_t g_interleaveMasks[3][3][16] =
+{
+    {
+        {0x00,0x80,0x80,0x01,0x80,0x80,0x02,0x80,0x80,0x03,0x80,0x80,0x04,0x80,0x80,0x05},
+        {0x80,0x00,0x80,0x80,0x01,0x80,0x80,0x02,0x80,0x80,0x03,0x80,0x80,0x04,0x80,0x80},
+        {0x80,0x80,0x00,0x80,0x80,0x01,0x80,0x80,0x02,0x80,0x80,0x03,0x80,0x80,0x04,0x80}
+    },
+    {
+        {0x80,0x80,0x06,0x80,0x80,0x07,0x80,0x80,0x08,0x80,0x80,0x09,0x80,0x80,0x0A,0x80},
+        {0x05,0x80,0x80,0x06,0x80,0x80,0x07,0x80,0x80,0x08,0x80,0x80,0x09,0x80,0x80,0x0A},
+        {0x80,0x05,0x80,0x80,0x06,0x80,0x80,0x07,0x80,0x80,0x08,0x80,0x80,0x09,0x80,0x80}
+    },
+    {
+        {0x80,0x0B,0x80,0x80,0x0C,0x80,0x80,0x0D,0x80,0x80,0x0E,0x80,0x80,0x0F,0x80,0x80},
+        {0x80,0x80,0x0B,0x80,0x80,0x0C,0x80,0x80,0x0D,0x80,0x80,0x0E,0x80,0x80,0x0F,0x80},
+        {0x0A,0x80,0x80,0x0B,0x80,0x80,0x0C,0x80,0x80,0x0D,0x80,0x80,0x0E,0x80,0x80,0x0F}
+    }
+};
+
+/** compute the three output channels of 16 pixels */
+static inline TARGET_AVX2 void avx2Pixels(__m256i y, __m256i u, __m256i v, 
+    __m256i &c0, __m256i &c1, __m256i &c2)
+{
+    const __m256i k16  = _mm256_set1_epi16(16);
+    const __m256i k128 = _mm256_set1_epi16(128);
+
+    __m256i yy = _mm256_mullo_epi16(_mm256_sub_epi16(y, k16), _mm256_set1_epi16(19));
+    u = _mm256_sub_epi16(u, k128);
+    v = _mm256_sub_epi16(v, k128);
+
+    c0 = _mm256_srai_epi16(_mm256_add_epi16(yy, _mm256_mullo_epi16(v, _mm256_set1_epi16(26))), 4);
+    c1 = _mm256_srai_epi16(_mm256_sub_epi16(_mm256_sub_epi16(yy, 
+            _mm256_mullo_epi16(v, _mm256_set1_epi16(13))), 
+            _mm256_mullo_epi16(u, _mm256_set1_epi16(6))), 4);
+    c2 = _mm256_srai_epi16(_mm256_add_epi16(yy, _mm256_slli_epi16(u, 5)), 4);
+}
+
+/** saturate sixteen 16-bit values to bytes, keeping their order */
+static inline TARGET_AVX2 __m128i avx2Pack(__m256i v)
+{
+    return _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+
+/** write 16 pixels of three channels as packed 24-bit pixels */
+static inline TARGET_AVX2 void avx2Store(uint8_t *rgb, __m256i c0, __m256i c1, __m256i c2)
+{
+    const __m128i ch[3] = { avx2Pack(c0), avx2Pack(c1), avx2Pack(c2) };
+    for(uint32_t block=0; block<3; block++)
+    {
+        __m128i out = _mm_or_si128(
+            _mm_or_si128(
+                _mm_shuffle_epi8(ch[0], _mm_load_si128((const __m128i*)g_interleaveMasks[block][0])),
+                _mm_shuffle_epi8(ch[1], _mm_load_si128((const __m128i*)g_interleaveMasks[block][1]))),
+                _mm_shuffle_epi8(ch[2], _mm_load_si128((const __m128i*)g_interleaveMasks[block][2])));
+        _mm_storeu_si128((__m128i*)(rgb + 16*block), out);
+    }
+}
+
+/** write 16 pixels in the requested layout, c0 is red */
+static inline TARGET_AVX2 void avx2StoreLayout(uint8_t *out, PixelLayout layout, __m256i c0, __m256i c1, __m256i c2)
+{
+    switch(layout)
+    {
+    case PIXEL_LAYOUT_BGR24:
+        avx2Store(out, c2, c1, c0);
+        break;
+    case PIXEL_LAYOUT_RGBA32:
+        {
+            // interleave the channels as 32-bit pixels
+            const __m128i alpha = _mm_set1_epi8((char)0xFF);
+            const __m128i r = avx2Pack(c0);
+            const __m128i g = avx2Pack(c1);
+            const __m128i b = avx2Pack(c2);
+            __m256i rg = _mm256_setr_m128i(_mm_unpacklo_epi8(r, g), _mm_unpackhi_epi8(r, g));
+            __m256i ba = _mm256_setr_m128i(_mm_unpacklo_epi8(b, alpha), _mm_unpackhi_epi8(b, alpha));
+            __m256i lo = _mm256_unpacklo_epi16(rg, ba);     // pixels 0..3, 8..11
+            __m256i hi = _mm256_unpackhi_epi16(rg, ba);     // pixels 4..7, 12..15
+            _mm256_storeu_si256((__m256i*)(out +  0), _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256((__m256i*)(out + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+        break;
+    default:
+        avx2Store(out, c0, c1, c2);
+        break;
+    }
+}
+
+static TARGET_AVX2 void YUYVRow_avx2(const uint8_t *yuyv, uint8_t *rgb, uint32_t pixels, PixelLayout layout)
+{
+    const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+    const uint32_t bpp = pixelLayoutBytes(layout);
+    uint32_t done = 0;
+    for(; done + 16 <= pixels; done += 16)
+    {
+        __m256i in = _mm256_loadu_si256((const __m256i*)(yuyv + 2*done));
+        __m256i y  = _mm256_and_si256(in, lowBytes);
+        __m256i pq = _mm256_srli_epi16(in, 8);
+        __m256i p  = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(pq, _MM_SHUFFLE(2,2,0,0)), _MM_SHUFFLE(2,2,0,0));
+        __m256i q  = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(pq, _MM_SHUFFLE(3,3,1,1)), _MM_SHUFFLE(3,3,1,1));
+
+        // the YUYV converter uses the second chroma byte as U
+        // and writes the channels in reverse order.
+        __m256i c0, c1, c2;
+        avx2Pixels(y, q, p, c2, c1, c0);
+        avx2StoreLayout(rgb + bpp*done, layout, c0, c1, c2);
+    }
+    YUYVRow_scalar(yuyv + 2*done, rgb + bpp*done, pixels - done, layout);
+}
+
+static TARGET_AVX2 void NV12Row_avx2(const uint8_t *y, const uint8_t *uv, uint8_t *rgb, uint32_t width, PixelLayout layout)
+{
+    const uint32_t bpp = pixelLayoutBytes(layout);
+    uint32_t done = 0;
+    for(; done + 16 <= width; done += 16)
+    {
+        __m256i yin  = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + done)));
+        __m256i uvin = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(uv + done)));
+        __m256i u = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(uvin, _MM_SHUFFLE(2,2,0,0)), _MM_SHUFFLE(2,2,0,0));
+        __m256i v = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(uvin, _MM_SHUFFLE(3,3,1,1)), _MM_SHUFFLE(3,3,1,1));
+
+        __m256i c0, c1, c2;
+        avx2Pixels(yin, u, v, c0, c1, c2);
+        avx2StoreLayout(rgb + bpp*done, layout, c0, c1, c2);
+    }
+    NV12Row_scalar(y + done, uv + done, rgb + bpp*done, width - done, layout);
+}
+
+static TARGET_AVX2 void I420Row_avx2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *rgb, uint32_t width, PixelLayout layout)
+{
+    const uint32_t bpp = pixelLayoutBytes(layout);
+    uint32_t done = 0;
+    for(; done + 16 <= width; done += 16)
+    {
+        // duplicate each chroma byte for the two pixels sharing it
+        __m128i u8 = _mm_loadl_epi64((const __m128i*)(u + done/2));
+        __m128i v8 = _mm_loadl_epi64((const __m128i*)(v + done/2));
+        __m256i yin = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + done)));
+        __m256i uin = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(u8, u8));
+        __m256i vin = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(v8, v8));
+
+        __m256i c0, c1, c2;
+        avx2Pixels(yin, uin, vin, c0, c1, c2);
+        avx2StoreLayout(rgb + bpp*done, layout, c0, c1, c2);
+    }
+    I420Row_scalar(y + done, u + done/2, v + done/2, rgb + bpp*done, width - done, layout);
+}
+
+static const YUVKernels g_sse2Kernels = 
+{
+    YUYVRow_sse2,
+    NV12Row_sse2,
+    I420Row_sse2
+};
+
+static const YUVKernels g_avx2Kernels = 
+{
+    YUYVRow_avx2,
+    NV12Row_avx2,
+    I420Row_avx2
+};
+
+const YUVKernels* getSSE2Kernels()
+{
+    return &g_sse2Kernels;
+}
+
+const YUVKernels* getAVX2Kernels()
+{
+    return &g_avx2Kernels;
+}
+
+#else
+
+const YUVKernels* getSSE2Kernels()
+{
+    return nullptr;
+}
+
+const YUVKernels* getAVX2Kernels()
+{
+    return nullptr;
+}
+
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+
+#include <arm_neon.h>
+
+// **********************************************************************
+//   NEON kernels, 16 pixels per iteration
+//
+//   NEON is part of the AArch64 base architecture. On 32-bit ARM
+//   the kernels are only available when the library is built
+//   with NEON enabled (e.g. -mfpu=neon).
+// **********************************************************************
+
+/** compute the three output channels of 8 pixels */
+static inline void neonPixels(int16x8_t y, int16x8_t u, int16x8_t v,
+    uint8x8_t &c0, uint8x8_t &c1, uint8x8_t &c2)
+{
+    const int16x8_t k128 = vdupq_n_s16(128);
+
+    int16x8_t yy = vmulq_n_s16(vsubq_s16(y, vdupq_n_s16(16)), 19);
+    u = vsubq_s16(u, k128);
+    v = vsubq_s16(v, k128);
+
+    c0 = vqmovun_s16(vshrq_n_s16(vaddq_s16(yy, vmulq_n_s16(v, 26)), 4));
+    c1 = vqmovun_s16(vshrq_n_s16(vsubq_s16(vsubq_s16(yy, vmulq_n_s16(v, 13)), vmulq_n_s16(u, 6)), 4));
+    c2 = vqmovun_s16(vshrq_n_s16(vaddq_s16(yy, vshlq_n_s16(u, 5)), 4));
+}
+
+static inline int16x8_t widen(uint8x8_t v)
+{
+    return vreinterpretq_s16_u16(vmovl_u8(v));
+}
+
+/** write 16 pixels in the requested layout, val[0] is red */
+static inline void neonStoreLayout(uint8_t *out, PixelLayout layout, uint8x16x3_t rgb)
+{
+    switch(layout)
+    {
+    case PIXEL_LAYOUT_BGR24:
+        {
+            uint8x16x3_t bgr;
+            bgr.val[0] = rgb.val[2];
+            bgr.val[1] = rgb.val[1];
+            bgr.val[2] = rgb.val[0];
+            vst3q_u8(out, bgr);
+        }
+        break;
+    case PIXEL_LAYOUT_RGBA32:
+        {
+            uint8x16x4_t rgba;
+            rgba.val[0] = rgb.val[0];
+            rgba.val[1] = rgb.val[1];
+            rgba.val[2] = rgb.val[2];
+            rgba.val[3] = vdupq_n_u8(255);
+            vst4q_u8(out, rgba);
+        }
+        break;
+    default:
+        vst3q_u8(out, rgb);
+        break;
+    }
+}
+
+static void YUYVRow_neon(const uint8_t *yuyv, uint8_t *rgb, uint32_t pixels, PixelLayout layout)
+{
+    const uint32_t bpp = pixelLayoutBytes(layout);
+    uint32_t done = 0;
+    for(; done + 16 <= pixels; done += 16)
+    {
+        // de-interleave 8 pixel pairs: Y0, P, Y1, Q
+        uint8x8x4_t in = vld4_u8(yuyv + 2*done);
+        int16x8_t p = widen(in.val[1]);
+        int16x8_t q = widen(in.val[3]);
+
+        // the YUYV converter uses the second chroma byte as U
+        // and writes the channels in reverse order.
+        uint8x8_t even[3], odd[3];
+        neonPixels(widen(in.val[0]), q, p, even[2], even[1], even[0]);
+        neonPixels(widen(in.val[2]), q, p, odd[2], odd[1], odd[0]);
+
+        uint8x16x3_t out;
+        for(uint32_t c=0; c<3; c++)
+        {
+            uint8x8x2_t z = vzip_u8(even[c], odd[c]);
+            out.val[c] = vcombine_u8(z.val[0], z.val[1]);
+        }
+        neonStoreLayout(rgb + bpp*done, layout, out);
+    }
+    YUYVRow_scalar(yuyv + 2*done, rgb + bpp*done, pixels - done, layout);
+}
+
+static void NV12Row_neon(const uint8_t *y, const uint8_t *uv, uint8_t *rgb, uint32_t width, PixelLayout layout)
+{
+    const uint32_t bpp = pixelLayoutBytes(layout);
+    uint32_t done = 0;
+    for(; done + 16 <= width; done += 16)
+    {
+        uint8x16_t yin = vld1q_u8(y + done);
+        uint8x8x2_t uvin = vld2_u8(uv + done);
+        uint8x8x2_t u = vzip_u8(uvin.val[0], uvin.val[0]);
+        uint8x8x2_t v = vzip_u8(uvin.val[1], uvin.val[1]);
+
+        uint8x8_t lo[3], hi[3];
+        neonPixels(widen(vget_low_u8(yin)), widen(u.val[0]), widen(v.val[0]), lo[0], lo[1], lo[2]);
+        neonPixels(widen(vget_high_u8(yin)), widen(u.val[1]), widen(v.val[1]), hi[0], hi[1], hi[2]);
+
+        uint8x16x3_t out;
+        out.val[0] = vcombine_u8(lo[0], hi[0]);
+        out.val[1] = vcombine_u8(lo[1], hi[1]);
+        out.val[2] = vcombine_u8(lo[2], hi[2]);
+        neonStoreLayout(rgb + bpp*done, layout, out);
+    }
+    NV12Row_scalar(y + done, uv + done, rgb + bpp*done, width - done, layout);
+}
+
+static void I420Row_neon(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *rgb, uint32_t width, PixelLayout layout)
+{
+    const uint32_t bpp = pixelLayoutBytes(layout);
+    uint32_t done = 0;
+    for(; done + 16 <= width; done += 16)
+    {
+        uint8x16_t yin = vld1q_u8(y + done);
+        uint8x8_t u8 = vld1_u8(u + done/2);
+        uint8x8_t v8 = vld1_u8(v + done/2);
+        uint8x8x2_t uu = vzip_u8(u8, u8);
+        uint8x8x2_t vv = vzip_u8(v8, v8);
+
+        uint8x8_t lo[3], hi[3];
+        neonPixels(widen(vget_low_u8(yin)), widen(uu.val[0]), widen(vv.val[0]), lo[0], lo[1], lo[2]);
+        neonPixels(widen(vget_high_u8(yin)), widen(uu.val[1]), widen(vv.val[1]), hi[0], hi[1], hi[2]);
+
+        uint8x16x3_t out;
+        out.val[0] = vcombine_u8(lo[0], hi[0]);
+        out.val[1] = vcombine_u8(lo[1], hi[1]);
+        out.val[2] = vcombine_u8(lo[2], hi[2]);
+        neonStoreLayout(rgb + bpp*done, layout, out);
+    }
+    I420Row_scalar(y + done, u + done/2, v + done/2, rgb + bpp*done, width - done, layout);
+}
+
+static const YUVKernels g_neonKernels = 
+{
+    YUYVRow_neon,
+    NV12Row_neon,
+    I420Row_neon
+};
+
+const YUVKernels* getNEONKernels()
+{
+    return &g_neonKernels;
+}
+
+#else
+
+const YUVKernels* getNEONKernels()
+{
+    return nullptr;
+}
+
+#endif
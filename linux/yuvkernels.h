@@ -0,0 +1,63 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux platform code
+    YUV to RGB row conversion kernels
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+    
+*/
+
+#ifndef linux_yuvkernels_h
+#define linux_yuvkernels_h
+
+#include <stdint.h>
+#include "yuvconverters.h"
+
+/** A set of kernels that each convert a single row of pixels
+    and write them in the requested layout.
+    
+    yuyvRow converts 'pixels' packed YUYV pixels, 'pixels' must be even.
+    nv12Row converts 'width' pixels using a Y row and an interleaved UV row.
+    i420Row converts 'width' pixels using a Y row and separate U and V rows.
+*/
+struct YUVKernels
+{
+    void (*yuyvRow)(const uint8_t *yuyv, uint8_t *rgb, uint32_t pixels, PixelLayout layout);
+    void (*nv12Row)(const uint8_t *y, const uint8_t *uv, uint8_t *rgb, uint32_t width, PixelLayout layout);
+    void (*i420Row)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *rgb, uint32_t width, PixelLayout layout);
+};
+
+// scalar reference kernels, also used for the remaining
+// pixels of a row by the SIMD kernels.
+void YUYVRow_scalar(const uint8_t *yuyv, uint8_t *rgb, uint32_t pixels, PixelLayout layout);
+void NV12Row_scalar(const uint8_t *y, const uint8_t *uv, uint8_t *rgb, uint32_t width, PixelLayout layout);
+void I420Row_scalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *rgb, uint32_t width, PixelLayout layout);
+
+/** return the SIMD kernels compiled into the library, or 
+    nullptr if the kernel set is not available on this
+    architecture. Does not check CPU support. */
+const YUVKernels* getSSE2Kernels();
+const YUVKernels* getAVX2Kernels();
+const YUVKernels* getNEONKernels();
+
+#endif
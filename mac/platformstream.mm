@@ -223,7 +223,7 @@ bool PlatformStream::open(Context *owner, deviceInfo *device, uint32_t width, ui
     m_width = width;
     m_height = height;
     m_owner = owner;
-    m_frameBuffer.resize(m_width*m_height*3);
+    m_framePool.init(getFrameSlotCount(), m_openOptions.m_historyFrames);
     m_tmpBuffer.resize(m_width*m_height*3);
 
     AVCaptureVideoDataOutput* output = [AVCaptureVideoDataOutput new];
@@ -274,6 +274,7 @@ bool PlatformStream::open(Context *owner, deviceInfo *device, uint32_t width, ui
 
     m_isOpen = true;
     m_frames = 0; // reset the frame counter
+    m_cursor.m_lastReadFrame = 0;
     return true;
 }
 
@@ -47,6 +47,14 @@ Context* createPlatformContext()
     return new PlatformContext();
 }
 
+// a factory function needed by libmain.cpp,
+// frame brokering is not supported on this platform
+Context* createClientContext(const char *brokerName)
+{
+    LOG(LOG_ERR, "Client contexts are not supported on this platform\n");
+    return nullptr;
+}
+
 PlatformContext::PlatformContext() : Context()
 {
     HRESULT hr;
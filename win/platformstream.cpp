@@ -165,7 +165,7 @@ void PlatformStream::close()
     m_owner = nullptr;
     m_width = 0;
     m_height = 0;
-    m_frameBuffer.resize(0);
+    m_framePool.clear();
     m_isOpen = false;    
 }
 
@@ -200,6 +200,7 @@ bool PlatformStream::open(Context *owner, deviceInfo *device, uint32_t width, ui
 
     m_owner = owner;
     m_frames = 0;
+    m_cursor.m_lastReadFrame = 0;
     m_width = 0;
     m_height = 0;    
 
@@ -476,9 +477,9 @@ bool PlatformStream::open(Context *owner, deviceInfo *device, uint32_t width, ui
             memcpy(&m_videoInfo, vi, sizeof(VIDEOINFOHEADER)); // save video header information
             LOG(LOG_INFO, "Width = %d, Height = %d\n", m_width, m_height);
 
-            //FIXME: for now, just set the frame buffer size to
-            //       width*height*3 for 24 RGB raw images
-            m_frameBuffer.resize(m_width*m_height*3);                  
+            //FIXME: for now, just allocate frame slots
+            //       for 24 RGB raw images
+            m_framePool.init(getFrameSlotCount(), m_openOptions.m_historyFrames);                  
         }
         CoTaskMemFree( info->pbFormat );        
     }
@@ -850,13 +851,6 @@ bool PlatformStream::getAutoProperty(uint32_t propID, bool &enabled)
 
 void PlatformStream::submitBuffer(const uint8_t *ptr, size_t bytes)
 {
-    m_bufferMutex.lock();
-    
-    if (m_frameBuffer.size() == 0)
-    {
-        LOG(LOG_ERR,"Stream::m_frameBuffer size is 0 - cant store frame buffers!\n");
-    }
-
     // Generate warning every 100 frames if the frame buffer is not
     // the expected size. 
     
@@ -866,15 +860,21 @@ void PlatformStream::submitBuffer(const uint8_t *ptr, size_t bytes)
         LOG(LOG_WARNING, "Warning: captureFrame received incorrect buffer size (got %d want %d)\n", bytes, wantSize);
     }
 
-    if (bytes <= m_frameBuffer.size())
+    if (bytes <= wantSize)
     {
+        FrameSlot *slot = beginFrame();
+        if (slot == nullptr)
+        {
+            return;
+        }
+
         // The Win32 API delivers upside-down BGR frames.
         // Conversion to regular RGB frames is done by
         // byte-reversing the buffer
             
         for(size_t y=0; y<m_height; y++)
         {
-            uint8_t *dst = &m_frameBuffer[(y*m_width)*3];
+            uint8_t *dst = slot->m_storage + (y*m_width)*3;
             const uint8_t *src = ptr + (m_width*3)*(m_height-y-1);
             for(uint32_t x=0; x<m_width; x++)
             {
@@ -887,11 +887,8 @@ void PlatformStream::submitBuffer(const uint8_t *ptr, size_t bytes)
             }
         }
 
-        m_newFrame = true; 
-        m_frames++;        
+        commitFrame(slot);
     }
-
-    m_bufferMutex.unlock();
 }
 
 